@@ -8,6 +8,9 @@
 
 // 平台相关头文件
 #include <libavutil/avutil.h>  // FFmpeg工具库
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #ifdef _WIN32
 #include <windows.h>  // Windows系统API
 #else
@@ -54,3 +57,83 @@ get_current_ts_usec()
     return (int64_t)now.tv_sec * 1000000 + (int64_t)now.tv_usec;
 #endif
 }
+
+// 进程内的堆分配计数
+static _Atomic(int64_t) alloc_counter;
+
+#ifdef NDI_STREAMER_DEBUG_ALLOC
+#ifndef __GLIBC__
+#error "NDI_STREAMER_DEBUG_ALLOC requires glibc"
+#endif
+
+// glibc分配器本身的入口
+void *
+__libc_malloc(size_t size);
+void *
+__libc_calloc(size_t nmemb, size_t size);
+void *
+__libc_realloc(void *ptr, size_t size);
+void *
+__libc_memalign(size_t alignment, size_t size);
+
+// 以下函数替换glibc的同名分配函数，计数后交给glibc分配，所以free等
+// 其余函数不必替换。共享库(FFmpeg、编码器、NDI)的调用同样经过这里
+
+void *
+malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_counter, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_counter, 1, memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_counter, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&alloc_counter, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    // 对齐须为2的幂且是指针大小的倍数
+    if (alignment % sizeof(void *) != 0
+        || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    void *ptr = memalign(alignment, size);
+    if (!ptr)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+#endif
+
+/**
+ * 获取进程内的累计堆分配次数
+ * @return 分配次数
+ */
+int64_t
+alloc_counter_get()
+{
+    return atomic_load_explicit(&alloc_counter, memory_order_relaxed);
+}
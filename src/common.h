@@ -25,4 +25,13 @@ av_error_fmt(char *out, char *str, int ec);
 int64_t
 get_current_ts_usec();
 
+/**
+ * 获取进程内的累计堆分配次数
+ * @return malloc、calloc、realloc及各对齐分配函数的调用次数
+ * @note 仅在以NDI_STREAMER_DEBUG_ALLOC构建时计数(替换glibc的分配函数，
+ *       包括FFmpeg、编码器和NDI库内部的分配)，否则始终为0
+ */
+int64_t
+alloc_counter_get();
+
 #endif
@@ -8,6 +8,8 @@
 
 #include <libavformat/avformat.h>
 #include <libavutil/channel_layout.h>
+#include <libavutil/cpu.h>
+#include <libavutil/pixdesc.h>
 #include <string.h>
 
 #include "common.h"
@@ -18,18 +20,23 @@ new_ffmpeg_output_ctx()
     FFmpegOutputCtx *ctx = malloc(sizeof(FFmpegOutputCtx));
     memset(ctx, 0, sizeof(FFmpegOutputCtx));
     ctx->error_str = malloc(AV_ERROR_MAX_STRING_SIZE + 100);
+    // 每个输出目标都先建立视频流，再建立音频流
+    ctx->video_stream_index = 0;
+    ctx->audio_stream_index = 1;
     return ctx;
 }
 
 int
 free_ffmpeg_output_ctx(FFmpegOutputCtx **ctx)
 {
-    if ((*ctx)->audio_codec_ctx)
-        avcodec_free_context(&(*ctx)->audio_codec_ctx);
-    if ((*ctx)->video_codec_ctx)
-        avcodec_free_context(&(*ctx)->video_codec_ctx);
-    if ((*ctx)->o_ctx)
-        avformat_close_input(&(*ctx)->o_ctx);
+    ffmpeg_output_close(*ctx);
+    for (int i = 0; i < (*ctx)->nb_targets; ++i) {
+        FFmpegOutputTarget *target = (*ctx)->targets[i];
+        av_dict_free(&target->options);
+        free(target->error_str);
+        free(target);
+    }
+    free((*ctx)->error_str);
 
     free(*ctx);
     *ctx = NULL;
@@ -37,37 +44,143 @@ free_ffmpeg_output_ctx(FFmpegOutputCtx **ctx)
 }
 
 int
-ffmpeg_output_init(FFmpegOutputCtx *ctx, const char *format, const char *output)
+ffmpeg_output_add_target(FFmpegOutputCtx *ctx, int rendition,
+                         const char *format, const char *output,
+                         const AVDictionary *options)
+{
+    if (ctx->nb_targets >= FFMPEG_OUTPUT_MAX_TARGETS) {
+        sprintf(ctx->error_str, "too many outputs (at most %d)\n",
+                FFMPEG_OUTPUT_MAX_TARGETS);
+        return -1;
+    }
+
+    const AVOutputFormat *oformat = av_guess_format(format, output, NULL);
+    if (!oformat) {
+        sprintf(ctx->error_str, "unknown output format '%s'\n", format);
+        return -1;
+    }
+
+    FFmpegOutputTarget *target = malloc(sizeof(FFmpegOutputTarget));
+    memset(target, 0, sizeof(FFmpegOutputTarget));
+    target->oformat = oformat;
+    target->output = output;
+    target->rendition = rendition;
+    target->error_str = malloc(AV_ERROR_MAX_STRING_SIZE + 100);
+    target->error_str[0] = '\0';
+    av_dict_copy(&target->options, options, 0);
+
+    ctx->targets[ctx->nb_targets] = target;
+    return ctx->nb_targets++;
+}
+
+// 在输出目标中按编码器参数建立一路流
+static int
+ffmpeg_output_add_stream(FFmpegOutputTarget *target, AVCodecContext *c_ctx,
+                         const char *error_msg)
+{
+    AVStream *stream = avformat_new_stream(target->o_ctx, NULL);
+    if (!stream) {
+        sprintf(target->error_str, "%s\n", error_msg);
+        return AVERROR(ENOMEM);
+    }
+
+    int ret = avcodec_parameters_from_context(stream->codecpar, c_ctx);
+    if (ret < 0) {
+        av_error_fmt(target->error_str, (char *)error_msg, ret);
+        return ret;
+    }
+    stream->time_base = c_ctx->time_base;
+    return 0;
+}
+
+int
+ffmpeg_output_open_target(FFmpegOutputCtx *ctx, FFmpegOutputTarget *target,
+                          const AVIOInterruptCB *int_cb)
 {
-    int ret = avformat_alloc_output_context2(&ctx->o_ctx, NULL, format, output);
+    int ret = avformat_alloc_output_context2(&target->o_ctx,
+                                             target->oformat, NULL,
+                                             target->output);
     if (ret < 0) {
-        av_error_fmt(ctx->error_str,
+        av_error_fmt(target->error_str,
                      "could not allocate output format context!", ret);
+        return ret;
+    }
+    if (int_cb) {
+        target->o_ctx->interrupt_callback = *int_cb;
     }
-    else if (!(ctx->o_ctx->oformat->flags & (int)AVFMT_NOFILE)) {
-        ret = avio_open2(&ctx->o_ctx->pb, output, AVIO_FLAG_WRITE, NULL, NULL);
+
+    if (!(target->o_ctx->oformat->flags & (int)AVFMT_NOFILE)) {
+        ret = avio_open2(&target->o_ctx->pb, target->output, AVIO_FLAG_WRITE,
+                         &target->o_ctx->interrupt_callback, NULL);
         if (ret < 0) {
-            av_error_fmt(ctx->error_str, "could not open output IO context!",
-                         ret);
-            avformat_close_input(&ctx->o_ctx);
+            av_error_fmt(target->error_str,
+                         "could not open output IO context!", ret);
+            ffmpeg_output_close_target(target);
+            return ret;
         }
     }
 
-    ctx->output = output;
+    if (target->rendition >= ctx->nb_renditions) {
+        sprintf(target->error_str, "no video encoder for rendition %d\n",
+                target->rendition);
+        ffmpeg_output_close_target(target);
+        return -1;
+    }
+    if ((ret = ffmpeg_output_add_stream(
+                 target, ctx->video_codec_ctxs[target->rendition],
+                 "could not initialize video stream codec parameters!"))
+                < 0
+        || (ret = ffmpeg_output_add_stream(
+                    target, ctx->audio_codec_ctx,
+                    "could not initialize audio stream codec parameters!"))
+                   < 0) {
+        ffmpeg_output_close_target(target);
+        return ret;
+    }
+
+    target->o_ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+    av_dump_format(target->o_ctx, 0, target->output, 1);
+
+    AVDictionary *options = NULL;
+    av_dict_copy(&options, target->options, 0);
+    ret = avformat_write_header(target->o_ctx, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        av_error_fmt(target->error_str, "could not write header!", ret);
+        ffmpeg_output_close_target(target);
+    }
     return ret;
 }
 
+void
+ffmpeg_output_close_target(FFmpegOutputTarget *target)
+{
+    if (!target->o_ctx)
+        return;
+    if (!(target->o_ctx->oformat->flags & (int)AVFMT_NOFILE))
+        avio_closep(&target->o_ctx->pb);
+    avformat_free_context(target->o_ctx);
+    target->o_ctx = NULL;
+}
+
 void
 ffmpeg_output_close(FFmpegOutputCtx *ctx)
 {
-    if (ctx->audio_codec_ctx)
-        avcodec_free_context(&ctx->audio_codec_ctx);
-    if (ctx->video_codec_ctx)
-        avcodec_free_context(&ctx->video_codec_ctx);
-    if (ctx->o_ctx)
-        avformat_close_input(&ctx->o_ctx);
+    ffmpeg_output_close_codecs(ctx);
+    for (int i = 0; i < ctx->nb_targets; ++i) {
+        ffmpeg_output_close_target(ctx->targets[i]);
+    }
+}
 
-    ctx->output = NULL;
+// 任一输出目标要求全局头时，编码器都把参数集放进extradata
+static int
+ffmpeg_output_needs_global_header(FFmpegOutputCtx *ctx)
+{
+    for (int i = 0; i < ctx->nb_targets; ++i) {
+        if (ctx->targets[i]->oformat->flags & AVFMT_GLOBALHEADER)
+            return 1;
+    }
+    return 0;
 }
 
 void
@@ -75,15 +188,316 @@ ffmpeg_output_close_codecs(FFmpegOutputCtx *ctx)
 {
     if (ctx->audio_codec_ctx)
         avcodec_free_context(&ctx->audio_codec_ctx);
-    if (ctx->video_codec_ctx)
-        avcodec_free_context(&ctx->video_codec_ctx);
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        avcodec_free_context(&ctx->video_codec_ctxs[i]);
+    }
+    ctx->nb_renditions = 0;
+}
+
+// 获取编码器支持的像素格式列表(以AV_PIX_FMT_NONE结尾)，未知时返回NULL
+static const enum AVPixelFormat *
+ffmpeg_output_supported_pix_fmts(const AVCodec *codec, AVCodecContext *c_ctx)
+{
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+    const void *fmts = NULL;
+    if (avcodec_get_supported_config(c_ctx, codec, AV_CODEC_CONFIG_PIX_FORMAT,
+                                     0, &fmts, NULL)
+        < 0) {
+        return NULL;
+    }
+    return fmts;
+#else
+    (void)c_ctx;
+    return codec->pix_fmts;
+#endif
+}
+
+// 估算从src转换到dst的相对代价，数值越小越便宜
+static int
+ffmpeg_output_pix_fmt_cost(enum AVPixelFormat src, enum AVPixelFormat dst)
+{
+    if (src == dst) {
+        return 0;
+    }
+
+    const AVPixFmtDescriptor *s = av_pix_fmt_desc_get(src);
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(dst);
+    if (!s || !d || (d->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        return -1;
+    }
+
+    int cost = 1; // 至少要转换一次，格式相同时可直通
+    int s_rgb = (s->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    int d_rgb = (d->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+
+    if (s_rgb != d_rgb) {
+        cost += 100; // RGB <-> YUV 矩阵运算
+    }
+    if (s->comp[0].depth != d->comp[0].depth) {
+        cost += 20;  // 位深变化
+    }
+    if ((s->flags & AV_PIX_FMT_FLAG_PLANAR) != (d->flags & AV_PIX_FMT_FLAG_PLANAR)
+        || s->nb_components != d->nb_components) {
+        cost += 5;   // 打包/平面布局重排
+    }
+
+    // 色度下采样需要滤波；上采样还会增加编码器的数据量
+    int s_sub = s_rgb ? 0 : s->log2_chroma_w + s->log2_chroma_h;
+    int d_sub = d_rgb ? 0 : d->log2_chroma_w + d->log2_chroma_h;
+    if (d_sub > s_sub) {
+        cost += 10 * (d_sub - s_sub);
+    }
+    else if (d_sub < s_sub) {
+        cost += 15 * (s_sub - d_sub);
+    }
+
+    return cost;
+}
+
+// 是否为4:2:0的YUV格式
+static int
+ffmpeg_output_is_yuv420(enum AVPixelFormat fmt)
+{
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(fmt);
+    return d && !(d->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL))
+           && d->nb_components >= 3 && d->log2_chroma_w == 1
+           && d->log2_chroma_h == 1;
+}
+
+// 从编码器支持的格式中选择由src转换代价最低的像素格式
+// @note 编码器支持4:2:0时只在4:2:0格式中选择：H.264的High 4:2:2/4:4:4
+// 档次多数推流服务器和播放器不接受，而UYVY和32位RGB到8位I420/NV12正好有
+// 帧转换器的向量化内核。需要4:2:2/4:4:4时用--video_pix_fmt指定
+static enum AVPixelFormat
+ffmpeg_output_negotiate_pix_fmt(const AVCodec *codec, AVCodecContext *c_ctx,
+                                enum AVPixelFormat src)
+{
+    const enum AVPixelFormat *fmts
+            = ffmpeg_output_supported_pix_fmts(codec, c_ctx);
+    if (!fmts) {
+        return AV_PIX_FMT_YUV420P;
+    }
+    if (src == AV_PIX_FMT_NONE) {
+        return fmts[0];
+    }
+
+    int only_420 = 0;
+    for (int i = 0; fmts[i] != AV_PIX_FMT_NONE && !only_420; ++i) {
+        only_420 = ffmpeg_output_is_yuv420(fmts[i]);
+    }
+
+    enum AVPixelFormat best = AV_PIX_FMT_NONE;
+    int best_cost = -1;
+    for (int i = 0; fmts[i] != AV_PIX_FMT_NONE; ++i) {
+        if (only_420 && !ffmpeg_output_is_yuv420(fmts[i])) {
+            continue;
+        }
+        int cost = ffmpeg_output_pix_fmt_cost(src, fmts[i]);
+        if (cost >= 0 && (best_cost < 0 || cost < best_cost)) {
+            best = fmts[i];
+            best_cost = cost;
+        }
+    }
+    return best != AV_PIX_FMT_NONE ? best : fmts[0];
+}
+
+// 为YUV编码格式设置矩阵、原色、传输特性和范围标记，使播放端按转换时
+// 使用的系数还原颜色。未指定矩阵时高清(>=720行)用BT.709，否则用BT.601
+static void
+ffmpeg_output_set_color(AVCodecContext *c_ctx, const FFmpegVideoConfig *config)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c_ctx->pix_fmt);
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_RGB))
+        return;
+
+    enum AVColorSpace colorspace = config->colorspace;
+    if (colorspace == AVCOL_SPC_UNSPECIFIED)
+        colorspace = config->height >= 720 ? AVCOL_SPC_BT709
+                                           : AVCOL_SPC_SMPTE170M;
+
+    if (colorspace == AVCOL_SPC_BT709) {
+        c_ctx->color_primaries = AVCOL_PRI_BT709;
+        c_ctx->color_trc = AVCOL_TRC_BT709;
+    }
+    else {
+        c_ctx->color_primaries = AVCOL_PRI_SMPTE170M;
+        c_ctx->color_trc = AVCOL_TRC_SMPTE170M;
+    }
+    c_ctx->colorspace = colorspace;
+    c_ctx->color_range = config->color_range == AVCOL_RANGE_JPEG
+                                 ? AVCOL_RANGE_JPEG
+                                 : AVCOL_RANGE_MPEG;
+}
+
+// 帧率取整后的每秒帧数，未知时按30计算
+static int
+ffmpeg_output_fps(AVRational framerate)
+{
+    if (framerate.num <= 0 || framerate.den <= 0)
+        return 30;
+    return FFMAX(1, (framerate.num + framerate.den / 2) / framerate.den);
+}
+
+// x264/x265的帧级并行线程数，每个帧线程让编码器多缓存一帧
+static int
+ffmpeg_output_frame_threads(const FFmpegVideoConfig *config)
+{
+    // 分片并行(ultra模式的zerolatency默认如此)只有一个帧线程
+    if (config->thread_type == FF_THREAD_SLICE
+        || (config->thread_type == 0
+            && config->latency_mode == FFMPEG_LATENCY_ULTRA))
+        return 1;
+
+    int cores = config->threads > 0 ? config->threads : av_cpu_count();
+    if (strcmp(config->encoder_name, "libx264") == 0) {
+        // x264默认取1.5倍核数，且每个帧线程至少要有两行宏块
+        int threads = config->threads > 0 ? config->threads : cores * 3 / 2;
+        return av_clip(threads, 1, ((config->height + 15) / 16 + 1) / 2);
+    }
+    // x265按核数查表
+    return cores >= 32 ? 6 : cores >= 16 ? 5 : cores >= 8 ? 3 : cores >= 4 ? 2 : 1;
+}
+
+// 按延迟模式设置GOP、B帧、码率缓冲和编码器私有选项
+// 返回B帧和前瞻带来的编码延迟(帧，不含帧级并行)，-1表示未知
+static int
+ffmpeg_output_set_latency(const AVCodec *codec, AVCodecContext *c_ctx,
+                          const FFmpegVideoConfig *config,
+                          AVDictionary **options)
+{
+    const char *encoder_name = config->encoder_name;
+    int fps = ffmpeg_output_fps(config->framerate);
+
+    if (config->latency_mode == FFMPEG_LATENCY_NORMAL) {
+        c_ctx->gop_size = 12;
+        if (strcmp(encoder_name, "libx264") == 0)
+            av_dict_set(options, "preset", "veryfast", 0);
+        return -1;
+    }
+    int ultra = config->latency_mode == FFMPEG_LATENCY_ULTRA;
+
+    // 不使用B帧，每秒一个关键帧(ultra下为一轮帧内刷新的长度)。码率缓冲
+    // low为1秒，ultra为1帧，关键帧不会形成在发送端排队的码率尖峰。
+    // 帧内刷新时编码器只在开头产生一个关键帧，输出晚连接、重连或丢包后
+    // 由流水线在下一帧设置pict_type=I请求关键帧(forced-idr使之成为IDR)，
+    // 解码端从该帧恢复
+    c_ctx->gop_size = fps;
+    c_ctx->max_b_frames = 0;
+    c_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    c_ctx->rc_max_rate = config->bitrate;
+    c_ctx->rc_buffer_size
+            = (int)(ultra ? config->bitrate / fps : config->bitrate);
+
+    if (strcmp(encoder_name, "libx264") == 0) {
+        av_dict_set(options, "preset", "veryfast", 0);
+        if (ultra) {
+            // zerolatency: 分片并行、无前瞻、无帧级缓存
+            av_dict_set(options, "tune", "zerolatency", 0);
+            av_dict_set(options, "intra-refresh", "1", 0);
+            av_dict_set(options, "forced-idr", "1", 0);
+            return 0;
+        }
+        av_dict_set(options, "rc-lookahead", "0", 0);
+        av_dict_set(options, "x264-params", "sync-lookahead=0", 0);
+        return 0;
+    }
+    if (strcmp(encoder_name, "libx265") == 0) {
+        av_dict_set(options, "preset", "veryfast", 0);
+        if (ultra) {
+            // zerolatency: 单帧线程(只用WPP行并行)、无前瞻
+            av_dict_set(options, "tune", "zerolatency", 0);
+            av_dict_set(options, "x265-params", "intra-refresh=1", 0);
+            av_dict_set(options, "forced-idr", "1", 0);
+            return 0;
+        }
+        av_dict_set(options, "x265-params", "bframes=0:rc-lookahead=0", 0);
+        return 0;
+    }
+    if (strncmp(encoder_name, "libvpx", 6) == 0) {
+        av_dict_set(options, "deadline", "realtime", 0);
+        av_dict_set(options, "cpu-used", "8", 0);
+        av_dict_set(options, "lag-in-frames", "0", 0);
+        if (codec->id == AV_CODEC_ID_VP9) {
+            av_dict_set(options, "row-mt", "1", 0);
+            if (ultra) {
+                // 按列分块并行；aq-mode=3为循环帧内刷新
+                av_dict_set(options, "tile-columns", "2", 0);
+                av_dict_set(options, "aq-mode", "3", 0);
+            }
+        }
+        return 0;
+    }
+    if (strcmp(encoder_name, "libsvtav1") == 0) {
+        // 低延迟预测结构，无前瞻；SVT-AV1没有帧内刷新，仍使用关键帧
+        av_dict_set(options, "preset", "10", 0);
+        av_dict_set(options, "svtav1-params", "pred-struct=1:lookahead=0", 0);
+        return 0;
+    }
+    return -1;
+}
+
+// 向x264-params/x265-params这类以':'分隔的选项追加一项
+static void
+ffmpeg_output_append_param(AVDictionary **options, const char *key,
+                           const char *param)
+{
+    if (av_dict_get(*options, key, NULL, 0)) {
+        av_dict_set(options, key, ":", AV_DICT_APPEND);
+        av_dict_set(options, key, param, AV_DICT_APPEND);
+    }
+    else {
+        av_dict_set(options, key, param, 0);
+    }
+}
+
+// 设置编码线程数和并行方式。libx264按thread_count/thread_type选择
+// 帧线程或分片线程，libx265使用自己的线程池参数
+static void
+ffmpeg_output_set_threads(AVCodecContext *c_ctx,
+                          const FFmpegVideoConfig *config,
+                          AVDictionary **options)
+{
+    c_ctx->thread_count = config->threads;
+    if (config->thread_type)
+        c_ctx->thread_type = config->thread_type;
+
+    if (strcmp(config->encoder_name, "libx265") == 0) {
+        char param[32];
+        if (config->threads > 0) {
+            snprintf(param, sizeof param, "pools=%d", config->threads);
+            ffmpeg_output_append_param(options, "x265-params", param);
+        }
+        if (config->thread_type == FF_THREAD_SLICE)
+            ffmpeg_output_append_param(options, "x265-params",
+                                       "frame-threads=1");
+    }
+}
+
+// 编码器内部帧级并行带来的延迟(帧)，必须在编码器打开之后调用
+static int
+ffmpeg_output_thread_delay(const AVCodecContext *c_ctx,
+                           const FFmpegVideoConfig *config)
+{
+    if (strcmp(config->encoder_name, "libx264") == 0
+        || strcmp(config->encoder_name, "libx265") == 0)
+        return ffmpeg_output_frame_threads(config) - 1;
+    // FFmpeg自带的帧级并行，thread_count在打开时已被确定
+    if (c_ctx->active_thread_type == FF_THREAD_FRAME)
+        return c_ctx->thread_count - 1;
+    return 0;
 }
 
 int
-ffmpeg_output_setup_video(FFmpegOutputCtx *ctx, const char *encoder_name,
-                          const int width, const int height,
-                          const AVRational framerate, const int64_t bitrate)
+ffmpeg_output_setup_video(FFmpegOutputCtx *ctx,
+                          const FFmpegVideoConfig *config)
 {
+    if (ctx->nb_renditions >= FFMPEG_OUTPUT_MAX_RENDITIONS) {
+        sprintf(ctx->error_str, "too many renditions (at most %d)\n",
+                FFMPEG_OUTPUT_MAX_RENDITIONS);
+        return -1;
+    }
+
+    const char *encoder_name = config->encoder_name;
     const AVCodec *codec = avcodec_find_encoder_by_name(encoder_name);
     if (!codec) {
         sprintf(ctx->error_str, "%s", "could not find video codec");
@@ -95,40 +509,40 @@ ffmpeg_output_setup_video(FFmpegOutputCtx *ctx, const char *encoder_name,
         printf("[INFO] Using Apple Silicon hardware acceleration with %s\n", encoder_name);
     }
 
-    AVStream *stream = avformat_new_stream(ctx->o_ctx, codec);
-    if (!stream) {
-        sprintf(ctx->error_str, "%s", "could not create video stream");
-        return -1;
-    }
-
-    ctx->video_stream_index = (int)(ctx->o_ctx->nb_streams) - 1;
     AVCodecContext *c_ctx = avcodec_alloc_context3(codec);
     if (!c_ctx) {
         sprintf(ctx->error_str, "%s", "could not allocate video codec context");
         return -1;
     }
 
-    c_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    c_ctx->pix_fmt = config->pix_fmt != AV_PIX_FMT_NONE
+                             ? config->pix_fmt
+                             : ffmpeg_output_negotiate_pix_fmt(
+                                       codec, c_ctx, config->src_pix_fmt);
     c_ctx->time_base.num = 1;
     c_ctx->time_base.den = AV_TIME_BASE;
-    c_ctx->width = width;
-    c_ctx->height = height;
-    c_ctx->framerate = framerate;
-    c_ctx->bit_rate = bitrate;
-    c_ctx->gop_size = 12;
+    c_ctx->width = config->width;
+    c_ctx->height = config->height;
+    c_ctx->framerate = config->framerate;
+    c_ctx->bit_rate = config->bitrate;
+    ffmpeg_output_set_color(c_ctx, config);
 
-    if (ctx->o_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+    if (ffmpeg_output_needs_global_header(ctx))
         c_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    // 帧的opaque_ref随数据包带出，供流水线统计编码和封装延迟(FFmpeg 6.0+)
+    c_ctx->flags |= AV_CODEC_FLAG_COPY_OPAQUE;
+#endif
 
     int ret;
     AVDictionary *codec_options = NULL;
+    int delay = ffmpeg_output_set_latency(codec, c_ctx, config, &codec_options);
+    ffmpeg_output_set_threads(c_ctx, config, &codec_options);
 
     // VideoToolbox编码器特定设置
     if (strstr(encoder_name, "videotoolbox") != NULL) {
         av_dict_set(&codec_options, "realtime", "1", 0);
         av_dict_set(&codec_options, "allow_sw", "0", 0);
-    } else if (strcmp(encoder_name, "libx264") == 0) {
-        av_dict_set(&codec_options, "preset", "veryfast", 0);
     }
 
     if (codec->id == AV_CODEC_ID_H264) {
@@ -140,14 +554,12 @@ ffmpeg_output_setup_video(FFmpegOutputCtx *ctx, const char *encoder_name,
         av_error_fmt(ctx->error_str, "could not open video codec!", ret);
         avcodec_free_context(&c_ctx);
     }
-    else if ((ret = avcodec_parameters_from_context(stream->codecpar, c_ctx)) < 0) {
-        av_error_fmt(ctx->error_str,
-                     "could not initialize video stream codec parameters!",
-                     ret);
-        avcodec_free_context(&c_ctx);
-    }
     else {
-        ctx->video_codec_ctx = c_ctx;
+        ctx->video_codec_ctxs[ctx->nb_renditions] = c_ctx;
+        ctx->video_delays[ctx->nb_renditions]
+                = delay < 0 ? -1
+                            : delay + ffmpeg_output_thread_delay(c_ctx, config);
+        ret = ctx->nb_renditions++;
     }
 
     av_dict_free(&codec_options);
@@ -163,13 +575,6 @@ ffmpeg_output_setup_audio(FFmpegOutputCtx *ctx, char *encoder_name,
         sprintf(ctx->error_str, "%s", "could not find audio codec");
         return -1;
     }
-    AVStream *stream = avformat_new_stream(ctx->o_ctx, codec);
-    if (!stream) {
-        sprintf(ctx->error_str, "%s", "could not create audio stream");
-        return -1;
-    }
-    ctx->audio_stream_index = (int)(ctx->o_ctx->nb_streams) - 1;
-
     AVCodecContext *c_ctx = avcodec_alloc_context3(codec);
     if (!c_ctx) {
         sprintf(ctx->error_str, "%s", "could not allocate audio codec context");
@@ -183,7 +588,7 @@ ffmpeg_output_setup_audio(FFmpegOutputCtx *ctx, char *encoder_name,
     c_ctx->ch_layout = (AVChannelLayout)AV_CHANNEL_LAYOUT_STEREO;
     c_ctx->bit_rate = bitrate;
 
-    if (ctx->o_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+    if (ffmpeg_output_needs_global_header(ctx))
         c_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
     int ret;
@@ -192,12 +597,6 @@ ffmpeg_output_setup_audio(FFmpegOutputCtx *ctx, char *encoder_name,
         av_error_fmt(ctx->error_str, "could not open audio codec!", ret);
         avcodec_free_context(&c_ctx);
     }
-    else if ((ret = avcodec_parameters_from_context(stream->codecpar, c_ctx)) < 0) {
-        av_error_fmt(ctx->error_str,
-                     "could not initialize audio stream codec parameters!",
-                     ret);
-        avcodec_free_context(&c_ctx);
-    }
     else {
         ctx->audio_codec_ctx = c_ctx;
     }
@@ -206,77 +605,89 @@ ffmpeg_output_setup_audio(FFmpegOutputCtx *ctx, char *encoder_name,
     return ret;
 }
 
-int
-ffmpeg_output_write_header(FFmpegOutputCtx *ctx, AVDictionary **av_opts)
+// 将帧送入指定编码器
+static int
+ffmpeg_output_encode_frame(FFmpegOutputCtx *ctx, AVCodecContext *codec_ctx,
+                           AVFrame *frame, const char *error_msg)
 {
-    ctx->o_ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
-    av_dump_format(ctx->o_ctx, 0, ctx->output, 1);
-
-    int ret = avformat_write_header(ctx->o_ctx, av_opts);
+    int ret = avcodec_send_frame(codec_ctx, frame);
+    if (frame)
+        av_frame_unref(frame);
     if (ret < 0) {
-        av_error_fmt(ctx->error_str, "could not write header!", ret);
+        av_error_fmt(ctx->error_str, (char *)error_msg, ret);
     }
     return ret;
 }
 
-int
-ffmpeg_output_send_video_frame(FFmpegOutputCtx *ctx, AVFrame *frame)
+// 从指定编码器取出一个数据包并设置流索引
+static int
+ffmpeg_output_receive_packet(FFmpegOutputCtx *ctx, AVCodecContext *codec_ctx,
+                             int stream_index, AVPacket *pkt,
+                             const char *error_msg)
 {
-    int ret = avcodec_send_frame(ctx->video_codec_ctx, frame);
-    av_frame_unref(frame);
+    int ret = avcodec_receive_packet(codec_ctx, pkt);
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+        return ret;
+    }
     if (ret < 0) {
-        av_error_fmt(ctx->error_str,
-                     "error sending frame to video codec context!", ret);
+        av_error_fmt(ctx->error_str, (char *)error_msg, ret);
         return ret;
     }
+    pkt->stream_index = stream_index;
+    return ret;
+}
 
-    AVPacket *pkt = av_packet_alloc();
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(ctx->video_codec_ctx, pkt);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        }
-        if (ret < 0) {
-            av_error_fmt(ctx->error_str,
-                         "error receiving packet from video codec context!", ret);
-            break;
-        }
+int
+ffmpeg_output_encode_video_frame(FFmpegOutputCtx *ctx, int rendition,
+                                 AVFrame *frame)
+{
+    return ffmpeg_output_encode_frame(
+            ctx, ctx->video_codec_ctxs[rendition], frame,
+            "error sending frame to video codec context!");
+}
 
-        pkt->stream_index = ctx->video_stream_index;
-        ret = av_interleaved_write_frame(ctx->o_ctx, pkt);
-        av_packet_unref(pkt);
-    }
-    av_packet_free(&pkt);
-    return ret;
+int
+ffmpeg_output_encode_audio_frame(FFmpegOutputCtx *ctx, AVFrame *frame)
+{
+    return ffmpeg_output_encode_frame(
+            ctx, ctx->audio_codec_ctx, frame,
+            "error sending frame to audio codec context!");
 }
 
 int
-ffmpeg_output_send_audio_frame(FFmpegOutputCtx *ctx, AVFrame *frame)
+ffmpeg_output_receive_video_packet(FFmpegOutputCtx *ctx, int rendition,
+                                   AVPacket *pkt)
 {
-    int ret = avcodec_send_frame(ctx->audio_codec_ctx, frame);
-    av_frame_unref(frame);
-    if (ret < 0) {
-        av_error_fmt(ctx->error_str,
-                     "error sending frame to audio codec context!", ret);
-        return ret;
-    }
+    return ffmpeg_output_receive_packet(
+            ctx, ctx->video_codec_ctxs[rendition], ctx->video_stream_index,
+            pkt,
+            "error receiving packet from video codec context!");
+}
 
-    AVPacket *pkt = av_packet_alloc();
-    while (ret >= 0) {
-        ret = avcodec_receive_packet(ctx->audio_codec_ctx, pkt);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-        }
-        if (ret < 0) {
-            av_error_fmt(ctx->error_str,
-                         "error receiving packet from audio codec context!", ret);
-            break;
-        }
+int
+ffmpeg_output_receive_audio_packet(FFmpegOutputCtx *ctx, AVPacket *pkt)
+{
+    return ffmpeg_output_receive_packet(
+            ctx, ctx->audio_codec_ctx, ctx->audio_stream_index, pkt,
+            "error receiving packet from audio codec context!");
+}
 
-        pkt->stream_index = ctx->audio_stream_index;
-        ret = av_interleaved_write_frame(ctx->o_ctx, pkt);
-        av_packet_unref(pkt);
+int
+ffmpeg_output_write_packet(FFmpegOutputCtx *ctx, FFmpegOutputTarget *target,
+                           AVPacket *pkt)
+{
+    AVCodecContext *codec_ctx
+            = pkt->stream_index == ctx->video_stream_index
+                      ? ctx->video_codec_ctxs[target->rendition]
+                      : ctx->audio_codec_ctx;
+    AVStream *stream = target->o_ctx->streams[pkt->stream_index];
+
+    // 编码器时间基为微秒，写入前换算到封装器选定的流时间基
+    av_packet_rescale_ts(pkt, codec_ctx->time_base, stream->time_base);
+
+    int ret = av_interleaved_write_frame(target->o_ctx, pkt);
+    if (ret < 0) {
+        av_error_fmt(target->error_str, "error writing packet!", ret);
     }
-    av_packet_free(&pkt);
     return ret;
 }
@@ -7,19 +7,64 @@
 // FFmpeg输出上下文头文件
 // 定义FFmpeg输出相关的结构体和接口函数
 // 用于封装FFmpeg格式输出、编码器设置和帧写入等操作
+// 一组音视频编码器可以同时输出到多个目标，每个目标有独立的封装器，
+// 编码一次、分别写出。视频可以有多个清晰度(各自一个编码器)，每个目标
+// 只输出其中一个清晰度，音频编码由所有目标共用
 
 #ifndef FFMPEG_OUTPUT_H
 #define FFMPEG_OUTPUT_H
 
 #include <libavcodec/avcodec.h>
+#include <libavformat/avio.h>
+
+#define FFMPEG_OUTPUT_MAX_TARGETS 8     // 输出目标数上限
+#define FFMPEG_OUTPUT_MAX_RENDITIONS 4  // 视频清晰度(编码器)数上限
+
+// 视频编码延迟模式
+enum FFmpegLatencyMode {
+    FFMPEG_LATENCY_NORMAL = 0, // 编码器默认设置(B帧、前瞻)，画质优先
+    FFMPEG_LATENCY_LOW,        // 无B帧、无前瞻，1秒码率缓冲，保留帧级并行
+    FFMPEG_LATENCY_ULTRA,      // 零延迟调优、分片并行、帧内刷新代替IDR，1帧码率缓冲
+};
+
+// 视频编码器配置
+typedef struct FFmpegVideoConfig {
+    const char *encoder_name;     // 编码器名称(如"libx264")
+    int width;                    // 视频宽度(像素)
+    int height;                   // 视频高度(像素)
+    AVRational framerate;         // 帧率
+    int64_t bitrate;              // 视频比特率(比特/秒)
+    enum AVPixelFormat src_pix_fmt; // 输入(NDI)像素格式，用于协商编码像素格式
+    enum AVPixelFormat pix_fmt;   // 指定编码像素格式，AV_PIX_FMT_NONE表示自动协商
+    enum AVColorSpace colorspace; // YUV矩阵，AVCOL_SPC_UNSPECIFIED表示按分辨率选择
+    enum AVColorRange color_range; // YUV范围，AVCOL_RANGE_UNSPECIFIED表示有限范围
+    int threads;                  // 编码线程数，0表示由编码器按CPU核数选择
+    int thread_type;              // FF_THREAD_SLICE或FF_THREAD_FRAME，0表示编码器默认
+    enum FFmpegLatencyMode latency_mode; // 延迟模式
+} FFmpegVideoConfig;
+
+// 输出目标：共用编码器的一路封装输出，可以独立连接和重连
+typedef struct FFmpegOutputTarget {
+    struct AVFormatContext *o_ctx;        // FFmpeg输出格式上下文，未连接时为NULL
+    const struct AVOutputFormat *oformat; // 封装格式
+    const char *output;                  // 输出文件路径/URL
+    AVDictionary *options;               // 写入文件头时使用的选项
+    int rendition;                       // 输出的视频清晰度(编码器索引)
+    char *error_str;                     // 错误信息字符串
+} FFmpegOutputTarget;
 
 typedef struct FFmpegOutputCtx {
-    struct AVFormatContext *o_ctx;        // FFmpeg输出格式上下文
     struct AVCodecContext *audio_codec_ctx; // 音频编码器上下文
-    struct AVCodecContext *video_codec_ctx; // 视频编码器上下文
-    int audio_stream_index;              // 音频流索引
-    int video_stream_index;              // 视频流索引
-    const char *output;                  // 输出文件路径/URL
+    // 各清晰度的视频编码器上下文，0为源分辨率，其余按分辨率从高到低排列
+    struct AVCodecContext *video_codec_ctxs[FFMPEG_OUTPUT_MAX_RENDITIONS];
+    int nb_renditions;                   // 已建立的视频编码器数
+    // 各视频编码器预计的编码延迟(帧)，即送入一帧后最多再送入多少帧才能
+    // 取出它的数据包，包括B帧、前瞻和帧级并行，-1表示未知(编码器默认设置)
+    int video_delays[FFMPEG_OUTPUT_MAX_RENDITIONS];
+    int audio_stream_index;              // 音频流在每个输出目标中的索引
+    int video_stream_index;              // 视频流在每个输出目标中的索引
+    FFmpegOutputTarget *targets[FFMPEG_OUTPUT_MAX_TARGETS]; // 输出目标
+    int nb_targets;                      // 输出目标数
     char *error_str;                     // 错误信息字符串
 } FFmpegOutputCtx;
 
@@ -34,19 +79,37 @@ new_ffmpeg_output_ctx();
 int
 free_ffmpeg_output_ctx(FFmpegOutputCtx **ctx);
 
-// 初始化FFmpeg输出上下文
-// 参数: 
+// 添加输出目标(只登记，不连接)，必须在设置编码器之前调用
+// 参数:
 //   ctx - FFmpeg输出上下文指针
-//   format - 输出格式名称(如"flv","mp4"等)
-//   output - 输出文件路径/URL
-// 返回值: 成功返回0，失败返回负数错误码
+//   rendition - 该目标输出的视频清晰度(编码器索引)
+//   format - 输出格式名称(如"flv","rtsp"等)
+//   output - 输出文件路径/URL，必须比ctx存活更久
+//   options - 写入文件头时使用的选项(会被复制)，可为NULL
+// 返回值: 成功返回目标索引，失败返回负数错误码
 int
-ffmpeg_output_init(FFmpegOutputCtx *ctx, const char *format,
-                   const char *output);
+ffmpeg_output_add_target(FFmpegOutputCtx *ctx, int rendition,
+                         const char *format, const char *output,
+                         const AVDictionary *options);
+
+// 连接输出目标：创建封装器、按当前编码器参数建立流并写入文件头
+// 参数:
+//   ctx - FFmpeg输出上下文指针，编码器必须已经就绪
+//   target - 输出目标
+//   int_cb - IO中断回调，用于在连接或写出阻塞时及时退出，可为NULL
+// 返回值: 成功返回0，失败返回负数错误码(错误信息见target->error_str)
+int
+ffmpeg_output_open_target(FFmpegOutputCtx *ctx, FFmpegOutputTarget *target,
+                          const AVIOInterruptCB *int_cb);
+
+// 断开输出目标，释放其封装器
+// 参数: target - 输出目标
+void
+ffmpeg_output_close_target(FFmpegOutputTarget *target);
 
 // 关闭FFmpeg输出上下文
 // 参数: ctx - FFmpeg输出上下文指针
-// 注意: 会释放内部资源但不会释放ctx本身
+// 注意: 断开所有输出目标并释放编码器，但保留目标列表，也不会释放ctx本身
 void
 ffmpeg_output_close(FFmpegOutputCtx *ctx);
 
@@ -56,27 +119,18 @@ ffmpeg_output_close(FFmpegOutputCtx *ctx);
 void
 ffmpeg_output_close_codecs(FFmpegOutputCtx *ctx);
 
-// 写入输出文件头
+// 添加一个视频编码器(一个清晰度)，按清晰度从高到低依次调用
+// 未指定编码像素格式时，从编码器支持的格式中选择由输入格式转换代价最低的一个。
+// YUV编码格式会带上颜色矩阵/范围标记，帧转换器按同样的标记选择RGB->YUV系数。
+// 延迟模式为libx264/libx265/libvpx/libsvtav1设置各自的低延迟选项，其他编码器
+// 只关闭B帧并限制码率缓冲；预计的编码延迟记录在video_delays中
 // 参数:
 //   ctx - FFmpeg输出上下文指针
-//   av_opts - 附加的AVDictionary选项
-// 返回值: 成功返回0，失败返回负数错误码
+//   config - 视频编码器配置
+// 返回值: 成功返回清晰度(编码器)索引，失败返回负数错误码
 int
-ffmpeg_output_write_header(FFmpegOutputCtx *ctx, AVDictionary **av_opts);
-
-// 设置视频编码器
-// 参数:
-//   ctx - FFmpeg输出上下文指针
-//   encoder_name - 编码器名称(如"libx264")
-//   width - 视频宽度(像素)
-//   height - 视频高度(像素)
-//   framerate - 帧率(AVRational结构)
-//   bitrate - 视频比特率(比特/秒)
-// 返回值: 成功返回0，失败返回负数错误码
-int
-ffmpeg_output_setup_video(FFmpegOutputCtx *ctx, const char *encoder_name,
-                          int width, int height, AVRational framerate,
-                          int64_t bitrate);
+ffmpeg_output_setup_video(FFmpegOutputCtx *ctx,
+                          const FFmpegVideoConfig *config);
 
 // 设置音频编码器
 // 参数:
@@ -87,20 +141,50 @@ ffmpeg_output_setup_video(FFmpegOutputCtx *ctx, const char *encoder_name,
 int
 ffmpeg_output_setup_audio(FFmpegOutputCtx *ctx, char *encoder_name,
                           int64_t bitrate);
-// 发送视频帧到编码器
+// 将视频帧送入编码器(不写出数据包)
 // 参数:
 //   ctx - FFmpeg输出上下文指针
-//   frame - 视频帧(AVFrame结构)
+//   rendition - 清晰度(编码器索引)
+//   frame - 视频帧，调用后会被unref；传NULL表示冲刷编码器
 // 返回值: 成功返回0，失败返回负数错误码
 int
-ffmpeg_output_send_video_frame(FFmpegOutputCtx *ctx, AVFrame *frame);
+ffmpeg_output_encode_video_frame(FFmpegOutputCtx *ctx, int rendition,
+                                 AVFrame *frame);
 
-// 发送音频帧到编码器
+// 将音频帧送入编码器(不写出数据包)
 // 参数:
 //   ctx - FFmpeg输出上下文指针
-//   frame - 音频帧(AVFrame结构)
+//   frame - 音频帧，调用后会被unref；传NULL表示冲刷编码器
 // 返回值: 成功返回0，失败返回负数错误码
 int
-ffmpeg_output_send_audio_frame(FFmpegOutputCtx *ctx, AVFrame *frame);
+ffmpeg_output_encode_audio_frame(FFmpegOutputCtx *ctx, AVFrame *frame);
+
+// 从视频编码器取出一个数据包，并设置其流索引
+// 参数:
+//   ctx - FFmpeg输出上下文指针
+//   rendition - 清晰度(编码器索引)
+//   pkt - 用于接收数据的数据包
+// 返回值: 成功返回0，暂无数据返回AVERROR(EAGAIN)，失败返回负数错误码
+int
+ffmpeg_output_receive_video_packet(FFmpegOutputCtx *ctx, int rendition,
+                                   AVPacket *pkt);
+
+// 从音频编码器取出一个数据包，并设置其流索引
+// 参数:
+//   ctx - FFmpeg输出上下文指针
+//   pkt - 用于接收数据的数据包
+// 返回值: 成功返回0，暂无数据返回AVERROR(EAGAIN)，失败返回负数错误码
+int
+ffmpeg_output_receive_audio_packet(FFmpegOutputCtx *ctx, AVPacket *pkt);
+
+// 将编码后的数据包写入输出目标(时间戳由编码器时间基换算到流时间基)
+// 参数:
+//   ctx - FFmpeg输出上下文指针
+//   target - 已连接的输出目标
+//   pkt - 数据包，写入后由封装器接管其引用
+// 返回值: 成功返回0，失败返回负数错误码(错误信息见target->error_str)
+int
+ffmpeg_output_write_packet(FFmpegOutputCtx *ctx, FFmpegOutputTarget *target,
+                           AVPacket *pkt);
 
 #endif
@@ -6,46 +6,81 @@
 
 #include "frame_converter.h"
 
+#include <libavutil/cpu.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 
+#include <stdatomic.h>
+#include <string.h>
+
 #include "common.h"
+#include "ndi_frame.h"
 
 // 帧转换器模块，提供NDI视频/音频帧到FFmpeg AVFrame的转换功能
 
+#define FC_FRAME_ALIGN 64         // 输出帧行字节数对齐，满足各级SIMD的要求
+#define FC_FRAME_HEIGHT_ALIGN 32  // 输出帧缓冲区高度对齐，编码器可安全越界读取
+#define FC_AUDIO_FRAME_SIZE 1024  // 编码器不限定帧长(frame_size为0)时的每帧样本数
+
 /**
  * 将NDI视频格式FourCC转换为FFmpeg像素格式
  * @param type NDI视频格式FourCC枚举值
- * @return 对应的FFmpeg像素格式，不支持的格式返回-1
+ * @return 对应的FFmpeg像素格式，不支持的格式返回AV_PIX_FMT_NONE
  */
 enum AVPixelFormat
 ndi_fourcc_to_ffmpeg(NDIlib_FourCC_video_type_e type)
 {
-    switch (type) {
-    case NDIlib_FourCC_video_type_UYVY:
-        return AV_PIX_FMT_UYVY422;
-    case NDIlib_FourCC_video_type_UYVA:
-        return AV_PIX_FMT_YUVA422P12;
-    case NDIlib_FourCC_video_type_BGRA:
-        return AV_PIX_FMT_BGRA;
-    case NDIlib_FourCC_video_type_BGRX:
-        return AV_PIX_FMT_BGR0;
-    case NDIlib_FourCC_video_type_RGBA:
-        return AV_PIX_FMT_RGBA;
-    case NDIlib_FourCC_video_type_I420:
-        return AV_PIX_FMT_YUV420P;
-    case NDIlib_FourCC_video_type_NV12:
-        return AV_PIX_FMT_NV12;
-    case NDIlib_FourCC_video_type_RGBX:
-        return AV_PIX_FMT_RGB444;
-    case NDIlib_FourCC_video_type_P216:
-        return AV_PIX_FMT_P216;
-    case NDIlib_FourCC_video_type_PA16:
-        return AV_PIX_FMT_P016;
-    case NDIlib_FourCC_video_type_YV12:
-        return AV_PIX_FMT_UYVY422;
+    const NdiFormatDesc *desc = ndi_format_desc(type);
+    return desc ? desc->pix_fmt : AV_PIX_FMT_NONE;
+}
+
+/**
+ * 选择视频转换路径
+ * @param desc 输入格式描述
+ * @param dst_pix_fmt 编码器像素格式
+ * @param same_size 输入与输出尺寸是否相同
+ * @return 转换路径
+ */
+static FcVideoPath
+fc_select_video_path(const NdiFormatDesc *desc, enum AVPixelFormat dst_pix_fmt,
+                     int same_size)
+{
+    if (!same_size)
+        return FC_VIDEO_PATH_SWSCALE;
+    if (desc->pix_fmt == dst_pix_fmt)
+        return FC_VIDEO_PATH_PASSTHROUGH;
+    if (desc->kernel != NDI_FORMAT_KERNEL_SWSCALE
+        && (dst_pix_fmt == AV_PIX_FMT_YUV420P || dst_pix_fmt == AV_PIX_FMT_NV12))
+        return FC_VIDEO_PATH_PIXCONV;
+    return FC_VIDEO_PATH_SWSCALE;
+}
+
+/**
+ * 描述视频帧将采用的转换路径
+ * @param fourcc 输入NDI FourCC
+ * @param dst_pix_fmt 编码器像素格式
+ * @param same_size 输入与输出尺寸是否相同
+ * @return 路径名称字符串("passthrough"、"pixconv"或"swscale")，不支持的
+ *         输入格式返回"unsupported"
+ * @note 与fc_ndi_video_frame_to_avframe中的路径选择保持一致
+ */
+const char *
+fc_video_conversion_path(NDIlib_FourCC_video_type_e fourcc,
+                         enum AVPixelFormat dst_pix_fmt, int same_size)
+{
+    const NdiFormatDesc *desc = ndi_format_desc(fourcc);
+    if (!desc)
+        return "unsupported";
+
+    switch (fc_select_video_path(desc, dst_pix_fmt, same_size)) {
+    case FC_VIDEO_PATH_PASSTHROUGH:
+        return "passthrough";
+    case FC_VIDEO_PATH_PIXCONV:
+        return "pixconv";
     default:
-        return -1;
+        return "swscale";
     }
 }
 
@@ -61,12 +96,63 @@ new_frame_converter_ctx()
     memset(ctx, 0, sizeof(FrameConverterCtx));
     ctx->error_str = malloc(AV_ERROR_MAX_STRING_SIZE + 100);
     ctx->video_frame = av_frame_alloc();
+    ctx->video_src_frame = av_frame_alloc();
     ctx->audio_frame = av_frame_alloc();
+    ctx->nb_threads = 1;
     ctx->frame_index = 0;
     ctx->start_ts = get_current_ts_usec();
     return ctx;
 }
 
+/**
+ * 设置视频转换线程数
+ * @param ctx 帧转换器上下文
+ * @param pool 共用的分片线程池，NULL表示自建
+ * @param nb_threads 线程数，0表示自动选择
+ * @return 实际使用的线程数
+ * @note 会使当前转换计划失效，下一帧按新的线程数重建
+ */
+int
+fc_set_video_threads(FrameConverterCtx *ctx, SlicePool *pool, int nb_threads)
+{
+    if (nb_threads <= 0) {
+        nb_threads = av_cpu_count();
+        if (nb_threads > FC_MAX_AUTO_THREADS)
+            nb_threads = FC_MAX_AUTO_THREADS;
+    }
+    if (pool && nb_threads > slice_pool_threads(pool))
+        nb_threads = slice_pool_threads(pool);
+    if (nb_threads < 1)
+        nb_threads = 1;
+
+    if (ctx->owns_slice_pool)
+        free_slice_pool(&ctx->slice_pool);
+    ctx->slice_pool = pool;
+    ctx->owns_slice_pool = 0;
+    if (!pool && nb_threads > 1) {
+        ctx->slice_pool = new_slice_pool(nb_threads);
+        ctx->owns_slice_pool = ctx->slice_pool != NULL;
+        if (!ctx->slice_pool)
+            nb_threads = 1;
+    }
+    ctx->nb_threads = nb_threads;
+    ctx->video_plan.desc = NULL;
+    return nb_threads;
+}
+
+/**
+ * 释放swscale分片上下文
+ * @param ctx 帧转换器上下文
+ */
+static void
+fc_free_sws_slices(FrameConverterCtx *ctx)
+{
+    for (int i = 0; i < ctx->nb_sws_slices; ++i)
+        sws_freeContext(ctx->sws_slice_ctxs[i]);
+    av_freep(&ctx->sws_slice_ctxs);
+    ctx->nb_sws_slices = 0;
+}
+
 /**
  * 释放帧转换器上下文资源
  * @param ctx 指向帧转换器上下文指针的指针
@@ -78,12 +164,22 @@ free_frame_converter_ctx(FrameConverterCtx **ctx)
 {
     if ((*ctx)->sws_ctx)
         sws_freeContext((*ctx)->sws_ctx);
+    fc_free_sws_slices(*ctx);
     if ((*ctx)->swr_context)
         swr_free(&(*ctx)->swr_context);
     if ((*ctx)->audio_frame)
         av_frame_free(&(*ctx)->audio_frame);
     if ((*ctx)->video_frame)
         av_frame_free(&(*ctx)->video_frame);
+    if ((*ctx)->video_src_frame)
+        av_frame_free(&(*ctx)->video_src_frame);
+    if ((*ctx)->owns_slice_pool)
+        free_slice_pool(&(*ctx)->slice_pool);
+    av_buffer_pool_uninit(&(*ctx)->video_pool);
+    av_buffer_pool_uninit(&(*ctx)->audio_pool);
+    if ((*ctx)->audio_fifo)
+        av_audio_fifo_free((*ctx)->audio_fifo);
+    av_freep(&(*ctx)->audio_tmp[0]);
 
     free(*ctx);
     *ctx = NULL;
@@ -93,174 +189,984 @@ free_frame_converter_ctx(FrameConverterCtx **ctx)
 /**
  * 重置帧转换器上下文状态
  * @param ctx 帧转换器上下文指针
- * @note 重置帧索引和起始时间戳，用于重新开始计数
+ * @note 重置帧索引和起始时间戳，用于重新开始计数；编码器可能已重建，
+ * 音频重采样器和FIFO一并丢弃
  */
 void
 fc_reset(FrameConverterCtx *ctx)
 {
     ctx->frame_index = 0;
     ctx->start_ts = get_current_ts_usec();
+
+    if (ctx->swr_context)
+        swr_free(&ctx->swr_context);
+    if (ctx->audio_fifo) {
+        av_audio_fifo_free(ctx->audio_fifo);
+        ctx->audio_fifo = NULL;
+    }
+    ctx->audio_in_sample_rate = 0;
+    ctx->audio_in_channels = 0;
+    ctx->audio_samples = 0;
 }
 
 /**
- * 将NDI视频帧转换为FFmpeg AVFrame
+ * 设置视频帧时间戳并推进帧索引
  * @param ctx 帧转换器上下文
- * @param codec_ctx FFmpeg编解码器上下文
+ * @param out_frame 输出帧
  * @param in_frame 输入的NDI视频帧
- * @return 转换后的AVFrame指针，失败返回NULL
- * @note 执行以下操作:
- * 1. 准备可写的输出帧
- * 2. 设置帧格式和尺寸
- * 3. 获取图像缓冲区
- * 4. 创建/获取图像缩放上下文
- * 5. 填充源图像参数
- * 6. 执行图像格式转换
- * 7. 设置时间戳和帧索引
+ * @param capture_ts 帧的采集时间(微秒)
+ * @note pts取采集时间在帧率网格上最近的位置(且严格递增)：上游丢弃的帧在
+ * 时间戳中留下空档，视频不会相对音频逐渐落后，pts也可直接用来估算帧的延迟
  */
-AVFrame *
-fc_ndi_video_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
-                              NDIlib_video_frame_v2_t *in_frame)
+static void
+fc_set_video_timing(FrameConverterCtx *ctx, AVFrame *out_frame,
+                    const NDIlib_video_frame_v2_t *in_frame,
+                    int64_t capture_ts)
 {
+    int64_t index = av_rescale_rnd(capture_ts - ctx->start_ts,
+                                   in_frame->frame_rate_N,
+                                   (int64_t)AV_TIME_BASE
+                                           * in_frame->frame_rate_D,
+                                   AV_ROUND_NEAR_INF);
+    if (index < ctx->frame_index)
+        index = ctx->frame_index;
 
-    AVFrame *out_frame = ctx->video_frame;
+    out_frame->pkt_dts = get_current_ts_usec() - ctx->start_ts;
+    out_frame->pts = index * AV_TIME_BASE * in_frame->frame_rate_D
+                     / in_frame->frame_rate_N;
+    ctx->frame_index = index + 1;
 
-    av_frame_make_writable(out_frame);
-    out_frame->format = codec_ctx->pix_fmt;
-    out_frame->width = codec_ctx->width;
-    out_frame->height = codec_ctx->height;
-    av_frame_get_buffer(out_frame, 0);
+    // AV_PICTURE_TYPE_I; // force infra
+    out_frame->pict_type = AV_PICTURE_TYPE_NONE;
+}
 
-    enum AVPixelFormat src_pix_fmt = ndi_fourcc_to_ffmpeg(in_frame->FourCC);
+/**
+ * 让swscale的RGB->YUV转换使用与编码器标记一致的矩阵和范围
+ * @param sws_ctx 缩放上下文
+ * @param codec_ctx 编码器上下文
+ */
+static void
+fc_sws_set_rgb_colorspace(struct SwsContext *sws_ctx,
+                          const AVCodecContext *codec_ctx)
+{
+    int *inv_table, *table;
+    int src_range, dst_range, brightness, contrast, saturation;
+    if (sws_getColorspaceDetails(sws_ctx, &inv_table, &src_range, &table,
+                                 &dst_range, &brightness, &contrast,
+                                 &saturation)
+        < 0)
+        return;
 
-    ctx->sws_ctx = sws_getCachedContext(
-            ctx->sws_ctx, in_frame->xres, in_frame->yres, src_pix_fmt,
-            out_frame->width, out_frame->height, out_frame->format, SWS_BICUBIC,
-            NULL, NULL, NULL);
+    sws_setColorspaceDetails(
+            sws_ctx, inv_table, 1,
+            sws_getCoefficients(codec_ctx->colorspace == AVCOL_SPC_BT709
+                                        ? SWS_CS_ITU709
+                                        : SWS_CS_ITU601),
+            codec_ctx->color_range == AVCOL_RANGE_JPEG, brightness, contrast,
+            saturation);
+}
 
-    int src_stride[4] = {};
-    uint8_t *src[4] = {};
+/**
+ * 计算编码器输入帧的平面布局，并按其大小重建视频帧缓冲池
+ * @param pool 要重建的缓冲池
+ * @param plan 转换计划(dst_*字段已填写)
+ * @return 成功返回0，失败返回负数错误码
+ * @note 仍被编码器引用的旧缓冲区在释放时才归还给已销毁的池
+ */
+static int
+fc_init_video_pool(AVBufferPool **pool, FcVideoPlan *plan)
+{
+    ptrdiff_t linesize[4];
+    size_t sizes[4];
+    int ret;
 
-    av_image_fill_linesizes(src_stride, src_pix_fmt, in_frame->xres);
-    av_image_fill_pointers(src, src_pix_fmt, in_frame->yres, in_frame->p_data,
-                           src_stride);
+    if ((ret = av_image_fill_linesizes(plan->dst_linesize, plan->dst_pix_fmt,
+                                       plan->dst_width))
+        < 0)
+        return ret;
+    for (int i = 0; i < 4; ++i) {
+        plan->dst_linesize[i] = FFALIGN(plan->dst_linesize[i], FC_FRAME_ALIGN);
+        linesize[i] = plan->dst_linesize[i];
+    }
 
-    sws_scale(ctx->sws_ctx, (const uint8_t *const *)src, src_stride, 0, in_frame->yres, out_frame->data,
-              out_frame->linesize);
+    if ((ret = av_image_fill_plane_sizes(
+                 sizes, plan->dst_pix_fmt,
+                 FFALIGN(plan->dst_height, FC_FRAME_HEIGHT_ALIGN), linesize))
+        < 0)
+        return ret;
 
-    out_frame->pkt_dts = get_current_ts_usec() - ctx->start_ts;
-    out_frame->pts = ctx->frame_index * AV_TIME_BASE * in_frame->frame_rate_D
-                     / in_frame->frame_rate_N;
-    ctx->frame_index++;
+    plan->dst_size = 0;
+    for (int i = 0; i < 4; ++i) {
+        plan->dst_offset[i] = plan->dst_size;
+        plan->dst_size += sizes[i];
+    }
 
-    // AV_PICTURE_TYPE_I; // force infra
-    out_frame->pict_type = AV_PICTURE_TYPE_NONE;
+    av_buffer_pool_uninit(pool);
+    *pool = av_buffer_pool_init(plan->dst_size + FC_FRAME_ALIGN, NULL);
+    return *pool ? 0 : AVERROR(ENOMEM);
+}
 
-    return out_frame;
+/**
+ * 从缓冲池为输出视频帧取一块缓冲区
+ * @param pool 按plan布局建立的缓冲池
+ * @param plan 转换计划
+ * @param out_frame 输出帧，原有引用会被释放
+ * @return 成功返回0，失败返回负数错误码
+ */
+static int
+fc_video_frame_get_buffer(AVBufferPool *pool, const FcVideoPlan *plan,
+                          AVFrame *out_frame)
+{
+    av_frame_unref(out_frame);
+    out_frame->buf[0] = av_buffer_pool_get(pool);
+    if (!out_frame->buf[0])
+        return AVERROR(ENOMEM);
+
+    out_frame->format = plan->dst_pix_fmt;
+    out_frame->width = plan->dst_width;
+    out_frame->height = plan->dst_height;
+    for (int i = 0; i < 4 && plan->dst_linesize[i]; ++i) {
+        out_frame->data[i] = out_frame->buf[0]->data + plan->dst_offset[i];
+        out_frame->linesize[i] = plan->dst_linesize[i];
+    }
+    return 0;
 }
 
 /**
- * 将NDI音频帧转换为FFmpeg AVFrame
+ * 创建单线程的swscale上下文
+ * @param flags 缩放算法(SWS_*)
+ * @return 缩放上下文，失败返回NULL
+ * @note swscale自带的分片线程不受共用线程池管理，因此固定为1个线程，
+ * 需要并行时由调用方为每个分片各建一个上下文放到线程池上执行
+ */
+static struct SwsContext *
+fc_alloc_sws_ctx(int src_w, int src_h, enum AVPixelFormat src_pix_fmt,
+                 int dst_w, int dst_h, enum AVPixelFormat dst_pix_fmt,
+                 int flags)
+{
+    struct SwsContext *sws_ctx = sws_alloc_context();
+    if (!sws_ctx)
+        return NULL;
+
+    av_opt_set_int(sws_ctx, "srcw", src_w, 0);
+    av_opt_set_int(sws_ctx, "srch", src_h, 0);
+    av_opt_set_int(sws_ctx, "src_format", src_pix_fmt, 0);
+    av_opt_set_int(sws_ctx, "dstw", dst_w, 0);
+    av_opt_set_int(sws_ctx, "dsth", dst_h, 0);
+    av_opt_set_int(sws_ctx, "dst_format", dst_pix_fmt, 0);
+    av_opt_set_int(sws_ctx, "sws_flags", flags, 0);
+    av_opt_set_int(sws_ctx, "threads", 1, 0);
+
+    if (sws_init_context(sws_ctx, NULL, NULL) < 0) {
+        sws_freeContext(sws_ctx);
+        return NULL;
+    }
+    return sws_ctx;
+}
+
+/**
+ * 为当前输入和编码器参数创建swscale上下文
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 编码器上下文
+ * @param in_frame 输入的NDI视频帧
+ * @param desc 输入格式描述
+ * @return 成功返回0，失败返回负数错误码
+ * @note 有线程池且帧足够大时，另为每个分片创建一个参数相同的上下文；
+ * 分片上下文创建失败时退化为单线程转换，不视为错误
+ */
+static int
+fc_init_sws_slices(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx,
+                   const NDIlib_video_frame_v2_t *in_frame,
+                   const NdiFormatDesc *desc)
+{
+    const AVPixFmtDescriptor *pix_desc = av_pix_fmt_desc_get(desc->pix_fmt);
+    int rgb = pix_desc && (pix_desc->flags & AV_PIX_FMT_FLAG_RGB);
+
+    fc_free_sws_slices(ctx);
+    if (ctx->sws_ctx)
+        sws_freeContext(ctx->sws_ctx);
+    ctx->sws_ctx = fc_alloc_sws_ctx(in_frame->xres, in_frame->yres,
+                                    desc->pix_fmt, codec_ctx->width,
+                                    codec_ctx->height, codec_ctx->pix_fmt,
+                                    SWS_BICUBIC);
+    if (!ctx->sws_ctx)
+        return AVERROR(ENOMEM);
+    if (rgb)
+        fc_sws_set_rgb_colorspace(ctx->sws_ctx, codec_ctx);
+
+    int nb_slices = codec_ctx->height / FC_MIN_SLICE_ROWS;
+    if (nb_slices > ctx->nb_threads)
+        nb_slices = ctx->nb_threads;
+    if (!ctx->slice_pool || nb_slices <= 1)
+        return 0;
+
+    ctx->sws_slice_ctxs = av_calloc(nb_slices, sizeof(*ctx->sws_slice_ctxs));
+    if (!ctx->sws_slice_ctxs)
+        return 0;
+    for (int i = 0; i < nb_slices; ++i) {
+        struct SwsContext *sws_ctx = fc_alloc_sws_ctx(
+                in_frame->xres, in_frame->yres, desc->pix_fmt,
+                codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt,
+                SWS_BICUBIC);
+        if (!sws_ctx) {
+            fc_free_sws_slices(ctx);
+            return 0;
+        }
+        if (rgb)
+            fc_sws_set_rgb_colorspace(sws_ctx, codec_ctx);
+        ctx->sws_slice_ctxs[ctx->nb_sws_slices++] = sws_ctx;
+    }
+    return 0;
+}
+
+/**
+ * 获取当前输入和编码器参数对应的视频转换计划
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 编码器上下文
+ * @param in_frame 输入的NDI视频帧
+ * @return 转换计划，不支持的输入格式或无法创建缩放上下文时返回NULL
+ * @note 参数与上一帧相同时直接复用，否则重新查表、选择路径，并预先准备
+ * RGB系数或swscale上下文，逐帧转换时不再重复这些工作
+ */
+static const FcVideoPlan *
+fc_get_video_plan(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx,
+                  const NDIlib_video_frame_v2_t *in_frame)
+{
+    FcVideoPlan *plan = &ctx->video_plan;
+
+    if (plan->desc && plan->fourcc == in_frame->FourCC
+        && plan->src_width == in_frame->xres
+        && plan->src_height == in_frame->yres
+        && plan->dst_pix_fmt == codec_ctx->pix_fmt
+        && plan->dst_width == codec_ctx->width
+        && plan->dst_height == codec_ctx->height
+        && plan->colorspace == codec_ctx->colorspace
+        && plan->color_range == codec_ctx->color_range)
+        return plan;
+
+    const NdiFormatDesc *desc = ndi_format_desc(in_frame->FourCC);
+    if (!desc) {
+        sprintf(ctx->error_str, "unsupported NDI video format 0x%08x\n",
+                (unsigned)in_frame->FourCC);
+        return NULL;
+    }
+
+    memset(plan, 0, sizeof(FcVideoPlan));
+    plan->fourcc = in_frame->FourCC;
+    plan->src_width = in_frame->xres;
+    plan->src_height = in_frame->yres;
+    plan->dst_pix_fmt = codec_ctx->pix_fmt;
+    plan->dst_width = codec_ctx->width;
+    plan->dst_height = codec_ctx->height;
+    plan->colorspace = codec_ctx->colorspace;
+    plan->color_range = codec_ctx->color_range;
+    plan->path = fc_select_video_path(
+            desc, codec_ctx->pix_fmt,
+            in_frame->xres == codec_ctx->width
+                    && in_frame->yres == codec_ctx->height);
+
+    int ret = fc_init_video_pool(&ctx->video_pool, plan);
+    if (ret < 0) {
+        av_error_fmt(ctx->error_str, "could not create video frame pool!", ret);
+        return NULL;
+    }
+
+    if (plan->path == FC_VIDEO_PATH_PIXCONV
+        && desc->kernel == NDI_FORMAT_KERNEL_RGB32) {
+        pixconv_rgb_coeffs_init(
+                &plan->rgb_coeffs,
+                desc->pix_fmt == AV_PIX_FMT_RGBA || desc->pix_fmt == AV_PIX_FMT_RGB0
+                        ? PIXCONV_ORDER_RGBA
+                        : PIXCONV_ORDER_BGRA,
+                codec_ctx->colorspace == AVCOL_SPC_BT709 ? PIXCONV_MATRIX_BT709
+                                                         : PIXCONV_MATRIX_BT601,
+                codec_ctx->color_range == AVCOL_RANGE_JPEG);
+    }
+
+    if (plan->path == FC_VIDEO_PATH_SWSCALE) {
+        if (fc_init_sws_slices(ctx, codec_ctx, in_frame, desc) < 0) {
+            sprintf(ctx->error_str, "%s", "could not create scaling context\n");
+            return NULL;
+        }
+    }
+
+    plan->desc = desc;
+    return plan;
+}
+
+/**
+ * 用pixconv内核把UYVY或32位RGB转换为I420/NV12
+ * @param plan 转换计划(路径为FC_VIDEO_PATH_PIXCONV)
+ * @param src 输入数据
+ * @param src_stride 输入行字节数
+ * @param out_frame 已分配缓冲区的输出帧
+ */
+static void
+fc_pixconv_convert(const FcVideoPlan *plan, const uint8_t *src, int src_stride,
+                   AVFrame *out_frame)
+{
+    int nv12 = out_frame->format == AV_PIX_FMT_NV12;
+
+    if (plan->desc->kernel == NDI_FORMAT_KERNEL_UYVY) {
+        if (nv12)
+            pixconv_uyvy_to_nv12(src, src_stride, out_frame->data,
+                                 out_frame->linesize, out_frame->width,
+                                 out_frame->height);
+        else
+            pixconv_uyvy_to_i420(src, src_stride, out_frame->data,
+                                 out_frame->linesize, out_frame->width,
+                                 out_frame->height);
+    }
+    else if (nv12) {
+        pixconv_rgb32_to_nv12(src, src_stride, out_frame->data,
+                              out_frame->linesize, out_frame->width,
+                              out_frame->height, &plan->rgb_coeffs);
+    }
+    else {
+        pixconv_rgb32_to_i420(src, src_stride, out_frame->data,
+                              out_frame->linesize, out_frame->width,
+                              out_frame->height, &plan->rgb_coeffs);
+    }
+}
+
+// pixconv分片任务参数
+typedef struct FcPixconvSlices {
+    const FcVideoPlan *plan;  // 转换计划
+    const uint8_t *src;  // 输入数据
+    int src_stride;  // 输入行字节数
+    AVFrame *out_frame;  // 输出帧
+} FcPixconvSlices;
+
+/**
+ * 转换第job个水平分片
+ * @note 分片起始行为偶数，色度行与亮度行一一对应，各分片互不重叠
+ */
+static void
+fc_pixconv_slice(void *arg, int job, int nb_jobs)
+{
+    FcPixconvSlices *s = arg;
+    AVFrame *out = s->out_frame;
+    int rows = ((out->height + nb_jobs - 1) / nb_jobs + 1) & ~1;
+    int y0 = job * rows;
+    int y1 = y0 + rows < out->height ? y0 + rows : out->height;
+    if (y0 >= y1)
+        return;
+
+    AVFrame slice = *out;
+    slice.height = y1 - y0;
+    slice.data[0] = out->data[0] + (ptrdiff_t)y0 * out->linesize[0];
+    for (int i = 1; i < 3 && out->data[i]; ++i)
+        slice.data[i] = out->data[i] + (ptrdiff_t)(y0 / 2) * out->linesize[i];
+
+    fc_pixconv_convert(s->plan, s->src + (ptrdiff_t)y0 * s->src_stride,
+                       s->src_stride, &slice);
+}
+
+/**
+ * 把帧按行切成至多nb_threads个分片，在线程池上并行执行pixconv转换
+ */
+static void
+fc_pixconv_convert_sliced(FrameConverterCtx *ctx, const FcVideoPlan *plan,
+                          const uint8_t *src, int src_stride,
+                          AVFrame *out_frame)
+{
+    int nb_slices = out_frame->height / FC_MIN_SLICE_ROWS;
+    if (nb_slices > ctx->nb_threads)
+        nb_slices = ctx->nb_threads;
+
+    if (!ctx->slice_pool || nb_slices <= 1) {
+        fc_pixconv_convert(plan, src, src_stride, out_frame);
+        return;
+    }
+
+    FcPixconvSlices slices = {
+        .plan = plan,
+        .src = src,
+        .src_stride = src_stride,
+        .out_frame = out_frame,
+    };
+    slice_pool_run(ctx->slice_pool, fc_pixconv_slice, &slices, nb_slices);
+}
+
+// swscale分片任务参数
+typedef struct FcSwsSlices {
+    struct SwsContext **sws_ctxs;  // 每个分片一个缩放上下文
+    const AVFrame *src_frame;  // 持有缓冲区引用的输入帧
+    AVFrame *out_frame;  // 输出帧
+    _Atomic(int) ret;  // 第一个失败分片的错误码
+} FcSwsSlices;
+
+/**
+ * 用第job个上下文输出第job个水平分片
+ * @note 每个上下文都读取完整的输入，只写输出帧中属于自己的行；
+ * 分片起始行按swscale要求的行数对齐
+ */
+static void
+fc_sws_slice(void *arg, int job, int nb_jobs)
+{
+    FcSwsSlices *s = arg;
+    struct SwsContext *sws_ctx = s->sws_ctxs[job];
+    int height = s->out_frame->height;
+    int align = sws_receive_slice_alignment(sws_ctx);
+    int rows = (height + nb_jobs - 1) / nb_jobs;
+    rows = (rows + align - 1) / align * align;
+    int y0 = job * rows;
+    int y1 = y0 + rows < height ? y0 + rows : height;
+    if (y0 >= y1)
+        return;
+
+    int ret = sws_frame_start(sws_ctx, s->out_frame, s->src_frame);
+    if (ret >= 0)
+        ret = sws_send_slice(sws_ctx, 0, s->src_frame->height);
+    if (ret >= 0)
+        ret = sws_receive_slice(sws_ctx, y0, y1 - y0);
+    sws_frame_end(sws_ctx);
+    if (ret < 0) {
+        int expected = 0;
+        atomic_compare_exchange_strong(&s->ret, &expected, ret);
+    }
+}
+
+/**
+ * 用swscale转换，有分片上下文和NDI缓冲区引用时在线程池上按行并行
+ * @return 成功返回0，失败返回负数错误码
+ */
+static int
+fc_sws_convert(FrameConverterCtx *ctx, const FcVideoPlan *plan,
+               uint8_t *src[4], int src_stride[4], AVBufferRef *in_buf,
+               AVFrame *out_frame)
+{
+    if (ctx->nb_sws_slices <= 1 || !in_buf) {
+        return sws_scale(ctx->sws_ctx, (const uint8_t *const *)src, src_stride,
+                         0, plan->src_height, out_frame->data,
+                         out_frame->linesize);
+    }
+
+    // 源帧持有NDI缓冲区的引用，各分片上下文不会再拷贝一份输入
+    AVFrame *src_frame = ctx->video_src_frame;
+    src_frame->buf[0] = av_buffer_ref(in_buf);
+    if (!src_frame->buf[0])
+        return AVERROR(ENOMEM);
+    src_frame->format = plan->desc->pix_fmt;
+    src_frame->width = plan->src_width;
+    src_frame->height = plan->src_height;
+    for (int i = 0; i < 4; ++i) {
+        src_frame->data[i] = src[i];
+        src_frame->linesize[i] = src_stride[i];
+    }
+
+    FcSwsSlices slices = {
+        .sws_ctxs = ctx->sws_slice_ctxs,
+        .src_frame = src_frame,
+        .out_frame = out_frame,
+    };
+    atomic_init(&slices.ret, 0);
+    slice_pool_run(ctx->slice_pool, fc_sws_slice, &slices, ctx->nb_sws_slices);
+    av_frame_unref(src_frame);
+    return atomic_load(&slices.ret);
+}
+
+/**
+ * 将NDI视频帧转换为FFmpeg AVFrame
  * @param ctx 帧转换器上下文
  * @param codec_ctx FFmpeg编解码器上下文
- * @param in_frame 输入的NDI音频帧
+ * @param in_frame 输入的NDI视频帧
+ * @param in_buf 持有in_frame像素数据的引用(可为NULL)
  * @return 转换后的AVFrame指针，失败返回NULL
- * @note 执行以下操作:
- * 1. 检查剩余样本数
- * 2. 准备可写的输出帧
- * 3. 设置音频参数(采样数、格式、采样率、声道布局)
- * 4. 获取音频缓冲区
- * 5. 处理刷新情况(无输入帧)
- * 6. 设置重采样参数
- * 7. 初始化重采样上下文
- * 8. 填充音频数据
- * 9. 执行重采样
- * 10. 设置时间戳
+ * @note 按转换计划执行:
+ * - 直通: 输出帧的平面直接指向NDI缓冲区并持有in_buf的引用，不做任何拷贝
+ *   (未提供in_buf时退化为一次平面拷贝)
+ * - pixconv: 尺寸相同的UYVY/RGB->I420/NV12使用向量化内核
+ * - swscale: 其余需要缩放或转换的情况
+ * 后两者在大帧上按行切片，分布到nb_threads个线程并行执行
  */
 AVFrame *
-fc_ndi_audio_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
-                              NDIlib_audio_frame_v2_t *in_frame)
+fc_ndi_video_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
+                              const NDIlib_video_frame_v2_t *in_frame,
+                              AVBufferRef *in_buf)
 {
+    const FcVideoPlan *plan = fc_get_video_plan(ctx, codec_ctx, in_frame);
+    if (!plan)
+        return NULL;
+
+    AVFrame *out_frame = ctx->video_frame;
+    int src_stride[4];
+    uint8_t *src[4];
     int ret;
-    int nb_samples = codec_ctx->frame_size;
 
-    int remaining_pre
-            = ctx->swr_context ? swr_get_out_samples(ctx->swr_context, 0) : 0;
+    ndi_format_fill_planes(plan->desc, in_frame, src, src_stride);
+
+    if (plan->path == FC_VIDEO_PATH_PASSTHROUGH && in_buf) {
+        // 直通路径：编码器直接读取NDI缓冲区
+        av_frame_unref(out_frame);
+        out_frame->buf[0] = av_buffer_ref(in_buf);
+        if (!out_frame->buf[0]) {
+            sprintf(ctx->error_str, "%s", "could not reference NDI frame\n");
+            return NULL;
+        }
+        out_frame->format = plan->desc->pix_fmt;
+        out_frame->width = in_frame->xres;
+        out_frame->height = in_frame->yres;
+        for (int i = 0; i < 4; ++i) {
+            out_frame->data[i] = src[i];
+            out_frame->linesize[i] = src_stride[i];
+        }
+
+        fc_set_video_timing(ctx, out_frame, in_frame,
+                            ndi_video_frame_capture_ts(in_buf));
+        return out_frame;
+    }
 
-    if (!in_frame && remaining_pre < nb_samples) { // wait
+    if ((ret = fc_video_frame_get_buffer(ctx->video_pool, plan, out_frame))
+        < 0) {
+        av_error_fmt(ctx->error_str, "could not allocate video frame!", ret);
         return NULL;
     }
 
-    AVFrame *out_frame = ctx->audio_frame;
+    switch (plan->path) {
+    case FC_VIDEO_PATH_PASSTHROUGH:
+        av_image_copy(out_frame->data, out_frame->linesize,
+                      (const uint8_t **)src, src_stride, out_frame->format,
+                      out_frame->width, out_frame->height);
+        break;
+    case FC_VIDEO_PATH_PIXCONV:
+        fc_pixconv_convert_sliced(ctx, plan, src[0], src_stride[0], out_frame);
+        break;
+    default:
+        if ((ret = fc_sws_convert(ctx, plan, src, src_stride, in_buf,
+                                  out_frame))
+            < 0) {
+            av_error_fmt(ctx->error_str, "error scaling video frame!", ret);
+            return NULL;
+        }
+        break;
+    }
+
+    fc_set_video_timing(ctx, out_frame, in_frame,
+                        in_buf ? ndi_video_frame_capture_ts(in_buf)
+                               : get_current_ts_usec());
+    return out_frame;
+}
+
+/**
+ * 获取每个音频帧的样本数
+ * @param codec_ctx 音频编码器上下文
+ * @return 编码器要求的frame_size，不限定时返回FC_AUDIO_FRAME_SIZE
+ */
+static int
+fc_audio_frame_size(const AVCodecContext *codec_ctx)
+{
+    return codec_ctx->frame_size > 0 ? codec_ctx->frame_size
+                                     : FC_AUDIO_FRAME_SIZE;
+}
+
+/**
+ * 从缓冲池为输出音频帧取一块缓冲区，每帧采样数或格式变化时重建缓冲池
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 音频编码器上下文
+ * @param out_frame 输出帧，原有引用会被释放
+ * @return 成功返回0，失败返回负数错误码
+ */
+static int
+fc_audio_frame_get_buffer(FrameConverterCtx *ctx,
+                          const AVCodecContext *codec_ctx, AVFrame *out_frame)
+{
+    int nb_channels = codec_ctx->ch_layout.nb_channels;
+    int ret;
 
-    av_frame_make_writable(out_frame);
-    out_frame->nb_samples = nb_samples;
+    av_frame_unref(out_frame);
+    out_frame->nb_samples = fc_audio_frame_size(codec_ctx);
     out_frame->format = codec_ctx->sample_fmt;
     out_frame->sample_rate = codec_ctx->sample_rate;
-    out_frame->ch_layout = codec_ctx->ch_layout;
-    av_frame_get_buffer(out_frame, 0);
+    if ((ret = av_channel_layout_copy(&out_frame->ch_layout,
+                                      &codec_ctx->ch_layout))
+        < 0)
+        return ret;
 
-    if (!in_frame) { // flush
-        out_frame->pkt_dts = get_current_ts_usec() - ctx->start_ts;
-        out_frame->pts = swr_next_pts(ctx->swr_context, INT64_MIN);
+    // 声道数超过data数组时需要单独分配extended_data，交给FFmpeg处理
+    if (nb_channels > AV_NUM_DATA_POINTERS)
+        return av_frame_get_buffer(out_frame, 0);
 
-        ret = swr_convert(ctx->swr_context, out_frame->data,
-                          out_frame->nb_samples, NULL, 0);
+    int size = av_samples_get_buffer_size(NULL, nb_channels,
+                                          out_frame->nb_samples,
+                                          out_frame->format, 0);
+    if (size < 0)
+        return size;
+    if (!ctx->audio_pool || ctx->audio_pool_size != size) {
+        av_buffer_pool_uninit(&ctx->audio_pool);
+        ctx->audio_pool = av_buffer_pool_init(size, NULL);
+        if (!ctx->audio_pool)
+            return AVERROR(ENOMEM);
+        ctx->audio_pool_size = size;
+    }
 
-        if (ret < 0) {
-            av_error_fmt(ctx->error_str, "error converting frame!", ret);
-            return NULL;
+    out_frame->buf[0] = av_buffer_pool_get(ctx->audio_pool);
+    if (!out_frame->buf[0])
+        return AVERROR(ENOMEM);
+    return av_samples_fill_arrays(out_frame->data, out_frame->linesize,
+                                  out_frame->buf[0]->data, nb_channels,
+                                  out_frame->nb_samples, out_frame->format, 0);
+}
+
+/**
+ * 按NDI音频参数准备转换，只在采样率或声道数变化时重建
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 音频编码器上下文
+ * @param in_frame 输入的NDI音频帧
+ * @return 成功返回0，失败返回负数错误码
+ * @note 输入已是编码器的采样率、声道布局和FLTP格式时不创建重采样器，
+ * 样本直接写入FIFO
+ */
+static int
+fc_setup_audio(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx,
+               const NDIlib_audio_frame_v2_t *in_frame)
+{
+    int ret;
+
+    if (in_frame->sample_rate == ctx->audio_in_sample_rate
+        && in_frame->no_channels == ctx->audio_in_channels)
+        return 0;
+
+    if (codec_ctx->ch_layout.nb_channels > AV_NUM_DATA_POINTERS
+        || in_frame->no_channels > AV_NUM_DATA_POINTERS
+        || in_frame->no_channels <= 0 || in_frame->sample_rate <= 0) {
+        sprintf(ctx->error_str, "unsupported NDI audio format (%d Hz, %d ch)\n",
+                in_frame->sample_rate, in_frame->no_channels);
+        return AVERROR(EINVAL);
+    }
+
+    // FIFO中保存的是编码器格式的样本，输入参数变化时可以保留
+    if (!ctx->audio_fifo) {
+        ctx->audio_fifo = av_audio_fifo_alloc(
+                codec_ctx->sample_fmt, codec_ctx->ch_layout.nb_channels,
+                fc_audio_frame_size(codec_ctx) * 2);
+        if (!ctx->audio_fifo) {
+            sprintf(ctx->error_str, "%s", "could not allocate audio FIFO\n");
+            return AVERROR(ENOMEM);
         }
-        return out_frame;
     }
 
     AVChannelLayout in_layout;
     av_channel_layout_default(&in_layout, in_frame->no_channels);
 
-    ret = swr_alloc_set_opts2(&ctx->swr_context, &out_frame->ch_layout,
-                              out_frame->format, out_frame->sample_rate,
-                              &in_layout, AV_SAMPLE_FMT_FLTP,
-                              in_frame->sample_rate, 0, NULL);
-    if (ret < 0) {
-        av_error_fmt(ctx->error_str, "error converting frame!", ret);
-        return NULL;
+    if (ctx->swr_context)
+        swr_free(&ctx->swr_context);
+    if (in_frame->sample_rate != codec_ctx->sample_rate
+        || codec_ctx->sample_fmt != AV_SAMPLE_FMT_FLTP
+        || av_channel_layout_compare(&in_layout, &codec_ctx->ch_layout) != 0) {
+        ret = swr_alloc_set_opts2(&ctx->swr_context, &codec_ctx->ch_layout,
+                                  codec_ctx->sample_fmt, codec_ctx->sample_rate,
+                                  &in_layout, AV_SAMPLE_FMT_FLTP,
+                                  in_frame->sample_rate, 0, NULL);
+        if (ret >= 0)
+            ret = swr_init(ctx->swr_context);
+        if (ret < 0) {
+            av_error_fmt(ctx->error_str, "could not create audio resampler!",
+                         ret);
+            swr_free(&ctx->swr_context);
+            return ret;
+        }
     }
 
+    ctx->audio_in_sample_rate = in_frame->sample_rate;
+    ctx->audio_in_channels = in_frame->no_channels;
+    return 0;
+}
+
+/**
+ * 把NDI音频帧写入FIFO，需要时先经过重采样
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 音频编码器上下文
+ * @param in_frame 输入的NDI音频帧
+ * @return 成功返回0，失败返回负数错误码
+ */
+static int
+fc_write_audio(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx,
+               const NDIlib_audio_frame_v2_t *in_frame)
+{
+    uint8_t *in[AV_NUM_DATA_POINTERS] = {};
+    int ret;
+
+    // NDI的FLTP平面之间按channel_stride_in_bytes排列
+    for (int i = 0; i < in_frame->no_channels; ++i)
+        in[i] = (uint8_t *)in_frame->p_data
+                + (size_t)i * in_frame->channel_stride_in_bytes;
+
     if (!ctx->swr_context) {
-        sprintf(ctx->error_str, "%s", "swr_alloc_set_opts returned null");
-        return NULL;
+        ret = av_audio_fifo_write(ctx->audio_fifo, (void **)in,
+                                  in_frame->no_samples);
+        return ret < 0 ? ret : 0;
+    }
+
+    int nb_out = swr_get_out_samples(ctx->swr_context, in_frame->no_samples);
+    if (nb_out < 0)
+        return nb_out;
+    if (nb_out > ctx->audio_tmp_samples) {
+        av_freep(&ctx->audio_tmp[0]);
+        ret = av_samples_alloc(ctx->audio_tmp, NULL,
+                               codec_ctx->ch_layout.nb_channels, nb_out,
+                               codec_ctx->sample_fmt, 0);
+        if (ret < 0) {
+            ctx->audio_tmp_samples = 0;
+            return ret;
+        }
+        ctx->audio_tmp_samples = nb_out;
     }
 
-    if (!swr_is_initialized(ctx->swr_context)) {
-        swr_init(ctx->swr_context);
+    ret = swr_convert(ctx->swr_context, ctx->audio_tmp, ctx->audio_tmp_samples,
+                      (const uint8_t **)in, in_frame->no_samples);
+    if (ret <= 0)
+        return ret;
+    ret = av_audio_fifo_write(ctx->audio_fifo, (void **)ctx->audio_tmp, ret);
+    return ret < 0 ? ret : 0;
+}
+
+/**
+ * 让样本计数与采集时间对齐
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx 音频编码器上下文
+ * @param in_frame 即将写入的NDI音频帧
+ * @param capture_ts 该帧的采集时间(微秒)
+ * @note 按样本数推算的本帧起点与采集时间相差超过一帧时(第一帧、上游丢帧
+ * 或两个时钟漂移)，把样本计数移到采集时间上，音频pts与视频pts一样相对
+ * start_ts计时。已输出的pts不能回退，样本计数只会向前移动
+ */
+static void
+fc_sync_audio(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx,
+              const NDIlib_audio_frame_v2_t *in_frame, int64_t capture_ts)
+{
+    int sample_rate = codec_ctx->sample_rate;
+    int64_t buffered = ctx->audio_fifo ? av_audio_fifo_size(ctx->audio_fifo)
+                                       : 0;
+    if (ctx->swr_context)
+        buffered += swr_get_delay(ctx->swr_context, sample_rate);
+
+    int64_t expected = ctx->audio_samples + buffered;
+    int64_t captured = av_rescale(capture_ts - ctx->start_ts, sample_rate,
+                                  AV_TIME_BASE);
+    int64_t frame_samples = av_rescale(in_frame->no_samples, sample_rate,
+                                       in_frame->sample_rate);
+    if (captured - expected > frame_samples
+        || expected - captured > frame_samples)
+        ctx->audio_samples = FFMAX(ctx->audio_samples, captured - buffered);
+}
+
+/**
+ * 将NDI音频帧转换为FFmpeg AVFrame
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx FFmpeg编解码器上下文
+ * @param in_frame 输入的NDI音频帧，为NULL时只取出FIFO中剩余的整帧
+ * @param capture_ts 输入帧的采集时间(微秒)，in_frame为NULL时忽略
+ * @return 转换后的AVFrame指针，样本不足一帧或失败时返回NULL
+ * @note 执行以下操作:
+ * 1. 采样率或声道数变化时重建重采样器
+ * 2. 样本计数偏离采集时间超过一帧时重新对齐
+ * 3. 样本直接(格式一致时)或经重采样写入FIFO
+ * 4. FIFO中够一帧时从缓冲池获取音频缓冲区并读出frame_size个样本
+ * 5. 按样本计数设置时间戳
+ */
+AVFrame *
+fc_ndi_audio_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
+                              NDIlib_audio_frame_v2_t *in_frame,
+                              int64_t capture_ts)
+{
+    int ret;
+    int nb_samples = fc_audio_frame_size(codec_ctx);
+
+    if (in_frame) {
+        if ((ret = fc_setup_audio(ctx, codec_ctx, in_frame)) < 0)
+            return NULL;
+        fc_sync_audio(ctx, codec_ctx, in_frame, capture_ts);
+        if ((ret = fc_write_audio(ctx, codec_ctx, in_frame)) < 0) {
+            av_error_fmt(ctx->error_str, "error converting frame!", ret);
+            return NULL;
+        }
     }
 
-    uint8_t *in[8] = {};
+    if (!ctx->audio_fifo || av_audio_fifo_size(ctx->audio_fifo) < nb_samples) {
+        return NULL;
+    }
 
-    av_samples_fill_arrays(in, NULL, (const uint8_t *)in_frame->p_data,
-                           in_frame->no_channels, in_frame->no_samples,
-                           AV_SAMPLE_FMT_FLTP, 0);
+    AVFrame *out_frame = ctx->audio_frame;
 
-    ret = swr_convert(ctx->swr_context, NULL, 0, (const uint8_t **)in,
-                      in_frame->no_samples);
+    if ((ret = fc_audio_frame_get_buffer(ctx, codec_ctx, out_frame)) < 0) {
+        av_error_fmt(ctx->error_str, "could not allocate audio frame!", ret);
+        return NULL;
+    }
+
+    ret = av_audio_fifo_read(ctx->audio_fifo, (void **)out_frame->data,
+                             nb_samples);
     if (ret < 0) {
         av_error_fmt(ctx->error_str, "error converting frame!", ret);
         return NULL;
     }
 
-    int remaining = swr_get_out_samples(ctx->swr_context, 0);
-    if (remaining < nb_samples) {
+    out_frame->pkt_dts = get_current_ts_usec() - ctx->start_ts;
+    out_frame->pts = av_rescale_q(ctx->audio_samples,
+                                  (AVRational){ 1, codec_ctx->sample_rate },
+                                  codec_ctx->time_base);
+    ctx->audio_samples += nb_samples;
+
+    return out_frame;
+}
+
+int64_t
+fc_audio_buffered_us(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx)
+{
+    int64_t buffered = 0;
+    if (ctx->swr_context)
+        buffered += swr_get_delay(ctx->swr_context, AV_TIME_BASE);
+    if (ctx->audio_fifo && codec_ctx->sample_rate > 0)
+        buffered += av_rescale(av_audio_fifo_size(ctx->audio_fifo),
+                               AV_TIME_BASE, codec_ctx->sample_rate);
+    return buffered;
+}
+
+FcScaler *
+new_fc_scaler()
+{
+    FcScaler *scaler = malloc(sizeof(FcScaler));
+    if (!scaler)
+        return NULL;
+    memset(scaler, 0, sizeof(FcScaler));
+    scaler->error_str = malloc(AV_ERROR_MAX_STRING_SIZE + 100);
+    if (!scaler->error_str) {
+        free(scaler);
         return NULL;
     }
+    return scaler;
+}
 
-    out_frame->pkt_dts = get_current_ts_usec() - ctx->start_ts;
-    out_frame->pts = swr_next_pts(ctx->swr_context, INT64_MIN);
+/**
+ * 释放缩放器的全部缩放上下文
+ * @param scaler 缩放器
+ */
+static void
+fc_scaler_free_sws(FcScaler *scaler)
+{
+    for (int i = 0; i < scaler->nb_slices; ++i)
+        sws_freeContext(scaler->slice_ctxs[i]);
+    av_freep(&scaler->slice_ctxs);
+    scaler->nb_slices = 0;
+    if (scaler->sws_ctx)
+        sws_freeContext(scaler->sws_ctx);
+    scaler->sws_ctx = NULL;
+}
+
+void
+fc_scaler_set_threads(FcScaler *scaler, SlicePool *pool, int nb_threads)
+{
+    fc_scaler_free_sws(scaler);
+    scaler->slice_pool = pool;
+    scaler->nb_threads = nb_threads;
+}
+
+void
+free_fc_scaler(FcScaler **scaler)
+{
+    fc_scaler_free_sws(*scaler);
+    av_buffer_pool_uninit(&(*scaler)->pool);
+    free((*scaler)->error_str);
+
+    free(*scaler);
+    *scaler = NULL;
+}
+
+int
+fc_scale_video_frame(FcScaler *scaler, const AVCodecContext *codec_ctx,
+                     const AVFrame *in_frame, AVFrame *out_frame)
+{
+    FcVideoPlan *plan = &scaler->plan;
+    int ret;
+
+    // 输入或编码器参数变化时才重建缩放上下文和缓冲池
+    if (!scaler->sws_ctx || scaler->src_pix_fmt != in_frame->format
+        || plan->src_width != in_frame->width
+        || plan->src_height != in_frame->height
+        || plan->dst_pix_fmt != codec_ctx->pix_fmt
+        || plan->dst_width != codec_ctx->width
+        || plan->dst_height != codec_ctx->height) {
+        scaler->src_pix_fmt = in_frame->format;
+        plan->src_width = in_frame->width;
+        plan->src_height = in_frame->height;
+        plan->dst_pix_fmt = codec_ctx->pix_fmt;
+        plan->dst_width = codec_ctx->width;
+        plan->dst_height = codec_ctx->height;
+
+        fc_scaler_free_sws(scaler);
+
+        if ((ret = fc_init_video_pool(&scaler->pool, plan)) < 0) {
+            av_error_fmt(scaler->error_str, "could not create video frame pool!",
+                         ret);
+            return ret;
+        }
+
+        // 逐级缩小，每级比例不大，双线性已经足够
+        scaler->sws_ctx = fc_alloc_sws_ctx(
+                in_frame->width, in_frame->height, in_frame->format,
+                codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt,
+                SWS_BILINEAR);
+        if (!scaler->sws_ctx) {
+            sprintf(scaler->error_str, "%s",
+                    "could not create scaling context\n");
+            return AVERROR(ENOMEM);
+        }
 
-    ret = swr_convert(ctx->swr_context, out_frame->data, out_frame->nb_samples,
-                      NULL, 0);
+        // 与帧转换器一样，大帧每个分片一个单线程上下文，在共用的线程池上
+        // 并行；分片上下文创建失败时退回整帧缩放
+        int nb_slices = codec_ctx->height / FC_MIN_SLICE_ROWS;
+        if (nb_slices > scaler->nb_threads)
+            nb_slices = scaler->nb_threads;
+        if (scaler->slice_pool && nb_slices > 1)
+            scaler->slice_ctxs = av_calloc(nb_slices,
+                                           sizeof(*scaler->slice_ctxs));
+        for (int i = 0; scaler->slice_ctxs && i < nb_slices; ++i) {
+            struct SwsContext *sws_ctx = fc_alloc_sws_ctx(
+                    in_frame->width, in_frame->height, in_frame->format,
+                    codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt,
+                    SWS_BILINEAR);
+            if (!sws_ctx) {
+                for (int j = 0; j < scaler->nb_slices; ++j)
+                    sws_freeContext(scaler->slice_ctxs[j]);
+                av_freep(&scaler->slice_ctxs);
+                scaler->nb_slices = 0;
+                break;
+            }
+            scaler->slice_ctxs[scaler->nb_slices++] = sws_ctx;
+        }
+    }
+
+    if ((ret = fc_video_frame_get_buffer(scaler->pool, plan, out_frame)) < 0) {
+        av_error_fmt(scaler->error_str, "could not allocate video frame!", ret);
+        return ret;
+    }
+
+    if (scaler->nb_slices > 1) {
+        FcSwsSlices slices = {
+            .sws_ctxs = scaler->slice_ctxs,
+            .src_frame = in_frame,
+            .out_frame = out_frame,
+        };
+        atomic_init(&slices.ret, 0);
+        slice_pool_run(scaler->slice_pool, fc_sws_slice, &slices,
+                       scaler->nb_slices);
+        ret = atomic_load(&slices.ret);
+    }
+    else
+        ret = sws_scale(scaler->sws_ctx, (const uint8_t *const *)in_frame->data,
+                        in_frame->linesize, 0, in_frame->height,
+                        out_frame->data, out_frame->linesize);
+    // 失败时缓冲区内容未定义，不能交给编码器
     if (ret < 0) {
-        av_error_fmt(ctx->error_str, "error converting frame!", ret);
-        return NULL;
+        av_frame_unref(out_frame);
+        av_error_fmt(scaler->error_str, "error scaling video frame!", ret);
+        return ret;
     }
 
-    return out_frame;
+    if ((ret = av_frame_copy_props(out_frame, in_frame)) < 0) {
+        av_error_fmt(scaler->error_str, "could not copy frame properties!",
+                     ret);
+        return ret;
+    }
+    return 0;
 }
@@ -10,15 +10,78 @@
 // 引入必要的库头文件
 #include <Processing.NDI.Lib.h>  // NDI库，用于网络设备接口视频传输
 #include <libavcodec/avcodec.h>  // FFmpeg编解码库
+#include <libavutil/audio_fifo.h>  // FFmpeg音频样本FIFO
 #include <libswresample/swresample.h>  // FFmpeg音频重采样库
 
+#include "ndi_format.h"  // NDI视频格式描述表
+#include "pixconv.h"     // 向量化像素格式转换
+#include "slice_pool.h"  // 分片并行线程池
+
+#define FC_MAX_AUTO_THREADS 4  // 自动选择时视频转换线程数的上限
+#define FC_MIN_SLICE_ROWS 64   // 每个分片的最少行数，过小的分片不值得并行
+
+// 视频转换路径
+typedef enum FcVideoPath {
+    FC_VIDEO_PATH_PASSTHROUGH = 0,  // 编码器直接引用NDI缓冲区
+    FC_VIDEO_PATH_PIXCONV,          // pixconv向量化内核
+    FC_VIDEO_PATH_SWSCALE,          // swscale缩放/转换
+} FcVideoPath;
+
+// 视频转换计划，输入格式、尺寸和编码器参数不变时逐帧复用
+typedef struct FcVideoPlan {
+    NDIlib_FourCC_video_type_e fourcc;  // 输入FourCC
+    int src_width;  // 输入宽度
+    int src_height;  // 输入高度
+    enum AVPixelFormat dst_pix_fmt;  // 编码器像素格式
+    int dst_width;  // 编码器宽度
+    int dst_height;  // 编码器高度
+    enum AVColorSpace colorspace;  // 编码器颜色矩阵
+    enum AVColorRange color_range;  // 编码器颜色范围
+    const NdiFormatDesc *desc;  // 输入格式描述，为NULL表示尚无计划
+    FcVideoPath path;  // 转换路径
+    PixconvRgbCoeffs rgb_coeffs;  // RGB输入走pixconv时的转换系数
+    int dst_linesize[4];  // 输出帧各平面行字节数
+    size_t dst_offset[4];  // 输出帧各平面在缓冲区中的偏移
+    size_t dst_size;  // 输出帧缓冲区字节数
+} FcVideoPlan;
+
+// 清晰度阶梯中的缩放器：把已是编码器格式的视频帧缩小到另一路编码器的
+// 尺寸，各级以上一级的输出为输入，完整分辨率的格式转换只做一次
+typedef struct FcScaler {
+    struct SwsContext *sws_ctx;  // 缩放上下文，输入或输出参数变化时重建
+    struct SwsContext **slice_ctxs;  // 分片上下文，大帧在线程池上按行并行
+    int nb_slices;  // 分片上下文数，不足2个时由sws_ctx整帧缩放
+    SlicePool *slice_pool;  // 多路流共用的分片线程池(不持有)
+    int nb_threads;  // 每帧的最大分片数
+    enum AVPixelFormat src_pix_fmt;  // 当前输入像素格式
+    FcVideoPlan plan;  // 输入尺寸和输出帧布局(只使用src_*和dst_*字段)
+    AVBufferPool *pool;  // 输出帧缓冲池
+    char *error_str;  // 错误信息字符串
+} FcScaler;
+
 // 定义帧转换器上下文结构体
 typedef struct FrameConverterCtx {
-    SwrContext *swr_context;  // 音频重采样上下文
+    SwrContext *swr_context;  // 音频重采样上下文，输入已是编码器格式时为NULL
     struct SwsContext *sws_ctx;  // 视频缩放/像素格式转换上下文
 
     AVFrame *audio_frame;  // 存储转换后的音频帧
     AVFrame *video_frame;  // 存储转换后的视频帧
+    FcVideoPlan video_plan;  // 当前视频转换计划
+    struct SwsContext **sws_slice_ctxs;  // 每个分片一个单线程缩放上下文
+    int nb_sws_slices;  // 分片上下文数，0表示swscale不分片
+    AVFrame *video_src_frame;  // 包装NDI输入的帧，供各分片上下文读取
+    SlicePool *slice_pool;  // 视频转换分片线程池，可由多个转换器共用
+    int owns_slice_pool;  // slice_pool由本转换器创建，释放时一并释放
+    int nb_threads;  // 视频转换线程数
+    AVBufferPool *video_pool;  // 输出视频帧缓冲池，随转换计划重建
+    AVBufferPool *audio_pool;  // 输出音频帧缓冲池
+    int audio_pool_size;  // 音频缓冲池中每块缓冲区的字节数
+    AVAudioFifo *audio_fifo;  // 编码器格式的待编码样本，按编码器帧长切分
+    int audio_in_sample_rate;  // 当前音频转换对应的NDI采样率，0表示尚未建立
+    int audio_in_channels;  // 当前音频转换对应的NDI声道数
+    uint8_t *audio_tmp[AV_NUM_DATA_POINTERS];  // 重采样输出的临时缓冲区
+    int audio_tmp_samples;  // 临时缓冲区可容纳的样本数
+    int64_t audio_samples;  // 下一个输出样本相对start_ts的位置(样本数)，用于计算pts
 
     int64_t frame_index;  // 帧索引计数器
     int64_t start_ts;  // 起始时间戳
@@ -28,6 +91,26 @@ typedef struct FrameConverterCtx {
 
 // 函数声明
 
+/**
+ * 将NDI视频格式FourCC转换为FFmpeg像素格式
+ * @param type NDI视频格式FourCC枚举值
+ * @return 对应的FFmpeg像素格式，不支持的格式返回AV_PIX_FMT_NONE
+ */
+enum AVPixelFormat
+ndi_fourcc_to_ffmpeg(NDIlib_FourCC_video_type_e type);
+
+/**
+ * 描述视频帧将采用的转换路径
+ * @param fourcc 输入NDI FourCC
+ * @param dst_pix_fmt 编码器像素格式
+ * @param same_size 输入与输出尺寸是否相同
+ * @return 路径名称字符串("passthrough"、"pixconv"或"swscale")，不支持的
+ *         输入格式返回"unsupported"
+ */
+const char *
+fc_video_conversion_path(NDIlib_FourCC_video_type_e fourcc,
+                         enum AVPixelFormat dst_pix_fmt, int same_size);
+
 /**
  * 创建并初始化一个新的帧转换器上下文
  * @return 返回新创建的FrameConverterCtx指针
@@ -35,6 +118,19 @@ typedef struct FrameConverterCtx {
 FrameConverterCtx *
 new_frame_converter_ctx();
 
+/**
+ * 设置视频转换线程数
+ * @param ctx 帧转换器上下文
+ * @param pool 多路流共用的分片线程池(不转移所有权)，NULL表示自建线程池
+ * @param nb_threads 每帧的分片数，0表示按CPU核数自动选择(最多
+ *                   FC_MAX_AUTO_THREADS)，共用线程池时不超过其线程数
+ * @return 实际使用的线程数
+ * @note 大帧按行切片后在分片线程池上并行转换：pixconv路径直接切分输出帧，
+ * swscale路径每个分片使用一个单线程的swscale上下文
+ */
+int
+fc_set_video_threads(FrameConverterCtx *ctx, SlicePool *pool, int nb_threads);
+
 /**
  * 释放帧转换器上下文
  * @param ctx 指向FrameConverterCtx指针的指针
@@ -46,6 +142,7 @@ free_frame_converter_ctx(FrameConverterCtx **ctx);
 /**
  * 重置帧转换器上下文状态
  * @param ctx FrameConverterCtx指针
+ * @note 同时丢弃缓存的音频样本和重采样器，下一帧按新的编码器参数重建
  */
 void
 fc_reset(FrameConverterCtx *);
@@ -55,20 +152,71 @@ fc_reset(FrameConverterCtx *);
  * @param ctx 帧转换器上下文
  * @param codec_ctx FFmpeg编解码上下文
  * @param in_frame 输入的NDI视频帧
- * @return 返回转换后的AVFrame指针
+ * @param in_buf 持有in_frame像素数据的引用(可为NULL)，格式与编码器一致时
+ *               输出帧直接引用该缓冲区而不做拷贝；其采集时间用于计算pts
+ * @return 返回转换后的AVFrame指针，失败返回NULL(错误信息见error_str)
  */
 AVFrame *
 fc_ndi_video_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
-                              NDIlib_video_frame_v2_t *in_frame);
+                              const NDIlib_video_frame_v2_t *in_frame,
+                              AVBufferRef *in_buf);
 
 /**
  * 将NDI音频帧转换为AVFrame
  * @param ctx 帧转换器上下文
  * @param codec_ctx FFmpeg编解码上下文
  * @param in_frame 输入的NDI音频帧
+ * @param capture_ts 输入帧的采集时间(微秒)，pts以此与视频对齐
  * @return 返回转换后的AVFrame指针
  */
 AVFrame *
 fc_ndi_audio_frame_to_avframe(FrameConverterCtx *ctx, AVCodecContext *codec_ctx,
-                              NDIlib_audio_frame_v2_t *in_frame);
+                              NDIlib_audio_frame_v2_t *in_frame,
+                              int64_t capture_ts);
+
+/**
+ * 获取重采样器和音频FIFO中已缓存、尚未取出的音频时长
+ * @param ctx 帧转换器上下文
+ * @param codec_ctx FFmpeg编解码上下文
+ * @return 缓存的时长(微秒)
+ * @note 只能在调用fc_ndi_audio_frame_to_avframe的线程中调用
+ */
+int64_t
+fc_audio_buffered_us(FrameConverterCtx *ctx, const AVCodecContext *codec_ctx);
+
+/**
+ * 创建缩放器
+ * @return 新创建的FcScaler指针，内存不足时返回NULL
+ */
+FcScaler *
+new_fc_scaler();
+
+/**
+ * 设置缩放器的分片并行
+ * @param scaler 缩放器
+ * @param pool 分片线程池(不转移所有权)，NULL表示整帧缩放
+ * @param nb_threads 每帧的最大分片数，通常取fc_set_video_threads的返回值
+ * @note 下一帧按新设置重建缩放上下文
+ */
+void
+fc_scaler_set_threads(FcScaler *scaler, SlicePool *pool, int nb_threads);
+
+/**
+ * 释放缩放器
+ * @param scaler 指向FcScaler指针的指针
+ */
+void
+free_fc_scaler(FcScaler **scaler);
+
+/**
+ * 把视频帧缩放到编码器尺寸，输出帧的缓冲区来自缩放器自己的缓冲池
+ * @param scaler 缩放器
+ * @param codec_ctx 目标编码器上下文，提供输出尺寸和像素格式
+ * @param in_frame 输入帧(上一级编码器的输入)
+ * @param out_frame 输出帧，原有引用会被释放，时间戳等属性复制自in_frame
+ * @return 成功返回0，失败返回负数错误码(错误信息见scaler->error_str)
+ */
+int
+fc_scale_video_frame(FcScaler *scaler, const AVCodecContext *codec_ctx,
+                     const AVFrame *in_frame, AVFrame *out_frame);
 #endif
@@ -0,0 +1,124 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "latency_hist.h"
+
+// 最高有效位的位置，v必须大于0
+static int
+latency_hist_msb(uint64_t v)
+{
+    int msb = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (v >> shift) {
+            v >>= shift;
+            msb += shift;
+        }
+    }
+    return msb;
+}
+
+// 值所在的桶：小于LATENCY_HIST_SUB_BUCKETS的值每个值一个桶，之后区间
+// [2^k, 2^(k+1))均分成LATENCY_HIST_SUB_BUCKETS个桶
+static int
+latency_hist_index(int64_t value)
+{
+    if (value < LATENCY_HIST_SUB_BUCKETS)
+        return value < 0 ? 0 : (int)value;
+
+    int k = latency_hist_msb((uint64_t)value);
+    if (k >= LATENCY_HIST_MAX_BITS)
+        return LATENCY_HIST_BUCKETS - 1;
+    int shift = k - LATENCY_HIST_SUB_BITS;
+    int sub = (int)(value >> shift) - LATENCY_HIST_SUB_BUCKETS;
+    return (shift + 1) * LATENCY_HIST_SUB_BUCKETS + sub;
+}
+
+// 桶的上界(桶内的最大值)
+static int64_t
+latency_hist_upper(int index)
+{
+    int group = index / LATENCY_HIST_SUB_BUCKETS;
+    int sub = index % LATENCY_HIST_SUB_BUCKETS;
+    if (group == 0)
+        return sub;
+
+    int shift = group - 1;
+    return ((int64_t)(LATENCY_HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void
+latency_hist_reset(LatencyHist *hist)
+{
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; ++i)
+        atomic_store_explicit(&hist->buckets[i], 0, memory_order_relaxed);
+    atomic_store(&hist->count, 0);
+    atomic_store(&hist->sum, 0);
+    atomic_store(&hist->max, 0);
+}
+
+void
+latency_hist_record(LatencyHist *hist, int64_t value_us)
+{
+    if (value_us < 0)
+        value_us = 0;
+
+    atomic_fetch_add_explicit(&hist->buckets[latency_hist_index(value_us)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value_us, memory_order_relaxed);
+
+    int64_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+    while (value_us > max
+           && !atomic_compare_exchange_weak_explicit(&hist->max, &max,
+                                                     value_us,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed)) {
+    }
+}
+
+void
+latency_hist_get_stats(LatencyHist *hist, LatencyHistStats *stats)
+{
+    // 并发记录时各桶读到的计数之和可能与count略有出入，以各桶之和为准
+    int64_t counts[LATENCY_HIST_BUCKETS];
+    int64_t total = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; ++i) {
+        counts[i] = atomic_load_explicit(&hist->buckets[i],
+                                         memory_order_relaxed);
+        total += counts[i];
+    }
+
+    int64_t count = atomic_load(&hist->count);
+    stats->count = total;
+    stats->sum_us = atomic_load(&hist->sum);
+    stats->mean_us = count > 0 ? stats->sum_us / count : 0;
+    stats->max_us = atomic_load(&hist->max);
+    stats->p50_us = 0;
+    stats->p99_us = 0;
+    if (total == 0)
+        return;
+
+    // 第ceil(total*p)个值所在的桶
+    int64_t p50_rank = (total + 1) / 2;
+    int64_t p99_rank = (total * 99 + 99) / 100;
+    int64_t seen = 0;
+    int have_p50 = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; ++i) {
+        seen += counts[i];
+        if (!have_p50 && seen >= p50_rank) {
+            stats->p50_us = latency_hist_upper(i);
+            have_p50 = 1;
+        }
+        if (seen >= p99_rank) {
+            stats->p99_us = latency_hist_upper(i);
+            break;
+        }
+    }
+    if (stats->p50_us > stats->max_us)
+        stats->p50_us = stats->max_us;
+    if (stats->p99_us > stats->max_us)
+        stats->p99_us = stats->max_us;
+}
@@ -0,0 +1,65 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 延迟直方图
+// HDR风格的对数线性分桶：每个2的幂区间再线性分成LATENCY_HIST_SUB_BUCKETS个桶，
+// 百分位的相对误差不超过1/LATENCY_HIST_SUB_BUCKETS。记录一个值只需几次原子
+// 加法，不加锁也不分配内存，可以在生产环境中一直开启，任意线程都可以读取
+
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define LATENCY_HIST_SUB_BITS 4                          // 每个2的幂区间的分桶位数
+#define LATENCY_HIST_SUB_BUCKETS (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_MAX_BITS 27                         // 可区分的最大值约2^27微秒(134秒)
+#define LATENCY_HIST_BUCKETS                                                  \
+    ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_BUCKETS)
+
+typedef struct LatencyHist {
+    _Atomic(int64_t) buckets[LATENCY_HIST_BUCKETS]; // 各桶的计数
+    _Atomic(int64_t) count;                         // 记录的值数
+    _Atomic(int64_t) sum;                           // 记录的值之和(微秒)
+    _Atomic(int64_t) max;                           // 记录的最大值(微秒)
+} LatencyHist;
+
+// 直方图摘要
+typedef struct LatencyHistStats {
+    int64_t count;   // 记录的值数
+    int64_t sum_us;  // 记录的值之和(微秒)
+    int64_t mean_us; // 平均值(微秒)
+    int64_t p50_us;  // 中位数(微秒)
+    int64_t p99_us;  // 99百分位(微秒)
+    int64_t max_us;  // 最大值(微秒)
+} LatencyHistStats;
+
+/**
+ * 清空直方图
+ * @param hist 直方图
+ * @note 与latency_hist_record并发调用时，清空前后的记录可能各丢失一部分
+ */
+void
+latency_hist_reset(LatencyHist *hist);
+
+/**
+ * 记录一个延迟值，可在任意线程调用
+ * @param hist 直方图
+ * @param value_us 延迟(微秒)，负值按0记录
+ */
+void
+latency_hist_record(LatencyHist *hist, int64_t value_us);
+
+/**
+ * 计算直方图摘要，可在任意线程调用
+ * @param hist 直方图
+ * @param stats 输出的摘要，百分位取所在桶的上界(不超过最大值)
+ */
+void
+latency_hist_get_stats(LatencyHist *hist, LatencyHistStats *stats);
+
+#endif
@@ -0,0 +1,548 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// winsock2.h必须在windows.h(经thread.h引入)之前包含
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+
+#define METRICS_ACCEPT_TIMEOUT 200 // 等待连接的超时(毫秒)，用于及时响应停止
+#define METRICS_IO_TIMEOUT 1000    // 读取请求和写出响应的超时(毫秒)
+#define METRICS_REQUEST_SIZE 4096  // 请求头长度上限
+#define METRICS_LISTEN_BACKLOG 8   // 等待处理的连接数上限
+
+#ifdef _WIN32
+typedef SOCKET MetricsSocket;
+#define METRICS_INVALID_SOCKET INVALID_SOCKET
+#define metrics_close_socket closesocket
+#else
+typedef int MetricsSocket;
+#define METRICS_INVALID_SOCKET (-1)
+#define metrics_close_socket close
+#endif
+
+// 客户端提前断开时不产生SIGPIPE(Linux)，macOS在套接字上设置SO_NOSIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+struct MetricsServer {
+    MetricsSocket fd;           // 监听套接字
+    MetricsCollectFunc collect; // 生成指标文本的回调
+    void *opaque;               // 回调参数
+    _Atomic(int) running;       // HTTP线程是否继续运行
+    Thread thread;              // HTTP线程
+};
+
+// 一路流水线在一次抓取中的快照，各指标族使用同一份数值
+typedef struct MetricsSnapshot {
+    PipelineNdiStats ndi;
+    PipelineStageStats stages;
+    PipelineWriterStats writers[FFMPEG_OUTPUT_MAX_TARGETS];
+    int64_t drops[PIPELINE_DROP_NB];
+    LatencyHistStats latency[PIPELINE_LATENCY_NB];
+} MetricsSnapshot;
+
+// 设置客户端连接的读写超时，避免一个不发请求的连接卡住HTTP线程
+static void
+metrics_setup_client(MetricsSocket fd, int timeout_ms)
+{
+#ifdef _WIN32
+    DWORD tv = timeout_ms;
+#else
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+#endif
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (const char *)&tv, sizeof tv);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+}
+
+static int
+metrics_send_all(MetricsSocket fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        int n = (int)send(fd, data, (int)FFMIN(size, 65536), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// 读取请求头并写出响应，请求体(如果有)被忽略
+static void
+metrics_handle_client(MetricsServer *server, MetricsSocket fd)
+{
+    char request[METRICS_REQUEST_SIZE];
+    size_t len = 0;
+    request[0] = '\0';
+    while (len < sizeof request - 1 && !strstr(request, "\r\n\r\n")) {
+        int n = (int)recv(fd, request + len, (int)(sizeof request - 1 - len),
+                          0);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        request[len] = '\0';
+    }
+
+    AVBPrint body;
+    av_bprint_init(&body, 0, AV_BPRINT_SIZE_UNLIMITED);
+    const char *status = "200 OK";
+    if (strncmp(request, "GET /metrics ", 13) == 0
+        || strncmp(request, "GET /metrics?", 13) == 0) {
+        server->collect(server->opaque, &body);
+    }
+    else {
+        status = "404 Not Found";
+        av_bprintf(&body, "only GET /metrics is served\n");
+    }
+    if (!av_bprint_is_complete(&body)) {
+        status = "500 Internal Server Error";
+        av_bprint_clear(&body);
+    }
+
+    char header[256];
+    int header_len = snprintf(header, sizeof header,
+                              "HTTP/1.1 %s\r\n"
+                              "Content-Type: text/plain; version=0.0.4; "
+                              "charset=utf-8\r\n"
+                              "Content-Length: %u\r\n"
+                              "Connection: close\r\n\r\n",
+                              status, body.len);
+    if (metrics_send_all(fd, header, header_len) == 0) {
+        metrics_send_all(fd, body.str, body.len);
+    }
+    av_bprint_finalize(&body, NULL);
+}
+
+// HTTP线程：逐个接受连接并响应，定期检查是否需要停止
+static void *
+metrics_server_thread(void *arg)
+{
+    MetricsServer *server = arg;
+
+    while (atomic_load(&server->running)) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(server->fd, &fds);
+        struct timeval tv = { 0, METRICS_ACCEPT_TIMEOUT * 1000 };
+        int ret = select((int)server->fd + 1, &fds, NULL, NULL, &tv);
+        if (ret < 0) {
+            thread_sleep_ms(METRICS_ACCEPT_TIMEOUT);
+            continue;
+        }
+        if (ret == 0) {
+            continue;
+        }
+
+        MetricsSocket fd = accept(server->fd, NULL, NULL);
+        if (fd == METRICS_INVALID_SOCKET) {
+            continue;
+        }
+        metrics_setup_client(fd, METRICS_IO_TIMEOUT);
+        metrics_handle_client(server, fd);
+        metrics_close_socket(fd);
+    }
+    return NULL;
+}
+
+static MetricsSocket
+metrics_listen(const char *addr, int port)
+{
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    if (port <= 0 || port > 65535
+        || inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        return METRICS_INVALID_SOCKET;
+    }
+
+    MetricsSocket fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == METRICS_INVALID_SOCKET) {
+        return METRICS_INVALID_SOCKET;
+    }
+    // 重启后立即重新监听同一端口
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof one);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof sa) != 0
+        || listen(fd, METRICS_LISTEN_BACKLOG) != 0) {
+        metrics_close_socket(fd);
+        return METRICS_INVALID_SOCKET;
+    }
+    return fd;
+}
+
+MetricsServer *
+new_metrics_server(const char *addr, int port, MetricsCollectFunc collect,
+                   void *opaque)
+{
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        return NULL;
+    }
+#endif
+
+    MetricsSocket fd = metrics_listen(addr, port);
+    if (fd == METRICS_INVALID_SOCKET) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return NULL;
+    }
+
+    MetricsServer *server = malloc(sizeof(MetricsServer));
+    memset(server, 0, sizeof(MetricsServer));
+    server->fd = fd;
+    server->collect = collect;
+    server->opaque = opaque;
+    atomic_store(&server->running, 1);
+    if (thread_start(&server->thread, metrics_server_thread, server) != 0) {
+        atomic_store(&server->running, 0);
+        free_metrics_server(&server);
+        return NULL;
+    }
+    return server;
+}
+
+void
+free_metrics_server(MetricsServer **server)
+{
+    atomic_store(&(*server)->running, 0);
+    thread_join(&(*server)->thread);
+    metrics_close_socket((*server)->fd);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(*server);
+    *server = NULL;
+}
+
+// 输出指标族的说明和类型
+static void
+metrics_family(AVBPrint *out, const char *name, const char *type,
+               const char *help)
+{
+    av_bprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// 输出转义后的标签值
+static void
+metrics_label_value(AVBPrint *out, const char *value)
+{
+    for (const char *p = value; *p; ++p) {
+        if (*p == '\\' || *p == '"') {
+            av_bprintf(out, "\\%c", *p);
+        }
+        else if (*p == '\n') {
+            av_bprintf(out, "\\n");
+        }
+        else {
+            av_bprint_chars(out, *p, 1);
+        }
+    }
+}
+
+// 输出样本的名称和source标签，后续标签和数值由调用方接着输出
+static void
+metrics_sample(AVBPrint *out, const char *name, const MetricsSource *src)
+{
+    av_bprintf(out, "%s{source=\"", name);
+    metrics_label_value(out, src->name);
+    av_bprintf(out, "\"");
+}
+
+// 输出一路输出目标的样本开头，带output(输出序号)和rendition标签。
+// 输出地址可能含有推流密钥，不作为标签导出
+static void
+metrics_output_sample(AVBPrint *out, const char *name,
+                      const MetricsSource *src, int index)
+{
+    metrics_sample(out, name, src);
+    av_bprintf(out, ",output=\"%d\",rendition=\"%d\"", index,
+               src->pl_ctx->outputs[index].target->rendition);
+}
+
+static double
+metrics_seconds(int64_t us)
+{
+    return (double)us / 1000000.0;
+}
+
+void
+metrics_write_pipelines(AVBPrint *out, const MetricsSource *sources,
+                        int nb_sources)
+{
+    MetricsSnapshot *snaps = calloc(FFMAX(nb_sources, 1),
+                                    sizeof(MetricsSnapshot));
+    if (!snaps) {
+        return;
+    }
+    for (int i = 0; i < nb_sources; ++i) {
+        PipelineCtx *ctx = sources[i].pl_ctx;
+        MetricsSnapshot *snap = &snaps[i];
+        pipeline_get_ndi_stats(ctx, &snap->ndi);
+        pipeline_get_stage_stats(ctx, &snap->stages);
+        for (int j = 0; j < ctx->nb_outputs; ++j) {
+            pipeline_get_writer_stats(ctx, j, &snap->writers[j]);
+        }
+        for (int j = 0; j < PIPELINE_DROP_NB; ++j) {
+            snap->drops[j] = pipeline_get_drops(ctx, j);
+        }
+        for (int j = 0; j < PIPELINE_LATENCY_NB; ++j) {
+            pipeline_get_latency(ctx, j, &snap->latency[j]);
+        }
+    }
+
+    // NDI接收器
+    metrics_family(out, "ndi_streamer_ndi_received_frames_total", "counter",
+                   "Frames received by the NDI receiver since it was created.");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_ndi_received_frames_total",
+                       &sources[i]);
+        av_bprintf(out, ",type=\"video\"} %lld\n",
+                   (long long)snaps[i].ndi.received_video);
+        metrics_sample(out, "ndi_streamer_ndi_received_frames_total",
+                       &sources[i]);
+        av_bprintf(out, ",type=\"audio\"} %lld\n",
+                   (long long)snaps[i].ndi.received_audio);
+    }
+    metrics_family(out, "ndi_streamer_ndi_dropped_frames_total", "counter",
+                   "Frames the NDI receiver reports as dropped.");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_ndi_dropped_frames_total",
+                       &sources[i]);
+        av_bprintf(out, ",type=\"video\"} %lld\n",
+                   (long long)snaps[i].ndi.dropped_video);
+        metrics_sample(out, "ndi_streamer_ndi_dropped_frames_total",
+                       &sources[i]);
+        av_bprintf(out, ",type=\"audio\"} %lld\n",
+                   (long long)snaps[i].ndi.dropped_audio);
+    }
+    metrics_family(out, "ndi_streamer_ndi_queued_frames", "gauge",
+                   "Frames waiting in the NDI receive queue.");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_ndi_queued_frames", &sources[i]);
+        av_bprintf(out, ",type=\"video\"} %lld\n",
+                   (long long)snaps[i].ndi.queued_video);
+        metrics_sample(out, "ndi_streamer_ndi_queued_frames", &sources[i]);
+        av_bprintf(out, ",type=\"audio\"} %lld\n",
+                   (long long)snaps[i].ndi.queued_audio);
+    }
+
+    // 采集和转换
+    metrics_family(out, "ndi_streamer_video_frames_total", "counter",
+                   "Video frames taken from NDI (capture) and converted "
+                   "(convert).");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_video_frames_total", &sources[i]);
+        av_bprintf(out, ",stage=\"capture\"} %lld\n",
+                   (long long)snaps[i].stages.captured_frames);
+        metrics_sample(out, "ndi_streamer_video_frames_total", &sources[i]);
+        av_bprintf(out, ",stage=\"convert\"} %lld\n",
+                   (long long)snaps[i].stages.converted_frames);
+    }
+    metrics_family(out, "ndi_streamer_video_convert_seconds_total", "counter",
+                   "Time spent converting video frames.");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_video_convert_seconds_total",
+                       &sources[i]);
+        av_bprintf(out, "} %.6f\n",
+                   metrics_seconds(snaps[i].stages.convert_time_us));
+    }
+
+    // 视频编码器，rendition 0为源分辨率
+    metrics_family(out, "ndi_streamer_encoder_frames_total", "counter",
+                   "Video frames sent to each encoder.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int r = 0; r < snaps[i].stages.nb_encoders; ++r) {
+            metrics_sample(out, "ndi_streamer_encoder_frames_total",
+                           &sources[i]);
+            av_bprintf(out, ",rendition=\"%d\"} %lld\n", r,
+                       (long long)snaps[i].stages.encoded_frames[r]);
+        }
+    }
+    metrics_family(out, "ndi_streamer_encoder_bytes_total", "counter",
+                   "Bytes of video packets produced by each encoder.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int r = 0; r < snaps[i].stages.nb_encoders; ++r) {
+            metrics_sample(out, "ndi_streamer_encoder_bytes_total",
+                           &sources[i]);
+            av_bprintf(out, ",rendition=\"%d\"} %lld\n", r,
+                       (long long)snaps[i].stages.encoded_bytes[r]);
+        }
+    }
+    metrics_family(out, "ndi_streamer_encoder_seconds_total", "counter",
+                   "Time each encoder thread spent scaling, sending frames "
+                   "and receiving packets.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int r = 0; r < snaps[i].stages.nb_encoders; ++r) {
+            metrics_sample(out, "ndi_streamer_encoder_seconds_total",
+                           &sources[i]);
+            av_bprintf(out, ",rendition=\"%d\"} %.6f\n", r,
+                       metrics_seconds(snaps[i].stages.encode_time_us[r]));
+        }
+    }
+    metrics_family(out, "ndi_streamer_audio_buffered_seconds", "gauge",
+                   "Audio held in the resampler and audio FIFO.");
+    for (int i = 0; i < nb_sources; ++i) {
+        metrics_sample(out, "ndi_streamer_audio_buffered_seconds",
+                       &sources[i]);
+        av_bprintf(out, "} %.6f\n",
+                   metrics_seconds(snaps[i].stages.audio_buffered_us));
+    }
+
+    // 输出目标
+    metrics_family(out, "ndi_streamer_output_connected", "gauge",
+                   "Whether the output is connected.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out, "ndi_streamer_output_connected",
+                                  &sources[i], j);
+            av_bprintf(out, "} %d\n", snaps[i].writers[j].connected);
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_connects_total", "counter",
+                   "Successful output connections; more than one means "
+                   "the output reconnected.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out, "ndi_streamer_output_connects_total",
+                                  &sources[i], j);
+            av_bprintf(out, "} %lld\n",
+                       (long long)snaps[i].writers[j].connects);
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_packets_total", "counter",
+                   "Packets written to the output.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            const PipelineWriterStats *ws = &snaps[i].writers[j];
+            metrics_output_sample(out, "ndi_streamer_output_packets_total",
+                                  &sources[i], j);
+            av_bprintf(out, ",type=\"video\"} %lld\n",
+                       (long long)ws->written_video_packets);
+            metrics_output_sample(out, "ndi_streamer_output_packets_total",
+                                  &sources[i], j);
+            av_bprintf(out, ",type=\"audio\"} %lld\n",
+                       (long long)(ws->written_packets
+                                   - ws->written_video_packets));
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_bytes_total", "counter",
+                   "Bytes written to the output.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out, "ndi_streamer_output_bytes_total",
+                                  &sources[i], j);
+            av_bprintf(out, "} %lld\n",
+                       (long long)snaps[i].writers[j].written_bytes);
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_write_seconds_total", "counter",
+                   "Time spent in the muxer writing packets.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out,
+                                  "ndi_streamer_output_write_seconds_total",
+                                  &sources[i], j);
+            av_bprintf(out, "} %.6f\n",
+                       metrics_seconds(snaps[i].writers[j].write_time_us));
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_write_max_seconds", "gauge",
+                   "Longest single packet write since the pipeline started.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out, "ndi_streamer_output_write_max_seconds",
+                                  &sources[i], j);
+            av_bprintf(out, "} %.6f\n",
+                       metrics_seconds(snaps[i].writers[j].write_time_max_us));
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_queued_bytes", "gauge",
+                   "Bytes waiting to be written to the output.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out, "ndi_streamer_output_queued_bytes",
+                                  &sources[i], j);
+            av_bprintf(out, "} %lld\n",
+                       (long long)snaps[i].writers[j].queued_bytes);
+        }
+    }
+    metrics_family(out, "ndi_streamer_output_dropped_packets_total", "counter",
+                   "Packets dropped because the output was behind or "
+                   "waiting for a keyframe.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < sources[i].pl_ctx->nb_outputs; ++j) {
+            metrics_output_sample(out,
+                                  "ndi_streamer_output_dropped_packets_total",
+                                  &sources[i], j);
+            av_bprintf(out, "} %lld\n",
+                       (long long)snaps[i].writers[j].dropped_packets);
+        }
+    }
+
+    // 丢弃和延迟
+    metrics_family(out, "ndi_streamer_dropped_total", "counter",
+                   "Frames or packets dropped by the pipeline.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < PIPELINE_DROP_NB; ++j) {
+            metrics_sample(out, "ndi_streamer_dropped_total", &sources[i]);
+            av_bprintf(out, ",reason=\"%s\"} %lld\n",
+                       pipeline_drop_reason_name(j),
+                       (long long)snaps[i].drops[j]);
+        }
+    }
+    metrics_family(out, "ndi_streamer_video_latency_seconds", "summary",
+                   "Time video frames spend in each pipeline stage.");
+    for (int i = 0; i < nb_sources; ++i) {
+        for (int j = 0; j < PIPELINE_LATENCY_NB; ++j) {
+            const LatencyHistStats *ls = &snaps[i].latency[j];
+            const char *stage = pipeline_latency_stage_name(j);
+            metrics_sample(out, "ndi_streamer_video_latency_seconds",
+                           &sources[i]);
+            av_bprintf(out, ",stage=\"%s\",quantile=\"0.5\"} %.6f\n", stage,
+                       metrics_seconds(ls->p50_us));
+            metrics_sample(out, "ndi_streamer_video_latency_seconds",
+                           &sources[i]);
+            av_bprintf(out, ",stage=\"%s\",quantile=\"0.99\"} %.6f\n", stage,
+                       metrics_seconds(ls->p99_us));
+            metrics_sample(out, "ndi_streamer_video_latency_seconds_sum",
+                           &sources[i]);
+            av_bprintf(out, ",stage=\"%s\"} %.6f\n", stage,
+                       metrics_seconds(ls->sum_us));
+            metrics_sample(out, "ndi_streamer_video_latency_seconds_count",
+                           &sources[i]);
+            av_bprintf(out, ",stage=\"%s\"} %lld\n", stage,
+                       (long long)ls->count);
+        }
+    }
+
+    free(snaps);
+}
@@ -0,0 +1,64 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// Prometheus指标导出
+// 在本地HTTP端口上提供/metrics，按Prometheus文本格式输出各路流水线的采集、
+// 转换、编码和写出计数。计数由各阶段线程独占写入，抓取只做读取，不会拖慢
+// 采集和编码线程。帧率、码率等由Prometheus按计数的变化率计算
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <libavutil/bprint.h>
+
+#include "pipeline.h"
+
+typedef struct MetricsServer MetricsServer;
+
+// 一路流水线及其source标签
+typedef struct MetricsSource {
+    const char *name;    // source标签的值(NDI源名称或地址)
+    PipelineCtx *pl_ctx; // 流水线上下文
+} MetricsSource;
+
+/**
+ * 生成指标文本的回调，在HTTP线程中调用
+ * @param opaque new_metrics_server传入的参数
+ * @param out 输出缓冲区
+ */
+typedef void (*MetricsCollectFunc)(void *opaque, AVBPrint *out);
+
+/**
+ * 在addr:port上监听，并启动处理HTTP请求的线程。只响应GET /metrics，
+ * 请求逐个处理，每次请求调用一次collect
+ * @param addr 监听的IPv4地址，如"127.0.0.1"
+ * @param port 监听端口
+ * @param collect 生成指标文本的回调
+ * @param opaque 回调参数
+ * @return 成功返回MetricsServer指针，地址无效或监听失败返回NULL
+ */
+MetricsServer *
+new_metrics_server(const char *addr, int port, MetricsCollectFunc collect,
+                   void *opaque);
+
+/**
+ * 停止HTTP线程并关闭监听
+ * @param server 指向MetricsServer指针的指针
+ */
+void
+free_metrics_server(MetricsServer **server);
+
+/**
+ * 按Prometheus文本格式输出各路流水线的指标，同名指标的各路样本连续输出
+ * @param out 输出缓冲区
+ * @param sources 各路流水线
+ * @param nb_sources 流水线数
+ */
+void
+metrics_write_pipelines(AVBPrint *out, const MetricsSource *sources,
+                        int nb_sources);
+
+#endif
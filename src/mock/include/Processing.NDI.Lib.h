@@ -0,0 +1,203 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 模拟NDI运行库用的NDI SDK精简声明
+// 以-DNDI_STREAMER_MOCK_NDI=ON配置且未找到NDI SDK时代替SDK的头文件，只包含
+// ndi-streamer和模拟运行库用到的类型和函数。枚举取值、结构体成员及其顺序
+// 与NDI SDK 5一致，安装了SDK时仍优先使用SDK的头文件
+
+#ifndef PROCESSING_NDI_LIB_H
+#define PROCESSING_NDI_LIB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef PROCESSINGNDILIB_API
+#define PROCESSINGNDILIB_API
+#endif
+
+// 帧类型
+typedef enum NDIlib_frame_type_e {
+    NDIlib_frame_type_none = 0,
+    NDIlib_frame_type_video = 1,
+    NDIlib_frame_type_audio = 2,
+    NDIlib_frame_type_metadata = 3,
+    NDIlib_frame_type_error = 4,
+    NDIlib_frame_type_status_change = 100,
+} NDIlib_frame_type_e;
+
+// 视频格式
+typedef enum NDIlib_FourCC_video_type_e {
+    NDIlib_FourCC_video_type_UYVY = 0x59565955,  // 'UYVY'
+    NDIlib_FourCC_video_type_UYVA = 0x41565955,  // 'UYVA'
+    NDIlib_FourCC_video_type_P216 = 0x36313250,  // 'P216'
+    NDIlib_FourCC_video_type_PA16 = 0x36314150,  // 'PA16'
+    NDIlib_FourCC_video_type_YV12 = 0x32315659,  // 'YV12'
+    NDIlib_FourCC_video_type_I420 = 0x30323449,  // 'I420'
+    NDIlib_FourCC_video_type_NV12 = 0x3231564e,  // 'NV12'
+    NDIlib_FourCC_video_type_BGRA = 0x41524742,  // 'BGRA'
+    NDIlib_FourCC_video_type_BGRX = 0x58524742,  // 'BGRX'
+    NDIlib_FourCC_video_type_RGBA = 0x41424752,  // 'RGBA'
+    NDIlib_FourCC_video_type_RGBX = 0x58424752,  // 'RGBX'
+} NDIlib_FourCC_video_type_e;
+
+// 逐行或隔行
+typedef enum NDIlib_frame_format_type_e {
+    NDIlib_frame_format_type_progressive = 1,
+    NDIlib_frame_format_type_interleaved = 0,
+    NDIlib_frame_format_type_field_0 = 2,
+    NDIlib_frame_format_type_field_1 = 3,
+} NDIlib_frame_format_type_e;
+
+// 接收带宽
+typedef enum NDIlib_recv_bandwidth_e {
+    NDIlib_recv_bandwidth_metadata_only = -10,
+    NDIlib_recv_bandwidth_audio_only = 10,
+    NDIlib_recv_bandwidth_lowest = 0,
+    NDIlib_recv_bandwidth_highest = 100,
+} NDIlib_recv_bandwidth_e;
+
+// 接收的视频格式
+typedef enum NDIlib_recv_color_format_e {
+    NDIlib_recv_color_format_BGRX_BGRA = 0,
+    NDIlib_recv_color_format_UYVY_BGRA = 1,
+    NDIlib_recv_color_format_RGBX_RGBA = 2,
+    NDIlib_recv_color_format_UYVY_RGBA = 3,
+    NDIlib_recv_color_format_fastest = 100,
+    NDIlib_recv_color_format_best = 101,
+} NDIlib_recv_color_format_e;
+
+static const int64_t NDIlib_send_timecode_synthesize = INT64_MAX;
+static const int64_t NDIlib_recv_timestamp_undefined = INT64_MAX;
+
+typedef struct NDIlib_source_t {
+    const char *p_ndi_name;
+    union {
+        const char *p_url_address;
+        const char *p_ip_address;
+    };
+} NDIlib_source_t;
+
+typedef struct NDIlib_video_frame_v2_t {
+    int xres, yres;
+    NDIlib_FourCC_video_type_e FourCC;
+    int frame_rate_N, frame_rate_D;
+    float picture_aspect_ratio;
+    NDIlib_frame_format_type_e frame_format_type;
+    int64_t timecode;
+    uint8_t *p_data;
+    union {
+        int line_stride_in_bytes;
+        int data_size_in_bytes;
+    };
+    const char *p_metadata;
+    int64_t timestamp;
+} NDIlib_video_frame_v2_t;
+
+typedef struct NDIlib_audio_frame_v2_t {
+    int sample_rate;
+    int no_channels;
+    int no_samples;
+    int64_t timecode;
+    float *p_data;
+    int channel_stride_in_bytes;
+    const char *p_metadata;
+    int64_t timestamp;
+} NDIlib_audio_frame_v2_t;
+
+typedef struct NDIlib_metadata_frame_t {
+    int length;
+    int64_t timecode;
+    char *p_data;
+} NDIlib_metadata_frame_t;
+
+typedef struct NDIlib_find_create_t {
+    bool show_local_sources;
+    const char *p_groups;
+    const char *p_extra_ips;
+} NDIlib_find_create_t;
+
+typedef void *NDIlib_find_instance_t;
+typedef void *NDIlib_recv_instance_t;
+
+typedef struct NDIlib_recv_create_v3_t {
+    NDIlib_source_t source_to_connect_to;
+    NDIlib_recv_color_format_e color_format;
+    NDIlib_recv_bandwidth_e bandwidth;
+    bool allow_video_fields;
+    const char *p_ndi_recv_name;
+} NDIlib_recv_create_v3_t;
+
+typedef struct NDIlib_recv_performance_t {
+    int64_t video_frames;
+    int64_t audio_frames;
+    int64_t metadata_frames;
+} NDIlib_recv_performance_t;
+
+typedef struct NDIlib_recv_queue_t {
+    int video_frames;
+    int audio_frames;
+    int metadata_frames;
+} NDIlib_recv_queue_t;
+
+PROCESSINGNDILIB_API bool
+NDIlib_initialize(void);
+
+PROCESSINGNDILIB_API void
+NDIlib_destroy(void);
+
+PROCESSINGNDILIB_API NDIlib_find_instance_t
+NDIlib_find_create_v2(const NDIlib_find_create_t *p_create_settings);
+
+PROCESSINGNDILIB_API void
+NDIlib_find_destroy(NDIlib_find_instance_t p_instance);
+
+PROCESSINGNDILIB_API const NDIlib_source_t *
+NDIlib_find_get_current_sources(NDIlib_find_instance_t p_instance,
+                                uint32_t *p_no_sources);
+
+PROCESSINGNDILIB_API bool
+NDIlib_find_wait_for_sources(NDIlib_find_instance_t p_instance,
+                             uint32_t timeout_in_ms);
+
+PROCESSINGNDILIB_API NDIlib_recv_instance_t
+NDIlib_recv_create_v3(const NDIlib_recv_create_v3_t *p_create_settings);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_destroy(NDIlib_recv_instance_t p_instance);
+
+PROCESSINGNDILIB_API NDIlib_frame_type_e
+NDIlib_recv_capture_v2(NDIlib_recv_instance_t p_instance,
+                       NDIlib_video_frame_v2_t *p_video_data,
+                       NDIlib_audio_frame_v2_t *p_audio_data,
+                       NDIlib_metadata_frame_t *p_metadata,
+                       uint32_t timeout_in_ms);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_free_video_v2(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_video_frame_v2_t *p_video_data);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_free_audio_v2(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_audio_frame_v2_t *p_audio_data);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_free_metadata(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_metadata_frame_t *p_metadata);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_get_performance(NDIlib_recv_instance_t p_instance,
+                            NDIlib_recv_performance_t *p_total,
+                            NDIlib_recv_performance_t *p_dropped);
+
+PROCESSINGNDILIB_API void
+NDIlib_recv_get_queue(NDIlib_recv_instance_t p_instance,
+                      NDIlib_recv_queue_t *p_total);
+
+PROCESSINGNDILIB_API int
+NDIlib_recv_get_no_connections(NDIlib_recv_instance_t p_instance);
+
+#endif
@@ -0,0 +1,696 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 模拟NDI运行库
+// 以-DNDI_STREAMER_MOCK_NDI=ON配置时代替NDI SDK的动态库链接进程序，实现
+// ndi-streamer用到的NDI接口。每个接收器按设定的分辨率、帧率和抖动生成
+// 水平滚动的彩条视频和三角波音频(FLTP)，无需网络上的NDI发送端即可测量
+// 流水线各阶段的性能。参数从环境变量读取：
+//
+//   NDI_MOCK_VIDEO    分辨率和帧率，如"1920x1080@30"或"1280x720@60000/1001"
+//   NDI_MOCK_FOURCC   视频格式：UYVY(默认)、BGRA、I420或NV12
+//   NDI_MOCK_JITTER   每帧送达时间的最大随机偏移(毫秒，可为小数)
+//   NDI_MOCK_AUDIO    采样率和声道数，如"48000x2"，"0"表示不产生音频
+//   NDI_MOCK_SOURCES  NDIlib_find_*列出的源数量
+//
+// 与真实接收器一样，取帧不及时时帧在"接收队列"中积压，超过
+// MOCK_MAX_QUEUED帧后丢弃最旧的帧并计入NDIlib_recv_get_performance
+
+#include <Processing.NDI.Lib.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+
+#include "common.h"
+#include "ndi_format.h"
+#include "thread.h"
+
+#define MOCK_MAX_QUEUED 16         // 接收队列中最多积压的帧数
+#define MOCK_POOL_SIZE 32          // 每个接收器缓存的空闲帧缓冲区数
+#define MOCK_AUDIO_FRAMES_PER_SEC 50 // 每个音频帧20毫秒
+#define MOCK_AUDIO_TONE 1000       // 测试音频率(Hz)
+#define MOCK_SCROLL_STEP 4         // 彩条每帧滚动的像素数(偶数)
+#define MOCK_MAX_SOURCES 16
+#define MOCK_NAME_SIZE 64
+
+// 全局配置，NDIlib_initialize时从环境变量读取
+typedef struct MockConfig {
+    int width;
+    int height;
+    int frame_rate_N;
+    int frame_rate_D;
+    NDIlib_FourCC_video_type_e fourcc;
+    int64_t jitter_us;
+    int sample_rate;       // 0表示不产生音频
+    int channels;
+    int nb_sources;
+} MockConfig;
+
+// 一种媒体的送达时间线。第i帧的理想时间为 start_ts + i * num / den 微秒，
+// 实际送达时间再加上随机抖动，但不早于上一帧
+typedef struct MockTimeline {
+    Mutex mu;                  // 同一媒体的取帧互斥
+    int64_t num;               // 帧间隔 = num / den 微秒
+    int64_t den;
+    int64_t jitter_us;
+    uint64_t rng;              // 抖动用的xorshift状态
+    int64_t start_ts;
+    _Atomic(int64_t) index;    // 下一帧的序号
+    _Atomic(int64_t) due_ts;   // 下一帧的送达时间
+    _Atomic(int64_t) received; // 已送出的帧数
+    _Atomic(int64_t) dropped;  // 积压过多而丢弃的帧数
+} MockTimeline;
+
+// 空闲帧缓冲区，释放帧时归还，避免每帧分配
+typedef struct MockPool {
+    Mutex mu;
+    uint8_t *buffers[MOCK_POOL_SIZE];
+    int nb_buffers;
+    size_t size;
+} MockPool;
+
+typedef struct MockRecv {
+    NDIlib_video_frame_v2_t video;  // 视频帧模板(不含数据指针)
+    const NdiFormatDesc *desc;
+    uint8_t *pattern;               // 渲染好的彩条，按偏移拷贝出每一帧
+    MockTimeline video_timeline;
+    MockTimeline audio_timeline;
+    MockPool video_pool;
+    MockPool audio_pool;
+    int audio_samples;              // 每个音频帧的样本数
+} MockRecv;
+
+typedef struct MockFind {
+    NDIlib_source_t sources[MOCK_MAX_SOURCES];
+    char names[MOCK_MAX_SOURCES][MOCK_NAME_SIZE];
+    char addresses[MOCK_MAX_SOURCES][MOCK_NAME_SIZE];
+} MockFind;
+
+static MockConfig mock_config;
+
+// 75%彩条：白、黄、青、绿、品红、红、蓝、黑
+static const uint8_t mock_bars_yuv[8][3] = {
+    { 180, 128, 128 }, { 168, 44, 136 }, { 145, 147, 44 }, { 133, 63, 52 },
+    { 63, 193, 204 },  { 51, 109, 212 }, { 28, 212, 120 }, { 16, 128, 128 },
+};
+static const uint8_t mock_bars_rgb[8][3] = {
+    { 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+    { 191, 0, 191 },   { 191, 0, 0 },   { 0, 0, 191 },   { 0, 0, 0 },
+};
+
+static const char *
+mock_getenv(const char *name, const char *def)
+{
+    const char *value = getenv(name);
+    return value && *value ? value : def;
+}
+
+static int
+mock_parse_config(MockConfig *cfg)
+{
+    const char *video = mock_getenv("NDI_MOCK_VIDEO", "1920x1080@30");
+    const char *fourcc = mock_getenv("NDI_MOCK_FOURCC", "UYVY");
+    const char *jitter = mock_getenv("NDI_MOCK_JITTER", "0");
+    const char *audio = mock_getenv("NDI_MOCK_AUDIO", "48000x2");
+    const char *sources = mock_getenv("NDI_MOCK_SOURCES", "1");
+
+    cfg->frame_rate_D = 1;
+    int n = sscanf(video, "%dx%d@%d/%d", &cfg->width, &cfg->height,
+                   &cfg->frame_rate_N, &cfg->frame_rate_D);
+    if (n < 3 || cfg->width <= 0 || cfg->height <= 0 || cfg->width % 2
+        || cfg->height % 2 || cfg->frame_rate_N <= 0 || cfg->frame_rate_D <= 0) {
+        printf("[ERROR] invalid NDI_MOCK_VIDEO \"%s\", expected "
+               "WIDTHxHEIGHT@RATE[/DEN] with even width and height\n",
+               video);
+        return -1;
+    }
+
+    static const NDIlib_FourCC_video_type_e fourccs[] = {
+        NDIlib_FourCC_video_type_UYVY, NDIlib_FourCC_video_type_BGRA,
+        NDIlib_FourCC_video_type_I420, NDIlib_FourCC_video_type_NV12,
+    };
+    cfg->fourcc = 0;
+    for (size_t i = 0; i < sizeof fourccs / sizeof fourccs[0]; ++i) {
+        if (!strcmp(fourcc, ndi_format_desc(fourccs[i])->name)) {
+            cfg->fourcc = fourccs[i];
+        }
+    }
+    if (!cfg->fourcc) {
+        printf("[ERROR] invalid NDI_MOCK_FOURCC \"%s\", expected UYVY, BGRA, "
+               "I420 or NV12\n",
+               fourcc);
+        return -1;
+    }
+
+    char *end;
+    double jitter_ms = strtod(jitter, &end);
+    if (*end || jitter_ms < 0) {
+        printf("[ERROR] invalid NDI_MOCK_JITTER \"%s\"\n", jitter);
+        return -1;
+    }
+    cfg->jitter_us = (int64_t)(jitter_ms * 1000);
+
+    cfg->sample_rate = 0;
+    cfg->channels = 0;
+    if (strcmp(audio, "0") != 0
+        && (sscanf(audio, "%dx%d", &cfg->sample_rate, &cfg->channels) != 2
+            || cfg->sample_rate < MOCK_AUDIO_FRAMES_PER_SEC
+            || cfg->channels <= 0)) {
+        printf("[ERROR] invalid NDI_MOCK_AUDIO \"%s\", expected RATExCHANNELS "
+               "or 0\n",
+               audio);
+        return -1;
+    }
+
+    cfg->nb_sources = atoi(sources);
+    if (cfg->nb_sources <= 0 || cfg->nb_sources > MOCK_MAX_SOURCES) {
+        printf("[ERROR] invalid NDI_MOCK_SOURCES \"%s\", expected 1 to %d\n",
+               sources, MOCK_MAX_SOURCES);
+        return -1;
+    }
+    return 0;
+}
+
+static int64_t
+mock_ideal_ts(const MockTimeline *t, int64_t index)
+{
+    return t->start_ts + index * t->num / t->den;
+}
+
+// 计算第index帧的送达时间
+static int64_t
+mock_due_ts(MockTimeline *t, int64_t index, int64_t prev_due_ts)
+{
+    int64_t due_ts = mock_ideal_ts(t, index);
+    if (t->jitter_us > 0) {
+        t->rng ^= t->rng << 13;
+        t->rng ^= t->rng >> 7;
+        t->rng ^= t->rng << 17;
+        due_ts += (int64_t)(t->rng % (uint64_t)(2 * t->jitter_us + 1))
+                  - t->jitter_us;
+    }
+    return due_ts > prev_due_ts ? due_ts : prev_due_ts;
+}
+
+static void
+mock_timeline_init(MockTimeline *t, int64_t num, int64_t den,
+                   int64_t jitter_us, uint64_t seed)
+{
+    mutex_init(&t->mu);
+    t->num = num;
+    t->den = den;
+    t->jitter_us = jitter_us;
+    t->rng = seed | 1;
+    t->start_ts = get_current_ts_usec();
+    atomic_store(&t->index, 0);
+    atomic_store(&t->due_ts, mock_due_ts(t, 0, t->start_ts));
+}
+
+// 已到送达时间、尚未取走的帧数
+static int64_t
+mock_timeline_queued(MockTimeline *t, int64_t now)
+{
+    int64_t index = atomic_load(&t->index);
+    if (atomic_load(&t->due_ts) > now) {
+        return 0;
+    }
+    int64_t last = (now - t->start_ts) * t->den / t->num;
+    return last >= index ? last - index + 1 : 1;
+}
+
+/**
+ * 等待下一帧送达，调用方持有t->mu
+ * @return 送达的帧序号，超时返回-1
+ */
+static int64_t
+mock_timeline_next(MockTimeline *t, uint32_t timeout_ms)
+{
+    int64_t now = get_current_ts_usec();
+
+    // 积压过多时丢弃最旧的帧，与NDI接收器的行为一致
+    int64_t queued = mock_timeline_queued(t, now);
+    if (queued > MOCK_MAX_QUEUED) {
+        int64_t skip = queued - MOCK_MAX_QUEUED;
+        int64_t index = atomic_load(&t->index) + skip;
+        atomic_store(&t->index, index);
+        atomic_store(&t->due_ts, mock_due_ts(t, index, 0));
+        atomic_fetch_add(&t->dropped, skip);
+    }
+
+    int64_t wait_us = atomic_load(&t->due_ts) - now;
+    if (wait_us > (int64_t)timeout_ms * 1000) {
+        if (timeout_ms > 0) {
+            thread_sleep_ms((int)timeout_ms);
+        }
+        return -1;
+    }
+    if (wait_us > 0) {
+        thread_sleep_ms((int)((wait_us + 999) / 1000));
+    }
+
+    int64_t index = atomic_load(&t->index);
+    atomic_store(&t->due_ts,
+                 mock_due_ts(t, index + 1, atomic_load(&t->due_ts)));
+    atomic_store(&t->index, index + 1);
+    atomic_fetch_add(&t->received, 1);
+    return index;
+}
+
+static void
+mock_pool_init(MockPool *pool, size_t size)
+{
+    mutex_init(&pool->mu);
+    pool->nb_buffers = 0;
+    pool->size = size;
+}
+
+static uint8_t *
+mock_pool_get(MockPool *pool)
+{
+    uint8_t *buf = NULL;
+    mutex_lock(&pool->mu);
+    if (pool->nb_buffers > 0) {
+        buf = pool->buffers[--pool->nb_buffers];
+    }
+    mutex_unlock(&pool->mu);
+    return buf ? buf : malloc(pool->size);
+}
+
+static void
+mock_pool_put(MockPool *pool, uint8_t *buf)
+{
+    mutex_lock(&pool->mu);
+    if (pool->nb_buffers < MOCK_POOL_SIZE) {
+        pool->buffers[pool->nb_buffers++] = buf;
+        buf = NULL;
+    }
+    mutex_unlock(&pool->mu);
+    free(buf);
+}
+
+static void
+mock_pool_uninit(MockPool *pool)
+{
+    for (int i = 0; i < pool->nb_buffers; ++i) {
+        free(pool->buffers[i]);
+    }
+    pool->nb_buffers = 0;
+    mutex_destroy(&pool->mu);
+}
+
+// 把彩条渲染到frame->p_data
+static void
+mock_render_bars(const NdiFormatDesc *desc, const NDIlib_video_frame_v2_t *frame)
+{
+    uint8_t *data[4];
+    int linesize[4];
+    ndi_format_fill_planes(desc, frame, data, linesize);
+
+    for (int y = 0; y < frame->yres; ++y) {
+        uint8_t *row = data[0] + (size_t)y * linesize[0];
+        for (int x = 0; x < frame->xres; x += 2) {
+            int bar = x * 8 / frame->xres;
+            const uint8_t *yuv = mock_bars_yuv[bar];
+            const uint8_t *rgb = mock_bars_rgb[bar];
+
+            switch (frame->FourCC) {
+            case NDIlib_FourCC_video_type_UYVY:
+                row[x * 2 + 0] = yuv[1];
+                row[x * 2 + 1] = yuv[0];
+                row[x * 2 + 2] = yuv[2];
+                row[x * 2 + 3] = yuv[0];
+                break;
+            case NDIlib_FourCC_video_type_BGRA:
+                for (int i = 0; i < 2; ++i) {
+                    row[(x + i) * 4 + 0] = rgb[2];
+                    row[(x + i) * 4 + 1] = rgb[1];
+                    row[(x + i) * 4 + 2] = rgb[0];
+                    row[(x + i) * 4 + 3] = 255;
+                }
+                break;
+            default: // I420、NV12
+                row[x] = yuv[0];
+                row[x + 1] = yuv[0];
+                if (y % 2 == 0) {
+                    uint8_t *u = data[1] + (size_t)(y / 2) * linesize[1];
+                    if (data[2]) {
+                        u[x / 2] = yuv[1];
+                        data[2][(size_t)(y / 2) * linesize[2] + x / 2] = yuv[2];
+                    }
+                    else {
+                        u[x] = yuv[1];
+                        u[x + 1] = yuv[2];
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+// 按帧序号把彩条向左滚动后拷贝到dst
+static void
+mock_copy_scrolled(const MockRecv *r, uint8_t *dst, int64_t index)
+{
+    NDIlib_video_frame_v2_t src_frame = r->video;
+    NDIlib_video_frame_v2_t dst_frame = r->video;
+    src_frame.p_data = r->pattern;
+    dst_frame.p_data = dst;
+
+    uint8_t *src_data[4], *dst_data[4];
+    int linesize[4];
+    ndi_format_fill_planes(r->desc, &src_frame, src_data, linesize);
+    ndi_format_fill_planes(r->desc, &dst_frame, dst_data, linesize);
+
+    int shift = (int)(index * MOCK_SCROLL_STEP % r->video.xres);
+    for (int p = 0; p < 4 && src_data[p]; ++p) {
+        int height = p == 0 ? r->video.yres
+                            : r->video.yres >> r->desc->chroma_shift_h;
+        // 平面内每像素的字节数 = 行字节数 / 宽度，shift为偶数，不会拆开
+        // UYVY的像素对和色度采样
+        int offset = (int)((int64_t)shift * linesize[p] / r->video.xres);
+        for (int y = 0; y < height; ++y) {
+            const uint8_t *s = src_data[p] + (size_t)y * linesize[p];
+            uint8_t *d = dst_data[p] + (size_t)y * linesize[p];
+            memcpy(d, s + offset, linesize[p] - offset);
+            memcpy(d + linesize[p] - offset, s, offset);
+        }
+    }
+}
+
+static void
+mock_fill_audio(const MockRecv *r, float *data, int64_t index)
+{
+    // 三角波，相邻声道相位错开
+    int period = mock_config.sample_rate / MOCK_AUDIO_TONE;
+    if (period < 2) {
+        period = 2;
+    }
+    int64_t pos = index * r->audio_samples;
+    for (int ch = 0; ch < mock_config.channels; ++ch) {
+        float *out = data + (size_t)ch * r->audio_samples;
+        for (int i = 0; i < r->audio_samples; ++i) {
+            int phase = (int)((pos + i + ch * period / 4) % period);
+            float v = 4.0f * (float)phase / (float)period;
+            out[i] = 0.25f * (v < 2.0f ? v - 1.0f : 3.0f - v);
+        }
+    }
+}
+
+bool
+NDIlib_initialize(void)
+{
+    if (mock_parse_config(&mock_config) < 0) {
+        return false;
+    }
+    printf("[INFO] NDI mock: %dx%d@%d/%d %s, jitter %.1f ms, ",
+           mock_config.width, mock_config.height, mock_config.frame_rate_N,
+           mock_config.frame_rate_D, ndi_format_desc(mock_config.fourcc)->name,
+           (double)mock_config.jitter_us / 1000);
+    if (mock_config.sample_rate > 0) {
+        printf("audio %d Hz x%d\n", mock_config.sample_rate,
+               mock_config.channels);
+    }
+    else {
+        printf("no audio\n");
+    }
+    return true;
+}
+
+void
+NDIlib_destroy(void)
+{
+}
+
+NDIlib_find_instance_t
+NDIlib_find_create_v2(const NDIlib_find_create_t *p_create_settings)
+{
+    (void)p_create_settings;
+    MockFind *find = calloc(1, sizeof(MockFind));
+    if (!find) {
+        return NULL;
+    }
+    for (int i = 0; i < mock_config.nb_sources; ++i) {
+        snprintf(find->names[i], MOCK_NAME_SIZE, "NDI-MOCK (Test Pattern %d)",
+                 i + 1);
+        snprintf(find->addresses[i], MOCK_NAME_SIZE, "127.0.0.1:%d",
+                 5961 + i);
+        find->sources[i].p_ndi_name = find->names[i];
+        find->sources[i].p_url_address = find->addresses[i];
+    }
+    return find;
+}
+
+void
+NDIlib_find_destroy(NDIlib_find_instance_t p_instance)
+{
+    free(p_instance);
+}
+
+const NDIlib_source_t *
+NDIlib_find_get_current_sources(NDIlib_find_instance_t p_instance,
+                                uint32_t *p_no_sources)
+{
+    MockFind *find = p_instance;
+    *p_no_sources = (uint32_t)mock_config.nb_sources;
+    return find->sources;
+}
+
+bool
+NDIlib_find_wait_for_sources(NDIlib_find_instance_t p_instance,
+                             uint32_t timeout_in_ms)
+{
+    (void)p_instance;
+    (void)timeout_in_ms;
+    return true;
+}
+
+NDIlib_recv_instance_t
+NDIlib_recv_create_v3(const NDIlib_recv_create_v3_t *p_create_settings)
+{
+    (void)p_create_settings;
+    MockRecv *r = calloc(1, sizeof(MockRecv));
+    if (!r) {
+        return NULL;
+    }
+
+    r->desc = ndi_format_desc(mock_config.fourcc);
+    r->video.xres = mock_config.width;
+    r->video.yres = mock_config.height;
+    r->video.FourCC = mock_config.fourcc;
+    r->video.frame_rate_N = mock_config.frame_rate_N;
+    r->video.frame_rate_D = mock_config.frame_rate_D;
+    r->video.frame_format_type = NDIlib_frame_format_type_progressive;
+    r->video.line_stride_in_bytes
+            = av_image_get_linesize(r->desc->pix_fmt, r->video.xres, 0);
+    size_t video_size = ndi_format_frame_size(r->desc, &r->video);
+
+    r->pattern = malloc(video_size);
+    if (!r->pattern) {
+        free(r);
+        return NULL;
+    }
+    r->video.p_data = r->pattern;
+    mock_render_bars(r->desc, &r->video);
+    r->video.p_data = NULL;
+
+    uint64_t seed = (uint64_t)get_current_ts_usec() ^ (uintptr_t)r;
+    mock_timeline_init(&r->video_timeline,
+                       1000000LL * mock_config.frame_rate_D,
+                       mock_config.frame_rate_N, mock_config.jitter_us, seed);
+    mock_pool_init(&r->video_pool, video_size);
+
+    if (mock_config.sample_rate > 0) {
+        r->audio_samples = mock_config.sample_rate / MOCK_AUDIO_FRAMES_PER_SEC;
+        mock_timeline_init(&r->audio_timeline, 1000000LL * r->audio_samples,
+                           mock_config.sample_rate, mock_config.jitter_us,
+                           seed * 31);
+        mock_pool_init(&r->audio_pool, (size_t)r->audio_samples
+                                               * mock_config.channels
+                                               * sizeof(float));
+    }
+    return r;
+}
+
+void
+NDIlib_recv_destroy(NDIlib_recv_instance_t p_instance)
+{
+    MockRecv *r = p_instance;
+    if (!r) {
+        return;
+    }
+    mutex_destroy(&r->video_timeline.mu);
+    mock_pool_uninit(&r->video_pool);
+    if (r->audio_samples > 0) {
+        mutex_destroy(&r->audio_timeline.mu);
+        mock_pool_uninit(&r->audio_pool);
+    }
+    free(r->pattern);
+    free(r);
+}
+
+static NDIlib_frame_type_e
+mock_capture_video(MockRecv *r, NDIlib_video_frame_v2_t *frame,
+                   uint32_t timeout_ms)
+{
+    mutex_lock(&r->video_timeline.mu);
+    int64_t index = mock_timeline_next(&r->video_timeline, timeout_ms);
+    mutex_unlock(&r->video_timeline.mu);
+    if (index < 0) {
+        return NDIlib_frame_type_none;
+    }
+
+    uint8_t *data = mock_pool_get(&r->video_pool);
+    if (!data) {
+        return NDIlib_frame_type_none;
+    }
+    mock_copy_scrolled(r, data, index);
+
+    *frame = r->video;
+    frame->p_data = data;
+    frame->timecode = (mock_ideal_ts(&r->video_timeline, index)
+                       - r->video_timeline.start_ts)
+                      * 10;
+    frame->timestamp = get_current_ts_usec() * 10;
+    return NDIlib_frame_type_video;
+}
+
+static NDIlib_frame_type_e
+mock_capture_audio(MockRecv *r, NDIlib_audio_frame_v2_t *frame,
+                   uint32_t timeout_ms)
+{
+    if (r->audio_samples == 0) {
+        thread_sleep_ms((int)timeout_ms);
+        return NDIlib_frame_type_none;
+    }
+
+    mutex_lock(&r->audio_timeline.mu);
+    int64_t index = mock_timeline_next(&r->audio_timeline, timeout_ms);
+    mutex_unlock(&r->audio_timeline.mu);
+    if (index < 0) {
+        return NDIlib_frame_type_none;
+    }
+
+    float *data = (float *)mock_pool_get(&r->audio_pool);
+    if (!data) {
+        return NDIlib_frame_type_none;
+    }
+    mock_fill_audio(r, data, index);
+
+    memset(frame, 0, sizeof(*frame));
+    frame->sample_rate = mock_config.sample_rate;
+    frame->no_channels = mock_config.channels;
+    frame->no_samples = r->audio_samples;
+    frame->timecode = (mock_ideal_ts(&r->audio_timeline, index)
+                       - r->audio_timeline.start_ts)
+                      * 10;
+    frame->p_data = data;
+    frame->channel_stride_in_bytes = r->audio_samples * (int)sizeof(float);
+    frame->timestamp = get_current_ts_usec() * 10;
+    return NDIlib_frame_type_audio;
+}
+
+NDIlib_frame_type_e
+NDIlib_recv_capture_v2(NDIlib_recv_instance_t p_instance,
+                       NDIlib_video_frame_v2_t *p_video_data,
+                       NDIlib_audio_frame_v2_t *p_audio_data,
+                       NDIlib_metadata_frame_t *p_metadata,
+                       uint32_t timeout_in_ms)
+{
+    MockRecv *r = p_instance;
+    (void)p_metadata;
+
+    // 同时请求音视频时取先送达的一种
+    if (p_video_data && p_audio_data && r->audio_samples > 0) {
+        if (atomic_load(&r->audio_timeline.due_ts)
+            < atomic_load(&r->video_timeline.due_ts)) {
+            p_video_data = NULL;
+        }
+        else {
+            p_audio_data = NULL;
+        }
+    }
+    if (p_video_data) {
+        return mock_capture_video(r, p_video_data, timeout_in_ms);
+    }
+    if (p_audio_data) {
+        return mock_capture_audio(r, p_audio_data, timeout_in_ms);
+    }
+    thread_sleep_ms((int)timeout_in_ms);
+    return NDIlib_frame_type_none;
+}
+
+void
+NDIlib_recv_free_video_v2(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_video_frame_v2_t *p_video_data)
+{
+    MockRecv *r = p_instance;
+    mock_pool_put(&r->video_pool, p_video_data->p_data);
+}
+
+void
+NDIlib_recv_free_audio_v2(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_audio_frame_v2_t *p_audio_data)
+{
+    MockRecv *r = p_instance;
+    mock_pool_put(&r->audio_pool, (uint8_t *)p_audio_data->p_data);
+}
+
+void
+NDIlib_recv_free_metadata(NDIlib_recv_instance_t p_instance,
+                          const NDIlib_metadata_frame_t *p_metadata)
+{
+    (void)p_instance;
+    (void)p_metadata;
+}
+
+void
+NDIlib_recv_get_performance(NDIlib_recv_instance_t p_instance,
+                            NDIlib_recv_performance_t *p_total,
+                            NDIlib_recv_performance_t *p_dropped)
+{
+    MockRecv *r = p_instance;
+    if (p_total) {
+        memset(p_total, 0, sizeof(*p_total));
+        p_total->video_frames = atomic_load(&r->video_timeline.received)
+                                + atomic_load(&r->video_timeline.dropped);
+        p_total->audio_frames = atomic_load(&r->audio_timeline.received)
+                                + atomic_load(&r->audio_timeline.dropped);
+    }
+    if (p_dropped) {
+        memset(p_dropped, 0, sizeof(*p_dropped));
+        p_dropped->video_frames = atomic_load(&r->video_timeline.dropped);
+        p_dropped->audio_frames = atomic_load(&r->audio_timeline.dropped);
+    }
+}
+
+void
+NDIlib_recv_get_queue(NDIlib_recv_instance_t p_instance,
+                      NDIlib_recv_queue_t *p_total)
+{
+    MockRecv *r = p_instance;
+    int64_t now = get_current_ts_usec();
+    memset(p_total, 0, sizeof(*p_total));
+    p_total->video_frames
+            = (int)FFMIN(mock_timeline_queued(&r->video_timeline, now),
+                         MOCK_MAX_QUEUED);
+    if (r->audio_samples > 0) {
+        p_total->audio_frames
+                = (int)FFMIN(mock_timeline_queued(&r->audio_timeline, now),
+                             MOCK_MAX_QUEUED);
+    }
+}
+
+int
+NDIlib_recv_get_no_connections(NDIlib_recv_instance_t p_instance)
+{
+    (void)p_instance;
+    return 1;
+}
@@ -0,0 +1,176 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "ndi_format.h"
+
+#include <libavutil/imgutils.h>
+#include <string.h>
+
+// NDI各平面在一块连续内存中依次存放：亮度(或打包像素)平面，随后是色度平面，
+// 带独立alpha的格式最后是alpha平面
+static const NdiFormatDesc ndi_formats[] = {
+    {
+        .fourcc = NDIlib_FourCC_video_type_UYVY,
+        .name = "UYVY",
+        .pix_fmt = AV_PIX_FMT_UYVY422,
+        .nb_planes = 1,
+        .kernel = NDI_FORMAT_KERNEL_UYVY,
+    },
+    {
+        // UYVY之后是每像素8位的alpha平面
+        .fourcc = NDIlib_FourCC_video_type_UYVA,
+        .name = "UYVA",
+        .pix_fmt = AV_PIX_FMT_UYVY422,
+        .nb_planes = 1,
+        .alpha = NDI_FORMAT_ALPHA_PLANE,
+        .alpha_stride_shift = 1,
+        .kernel = NDI_FORMAT_KERNEL_UYVY,
+    },
+    {
+        // 16位4:2:2半平面：Y平面后是全高度的交织UV平面
+        .fourcc = NDIlib_FourCC_video_type_P216,
+        .name = "P216",
+        .pix_fmt = AV_PIX_FMT_P216LE,
+        .nb_planes = 2,
+    },
+    {
+        // P216之后是每像素16位的alpha平面
+        .fourcc = NDIlib_FourCC_video_type_PA16,
+        .name = "PA16",
+        .pix_fmt = AV_PIX_FMT_P216LE,
+        .nb_planes = 2,
+        .alpha = NDI_FORMAT_ALPHA_PLANE,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_YV12,
+        .name = "YV12",
+        .pix_fmt = AV_PIX_FMT_YUV420P,
+        .nb_planes = 3,
+        .chroma_shift_h = 1,
+        .chroma_stride_shift = 1,
+        .swap_uv = 1,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_I420,
+        .name = "I420",
+        .pix_fmt = AV_PIX_FMT_YUV420P,
+        .nb_planes = 3,
+        .chroma_shift_h = 1,
+        .chroma_stride_shift = 1,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_NV12,
+        .name = "NV12",
+        .pix_fmt = AV_PIX_FMT_NV12,
+        .nb_planes = 2,
+        .chroma_shift_h = 1,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_BGRA,
+        .name = "BGRA",
+        .pix_fmt = AV_PIX_FMT_BGRA,
+        .nb_planes = 1,
+        .alpha = NDI_FORMAT_ALPHA_PACKED,
+        .kernel = NDI_FORMAT_KERNEL_RGB32,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_BGRX,
+        .name = "BGRX",
+        .pix_fmt = AV_PIX_FMT_BGR0,
+        .nb_planes = 1,
+        .kernel = NDI_FORMAT_KERNEL_RGB32,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_RGBA,
+        .name = "RGBA",
+        .pix_fmt = AV_PIX_FMT_RGBA,
+        .nb_planes = 1,
+        .alpha = NDI_FORMAT_ALPHA_PACKED,
+        .kernel = NDI_FORMAT_KERNEL_RGB32,
+    },
+    {
+        .fourcc = NDIlib_FourCC_video_type_RGBX,
+        .name = "RGBX",
+        .pix_fmt = AV_PIX_FMT_RGB0,
+        .nb_planes = 1,
+        .kernel = NDI_FORMAT_KERNEL_RGB32,
+    },
+};
+
+const NdiFormatDesc *
+ndi_format_desc(NDIlib_FourCC_video_type_e fourcc)
+{
+    for (size_t i = 0; i < sizeof(ndi_formats) / sizeof(ndi_formats[0]); ++i) {
+        if (ndi_formats[i].fourcc == fourcc)
+            return &ndi_formats[i];
+    }
+    return NULL;
+}
+
+// 亮度(或打包像素)平面的行字节数，发送端未填写时按宽度推算
+static int
+ndi_format_stride(const NdiFormatDesc *desc,
+                  const NDIlib_video_frame_v2_t *frame)
+{
+    if (frame->line_stride_in_bytes > 0)
+        return frame->line_stride_in_bytes;
+    return av_image_get_linesize(desc->pix_fmt, frame->xres, 0);
+}
+
+static int
+ndi_format_chroma_height(const NdiFormatDesc *desc,
+                         const NDIlib_video_frame_v2_t *frame)
+{
+    return (frame->yres + (1 << desc->chroma_shift_h) - 1)
+           >> desc->chroma_shift_h;
+}
+
+void
+ndi_format_fill_planes(const NdiFormatDesc *desc,
+                       const NDIlib_video_frame_v2_t *frame, uint8_t *data[4],
+                       int linesize[4])
+{
+    int stride = ndi_format_stride(desc, frame);
+    int chroma_stride = stride >> desc->chroma_stride_shift;
+    int chroma_height = ndi_format_chroma_height(desc, frame);
+
+    memset(data, 0, sizeof(uint8_t *) * 4);
+    memset(linesize, 0, sizeof(int) * 4);
+
+    uint8_t *p = frame->p_data;
+    data[0] = p;
+    linesize[0] = stride;
+    p += (size_t)stride * frame->yres;
+
+    for (int i = 1; i < desc->nb_planes; ++i) {
+        data[i] = p;
+        linesize[i] = chroma_stride;
+        p += (size_t)chroma_stride * chroma_height;
+    }
+
+    if (desc->swap_uv) {
+        uint8_t *tmp = data[1];
+        data[1] = data[2];
+        data[2] = tmp;
+    }
+}
+
+size_t
+ndi_format_frame_size(const NdiFormatDesc *desc,
+                      const NDIlib_video_frame_v2_t *frame)
+{
+    size_t stride = (size_t)ndi_format_stride(desc, frame);
+    size_t size = stride * frame->yres;
+
+    if (desc->nb_planes > 1) {
+        size += (size_t)(desc->nb_planes - 1)
+                * (stride >> desc->chroma_stride_shift)
+                * ndi_format_chroma_height(desc, frame);
+    }
+    if (desc->alpha == NDI_FORMAT_ALPHA_PLANE)
+        size += (stride >> desc->alpha_stride_shift) * frame->yres;
+    return size;
+}
@@ -0,0 +1,77 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// NDI视频格式描述表
+// 每个FourCC对应一条描述：FFmpeg像素格式、平面布局、alpha处理方式以及
+// 首选的转换内核。平面指针和行字节数按发送端给出的 line_stride_in_bytes
+// 计算，而不是按图像宽度推算
+
+#ifndef NDI_FORMAT_H
+#define NDI_FORMAT_H
+
+#include <Processing.NDI.Lib.h>
+#include <libavutil/pixfmt.h>
+#include <stddef.h>
+
+// alpha通道的存放方式
+typedef enum NdiFormatAlpha {
+    NDI_FORMAT_ALPHA_NONE = 0, // 无alpha
+    NDI_FORMAT_ALPHA_PACKED,   // 与颜色交织在同一像素内(由pix_fmt表达)
+    NDI_FORMAT_ALPHA_PLANE,    // 颜色平面之后的独立平面，编码时丢弃
+} NdiFormatAlpha;
+
+// 不缩放时首选的转换内核
+typedef enum NdiFormatKernel {
+    NDI_FORMAT_KERNEL_SWSCALE = 0, // 通用swscale
+    NDI_FORMAT_KERNEL_UYVY,        // pixconv UYVY->I420/NV12
+    NDI_FORMAT_KERNEL_RGB32,       // pixconv 32位RGB->I420/NV12
+} NdiFormatKernel;
+
+// NDI视频格式描述
+typedef struct NdiFormatDesc {
+    NDIlib_FourCC_video_type_e fourcc; // NDI FourCC
+    const char *name;                  // 格式名称
+    enum AVPixelFormat pix_fmt;        // 颜色平面对应的FFmpeg像素格式
+    int nb_planes;                     // 颜色平面数(不含独立alpha平面)
+    int chroma_shift_h;                // 色度平面高度 = 图像高度 >> shift(向上取整)
+    int chroma_stride_shift;           // 色度平面行字节数 = 行跨度 >> shift
+    int swap_uv;                       // 色度平面顺序为V、U(YV12)
+    NdiFormatAlpha alpha;              // alpha存放方式
+    int alpha_stride_shift;            // 独立alpha平面行字节数 = 行跨度 >> shift
+    NdiFormatKernel kernel;            // 首选转换内核
+} NdiFormatDesc;
+
+/**
+ * 查找FourCC对应的格式描述
+ * @param fourcc NDI视频格式FourCC
+ * @return 格式描述，不支持的格式返回NULL
+ */
+const NdiFormatDesc *
+ndi_format_desc(NDIlib_FourCC_video_type_e fourcc);
+
+/**
+ * 按实际行跨度填充颜色平面指针和行字节数
+ * @param desc 格式描述
+ * @param frame NDI视频帧
+ * @param data 输出的平面指针(按FFmpeg平面顺序，未使用的置NULL)
+ * @param linesize 输出的各平面行字节数
+ */
+void
+ndi_format_fill_planes(const NdiFormatDesc *desc,
+                       const NDIlib_video_frame_v2_t *frame, uint8_t *data[4],
+                       int linesize[4]);
+
+/**
+ * 计算帧数据的总字节数(包括独立alpha平面)
+ * @param desc 格式描述
+ * @param frame NDI视频帧
+ * @return 字节数
+ */
+size_t
+ndi_format_frame_size(const NdiFormatDesc *desc,
+                      const NDIlib_video_frame_v2_t *frame);
+
+#endif
@@ -0,0 +1,85 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "ndi_frame.h"
+
+#include "common.h"
+#include "ndi_format.h"
+
+// 引用的不透明数据：保存归还帧所需的NDI输入和帧描述。本身取自缓冲池，
+// 稳态下包装一帧不分配内存
+typedef struct NdiVideoFrameHolder {
+    AVBufferRef *pool_ref;          // 本结构所在的缓冲池缓冲区
+    NdiSource *src;                 // NDI输入
+    NDIlib_video_frame_v2_t frame;  // NDI视频帧描述
+    int64_t capture_ts;             // 从NDI取出的本地时间(微秒)
+} NdiVideoFrameHolder;
+
+// 帧数据字节数，仅用于填写AVBufferRef的size
+static size_t
+ndi_video_frame_data_size(const NDIlib_video_frame_v2_t *frame)
+{
+    const NdiFormatDesc *desc = ndi_format_desc(frame->FourCC);
+    if (desc)
+        return ndi_format_frame_size(desc, frame);
+    return (size_t)frame->line_stride_in_bytes * frame->yres;
+}
+
+// 最后一个引用释放时归还NDI缓冲区
+static void
+ndi_video_frame_free(void *opaque, uint8_t *data)
+{
+    NdiVideoFrameHolder *holder = opaque;
+    AVBufferRef *pool_ref = holder->pool_ref;
+    (void)data;  // 像素数据属于NDI，由ndi_source_free_video归还
+    ndi_source_free_video(holder->src, &holder->frame);
+    av_buffer_unref(&pool_ref);
+}
+
+AVBufferPool *
+ndi_video_frame_pool_init(void)
+{
+    return av_buffer_pool_init(sizeof(NdiVideoFrameHolder), NULL);
+}
+
+AVBufferRef *
+ndi_video_frame_wrap(AVBufferPool *pool, NdiSource *src,
+                     const NDIlib_video_frame_v2_t *frame)
+{
+    AVBufferRef *pool_ref = av_buffer_pool_get(pool);
+    if (!pool_ref) {
+        ndi_source_free_video(src, frame);
+        return NULL;
+    }
+    NdiVideoFrameHolder *holder = (NdiVideoFrameHolder *)pool_ref->data;
+    holder->pool_ref = pool_ref;
+    holder->src = src;
+    holder->frame = *frame;
+    holder->capture_ts = get_current_ts_usec();
+
+    // 只读标记使 av_frame_make_writable 等操作拷贝而不是写入NDI内存
+    AVBufferRef *buf = av_buffer_create(
+            frame->p_data, ndi_video_frame_data_size(frame),
+            ndi_video_frame_free, holder, AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        ndi_video_frame_free(holder, NULL);
+    }
+    return buf;
+}
+
+const NDIlib_video_frame_v2_t *
+ndi_video_frame_get(const AVBufferRef *buf)
+{
+    NdiVideoFrameHolder *holder = av_buffer_get_opaque(buf);
+    return &holder->frame;
+}
+
+int64_t
+ndi_video_frame_capture_ts(const AVBufferRef *buf)
+{
+    NdiVideoFrameHolder *holder = av_buffer_get_opaque(buf);
+    return holder->capture_ts;
+}
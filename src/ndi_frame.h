@@ -0,0 +1,54 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 引用计数的NDI视频帧
+// 将NDI接收到的视频帧包装为AVBufferRef，最后一个引用释放时才调用
+// ndi_source_free_video 归还NDI缓冲区，帧可以在队列中停留或被多个
+// 消费者读取而无需拷贝像素数据
+
+#ifndef NDI_FRAME_H
+#define NDI_FRAME_H
+
+#include <Processing.NDI.Lib.h>
+#include <libavutil/buffer.h>
+
+#include "ndi_source.h"
+
+/**
+ * 创建包装NDI视频帧用的缓冲池，按同时在用的帧数增长，之后复用
+ * @return 缓冲池，用av_buffer_pool_uninit释放；失败返回NULL
+ */
+AVBufferPool *
+ndi_video_frame_pool_init(void);
+
+/**
+ * 包装NDI视频帧，接管其所有权
+ * @param pool ndi_video_frame_pool_init 创建的缓冲池
+ * @param src 产生该帧的NDI输入，必须比返回的引用存活更久
+ * @param frame ndi_source_capture 返回的视频帧
+ * @return 指向像素数据的只读AVBufferRef，失败时立即释放NDI帧并返回NULL
+ */
+AVBufferRef *
+ndi_video_frame_wrap(AVBufferPool *pool, NdiSource *src,
+                     const NDIlib_video_frame_v2_t *frame);
+
+/**
+ * 获取被包装的NDI视频帧描述
+ * @param buf ndi_video_frame_wrap 返回的引用(或其副本)
+ * @return NDI视频帧描述，生命周期与buf相同
+ */
+const NDIlib_video_frame_v2_t *
+ndi_video_frame_get(const AVBufferRef *buf);
+
+/**
+ * 获取帧被包装(即从NDI取出)时的本地时间
+ * @param buf ndi_video_frame_wrap 返回的引用(或其副本)
+ * @return 微秒时间戳(与get_current_ts_usec同一时钟)
+ */
+int64_t
+ndi_video_frame_capture_ts(const AVBufferRef *buf);
+
+#endif
@@ -0,0 +1,475 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "ndi_record.h"
+
+#include <libavutil/imgutils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ndi_format.h"
+#include "thread.h"
+
+#define NDI_RECORD_MAGIC "NDIREC\r\n"
+#define NDI_RECORD_VERSION 1
+#define NDI_RECORD_BYTE_ORDER 0x01020304u
+#define NDI_RECORD_SEGMENT (64 << 20) // 每次扩展和映射的字节数，NDI_RECORD_ALIGN的整数倍
+
+// 文件头，大小为NDI_RECORD_ALIGN
+typedef struct NdiRecordFileHeader {
+    char magic[8];          // NDI_RECORD_MAGIC
+    uint32_t version;       // NDI_RECORD_VERSION
+    uint32_t byte_order;    // 按本机字节序写入的NDI_RECORD_BYTE_ORDER
+    uint32_t frame_size;    // sizeof(NdiRecordFrame)
+    uint8_t reserved[NDI_RECORD_ALIGN - 20];
+} NdiRecordFileHeader;
+
+_Static_assert(sizeof(NdiRecordFileHeader) == NDI_RECORD_ALIGN,
+               "file header must be NDI_RECORD_ALIGN bytes");
+_Static_assert(sizeof(NdiRecordFrame) == NDI_RECORD_ALIGN,
+               "frame header must be NDI_RECORD_ALIGN bytes");
+
+struct NdiRecordWriter {
+    Mutex mu;               // 音视频采集线程都会写入
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    uint8_t *map;           // 当前映射的段，未映射时为NULL
+    int64_t map_offset;     // 当前段在文件中的位置
+    int64_t pos;            // 下一次写入的位置
+    int failed;             // 映射失败后不再写入
+};
+
+struct NdiRecordReader {
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    const uint8_t *data;    // 整个文件的只读映射
+    int64_t map_size;       // 映射的字节数(文件长度)
+    int64_t size;           // 有效内容的字节数
+};
+
+static int64_t
+ndi_record_align(int64_t size)
+{
+    return (size + NDI_RECORD_ALIGN - 1) & ~(int64_t)(NDI_RECORD_ALIGN - 1);
+}
+
+static void
+ndi_record_unmap_segment(NdiRecordWriter *w)
+{
+    if (!w->map) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(w->map);
+    CloseHandle(w->mapping);
+    w->mapping = NULL;
+#else
+    munmap(w->map, NDI_RECORD_SEGMENT);
+#endif
+    w->map = NULL;
+}
+
+// 扩展文件并映射包含pos的段
+static int
+ndi_record_map_segment(NdiRecordWriter *w, int64_t pos)
+{
+    ndi_record_unmap_segment(w);
+    int64_t offset = pos - pos % NDI_RECORD_SEGMENT;
+    int64_t end = offset + NDI_RECORD_SEGMENT;
+
+#ifdef _WIN32
+    w->mapping = CreateFileMappingA(w->file, NULL, PAGE_READWRITE,
+                                    (DWORD)(end >> 32), (DWORD)end, NULL);
+    if (!w->mapping) {
+        return -1;
+    }
+    w->map = MapViewOfFile(w->mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32),
+                           (DWORD)offset, NDI_RECORD_SEGMENT);
+    if (!w->map) {
+        CloseHandle(w->mapping);
+        w->mapping = NULL;
+        return -1;
+    }
+#else
+    if (ftruncate(w->fd, (off_t)end) < 0) {
+        return -1;
+    }
+    void *map = mmap(NULL, NDI_RECORD_SEGMENT, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, w->fd, (off_t)offset);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    w->map = map;
+#endif
+    w->map_offset = offset;
+    return 0;
+}
+
+// 从w->pos开始写入，跨段时逐段映射
+static int
+ndi_record_copy(NdiRecordWriter *w, const void *src, int64_t size)
+{
+    const uint8_t *p = src;
+    while (size > 0) {
+        if (!w->map || w->pos < w->map_offset
+            || w->pos >= w->map_offset + NDI_RECORD_SEGMENT) {
+            if (ndi_record_map_segment(w, w->pos) < 0) {
+                return -1;
+            }
+        }
+        int64_t in_segment = w->map_offset + NDI_RECORD_SEGMENT - w->pos;
+        int64_t n = size < in_segment ? size : in_segment;
+        memcpy(w->map + (w->pos - w->map_offset), p, (size_t)n);
+        w->pos += n;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// 写入一帧，补齐部分在扩展文件时已是零
+static int
+ndi_record_write(NdiRecordWriter *w, const NdiRecordFrame *frame,
+                 const void *data)
+{
+    mutex_lock(&w->mu);
+    int ret = -1;
+    if (!w->failed) {
+        int64_t start = w->pos;
+        ret = ndi_record_copy(w, frame, sizeof(NdiRecordFrame));
+        if (ret >= 0) {
+            ret = ndi_record_copy(w, data, (int64_t)frame->data_size);
+        }
+        if (ret >= 0) {
+            w->pos = start + sizeof(NdiRecordFrame)
+                     + ndi_record_align((int64_t)frame->data_size);
+        }
+        else {
+            w->pos = start;
+            w->failed = 1;
+        }
+    }
+    mutex_unlock(&w->mu);
+    return ret;
+}
+
+NdiRecordWriter *
+new_ndi_record_writer(const char *path)
+{
+    NdiRecordWriter *w = calloc(1, sizeof(NdiRecordWriter));
+    if (!w) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    w->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                          NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (w->file == INVALID_HANDLE_VALUE) {
+        free(w);
+        return NULL;
+    }
+#else
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+#endif
+    mutex_init(&w->mu);
+
+    NdiRecordFileHeader header = {};
+    memcpy(header.magic, NDI_RECORD_MAGIC, sizeof header.magic);
+    header.version = NDI_RECORD_VERSION;
+    header.byte_order = NDI_RECORD_BYTE_ORDER;
+    header.frame_size = sizeof(NdiRecordFrame);
+    if (ndi_record_copy(w, &header, sizeof header) < 0) {
+        free_ndi_record_writer(&w);
+        return NULL;
+    }
+    return w;
+}
+
+void
+free_ndi_record_writer(NdiRecordWriter **writer)
+{
+    NdiRecordWriter *w = *writer;
+    if (!w) {
+        return;
+    }
+
+    ndi_record_unmap_segment(w);
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = w->pos;
+    SetFilePointerEx(w->file, end, NULL, FILE_BEGIN);
+    SetEndOfFile(w->file);
+    CloseHandle(w->file);
+#else
+    if (ftruncate(w->fd, (off_t)w->pos) < 0) {
+        printf("[ERROR] couldn't truncate recording\n");
+    }
+    close(w->fd);
+#endif
+    mutex_destroy(&w->mu);
+    free(w);
+    *writer = NULL;
+}
+
+int
+ndi_record_write_video(NdiRecordWriter *writer,
+                       const NDIlib_video_frame_v2_t *frame, size_t size,
+                       int64_t capture_ts)
+{
+    NdiRecordFrame rf = {};
+    rf.type = NDI_RECORD_VIDEO;
+    rf.data_size = size;
+    rf.capture_ts = capture_ts;
+    rf.timecode = frame->timecode;
+    rf.timestamp = frame->timestamp;
+    rf.xres = frame->xres;
+    rf.yres = frame->yres;
+    rf.fourcc = (uint32_t)frame->FourCC;
+    rf.frame_rate_N = frame->frame_rate_N;
+    rf.frame_rate_D = frame->frame_rate_D;
+    rf.frame_format_type = frame->frame_format_type;
+    rf.line_stride_in_bytes = frame->line_stride_in_bytes;
+    rf.picture_aspect_ratio = frame->picture_aspect_ratio;
+    return ndi_record_write(writer, &rf, frame->p_data);
+}
+
+int
+ndi_record_write_audio(NdiRecordWriter *writer,
+                       const NDIlib_audio_frame_v2_t *frame,
+                       int64_t capture_ts)
+{
+    NdiRecordFrame rf = {};
+    rf.type = NDI_RECORD_AUDIO;
+    rf.data_size = (uint64_t)frame->channel_stride_in_bytes
+                   * frame->no_channels;
+    rf.capture_ts = capture_ts;
+    rf.timecode = frame->timecode;
+    rf.timestamp = frame->timestamp;
+    rf.sample_rate = frame->sample_rate;
+    rf.no_channels = frame->no_channels;
+    rf.no_samples = frame->no_samples;
+    rf.channel_stride_in_bytes = frame->channel_stride_in_bytes;
+    return ndi_record_write(writer, &rf, frame->p_data);
+}
+
+// 检查帧头描述的画面或样本是否完整落在帧数据内，损坏的文件不会导致越界读取
+static int
+ndi_record_frame_valid(const NdiRecordFrame *frame)
+{
+    if (frame->type == NDI_RECORD_AUDIO) {
+        return frame->sample_rate > 0 && frame->no_channels > 0
+               && frame->no_samples > 0
+               && frame->channel_stride_in_bytes
+                          >= (int64_t)frame->no_samples * (int)sizeof(float)
+               && (uint64_t)frame->no_channels * frame->channel_stride_in_bytes
+                          <= frame->data_size;
+    }
+
+    NDIlib_video_frame_v2_t video;
+    ndi_record_get_video(frame, &video);
+    const NdiFormatDesc *desc = ndi_format_desc(video.FourCC);
+    if (!desc || video.xres <= 0 || video.yres <= 0
+        || video.line_stride_in_bytes < 0) {
+        return 0;
+    }
+    int row_size = av_image_get_linesize(desc->pix_fmt, video.xres, 0);
+    if (row_size <= 0
+        || (video.line_stride_in_bytes > 0
+            && video.line_stride_in_bytes < row_size)) {
+        return 0;
+    }
+    return ndi_format_frame_size(desc, &video) <= frame->data_size;
+}
+
+// 检查文件头并扫描所有帧头，确定有效内容的长度
+static int
+ndi_record_scan(NdiRecordReader *r, NdiRecordInfo *info)
+{
+    int64_t file_size = r->map_size;
+    const NdiRecordFileHeader *header = (const NdiRecordFileHeader *)r->data;
+    if (file_size < (int64_t)sizeof *header
+        || memcmp(header->magic, NDI_RECORD_MAGIC, sizeof header->magic) != 0
+        || header->version != NDI_RECORD_VERSION
+        || header->byte_order != NDI_RECORD_BYTE_ORDER
+        || header->frame_size != sizeof(NdiRecordFrame)) {
+        return -1;
+    }
+
+    memset(info, 0, sizeof *info);
+    int64_t pos = sizeof *header;
+    while (pos + (int64_t)sizeof(NdiRecordFrame) <= file_size) {
+        const NdiRecordFrame *frame = (const NdiRecordFrame *)(r->data + pos);
+        if (frame->type != NDI_RECORD_VIDEO && frame->type != NDI_RECORD_AUDIO) {
+            break;
+        }
+        // 中途退出时最后一帧可能不完整
+        int64_t next = pos + sizeof(NdiRecordFrame)
+                       + ndi_record_align((int64_t)frame->data_size);
+        if (frame->data_size > (uint64_t)file_size || next > file_size) {
+            break;
+        }
+        // 帧头与数据长度不符时视为文件损坏，只回放之前的部分
+        if (!ndi_record_frame_valid(frame)) {
+            break;
+        }
+        if (frame->type == NDI_RECORD_VIDEO) {
+            info->nb_video++;
+        }
+        else {
+            info->nb_audio++;
+        }
+        if (info->nb_video + info->nb_audio == 1) {
+            info->first_ts = frame->capture_ts;
+        }
+        info->last_ts = frame->capture_ts;
+        pos = next;
+    }
+    info->size = pos;
+    r->size = pos;
+    return 0;
+}
+
+NdiRecordReader *
+new_ndi_record_reader(const char *path, NdiRecordInfo *info)
+{
+    NdiRecordReader *r = calloc(1, sizeof(NdiRecordReader));
+    if (!r) {
+        return NULL;
+    }
+
+#ifdef _WIN32
+    r->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (r->file == INVALID_HANDLE_VALUE) {
+        free(r);
+        return NULL;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(r->file, &size) && size.QuadPart > 0) {
+        r->map_size = size.QuadPart;
+        r->mapping = CreateFileMappingA(r->file, NULL, PAGE_READONLY, 0, 0,
+                                        NULL);
+    }
+    if (r->mapping) {
+        r->data = MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(r);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        r->map_size = st.st_size;
+        void *data = mmap(NULL, (size_t)r->map_size, PROT_READ, MAP_SHARED,
+                          fd, 0);
+        r->data = data == MAP_FAILED ? NULL : data;
+    }
+    close(fd);
+#endif
+
+    if (!r->data || ndi_record_scan(r, info) < 0) {
+        free_ndi_record_reader(&r);
+        return NULL;
+    }
+    return r;
+}
+
+void
+free_ndi_record_reader(NdiRecordReader **reader)
+{
+    NdiRecordReader *r = *reader;
+    if (!r) {
+        return;
+    }
+#ifdef _WIN32
+    if (r->data) {
+        UnmapViewOfFile(r->data);
+    }
+    if (r->mapping) {
+        CloseHandle(r->mapping);
+    }
+    CloseHandle(r->file);
+#else
+    if (r->data) {
+        munmap((void *)r->data, (size_t)r->map_size);
+    }
+#endif
+    free(r);
+    *reader = NULL;
+}
+
+const NdiRecordFrame *
+ndi_record_next(const NdiRecordReader *reader, int64_t *offset, int type)
+{
+    int64_t pos = *offset > 0 ? *offset : (int64_t)sizeof(NdiRecordFileHeader);
+    while (pos < reader->size) {
+        const NdiRecordFrame *frame
+                = (const NdiRecordFrame *)(reader->data + pos);
+        pos += sizeof(NdiRecordFrame)
+               + ndi_record_align((int64_t)frame->data_size);
+        if ((int)frame->type == type) {
+            *offset = pos;
+            return frame;
+        }
+    }
+    return NULL;
+}
+
+void
+ndi_record_get_video(const NdiRecordFrame *frame,
+                     NDIlib_video_frame_v2_t *video)
+{
+    memset(video, 0, sizeof *video);
+    video->xres = frame->xres;
+    video->yres = frame->yres;
+    video->FourCC = (NDIlib_FourCC_video_type_e)frame->fourcc;
+    video->frame_rate_N = frame->frame_rate_N;
+    video->frame_rate_D = frame->frame_rate_D;
+    video->picture_aspect_ratio = frame->picture_aspect_ratio;
+    video->frame_format_type
+            = (NDIlib_frame_format_type_e)frame->frame_format_type;
+    video->timecode = frame->timecode;
+    video->p_data = (uint8_t *)(frame + 1);
+    video->line_stride_in_bytes = frame->line_stride_in_bytes;
+    video->timestamp = frame->timestamp;
+}
+
+void
+ndi_record_get_audio(const NdiRecordFrame *frame,
+                     NDIlib_audio_frame_v2_t *audio)
+{
+    memset(audio, 0, sizeof *audio);
+    audio->sample_rate = frame->sample_rate;
+    audio->no_channels = frame->no_channels;
+    audio->no_samples = frame->no_samples;
+    audio->timecode = frame->timecode;
+    audio->p_data = (float *)(frame + 1);
+    audio->channel_stride_in_bytes = frame->channel_stride_in_bytes;
+    audio->timestamp = frame->timestamp;
+}
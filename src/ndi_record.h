@@ -0,0 +1,157 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// NDI录制文件
+// 把NDI接收到的原始音视频帧(连同FourCC、行跨度、NDI时间码和时间戳)按接收
+// 顺序追加到文件中，供之后回放。文件以内存映射方式按段写入和读取：
+//
+//   文件头(NDI_RECORD_ALIGN字节) | 帧头 | 数据 | 补齐 | 帧头 | 数据 | 补齐 | ...
+//
+// 每帧的帧头和数据都按NDI_RECORD_ALIGN对齐，回放时帧数据直接指向映射的
+// 文件内容，无需拷贝。文件按段预先扩展，写入中途退出时末尾是全零的
+// 帧头，读取到此为止。数据按本机字节序保存
+
+#ifndef NDI_RECORD_H
+#define NDI_RECORD_H
+
+#include <Processing.NDI.Lib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NDI_RECORD_ALIGN 128 // 文件头、帧头和帧数据的对齐字节数
+
+enum NdiRecordType {
+    NDI_RECORD_END = 0,   // 文件结束(已扩展但未写入的部分)
+    NDI_RECORD_VIDEO = 1, // 视频帧
+    NDI_RECORD_AUDIO = 2, // 音频帧(FLTP)
+};
+
+// 帧头，大小为NDI_RECORD_ALIGN
+typedef struct NdiRecordFrame {
+    uint32_t type;        // enum NdiRecordType
+    uint32_t reserved0;
+    uint64_t data_size;   // 数据字节数(不含补齐)
+    int64_t capture_ts;   // 录制时从NDI取出的本地时间(微秒)
+    int64_t timecode;     // NDI时间码
+    int64_t timestamp;    // NDI时间戳
+
+    // 仅视频
+    int32_t xres;
+    int32_t yres;
+    uint32_t fourcc;
+    int32_t frame_rate_N;
+    int32_t frame_rate_D;
+    int32_t frame_format_type;
+    int32_t line_stride_in_bytes;
+    float picture_aspect_ratio;
+
+    // 仅音频
+    int32_t sample_rate;
+    int32_t no_channels;
+    int32_t no_samples;
+    int32_t channel_stride_in_bytes;
+
+    uint8_t reserved[40];
+} NdiRecordFrame;
+
+typedef struct NdiRecordWriter NdiRecordWriter;
+typedef struct NdiRecordReader NdiRecordReader;
+
+// 录制文件的概况，打开时扫描得到
+typedef struct NdiRecordInfo {
+    int64_t nb_video;      // 视频帧数
+    int64_t nb_audio;      // 音频帧数
+    int64_t first_ts;      // 第一帧的capture_ts
+    int64_t last_ts;       // 最后一帧的capture_ts
+    int64_t size;          // 有效内容的字节数
+} NdiRecordInfo;
+
+/**
+ * 创建录制文件，已存在时覆盖
+ * @param path 文件路径
+ * @return 成功返回NdiRecordWriter指针，失败返回NULL
+ */
+NdiRecordWriter *
+new_ndi_record_writer(const char *path);
+
+/**
+ * 把文件截断到实际写入的长度并关闭
+ * @param writer 指向NdiRecordWriter指针的指针
+ */
+void
+free_ndi_record_writer(NdiRecordWriter **writer);
+
+/**
+ * 追加一个视频帧，可在多个线程中调用
+ * @param writer 录制文件
+ * @param frame NDI视频帧
+ * @param size 帧数据字节数
+ * @param capture_ts 从NDI取出的本地时间(微秒)
+ * @return 成功返回0，失败返回-1
+ */
+int
+ndi_record_write_video(NdiRecordWriter *writer,
+                       const NDIlib_video_frame_v2_t *frame, size_t size,
+                       int64_t capture_ts);
+
+/**
+ * 追加一个音频帧，可在多个线程中调用
+ * @param writer 录制文件
+ * @param frame NDI音频帧
+ * @param capture_ts 从NDI取出的本地时间(微秒)
+ * @return 成功返回0，失败返回-1
+ */
+int
+ndi_record_write_audio(NdiRecordWriter *writer,
+                       const NDIlib_audio_frame_v2_t *frame,
+                       int64_t capture_ts);
+
+/**
+ * 以只读方式映射录制文件并检查格式
+ * @param path 文件路径
+ * @param info 输出的文件概况
+ * @return 成功返回NdiRecordReader指针，文件无法打开或格式不符返回NULL
+ * @note 扫描在第一个不完整或帧头与数据长度不符的帧处停止，之后的内容不回放
+ */
+NdiRecordReader *
+new_ndi_record_reader(const char *path, NdiRecordInfo *info);
+
+/**
+ * 解除映射并关闭文件，之前取得的帧数据随之失效
+ * @param reader 指向NdiRecordReader指针的指针
+ */
+void
+free_ndi_record_reader(NdiRecordReader **reader);
+
+/**
+ * 从offset开始查找下一个指定类型的帧
+ * @param reader 录制文件
+ * @param offset 开始查找的位置，找到时更新为该帧之后的位置；0表示从头开始
+ * @param type NDI_RECORD_VIDEO或NDI_RECORD_AUDIO
+ * @return 帧头，帧数据紧随其后；到达文件末尾返回NULL
+ */
+const NdiRecordFrame *
+ndi_record_next(const NdiRecordReader *reader, int64_t *offset, int type);
+
+/**
+ * 用帧头和帧数据填写NDI视频帧，p_data指向映射的文件内容
+ * @param frame 帧头
+ * @param video 输出的NDI视频帧
+ */
+void
+ndi_record_get_video(const NdiRecordFrame *frame,
+                     NDIlib_video_frame_v2_t *video);
+
+/**
+ * 用帧头和帧数据填写NDI音频帧，p_data指向映射的文件内容
+ * @param frame 帧头
+ * @param audio 输出的NDI音频帧
+ */
+void
+ndi_record_get_audio(const NdiRecordFrame *frame,
+                     NDIlib_audio_frame_v2_t *audio);
+
+#endif
@@ -0,0 +1,355 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "ndi_source.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ndi_format.h"
+#include "ndi_record.h"
+#include "thread.h"
+
+#define NDI_REPLAY_MAX_QUEUED 32       // 统计回放积压时最多向后查看的帧数
+#define NDI_REPLAY_DEFAULT_SPACING 40000 // 只有一帧时每轮回放的时长(微秒)
+
+// 回放中一种媒体的读取位置。position = 轮数 * 有效长度 + 文件内偏移，
+// 指向下一次查找的起点，单调递增，可在其他线程无锁读取
+typedef struct NdiReplayCursor {
+    Mutex mu;                     // 同一媒体的取帧互斥
+    int type;                     // NDI_RECORD_VIDEO或NDI_RECORD_AUDIO
+    _Atomic(int64_t) position;
+    _Atomic(int64_t) received;    // 已送出的帧数
+} NdiReplayCursor;
+
+struct NdiSource {
+    NDIlib_recv_instance_t recv;  // NDI接收器，回放时为NULL
+    NdiRecordWriter *writer;      // 录制文件，不录制时为NULL
+    _Atomic(int) record_failed;   // 录制失败，已报告过
+
+    NdiRecordReader *reader;      // 回放的录制文件
+    NdiRecordInfo info;
+    NdiReplayMode mode;
+    int64_t start_ts;             // 回放开始的本地时间
+    int64_t loop_duration;        // 每轮回放的时长(微秒)
+    NdiReplayCursor video;
+    NdiReplayCursor audio;
+};
+
+NdiSource *
+new_ndi_source_recv(const NDIlib_recv_create_v3_t *desc)
+{
+    NDIlib_recv_instance_t recv = NDIlib_recv_create_v3(desc);
+    if (!recv) {
+        return NULL;
+    }
+    NdiSource *src = calloc(1, sizeof(NdiSource));
+    if (!src) {
+        NDIlib_recv_destroy(recv);
+        return NULL;
+    }
+    src->recv = recv;
+    return src;
+}
+
+static void
+ndi_replay_cursor_init(NdiReplayCursor *c, int type)
+{
+    mutex_init(&c->mu);
+    c->type = type;
+    atomic_store(&c->position, 0);
+    atomic_store(&c->received, 0);
+}
+
+NdiSource *
+new_ndi_source_replay(const char *path, NdiReplayMode mode)
+{
+    NdiSource *src = calloc(1, sizeof(NdiSource));
+    if (!src) {
+        return NULL;
+    }
+    src->reader = new_ndi_record_reader(path, &src->info);
+    if (!src->reader || src->info.nb_video == 0) {
+        free_ndi_record_reader(&src->reader);
+        free(src);
+        return NULL;
+    }
+
+    // 每轮的时长比首尾间隔多一个平均帧间隔，循环时不会有两帧挤在一起
+    int64_t nb_frames = src->info.nb_video + src->info.nb_audio;
+    int64_t span = src->info.last_ts - src->info.first_ts;
+    src->loop_duration = span
+                         + (nb_frames > 1 && span > 0
+                                    ? span / (nb_frames - 1)
+                                    : NDI_REPLAY_DEFAULT_SPACING);
+    src->mode = mode;
+    src->start_ts = get_current_ts_usec();
+    ndi_replay_cursor_init(&src->video, NDI_RECORD_VIDEO);
+    ndi_replay_cursor_init(&src->audio, NDI_RECORD_AUDIO);
+
+    printf("[INFO] replaying %s: %lld video and %lld audio frames, %.1f s, "
+           "%s\n",
+           path, (long long)src->info.nb_video, (long long)src->info.nb_audio,
+           (double)span / 1000000,
+           mode == NDI_REPLAY_FAST ? "as fast as possible" : "real time");
+    return src;
+}
+
+void
+free_ndi_source(NdiSource **src)
+{
+    NdiSource *s = *src;
+    if (!s) {
+        return;
+    }
+    free_ndi_record_writer(&s->writer);
+    if (s->recv) {
+        NDIlib_recv_destroy(s->recv);
+    }
+    if (s->reader) {
+        mutex_destroy(&s->video.mu);
+        mutex_destroy(&s->audio.mu);
+        free_ndi_record_reader(&s->reader);
+    }
+    free(s);
+    *src = NULL;
+}
+
+int
+ndi_source_record(NdiSource *src, const char *path)
+{
+    if (!src->recv || src->writer) {
+        return -1;
+    }
+    src->writer = new_ndi_record_writer(path);
+    return src->writer ? 0 : -1;
+}
+
+int
+ndi_source_is_paced(const NdiSource *src)
+{
+    return !src->reader || src->mode == NDI_REPLAY_REALTIME;
+}
+
+// 把NDI接收器取到的帧追加到录制文件，出错时停止录制
+static void
+ndi_source_record_frame(NdiSource *src, NDIlib_frame_type_e type,
+                        const NDIlib_video_frame_v2_t *video,
+                        const NDIlib_audio_frame_v2_t *audio)
+{
+    if (atomic_load_explicit(&src->record_failed, memory_order_relaxed)) {
+        return;
+    }
+
+    int ret = 0;
+    int64_t capture_ts = get_current_ts_usec();
+    if (type == NDIlib_frame_type_video) {
+        const NdiFormatDesc *desc = ndi_format_desc(video->FourCC);
+        if (!desc) {
+            return;  // 不支持的格式流水线也无法处理，不必录制
+        }
+        ret = ndi_record_write_video(src->writer, video,
+                                     ndi_format_frame_size(desc, video),
+                                     capture_ts);
+    }
+    else if (type == NDIlib_frame_type_audio) {
+        ret = ndi_record_write_audio(src->writer, audio, capture_ts);
+    }
+
+    if (ret < 0 && !atomic_exchange(&src->record_failed, 1)) {
+        printf("[ERROR] couldn't write recording, recording stopped\n");
+    }
+}
+
+// 第loop轮中frame的送达时间
+static int64_t
+ndi_replay_due_ts(const NdiSource *src, const NdiRecordFrame *frame,
+                  int64_t loop)
+{
+    return src->start_ts + loop * src->loop_duration + frame->capture_ts
+           - src->info.first_ts;
+}
+
+// 从position开始查找下一帧，到文件末尾时从头开始下一轮
+static const NdiRecordFrame *
+ndi_replay_peek(const NdiSource *src, int type, int64_t position,
+                int64_t *loop, int64_t *offset)
+{
+    *loop = position / src->info.size;
+    *offset = position % src->info.size;
+    const NdiRecordFrame *frame = ndi_record_next(src->reader, offset, type);
+    if (!frame) {
+        ++*loop;
+        *offset = 0;
+        frame = ndi_record_next(src->reader, offset, type);
+    }
+    return frame;
+}
+
+static const NdiRecordFrame *
+ndi_replay_capture(NdiSource *src, NdiReplayCursor *c, uint32_t timeout_ms)
+{
+    mutex_lock(&c->mu);
+    int64_t loop, offset;
+    const NdiRecordFrame *frame = ndi_replay_peek(
+            src, c->type, atomic_load(&c->position), &loop, &offset);
+    int64_t position = loop * src->info.size + offset;
+
+    if (!frame) {
+        mutex_unlock(&c->mu);
+        thread_sleep_ms((int)timeout_ms);
+        return NULL;
+    }
+    if (src->mode == NDI_REPLAY_REALTIME) {
+        int64_t wait_us = ndi_replay_due_ts(src, frame, loop)
+                          - get_current_ts_usec();
+        if (wait_us > (int64_t)timeout_ms * 1000) {
+            mutex_unlock(&c->mu);
+            thread_sleep_ms((int)timeout_ms);
+            return NULL;
+        }
+        if (wait_us > 0) {
+            thread_sleep_ms((int)((wait_us + 999) / 1000));
+        }
+    }
+    else if (c == &src->audio) {
+        // 尽快回放时音频不超过已送出的视频，按录制顺序交错
+        for (uint32_t waited = 0; atomic_load(&src->video.position) < position;
+             ++waited) {
+            if (waited >= timeout_ms) {
+                mutex_unlock(&c->mu);
+                return NULL;
+            }
+            thread_sleep_ms(1);
+        }
+    }
+
+    atomic_store(&c->position, position);
+    atomic_fetch_add(&c->received, 1);
+    mutex_unlock(&c->mu);
+    return frame;
+}
+
+// 回放中已到送达时间、尚未取走的帧数，尽快回放时没有积压
+static int
+ndi_replay_queued(const NdiSource *src, NdiReplayCursor *c, int64_t now)
+{
+    if (src->mode == NDI_REPLAY_FAST) {
+        return 0;
+    }
+    int64_t position = atomic_load(&c->position);
+    int nb_queued = 0;
+    while (nb_queued < NDI_REPLAY_MAX_QUEUED) {
+        int64_t loop, offset;
+        const NdiRecordFrame *frame
+                = ndi_replay_peek(src, c->type, position, &loop, &offset);
+        if (!frame || ndi_replay_due_ts(src, frame, loop) > now) {
+            break;
+        }
+        position = loop * src->info.size + offset;
+        nb_queued++;
+    }
+    return nb_queued;
+}
+
+NDIlib_frame_type_e
+ndi_source_capture(NdiSource *src, NDIlib_video_frame_v2_t *video,
+                   NDIlib_audio_frame_v2_t *audio, uint32_t timeout_ms)
+{
+    if (src->recv) {
+        NDIlib_frame_type_e type = NDIlib_recv_capture_v2(src->recv, video,
+                                                          audio, NULL,
+                                                          timeout_ms);
+        if (src->writer) {
+            ndi_source_record_frame(src, type, video, audio);
+        }
+        return type;
+    }
+
+    // 同时请求音视频时取录制顺序在前的一种
+    if (video && audio) {
+        int64_t loop, offset;
+        const NdiRecordFrame *next_audio = ndi_replay_peek(
+                src, NDI_RECORD_AUDIO, atomic_load(&src->audio.position),
+                &loop, &offset);
+        int64_t audio_position = loop * src->info.size + offset;
+        ndi_replay_peek(src, NDI_RECORD_VIDEO,
+                        atomic_load(&src->video.position), &loop, &offset);
+        if (next_audio && audio_position < loop * src->info.size + offset) {
+            video = NULL;
+        }
+        else {
+            audio = NULL;
+        }
+    }
+
+    const NdiRecordFrame *frame;
+    if (video) {
+        frame = ndi_replay_capture(src, &src->video, timeout_ms);
+        if (frame) {
+            ndi_record_get_video(frame, video);
+            return NDIlib_frame_type_video;
+        }
+    }
+    else if (audio) {
+        frame = ndi_replay_capture(src, &src->audio, timeout_ms);
+        if (frame) {
+            ndi_record_get_audio(frame, audio);
+            return NDIlib_frame_type_audio;
+        }
+    }
+    else {
+        thread_sleep_ms((int)timeout_ms);
+    }
+    return NDIlib_frame_type_none;
+}
+
+void
+ndi_source_free_video(NdiSource *src, const NDIlib_video_frame_v2_t *video)
+{
+    // 回放的帧数据就是映射的文件内容，无需归还
+    if (src->recv) {
+        NDIlib_recv_free_video_v2(src->recv, video);
+    }
+}
+
+void
+ndi_source_free_audio(NdiSource *src, const NDIlib_audio_frame_v2_t *audio)
+{
+    if (src->recv) {
+        NDIlib_recv_free_audio_v2(src->recv, audio);
+    }
+}
+
+void
+ndi_source_get_queue(NdiSource *src, NDIlib_recv_queue_t *queue)
+{
+    if (src->recv) {
+        NDIlib_recv_get_queue(src->recv, queue);
+        return;
+    }
+    int64_t now = get_current_ts_usec();
+    memset(queue, 0, sizeof *queue);
+    queue->video_frames = ndi_replay_queued(src, &src->video, now);
+    queue->audio_frames = ndi_replay_queued(src, &src->audio, now);
+}
+
+void
+ndi_source_get_performance(NdiSource *src, NDIlib_recv_performance_t *total,
+                           NDIlib_recv_performance_t *dropped)
+{
+    if (src->recv) {
+        NDIlib_recv_get_performance(src->recv, total, dropped);
+        return;
+    }
+    memset(total, 0, sizeof *total);
+    memset(dropped, 0, sizeof *dropped);
+    total->video_frames = atomic_load(&src->video.received);
+    total->audio_frames = atomic_load(&src->audio.received);
+}
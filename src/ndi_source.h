@@ -0,0 +1,106 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// NDI输入
+// 流水线取帧的来源：NDI接收器，或者回放ndi_record录制的文件。接口与
+// NDIlib_recv_*一一对应，流水线不区分两者。NDI接收器还可以同时把收到的
+// 每一帧录制到文件中。回放有两种方式：
+//   NDI_REPLAY_REALTIME 按录制时的间隔送出，重现原来的到达时间和抖动
+//   NDI_REPLAY_FAST     不等待，尽快送出，用于测量吞吐量；流水线在采集队列
+//                       满时等待而不丢帧，音频按录制顺序跟随视频送出
+// 回放到文件末尾后从头循环
+
+#ifndef NDI_SOURCE_H
+#define NDI_SOURCE_H
+
+#include <Processing.NDI.Lib.h>
+
+typedef enum NdiReplayMode {
+    NDI_REPLAY_REALTIME = 0, // 按录制时的间隔
+    NDI_REPLAY_FAST,         // 尽快
+} NdiReplayMode;
+
+typedef struct NdiSource NdiSource;
+
+/**
+ * 创建NDI接收器
+ * @param desc 接收器配置
+ * @return 成功返回NdiSource指针，失败返回NULL
+ */
+NdiSource *
+new_ndi_source_recv(const NDIlib_recv_create_v3_t *desc);
+
+/**
+ * 打开录制文件用于回放
+ * @param path 录制文件路径
+ * @param mode 回放方式
+ * @return 成功返回NdiSource指针，文件无法打开、格式不符或没有视频帧时返回NULL
+ */
+NdiSource *
+new_ndi_source_replay(const char *path, NdiReplayMode mode);
+
+/**
+ * 释放NDI输入，停止录制并关闭录制文件
+ * @param src 指向NdiSource指针的指针
+ */
+void
+free_ndi_source(NdiSource **src);
+
+/**
+ * 把之后从NDI接收器取到的每一帧录制到文件中，须在开始取帧前调用，回放时
+ * 不可用
+ * @param src NDI输入
+ * @param path 录制文件路径，已存在时覆盖
+ * @return 成功返回0，失败返回-1
+ */
+int
+ndi_source_record(NdiSource *src, const char *path);
+
+/**
+ * 是否按时间送出帧。尽快回放时返回0，此时采集阶段应等待而不是丢帧
+ * @param src NDI输入
+ */
+int
+ndi_source_is_paced(const NdiSource *src);
+
+/**
+ * 取一帧，同NDIlib_recv_capture_v2(不取元数据)
+ * @param src NDI输入
+ * @param video 视频帧，不需要时为NULL
+ * @param audio 音频帧，不需要时为NULL
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 取到的帧类型，超时返回NDIlib_frame_type_none
+ */
+NDIlib_frame_type_e
+ndi_source_capture(NdiSource *src, NDIlib_video_frame_v2_t *video,
+                   NDIlib_audio_frame_v2_t *audio, uint32_t timeout_ms);
+
+/**
+ * 归还视频帧，同NDIlib_recv_free_video_v2，可在任意线程调用
+ */
+void
+ndi_source_free_video(NdiSource *src, const NDIlib_video_frame_v2_t *video);
+
+/**
+ * 归还音频帧，同NDIlib_recv_free_audio_v2，可在任意线程调用
+ */
+void
+ndi_source_free_audio(NdiSource *src, const NDIlib_audio_frame_v2_t *audio);
+
+/**
+ * 已到达尚未取走的帧数，同NDIlib_recv_get_queue
+ */
+void
+ndi_source_get_queue(NdiSource *src, NDIlib_recv_queue_t *queue);
+
+/**
+ * 收到和丢弃的帧数，同NDIlib_recv_get_performance
+ */
+void
+ndi_source_get_performance(NdiSource *src, NDIlib_recv_performance_t *total,
+                           NDIlib_recv_performance_t *dropped);
+
+#endif
@@ -5,29 +5,101 @@
 // https://opensource.org/licenses/MIT.
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <Processing.NDI.Lib.h>  // NDI库头文件
+#include <libavutil/cpu.h>      // CPU核数
+#include <libavutil/mathematics.h> // 时间戳/比例换算
+#include <libavutil/pixdesc.h>   // 像素格式描述
 
 #include "ffmpeg_output.h"      // FFmpeg输出模块
 #include "frame_converter.h"    // 帧转换模块
+#include "metrics.h"            // Prometheus指标导出
+#include "ndi_source.h"         // NDI接收器或录制文件回放
+#include "pipeline.h"           // 多线程处理流水线
+#include "pixconv.h"            // 向量化像素格式转换
+#include "thread.h"             // 跨平台线程原语
+#include "trace.h"              // 逐帧跟踪
 #include "util.h"               // 工具函数
 
 #define NDI_RECV_TIMEOUT 2000   // NDI接收超时时间(毫秒)
+#define MAX_SOURCES 64          // 一个进程中的NDI源数上限
+#define SOURCE_MAX_ARGS 64      // 源文件中每行的参数数上限
+
+// 低于源分辨率的一路清晰度输出
+typedef struct RenditionOption {
+    int height;                 // 目标高度，宽度按源画面比例计算
+    int bitrate;                // 视频比特率
+    char output[255];           // 输出地址
+    int level;                  // 视频编码器索引，高度和比特率相同的输出共用
+} RenditionOption;
 
 // 应用程序选项结构体
 typedef struct AppOptions {
     char ndi_input_addr[255];    // NDI输入地址
-    char output[255];           // 输出地址
+    char sources_file[255];     // 多个NDI源的配置文件，每行一个源的参数
+    char outputs[FFMPEG_OUTPUT_MAX_TARGETS][255]; // 输出地址，共用一次编码
+    int nb_outputs;             // 输出地址数
+    RenditionOption renditions[FFMPEG_OUTPUT_MAX_TARGETS]; // 较低清晰度输出，按高度、比特率从高到低
+    int nb_renditions;          // 较低清晰度输出数
     char output_format[30];     // 输出格式(rtsp/rtmp)
     char video_encoder[40];     // 视频编码器
     char audio_encoder[40];     // 音频编码器
+    char video_pix_fmt[32];     // 视频编码像素格式(auto表示自动协商)
+    enum AVColorSpace video_colorspace; // YUV矩阵(UNSPECIFIED表示按分辨率选择)
+    enum AVColorRange video_color_range; // YUV范围
+    int convert_threads;        // 视频转换线程数(0表示自动)
+    int max_latency_ms;         // 端到端延迟上限(毫秒，0表示不限制)
+    enum FFmpegLatencyMode latency_mode; // 视频编码延迟模式
+    int encoder_threads;        // 每个视频编码器的线程数(0表示自动)
+    int encoder_thread_type;    // FF_THREAD_SLICE/FF_THREAD_FRAME，0表示编码器默认
+    char encoder_cpus_str[64];  // 视频编码线程的CPU列表
+    ThreadCpuSet encoder_cpus;  // 视频编码线程的CPU亲和性
+    int has_encoder_cpus;       // 是否指定了encoder_cpus
     int video_bitrate;          // 视频比特率
     int audio_bitrate;          // 音频比特率
+    char metrics_addr[64];      // 指标HTTP服务的监听地址
+    int metrics_port;           // 指标HTTP服务的端口(0表示不启用)
+    char trace_file[255];       // 跟踪文件路径(为空表示不启用)
+    char record_file[255];      // 录制NDI输入的文件路径(为空表示不录制)
+    char replay_file[255];      // 回放的录制文件，代替NDI输入(为空表示不回放)
+    NdiReplayMode replay_mode;  // 回放方式
 } AppOptions;
 
+// 一路NDI源的推流任务：接收器、编码器和流水线都是独立的，只共用
+// 视频转换的分片线程池
+typedef struct Stream {
+    AppOptions opts;            // 该源的选项
+    NDIlib_source_t source;     // 要连接的NDI源
+    SlicePool *slice_pool;      // 所有源共用的分片线程池，可为NULL
+    int encoder_threads;        // 每个视频编码器的线程数(0表示自动)
+    char tag[300];              // 日志前缀，只有一路源时为空
+    Thread thread;              // 推流线程
+    Mutex pl_mu;                // 保护pl_ctx，导出指标时不会读到已释放的流水线
+    PipelineCtx *pl_ctx;        // 该源的流水线，未创建时为NULL
+} Stream;
+
+// 导出指标时遍历的推流任务
+typedef struct StreamSet {
+    Stream *streams;
+    int nb_streams;
+} StreamSet;
+
 // 函数声明
 AppOptions read_params(int argc, char **argv);  // 读取命令行参数
+void parse_params(int argc, char **argv, AppOptions *res); // 解析参数到res
+void finish_params(AppOptions *res);            // 补全默认值并整理清晰度
+int read_sources(const char *path, const AppOptions *base, Stream *streams,
+                 int max_streams);              // 从文件读取多个NDI源
+const char *output_format_for_url(const char *url,
+                                  const char *output_format); // 推断封装格式
 void find_ndi_source(NDIlib_source_t *source);  // 查找NDI源
+int open_video_encoders(Stream *s, FFmpegOutputCtx *fa_ctx,
+                        const FFmpegVideoConfig *video_config); // 打开视频编码器
+void *run_stream(void *arg);                    // 一路源的推流线程
+void collect_metrics(void *opaque, AVBPrint *out); // 输出各路源的指标
+const char *stream_input_name(const Stream *s); // 日志和指标中的源名称
 
 // 主函数
 int main(int argc, char **argv)
@@ -35,106 +107,250 @@ int main(int argc, char **argv)
     // 读取命令行参数
     AppOptions opts = read_params(argc, argv);
 
-    // 检查视频编码器是否可用
-    if (!avcodec_find_encoder_by_name(opts.video_encoder)) {
-        printf("[ERROR] codec '%s' not found\n", opts.video_encoder);
-        return 1;
+    // 每行一个NDI源时，命令行参数作为各行的默认值
+    Stream *streams = calloc(MAX_SOURCES, sizeof(Stream));
+    int nb_streams = 1;
+    if (strlen(opts.sources_file)) {
+        nb_streams = read_sources(opts.sources_file, &opts, streams,
+                                  MAX_SOURCES);
+        if (nb_streams <= 0) {
+            free(streams);
+            return 1;
+        }
     }
-    // 检查音频编码器是否可用
-    if (!avcodec_find_encoder_by_name(opts.audio_encoder)) {
-        printf("[ERROR] codec '%s' not found\n", opts.audio_encoder);
-        return 1;
+    else {
+        streams[0].opts = opts;
+    }
+
+    for (int i = 0; i < nb_streams; ++i) {
+        // 检查视频编码器是否可用
+        if (!avcodec_find_encoder_by_name(streams[i].opts.video_encoder)) {
+            printf("[ERROR] codec '%s' not found\n",
+                   streams[i].opts.video_encoder);
+            free(streams);
+            return 1;
+        }
+        // 检查音频编码器是否可用
+        if (!avcodec_find_encoder_by_name(streams[i].opts.audio_encoder)) {
+            printf("[ERROR] codec '%s' not found\n",
+                   streams[i].opts.audio_encoder);
+            free(streams);
+            return 1;
+        }
     }
 
     // 初始化NDI库
     if (!NDIlib_initialize()) {
         printf("[ERROR] Unable to initialize NDI library");
+        free(streams);
         return 1;
     }
 
-    NDIlib_source_t source = {};  // NDI源
-
-    // 如果没有指定NDI输入地址，则查找可用的NDI源
-    if (!strlen(opts.ndi_input_addr)) {
-        find_ndi_source(&source);
+    // 如果没有指定NDI输入地址，则查找可用的NDI源(仅限单路源，回放时不需要)
+    if (nb_streams == 1 && !strlen(streams[0].opts.ndi_input_addr)
+        && !strlen(streams[0].opts.replay_file)) {
+        find_ndi_source(&streams[0].source);
     }
     else {
-        source.p_url_address = opts.ndi_input_addr;
+        for (int i = 0; i < nb_streams; ++i) {
+            streams[i].source.p_url_address = streams[i].opts.ndi_input_addr;
+        }
     }
 
-    // 创建NDI接收器配置
-    NDIlib_recv_create_v3_t recv_create_desc = {
-        .source_to_connect_to = source,  // 要连接的NDI源
-        .p_ndi_recv_name = "ndi-streamer",  // 接收器名称
-        .bandwidth = NDIlib_recv_bandwidth_lowest,  // 带宽设置
-    };
+    // 所有源的视频转换和清晰度阶梯的缩放(swscale上下文固定为单线程、
+    // 按分片并行)共用一个按CPU核数确定的分片线程池。编码器(x264等)使用
+    // 自己的线程，无法交给外部线程池，多路源时按源数均分CPU核数，避免
+    // 超额占用CPU。各阶段线程只在队列之间传递帧并等待分片完成，不做
+    // 重计算
+    int nb_cpus = av_cpu_count();
+    SlicePool *slice_pool = new_slice_pool(nb_cpus);
+    for (int i = 0; i < nb_streams; ++i) {
+        Stream *s = &streams[i];
+        s->slice_pool = slice_pool;
+        s->encoder_threads = s->opts.encoder_threads;
+        if (s->encoder_threads == 0 && nb_streams > 1) {
+            s->encoder_threads = FFMAX(1, nb_cpus / nb_streams);
+        }
+        if (nb_streams > 1) {
+            snprintf(s->tag, sizeof s->tag, "[%s] ", stream_input_name(s));
+        }
+    }
 
-    // 创建NDI接收器实例
-    NDIlib_recv_instance_t recv = NDIlib_recv_create_v3(&recv_create_desc);
+    for (int i = 0; i < nb_streams; ++i) {
+        mutex_init(&streams[i].pl_mu);
+    }
 
-    if (!recv) {
-        printf("[ERROR] Unable to create NDI receiver instance");
-        return 1;
+    // 指标HTTP服务，所有源共用一个端口
+    StreamSet stream_set = { streams, nb_streams };
+    MetricsServer *metrics_server = NULL;
+    if (opts.metrics_port > 0) {
+        metrics_server = new_metrics_server(opts.metrics_addr,
+                                            opts.metrics_port,
+                                            collect_metrics, &stream_set);
+        if (!metrics_server) {
+            printf("[ERROR] couldn't listen on %s:%d for metrics\n",
+                   opts.metrics_addr, opts.metrics_port);
+        }
+        else {
+            printf("[INFO] metrics at http://%s:%d/metrics\n",
+                   opts.metrics_addr, opts.metrics_port);
+        }
+    }
+
+    // 逐帧跟踪，收到SIGUSR1或退出时写出
+    if (strlen(opts.trace_file) && trace_start(opts.trace_file) < 0) {
+        printf("[ERROR] couldn't start tracing\n");
+    }
+
+    // 初始化事件处理，每路源一个推流线程
+    eh_init();
+    int nb_started = 0;
+    for (; nb_started < nb_streams; ++nb_started) {
+        if (thread_start(&streams[nb_started].thread, run_stream,
+                         &streams[nb_started])
+            != 0) {
+            printf("[ERROR] %scouldn't start stream thread\n",
+                   streams[nb_started].tag);
+            break;
+        }
+    }
+    for (int i = 0; i < nb_started; ++i) {
+        thread_join(&streams[i].thread);
+    }
+
+    // 清理资源
+    trace_stop();
+    if (metrics_server) {
+        free_metrics_server(&metrics_server);
     }
+    for (int i = 0; i < nb_streams; ++i) {
+        mutex_destroy(&streams[i].pl_mu);
+    }
+    free_slice_pool(&slice_pool);
+    free(streams);
+    NDIlib_destroy();
+    return nb_started == nb_streams ? 0 : 1;
+}
+
+// 一路NDI源的推流线程：接收、编码并写出，直到收到终止信号
+void *run_stream(void *arg)
+{
+    Stream *s = arg;
+    AppOptions *opts = &s->opts;
+    const char *tag = s->tag;
 
-    // 根据输出格式设置FFmpeg输出格式
-    char ffmpeg_output_format[30];
-    if (strcmp(opts.output_format, "rtmp") == 0) {
-        snprintf(ffmpeg_output_format, sizeof ffmpeg_output_format, "flv");
+    NdiSource *recv;
+    if (strlen(opts->replay_file)) {
+        // 回放录制文件代替NDI接收器
+        recv = new_ndi_source_replay(opts->replay_file, opts->replay_mode);
+        if (!recv) {
+            printf("[ERROR] %scouldn't replay \"%s\"\n", tag,
+                   opts->replay_file);
+            return NULL;
+        }
     }
     else {
-        snprintf(ffmpeg_output_format, sizeof ffmpeg_output_format, "%s",
-                 opts.output_format);
+        // 创建NDI接收器配置
+        NDIlib_recv_create_v3_t recv_create_desc = {
+            .source_to_connect_to = s->source,  // 要连接的NDI源
+            .p_ndi_recv_name = "ndi-streamer",  // 接收器名称
+            .bandwidth = NDIlib_recv_bandwidth_lowest,  // 带宽设置
+        };
+
+        // 创建NDI接收器实例
+        recv = new_ndi_source_recv(&recv_create_desc);
+
+        if (!recv) {
+            printf("[ERROR] %sUnable to create NDI receiver instance\n", tag);
+            return NULL;
+        }
+        if (strlen(opts->record_file)
+            && ndi_source_record(recv, opts->record_file) < 0) {
+            printf("[ERROR] %scouldn't create recording \"%s\"\n", tag,
+                   opts->record_file);
+            free_ndi_source(&recv);
+            return NULL;
+        }
     }
 
-    // 初始化FFmpeg输出和帧转换上下文
+    // 初始化FFmpeg输出，每个输出地址一个输出目标，共用同一组编码器
     FFmpegOutputCtx *fa_ctx = new_ffmpeg_output_ctx();
-    FrameConverterCtx *fc_ctx = new_frame_converter_ctx();
+    int targets_ok = 1;
+    for (int i = 0; i < opts->nb_outputs + opts->nb_renditions && targets_ok;
+         ++i) {
+        int r = i - opts->nb_outputs;  // 较低清晰度的序号，<0表示-o输出
+        const RenditionOption *ro = r >= 0 ? &opts->renditions[r] : NULL;
+        const char *output = ro ? ro->output : opts->outputs[i];
+        const char *format = output_format_for_url(output, opts->output_format);
+
+        // 设置输出选项
+        AVDictionary *output_options = NULL;
+        av_dict_set(&output_options, "max_interleave_delta", "0", 0);
 
-    // 设置输出选项
-    AVDictionary *output_options = NULL;
-    av_dict_set(&output_options, "max_interleave_delta", "0", 0);
+        // 如果是RTSP输出，设置传输协议为TCP
+        if (strcmp(format, "rtsp") == 0) {
+            av_dict_set(&output_options, "rtsp_transport", "tcp", 0);
+        }
 
-    // 如果是RTSP输出，设置传输协议为TCP
-    if (strcmp(opts.output_format, "rtsp") == 0) {
-        av_dict_set(&output_options, "rtsp_transport", "tcp", 0);
+        int ret = ffmpeg_output_add_target(fa_ctx, ro ? ro->level : 0, format,
+                                           output, output_options);
+        av_dict_free(&output_options);
+        if (ret < 0) {
+            printf("[ERROR] %s%s", tag, fa_ctx->error_str);
+            targets_ok = 0;
+        }
+    }
+    if (!targets_ok) {
+        free_ffmpeg_output_ctx(&fa_ctx);
+        free_ndi_source(&recv);
+        return NULL;
     }
 
-    // 初始化事件处理
-    eh_init();
+    // 初始化帧转换和流水线上下文
+    FrameConverterCtx *fc_ctx = new_frame_converter_ctx();
+    int convert_threads = fc_set_video_threads(fc_ctx, s->slice_pool,
+                                               opts->convert_threads);
+    PipelineCtx *pl_ctx = new_pipeline_ctx(recv, fc_ctx, fa_ctx);
+    if (!pl_ctx) {
+        printf("[ERROR] %scould not allocate the pipeline\n", tag);
+        free_ffmpeg_output_ctx(&fa_ctx);
+        free_frame_converter_ctx(&fc_ctx);
+        free_ndi_source(&recv);
+        return NULL;
+    }
+    pipeline_set_max_latency(pl_ctx, opts->max_latency_ms);
+    pipeline_set_encoder_affinity(
+            pl_ctx, opts->has_encoder_cpus ? &opts->encoder_cpus : NULL);
+    mutex_lock(&s->pl_mu);
+    s->pl_ctx = pl_ctx;
+    mutex_unlock(&s->pl_mu);
+
+    int restarting = 0;
     while (eh_alive()) {  // 主循环
-        // 如果已有输出，先关闭
-        if (fa_ctx->output != NULL) {
-            ffmpeg_output_close(fa_ctx);
-#ifdef _WIN32
-            Sleep(2000);  // Windows下等待2秒
-#else
-            sleep(2);     // Unix下等待2秒
-#endif
-        }
-
-        // 初始化FFmpeg输出
-        if (ffmpeg_output_init(fa_ctx, ffmpeg_output_format, opts.output) < 0) {
-            printf("[ERROR] %s", fa_ctx->error_str);
-            continue;
+        // 如果流水线已运行过，等待2秒后重建编码器
+        if (restarting) {
+            thread_sleep_ms(2000);
         }
+        restarting = 1;
 
         NDIlib_video_frame_v2_t v_frame;  // NDI视频帧
-        NDIlib_audio_frame_v2_t a_frame;  // NDI音频帧
 
         int width = 0, height = 0;       // 视频宽高
         AVRational frame_rate = {};      // 帧率
+        enum AVPixelFormat src_pix_fmt = AV_PIX_FMT_NONE; // 输入像素格式
+        NDIlib_FourCC_video_type_e src_fourcc = 0;        // 输入FourCC
 
         // 获取视频参数
         while (eh_alive()) {
-            if (NDIlib_recv_capture_v2(recv, &v_frame, NULL, NULL,
-                                       NDI_RECV_TIMEOUT)
+            if (ndi_source_capture(recv, &v_frame, NULL, NDI_RECV_TIMEOUT)
                 == NDIlib_frame_type_video) {
                 width = v_frame.xres;
                 height = v_frame.yres;
                 frame_rate.num = v_frame.frame_rate_N;
                 frame_rate.den = v_frame.frame_rate_D;
-                NDIlib_recv_free_video_v2(recv, &v_frame);
+                src_fourcc = v_frame.FourCC;
+                src_pix_fmt = ndi_fourcc_to_ffmpeg(v_frame.FourCC);
+                ndi_source_free_video(recv, &v_frame);
                 break;
             }
         }
@@ -143,79 +359,200 @@ int main(int argc, char **argv)
         ffmpeg_output_close_codecs(fa_ctx);
 
         // 设置视频编码参数
-        ffmpeg_output_setup_video(fa_ctx, opts.video_encoder, width, height,
-                                  frame_rate, opts.video_bitrate);
-        // 设置音频编码参数
-        ffmpeg_output_setup_audio(fa_ctx, opts.audio_encoder,
-                                  opts.audio_bitrate);
+        FFmpegVideoConfig video_config = {
+            .encoder_name = opts->video_encoder,
+            .width = width,
+            .height = height,
+            .framerate = frame_rate,
+            .bitrate = opts->video_bitrate,
+            .src_pix_fmt = src_pix_fmt,
+            .pix_fmt = strcmp(opts->video_pix_fmt, "auto") == 0
+                               ? AV_PIX_FMT_NONE
+                               : av_get_pix_fmt(opts->video_pix_fmt),
+            .colorspace = opts->video_colorspace,
+            .color_range = opts->video_color_range,
+            .threads = s->encoder_threads,
+            .thread_type = opts->encoder_thread_type,
+            .latency_mode = opts->latency_mode,
+        };
+        if (open_video_encoders(s, fa_ctx, &video_config) < 0) {
+            continue;
+        }
+
+        // 报告选定的视频转换路径
+        const AVCodecContext *video_codec_ctx = fa_ctx->video_codec_ctxs[0];
+        enum AVPixelFormat dst_pix_fmt = video_codec_ctx->pix_fmt;
+        const NdiFormatDesc *src_desc = ndi_format_desc(src_fourcc);
+        printf("[INFO] %svideo conversion: %s (%s) -> %s (%s, cpu: %s, "
+               "threads: %d)\n",
+               tag, src_desc ? src_desc->name : "unknown",
+               src_desc ? av_get_pix_fmt_name(src_desc->pix_fmt) : "none",
+               av_get_pix_fmt_name(dst_pix_fmt),
+               fc_video_conversion_path(src_fourcc, dst_pix_fmt, 1),
+               pixconv_get_funcs()->name, convert_threads);
 
-        // 写入输出头
-        if (ffmpeg_output_write_header(fa_ctx, &output_options) < 0) {
-            printf("[ERROR] %s", fa_ctx->error_str);
+        // 设置音频编码参数
+        if (ffmpeg_output_setup_audio(fa_ctx, opts->audio_encoder,
+                                      opts->audio_bitrate)
+            < 0) {
+            printf("[ERROR] %s%s", tag, fa_ctx->error_str);
             continue;
         }
 
         // 重置帧转换器
         fc_reset(fc_ctx);
 
-        // 主处理循环
-        while (eh_alive()) {
-            // 从NDI接收帧
-            NDIlib_frame_type_e res = NDIlib_recv_capture_v2(
-                    recv, &v_frame, &a_frame, NULL, NDI_RECV_TIMEOUT);
-
-            if (res == NDIlib_frame_type_video) {  // 视频帧处理
-                // 检查分辨率是否变化
-                if (width != v_frame.xres || height != v_frame.yres) {
-                    break;
-                }
+        // 启动 采集 -> 转换 -> 编码 -> 封装 流水线，直到出错、分辨率变化或收到终止信号。
+        // 各输出在自己的封装线程中连接，单个输出断开时只重连该输出
+        if (pipeline_start(pl_ctx, width, height) < 0) {
+            printf("[ERROR] %s%s\n", tag, pl_ctx->error_str);
+            continue;
+        }
+        if (pipeline_wait(pl_ctx) == PIPELINE_STATUS_ERROR) {
+            printf("[ERROR] %s%s", tag, pl_ctx->error_str);
+        }
+        pipeline_stop(pl_ctx);
+    }
 
-                // 转换NDI视频帧为AVFrame
-                AVFrame *frame = fc_ndi_video_frame_to_avframe(
-                        fc_ctx, fa_ctx->video_codec_ctx, &v_frame);
+    // 清理资源
+    mutex_lock(&s->pl_mu);
+    s->pl_ctx = NULL;
+    mutex_unlock(&s->pl_mu);
+    free_pipeline_ctx(&pl_ctx);
+    free_ffmpeg_output_ctx(&fa_ctx);
+    free_frame_converter_ctx(&fc_ctx);
+    free_ndi_source(&recv);
+    return NULL;
+}
 
-                NDIlib_recv_free_video_v2(recv, &v_frame);
+// 输出各路源的指标，在指标HTTP线程中调用。持有各路源的锁直到输出完成，
+// 期间推流线程不会释放流水线
+void collect_metrics(void *opaque, AVBPrint *out)
+{
+    StreamSet *set = opaque;
+    MetricsSource sources[MAX_SOURCES];
+    int nb_sources = 0;
 
-                // 发送视频帧到输出
-                if (ffmpeg_output_send_video_frame(fa_ctx, frame) < 0) {
-                    printf("[ERROR] %s", fa_ctx->error_str);
-                    break;
-                }
-            }
-            else if (res == NDIlib_frame_type_audio) {  // 音频帧处理
-                // 转换NDI音频帧为AVFrame
-                AVFrame *frame = fc_ndi_audio_frame_to_avframe(
-                        fc_ctx, fa_ctx->audio_codec_ctx, &a_frame);
+    for (int i = 0; i < set->nb_streams; ++i) {
+        Stream *s = &set->streams[i];
+        mutex_lock(&s->pl_mu);
+        if (s->pl_ctx) {
+            sources[nb_sources].name = s->source.p_ndi_name
+                                               ? s->source.p_ndi_name
+                                               : stream_input_name(s);
+            sources[nb_sources].pl_ctx = s->pl_ctx;
+            nb_sources++;
+        }
+    }
+    metrics_write_pipelines(out, sources, nb_sources);
+    for (int i = 0; i < set->nb_streams; ++i) {
+        mutex_unlock(&set->streams[i].pl_mu);
+    }
+}
 
-                if (!frame) {
-                    continue;
-                }
-                // 发送音频帧到输出
-                if (ffmpeg_output_send_audio_frame(fa_ctx, frame) < 0) {
-                    printf("[ERROR] %s", fa_ctx->error_str);
-                    break;
-                }
-                NDIlib_recv_free_audio_v2(recv, &a_frame);
-
-                // 处理可能的剩余音频帧
-                while ((frame = fc_ndi_audio_frame_to_avframe(
-                                fc_ctx, fa_ctx->audio_codec_ctx, NULL))
-                       != NULL) {
-                    if (ffmpeg_output_send_audio_frame(fa_ctx, frame) < 0) {
-                        printf("[ERROR] %s", fa_ctx->error_str);
-                        break;
-                    }
-                }
-            }
+// 日志和指标中的源名称：NDI输入地址，回放时为录制文件路径
+const char *stream_input_name(const Stream *s)
+{
+    return strlen(s->opts.replay_file) ? s->opts.replay_file
+                                       : s->opts.ndi_input_addr;
+}
+
+// 根据输出地址推断封装格式，无法从协议判断时使用output_format
+const char *output_format_for_url(const char *url, const char *output_format)
+{
+    if (strncmp(url, "rtmp://", 7) == 0 || strncmp(url, "rtmps://", 8) == 0) {
+        return "flv";
+    }
+    if (strncmp(url, "rtsp://", 7) == 0 || strncmp(url, "rtsps://", 8) == 0) {
+        return "rtsp";
+    }
+    return strcmp(output_format, "rtmp") == 0 ? "flv" : output_format;
+}
+
+// 打开源分辨率和各级较低清晰度的视频编码器。较低清晰度由上一级的编码器
+// 输入逐级缩小，像素格式和颜色标记与源分辨率的编码器一致。编码库内部的
+// 线程在打开编码器时创建，继承当前线程的CPU亲和性，打开之后再恢复
+int open_video_encoders(Stream *s, FFmpegOutputCtx *fa_ctx,
+                        const FFmpegVideoConfig *video_config)
+{
+    const AppOptions *opts = &s->opts;
+    const char *tag = s->tag;
+
+    ThreadCpuSet saved_cpus;
+    int pinned = opts->has_encoder_cpus
+                 && thread_get_affinity(&saved_cpus) == 0
+                 && thread_set_affinity(&opts->encoder_cpus) == 0;
+    if (opts->has_encoder_cpus && !pinned) {
+        printf("[INFO] %scouldn't set encoder CPU affinity, encoder threads "
+               "run on any CPU\n",
+               tag);
+    }
+
+    int ret = ffmpeg_output_setup_video(fa_ctx, video_config);
+    const AVCodecContext *video_codec_ctx
+            = ret >= 0 ? fa_ctx->video_codec_ctxs[0] : NULL;
+    for (int i = 0; i < opts->nb_renditions && ret >= 0; ++i) {
+        const RenditionOption *ro = &opts->renditions[i];
+        if (i > 0 && ro->level == opts->renditions[i - 1].level) {
+            continue;
+        }
+
+        int height = video_config->height;
+        int r_height = FFMIN(ro->height, height) & ~1;
+        FFmpegVideoConfig rendition_config = *video_config;
+        rendition_config.width
+                = (int)av_rescale(video_config->width, r_height, height) & ~1;
+        rendition_config.height = r_height;
+        rendition_config.bitrate = ro->bitrate;
+        rendition_config.src_pix_fmt = video_codec_ctx->pix_fmt;
+        rendition_config.pix_fmt = video_codec_ctx->pix_fmt;
+        rendition_config.colorspace = video_codec_ctx->colorspace;
+        rendition_config.color_range = video_codec_ctx->color_range;
+        ret = ffmpeg_output_setup_video(fa_ctx, &rendition_config);
+        if (ret >= 0) {
+            printf("[INFO] %srendition %d: %dx%d, %d bps\n", tag, ro->level,
+                   rendition_config.width, rendition_config.height,
+                   ro->bitrate);
         }
     }
 
-    // 清理资源
-    av_dict_free(&output_options);
-    free_ffmpeg_output_ctx(&fa_ctx);
-    free_frame_converter_ctx(&fc_ctx);
-    NDIlib_recv_destroy(recv);
-    NDIlib_destroy();
+    if (pinned) {
+        thread_set_affinity(&saved_cpus);
+    }
+    if (ret < 0) {
+        printf("[ERROR] %s%s", tag, fa_ctx->error_str);
+        return ret;
+    }
+
+    // 报告编码线程设置和每个编码器预计的编码延迟
+    char threads[16] = "auto";
+    if (video_config->threads > 0) {
+        snprintf(threads, sizeof threads, "%d", video_config->threads);
+    }
+    printf("[INFO] %svideo encoder threads: %s (%s), cpus: %s\n", tag,
+           threads,
+           opts->encoder_thread_type == FF_THREAD_SLICE   ? "slice"
+           : opts->encoder_thread_type == FF_THREAD_FRAME ? "frame"
+                                                          : "auto",
+           pinned ? opts->encoder_cpus_str : "any");
+    for (int i = 0; i < fa_ctx->nb_renditions; ++i) {
+        int delay = fa_ctx->video_delays[i];
+        if (delay < 0) {
+            printf("[INFO] %srendition %d encoder delay: unknown (encoder "
+                   "defaults)\n",
+                   tag, i);
+        }
+        else if (video_config->framerate.num > 0) {
+            printf("[INFO] %srendition %d encoder delay: %d frame(s), "
+                   "%.1f ms\n",
+                   tag, i, delay,
+                   delay * 1000.0 / av_q2d(video_config->framerate));
+        }
+        else {
+            printf("[INFO] %srendition %d encoder delay: %d frame(s)\n", tag,
+                   i, delay);
+        }
+    }
     return 0;
 }
 
@@ -300,7 +637,9 @@ const ProgramOption options[] = {
       0 },
     { "f,output_format", "rtsp, rtmp (optional, by default 'rtsp')", 0 },
     { "o,output",
-      "output url (optional, by default 'rtsp://127.0.0.1:8554/live.sdp')", 0 },
+      "output url, repeat to stream one encode to several outputs (optional, "
+      "by default 'rtsp://127.0.0.1:8554/live.sdp')",
+      0 },
     { "v,video_codec", "ffmpeg video encoder (optional, by default 'libvpx')",
       0 },
     { "a,audio_codec", "ffmpeg audio encoder (optional, by default 'libopus')",
@@ -308,6 +647,73 @@ const ProgramOption options[] = {
     { "h,help", "show help", 1 },
     { "video_bitrate", "video bitrate (optional, by default '30000000')", 0 },
     { "audio_bitrate", "audio bitrate (optional, by default '320000')", 0 },
+    { "video_pix_fmt",
+      "encoder pixel format, or 'auto' to pick the cheapest one supported "
+      "by the encoder for the NDI source (optional, by default 'auto')",
+      0 },
+    { "video_colorspace",
+      "auto, bt601, bt709 (optional, by default 'auto': bt709 for 720p and "
+      "above)",
+      0 },
+    { "video_range", "limited, full (optional, by default 'limited')", 0 },
+    { "rendition",
+      "HEIGHT:BITRATE:URL, also encode a lower resolution scaled down from "
+      "the next higher one and send it to URL; repeat for more renditions "
+      "(optional)",
+      0 },
+    { "latency_mode",
+      "normal, low (no B-frames or lookahead), ultra (zero-latency tuning, "
+      "intra refresh, one-frame VBV) (optional, by default 'normal')",
+      0 },
+    { "encoder_threads",
+      "threads per video encoder, 0 for the encoder's default (optional, by "
+      "default '0', or cores / sources with several sources)",
+      0 },
+    { "encoder_thread_type",
+      "auto, slice (no added delay), frame (one frame of delay per thread) "
+      "(optional, by default 'auto')",
+      0 },
+    { "encoder_cpus",
+      "pin video encoder threads to these CPUs, e.g. '0-3,8' (optional, "
+      "Linux and Windows)",
+      0 },
+    { "sources",
+      "file with one NDI source per line, each line holding that source's "
+      "-n, -o and other options; the command line gives the defaults "
+      "(optional)",
+      0 },
+    { "convert_threads",
+      "video conversion threads, 0 for one per core up to 4 (optional, by "
+      "default '0')",
+      0 },
+    { "max_latency_ms",
+      "drop frames that are older than this many milliseconds, 0 to "
+      "disable (optional, by default '0')",
+      0 },
+    { "metrics_port",
+      "serve Prometheus metrics at http://ADDR:PORT/metrics, 0 to disable "
+      "(optional, by default '0')",
+      0 },
+    { "metrics_addr",
+      "IPv4 address for the metrics listener (optional, by default "
+      "'127.0.0.1')",
+      0 },
+    { "trace_file",
+      "record capture, convert, encode and write spans of each frame and "
+      "write them as Chrome trace JSON on SIGUSR1 and at exit (optional)",
+      0 },
+    { "record_file",
+      "also write every raw frame received from the NDI source to this file "
+      "for --replay_file (optional)",
+      0 },
+    { "replay_file",
+      "stream a file written with --record_file instead of an NDI source, "
+      "looping at the end (optional)",
+      0 },
+    { "replay_mode",
+      "realtime (recorded timing and jitter), fast (no waiting, for "
+      "throughput tests) (optional, by default 'realtime')",
+      0 },
     { NULL, NULL, 0 },
 };
 
@@ -315,21 +721,90 @@ const ProgramOption options[] = {
 AppOptions read_params(int argc, char **argv)
 {
     AppOptions res = {};
-    const ProgramOption *opt = NULL;
-
-    // 初始化选项解析器
-    OptionParserCtx *op_ctx = op_init(options);
-    int c;
-    char *end;
 
     // 设置默认值
     sprintf(res.audio_encoder, "libopus");
     sprintf(res.video_encoder, "h264_videotoolbox");
     sprintf(res.output_format, "rtsp");
-    sprintf(res.output, "rtsp://127.0.0.1:8554/live.sdp");
+    sprintf(res.video_pix_fmt, "auto");
+    sprintf(res.metrics_addr, "127.0.0.1");
+    res.video_colorspace = AVCOL_SPC_UNSPECIFIED;
+    res.video_color_range = AVCOL_RANGE_MPEG;
     res.video_bitrate = 30000000;
     res.audio_bitrate = 320000;
 
+    parse_params(argc, argv, &res);
+    finish_params(&res);
+    return res;
+}
+
+// 从文件读取多个NDI源：每行是一个源的参数(与命令行写法相同，必须包含
+// -n或--replay_file，以及-o)，空行和以#开头的行被忽略；命令行上的其他参数作为每行的默认值
+int read_sources(const char *path, const AppOptions *base, Stream *streams,
+                 int max_streams)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("[ERROR] couldn't open sources file \"%s\"\n", path);
+        return -1;
+    }
+
+    char line[4096];
+    int nb_streams = 0;
+    for (int line_no = 1; fgets(line, sizeof line, f); ++line_no) {
+        char *argv[SOURCE_MAX_ARGS + 1] = { "ndi-streamer" };
+        int argc = 1;
+        for (char *arg = strtok(line, " \t\r\n");
+             arg && argc < SOURCE_MAX_ARGS; arg = strtok(NULL, " \t\r\n")) {
+            argv[argc++] = arg;
+        }
+        if (argc == 1 || argv[1][0] == '#') {
+            continue;
+        }
+        if (nb_streams >= max_streams) {
+            printf("[ERROR] too many sources (at most %d)\n", max_streams);
+            fclose(f);
+            return -1;
+        }
+
+        AppOptions *res = &streams[nb_streams++].opts;
+        *res = *base;
+        res->ndi_input_addr[0] = '\0';
+        res->record_file[0] = '\0';
+        res->replay_file[0] = '\0';
+        res->sources_file[0] = '\0';
+        res->nb_outputs = 0;
+        res->nb_renditions = 0;
+        parse_params(argc, argv, res);
+        if ((!strlen(res->ndi_input_addr) && !strlen(res->replay_file))
+            || res->nb_outputs == 0) {
+            printf("[ERROR] %s:%d: each source needs -n (or --replay_file) "
+                   "and -o\n",
+                   path, line_no);
+            fclose(f);
+            return -1;
+        }
+        finish_params(res);
+    }
+    fclose(f);
+
+    if (nb_streams == 0) {
+        printf("[ERROR] no sources in \"%s\"\n", path);
+    }
+    return nb_streams;
+}
+
+// 解析参数，覆盖out中已有的值
+void parse_params(int argc, char **argv, AppOptions *out)
+{
+    AppOptions res = *out;
+    const ProgramOption *opt = NULL;
+
+    // 初始化选项解析器
+    OptionParserCtx *op_ctx = op_init(options);
+    int c;
+    char *end;
+
     // 解析命令行参数
     for (; (c = op_parse(argc, argv, op_ctx, &opt)) != -1;) {
         switch (c) {
@@ -345,8 +820,16 @@ AppOptions read_params(int argc, char **argv)
             }
             snprintf(res.output_format, sizeof res.output_format, "%s", optarg);
             break;
-        case 'o':  // 输出地址
-            snprintf(res.output, sizeof res.output, "%s", optarg);
+        case 'o':  // 输出地址，可重复指定
+            if (res.nb_outputs >= FFMPEG_OUTPUT_MAX_TARGETS) {
+                printf("too many outputs (at most %d)\n",
+                       FFMPEG_OUTPUT_MAX_TARGETS);
+                op_free(&op_ctx);
+                exit(0);
+            }
+            snprintf(res.outputs[res.nb_outputs], sizeof res.outputs[0], "%s",
+                     optarg);
+            res.nb_outputs++;
             break;
         case 'v':  // 视频编码器
             snprintf(res.video_encoder, sizeof res.video_encoder, "%s", optarg);
@@ -373,6 +856,174 @@ AppOptions read_params(int argc, char **argv)
                     res.video_bitrate = (int)si;
                 }
             }
+            else if (strcmp(opt->name, "video_pix_fmt") == 0) {  // 视频编码像素格式
+                if (strcmp(optarg, "auto") != 0
+                    && av_get_pix_fmt(optarg) == AV_PIX_FMT_NONE) {
+                    printf("unknown pixel format \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                snprintf(res.video_pix_fmt, sizeof res.video_pix_fmt, "%s",
+                         optarg);
+            }
+            else if (strcmp(opt->name, "video_colorspace") == 0) {  // YUV矩阵
+                if (strcmp(optarg, "auto") == 0) {
+                    res.video_colorspace = AVCOL_SPC_UNSPECIFIED;
+                }
+                else if (strcmp(optarg, "bt601") == 0) {
+                    res.video_colorspace = AVCOL_SPC_SMPTE170M;
+                }
+                else if (strcmp(optarg, "bt709") == 0) {
+                    res.video_colorspace = AVCOL_SPC_BT709;
+                }
+                else {
+                    printf("unknown colorspace \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+            }
+            else if (strcmp(opt->name, "video_range") == 0) {  // YUV范围
+                if (strcmp(optarg, "limited") == 0) {
+                    res.video_color_range = AVCOL_RANGE_MPEG;
+                }
+                else if (strcmp(optarg, "full") == 0) {
+                    res.video_color_range = AVCOL_RANGE_JPEG;
+                }
+                else {
+                    printf("unknown color range \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+            }
+            else if (strcmp(opt->name, "rendition") == 0) {  // 较低清晰度
+                long h = strtol(optarg, &end, 10);
+                long br = h > 0 && *end == ':' ? strtol(end + 1, &end, 10) : 0;
+                if (br <= 0 || *end != ':' || end[1] == '\0'
+                    || res.nb_renditions >= FFMPEG_OUTPUT_MAX_TARGETS) {
+                    printf("couldn't parse rendition \"%s\", expected "
+                           "HEIGHT:BITRATE:URL\n",
+                           optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                RenditionOption *ro = &res.renditions[res.nb_renditions++];
+                ro->height = (int)h;
+                ro->bitrate = (int)br;
+                snprintf(ro->output, sizeof ro->output, "%s", end + 1);
+            }
+            else if (strcmp(opt->name, "latency_mode") == 0) {  // 编码延迟模式
+                if (strcmp(optarg, "normal") == 0) {
+                    res.latency_mode = FFMPEG_LATENCY_NORMAL;
+                }
+                else if (strcmp(optarg, "low") == 0) {
+                    res.latency_mode = FFMPEG_LATENCY_LOW;
+                }
+                else if (strcmp(optarg, "ultra") == 0) {
+                    res.latency_mode = FFMPEG_LATENCY_ULTRA;
+                }
+                else {
+                    printf("unknown latency mode \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+            }
+            else if (strcmp(opt->name, "encoder_threads") == 0) {  // 编码线程数
+                long si = strtol(optarg, &end, 10);
+                if (end == optarg || si < 0) {
+                    printf("couldn't convert \"%s\" to thread count\n",
+                           optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                res.encoder_threads = (int)si;
+            }
+            else if (strcmp(opt->name, "encoder_thread_type") == 0) {  // 编码并行方式
+                if (strcmp(optarg, "auto") == 0) {
+                    res.encoder_thread_type = 0;
+                }
+                else if (strcmp(optarg, "slice") == 0) {
+                    res.encoder_thread_type = FF_THREAD_SLICE;
+                }
+                else if (strcmp(optarg, "frame") == 0) {
+                    res.encoder_thread_type = FF_THREAD_FRAME;
+                }
+                else {
+                    printf("unknown thread type \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+            }
+            else if (strcmp(opt->name, "encoder_cpus") == 0) {  // 编码线程CPU亲和性
+                if (thread_cpu_set_parse(&res.encoder_cpus, optarg) < 0) {
+                    printf("couldn't parse cpu list \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                snprintf(res.encoder_cpus_str, sizeof res.encoder_cpus_str,
+                         "%s", optarg);
+                res.has_encoder_cpus = 1;
+            }
+            else if (strcmp(opt->name, "sources") == 0) {  // 多个NDI源
+                snprintf(res.sources_file, sizeof res.sources_file, "%s",
+                         optarg);
+            }
+            else if (strcmp(opt->name, "convert_threads") == 0) {  // 视频转换线程数
+                long si = strtol(optarg, &end, 10);
+                if (end == optarg || si < 0) {
+                    printf("couldn't convert \"%s\" to thread count\n",
+                           optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                res.convert_threads = (int)si;
+            }
+            else if (strcmp(opt->name, "max_latency_ms") == 0) {  // 延迟上限
+                long si = strtol(optarg, &end, 10);
+                if (end == optarg || si < 0) {
+                    printf("couldn't convert \"%s\" to milliseconds\n",
+                           optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                res.max_latency_ms = (int)si;
+            }
+            else if (strcmp(opt->name, "metrics_port") == 0) {  // 指标端口
+                long si = strtol(optarg, &end, 10);
+                if (end == optarg || si < 0 || si > 65535) {
+                    printf("couldn't convert \"%s\" to port\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+                res.metrics_port = (int)si;
+            }
+            else if (strcmp(opt->name, "trace_file") == 0) {  // 跟踪文件
+                snprintf(res.trace_file, sizeof res.trace_file, "%s", optarg);
+            }
+            else if (strcmp(opt->name, "record_file") == 0) {  // 录制文件
+                snprintf(res.record_file, sizeof res.record_file, "%s",
+                         optarg);
+            }
+            else if (strcmp(opt->name, "replay_file") == 0) {  // 回放文件
+                snprintf(res.replay_file, sizeof res.replay_file, "%s",
+                         optarg);
+            }
+            else if (strcmp(opt->name, "replay_mode") == 0) {  // 回放方式
+                if (strcmp(optarg, "realtime") == 0) {
+                    res.replay_mode = NDI_REPLAY_REALTIME;
+                }
+                else if (strcmp(optarg, "fast") == 0) {
+                    res.replay_mode = NDI_REPLAY_FAST;
+                }
+                else {
+                    printf("unknown replay mode \"%s\"\n", optarg);
+                    op_free(&op_ctx);
+                    exit(0);
+                }
+            }
+            else if (strcmp(opt->name, "metrics_addr") == 0) {  // 指标监听地址
+                snprintf(res.metrics_addr, sizeof res.metrics_addr, "%s",
+                         optarg);
+            }
             else if (strcmp(opt->name, "audio_bitrate") == 0) {  // 音频比特率
                 long si = strtol(optarg, &end, 10);
                 if (end == optarg) {
@@ -388,6 +1039,45 @@ AppOptions read_params(int argc, char **argv)
         }
     }
     op_free(&op_ctx);
+    *out = res;
+}
 
-    return res;
+// 补全默认输出地址，并按高度整理较低清晰度
+void finish_params(AppOptions *out)
+{
+    AppOptions res = *out;
+    if (res.nb_outputs == 0) {
+        sprintf(res.outputs[0], "rtsp://127.0.0.1:8554/live.sdp");
+        res.nb_outputs = 1;
+    }
+
+    // 清晰度按高度从高到低排列，每级由上一级缩小；高度相同时再按比特率
+    // 从高到低排列，使高度和比特率都相同的输出相邻并共用一个编码器
+    for (int i = 1; i < res.nb_renditions; ++i) {
+        RenditionOption ro = res.renditions[i];
+        int j = i;
+        for (; j > 0; --j) {
+            const RenditionOption *prev = &res.renditions[j - 1];
+            if (prev->height > ro.height
+                || (prev->height == ro.height && prev->bitrate >= ro.bitrate)) {
+                break;
+            }
+            res.renditions[j] = res.renditions[j - 1];
+        }
+        res.renditions[j] = ro;
+    }
+    for (int i = 0; i < res.nb_renditions; ++i) {
+        RenditionOption *ro = &res.renditions[i];
+        const RenditionOption *prev = i > 0 ? &res.renditions[i - 1] : NULL;
+        ro->level = prev && prev->height == ro->height
+                                    && prev->bitrate == ro->bitrate
+                            ? prev->level
+                            : (prev ? prev->level : 0) + 1;
+        if (ro->level >= FFMPEG_OUTPUT_MAX_RENDITIONS) {
+            printf("too many renditions (at most %d)\n",
+                   FFMPEG_OUTPUT_MAX_RENDITIONS - 1);
+            exit(0);
+        }
+    }
+    *out = res;
 }
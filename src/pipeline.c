@@ -0,0 +1,1479 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ndi_frame.h"
+#include "probes.h"
+#include "trace.h"
+#include "util.h"
+
+#define PIPELINE_CAPTURE_TIMEOUT 100     // NDI采集超时(毫秒)，用于及时响应停止请求
+#define PIPELINE_WAIT_TIMEOUT 100        // 队列等待超时(毫秒)
+#define PIPELINE_VIDEO_CAPTURE_QUEUE_SIZE 4   // 视频采集 -> 视频转换 队列容量
+#define PIPELINE_VIDEO_FRAME_QUEUE_SIZE 4     // 视频转换 -> 视频编码 队列容量
+#define PIPELINE_AUDIO_CAPTURE_QUEUE_SIZE 32  // 音频采集 -> 音频编码 队列容量
+#define PIPELINE_PACKET_QUEUE_SIZE 256        // 编码 -> 封装 队列容量(数据包)
+#define PIPELINE_ALLOC_WARMUP_FRAMES 120      // 缓冲池和回收队列填满所需的预热帧数
+#define PIPELINE_MUX_BYTE_BUDGET (16 * 1024 * 1024) // 每路输出待写出数据包的字节上限
+#define PIPELINE_OUTPUT_RETRY_INTERVAL 2000 // 输出连接失败或断开后的重连间隔(毫秒)
+#define PIPELINE_NDI_MAX_QUEUED_VIDEO 1  // NDI接收队列中允许积压的视频帧数
+#define PIPELINE_NDI_STATS_INTERVAL 1000000 // NDI接收器统计刷新间隔(微秒)
+
+static int
+pipeline_running(PipelineCtx *ctx)
+{
+    return atomic_load(&ctx->status) == PIPELINE_STATUS_RUNNING;
+}
+
+// 判断pts(编码器时间基，即微秒)对应的帧或数据包是否已超过延迟上限。
+// 视频pts按采集时间生成；音频pts按样本数递增，偏离采集时间超过一帧时
+// 重新对齐，两者都相对转换器的起始时间
+static int
+pipeline_is_stale(PipelineCtx *ctx, int64_t pts)
+{
+    return ctx->max_latency_us > 0 && pts != AV_NOPTS_VALUE
+           && get_current_ts_usec() - ctx->fc_ctx->start_ts - pts
+                      > ctx->max_latency_us;
+}
+
+// @param pts 被丢弃的帧或数据包的pts，尚未转换的帧为AV_NOPTS_VALUE
+// @param size 字节数，仅用于探针，未知时为0
+static void
+pipeline_count_drop(PipelineCtx *ctx, enum PipelineDropReason reason,
+                    int64_t pts, int size)
+{
+    atomic_fetch_add(&ctx->drops[reason], 1);
+    PROBE_FRAME_DROPPED(reason, pts, size);
+}
+
+// 由所属线程累加计数器。只有一个写入者，普通的读取+写入即可，
+// 不需要带锁前缀的原子加法
+static void
+pipeline_counters_add(PipelineCounters *c, int64_t count, int64_t bytes,
+                      int64_t time_us)
+{
+    atomic_store_explicit(
+            &c->count,
+            atomic_load_explicit(&c->count, memory_order_relaxed) + count,
+            memory_order_relaxed);
+    atomic_store_explicit(
+            &c->bytes,
+            atomic_load_explicit(&c->bytes, memory_order_relaxed) + bytes,
+            memory_order_relaxed);
+    atomic_store_explicit(
+            &c->time_us,
+            atomic_load_explicit(&c->time_us, memory_order_relaxed) + time_us,
+            memory_order_relaxed);
+    if (time_us > atomic_load_explicit(&c->time_max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&c->time_max_us, time_us, memory_order_relaxed);
+    }
+}
+
+static void
+pipeline_counters_reset(PipelineCounters *c)
+{
+    atomic_store(&c->count, 0);
+    atomic_store(&c->bytes, 0);
+    atomic_store(&c->time_us, 0);
+    atomic_store(&c->time_max_us, 0);
+    atomic_store(&c->level, 0);
+}
+
+// 随视频帧经过各级编码器传递的时间戳(微秒)，挂在AVFrame.opaque_ref上，
+// 编码器设置了AV_CODEC_FLAG_COPY_OPAQUE时由数据包带出。各级清晰度引用
+// 同一份，每级只写自己的槽位
+typedef struct PipelineFrameTiming {
+    int64_t capture_ts;                              // 从NDI取出
+    int64_t convert_ts;                              // 转换完成
+    int64_t submit_ts[FFMPEG_OUTPUT_MAX_RENDITIONS]; // 送入各级编码器
+    int64_t packet_ts[FFMPEG_OUTPUT_MAX_RENDITIONS]; // 从各级编码器取出
+} PipelineFrameTiming;
+
+// 音频采集队列中的元素：NDI音频帧描述和取出时的本地时间，后者用于把
+// 音频pts与视频对齐
+typedef struct PipelineAudioItem {
+    NDIlib_audio_frame_v2_t frame;
+    int64_t capture_ts;
+} PipelineAudioItem;
+
+static PipelineFrameTiming *
+pipeline_timing(AVBufferRef *opaque_ref)
+{
+    return opaque_ref ? (PipelineFrameTiming *)opaque_ref->data : NULL;
+}
+
+// 记录帧送入第rendition级编码器的时间
+static void
+pipeline_mark_submit(PipelineCtx *ctx, const AVFrame *frame, int rendition)
+{
+    PipelineFrameTiming *timing = pipeline_timing(frame->opaque_ref);
+    if (!timing) {
+        return;
+    }
+    int64_t now = get_current_ts_usec();
+    timing->submit_ts[rendition] = now;
+    if (rendition == 0) {
+        latency_hist_record(&ctx->latency[PIPELINE_LATENCY_ENCODE_WAIT],
+                            now - timing->convert_ts);
+    }
+}
+
+// 记录数据包从第rendition级编码器取出的时间
+static void
+pipeline_mark_packet(PipelineCtx *ctx, const AVPacket *pkt, int rendition)
+{
+    PipelineFrameTiming *timing = pipeline_timing(pkt->opaque_ref);
+    if (!timing) {
+        return;
+    }
+    int64_t now = get_current_ts_usec();
+    timing->packet_ts[rendition] = now;
+    latency_hist_record(&ctx->latency[PIPELINE_LATENCY_ENCODE],
+                        now - timing->submit_ts[rendition]);
+}
+
+// 唤醒一路输出的封装线程
+static void
+pipeline_notify_mux(PipelineOutput *out)
+{
+    if (atomic_load(&out->mux_waiting)) {
+        mutex_lock(&out->mux_mu);
+        cond_broadcast(&out->mux_cv);
+        mutex_unlock(&out->mux_mu);
+    }
+}
+
+// 唤醒所有在队列上等待的阶段线程
+static void
+pipeline_wake_all(PipelineCtx *ctx)
+{
+    spsc_queue_wake(ctx->video_capture_queue);
+    spsc_queue_wake(ctx->video_frame_queue);
+    spsc_queue_wake(ctx->audio_capture_queue);
+
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineOutput *out = &ctx->outputs[i];
+        spsc_queue_wake(out->video_packet_queue);
+        spsc_queue_wake(out->audio_packet_queue);
+        mutex_lock(&out->mux_mu);
+        cond_broadcast(&out->mux_cv);
+        mutex_unlock(&out->mux_mu);
+    }
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        spsc_queue_wake(ctx->renditions[i].frame_queue);
+    }
+}
+
+// 设置停止原因，只有第一个原因生效
+static void
+pipeline_set_status(PipelineCtx *ctx, int status, const char *error_str)
+{
+    int expected = PIPELINE_STATUS_RUNNING;
+    if (atomic_compare_exchange_strong(&ctx->status, &expected, status)) {
+        if (error_str) {
+            snprintf(ctx->error_str, AV_ERROR_MAX_STRING_SIZE + 100, "%s",
+                     error_str);
+        }
+        pipeline_wake_all(ctx);
+    }
+}
+
+static void
+pipeline_free_audio(PipelineCtx *ctx, PipelineAudioItem *item)
+{
+    ndi_source_free_audio(ctx->source, &item->frame);
+    free(item);
+}
+
+// 归还NDI音频数据，描述结构交还采集线程复用
+static void
+pipeline_recycle_audio(PipelineCtx *ctx, PipelineAudioItem *item)
+{
+    ndi_source_free_audio(ctx->source, &item->frame);
+    if (spsc_queue_push(ctx->audio_capture_recycle, item) < 0) {
+        free(item);
+    }
+}
+
+// 从回收队列取一个帧外壳，队列为空时才新分配
+static AVFrame *
+pipeline_get_frame(SpscQueue *recycle)
+{
+    AVFrame *frame = spsc_queue_pop(recycle);
+    if (!frame) {
+        frame = av_frame_alloc();
+    }
+    return frame;
+}
+
+// 释放帧引用并把外壳放回回收队列
+static void
+pipeline_put_frame(SpscQueue *recycle, AVFrame *frame)
+{
+    av_frame_unref(frame);
+    if (spsc_queue_push(recycle, frame) < 0) {
+        av_frame_free(&frame);
+    }
+}
+
+// 从回收队列取一个数据包外壳，队列为空时才新分配
+static AVPacket *
+pipeline_get_packet(SpscQueue *recycle)
+{
+    AVPacket *pkt = spsc_queue_pop(recycle);
+    if (!pkt) {
+        pkt = av_packet_alloc();
+    }
+    return pkt;
+}
+
+// 释放数据包引用并把外壳放回回收队列
+static void
+pipeline_put_packet(SpscQueue *recycle, AVPacket *pkt)
+{
+    av_packet_unref(pkt);
+    if (spsc_queue_push(recycle, pkt) < 0) {
+        av_packet_free(&pkt);
+    }
+}
+
+// 刷新NDI接收队列深度和NDI报告的丢帧数
+static void
+pipeline_update_ndi_stats(PipelineCtx *ctx, const NDIlib_recv_queue_t *queue)
+{
+    NDIlib_recv_performance_t total, dropped;
+    ndi_source_get_performance(ctx->source, &total, &dropped);
+
+    atomic_store(&ctx->ndi_received_video, total.video_frames);
+    atomic_store(&ctx->ndi_received_audio, total.audio_frames);
+    atomic_store(&ctx->ndi_queued_video, queue->video_frames);
+    atomic_store(&ctx->ndi_queued_audio, queue->audio_frames);
+    atomic_store(&ctx->ndi_dropped_video, dropped.video_frames);
+    atomic_store(&ctx->ndi_dropped_audio, dropped.audio_frames);
+}
+
+// NDI接收队列中积压的视频帧超过PIPELINE_NDI_MAX_QUEUED_VIDEO时，
+// 直接取出下一帧并丢弃手中的旧帧，直到积压消除。旧帧不做转换
+// 也不包装，返回时v_frame是已取到的最新一帧
+static void
+pipeline_skip_to_newest_video(PipelineCtx *ctx,
+                              NDIlib_video_frame_v2_t *v_frame,
+                              NDIlib_recv_queue_t *queue)
+{
+    NDIlib_video_frame_v2_t next;
+
+    for (;;) {
+        ndi_source_get_queue(ctx->source, queue);
+        if (queue->video_frames <= PIPELINE_NDI_MAX_QUEUED_VIDEO) {
+            return;
+        }
+        if (ndi_source_capture(ctx->source, &next, NULL, 0)
+            != NDIlib_frame_type_video) {
+            return;
+        }
+        ndi_source_free_video(ctx->source, v_frame);
+        *v_frame = next;
+        pipeline_count_drop(ctx, PIPELINE_DROP_NDI_BACKLOG, AV_NOPTS_VALUE, 0);
+    }
+}
+
+// 视频采集阶段：只负责从NDI取帧并入队，队列满时丢弃视频帧而不是阻塞
+// (尽快回放时等待)。入队的是引用计数包装后的NDI帧，NDI缓冲区在最后一个
+// 引用释放时才归还
+static void *
+pipeline_video_capture_thread(void *arg)
+{
+    PipelineCtx *ctx = arg;
+    NDIlib_video_frame_v2_t v_frame;
+    NDIlib_recv_queue_t queue;
+    int64_t stats_ts = 0;
+
+    trace_thread_name("video capture");
+    while (pipeline_running(ctx)) {
+        int64_t trace_ts = trace_begin();
+        if (ndi_source_capture(ctx->source, &v_frame, NULL,
+                               PIPELINE_CAPTURE_TIMEOUT)
+            != NDIlib_frame_type_video) {
+            continue;
+        }
+        trace_end("NDIlib_recv_capture_v2", "video", trace_ts,
+                  AV_NOPTS_VALUE, -1);
+
+        // 本线程上一轮处理得慢时，NDI中已经排着更新的帧
+        pipeline_skip_to_newest_video(ctx, &v_frame, &queue);
+
+        int64_t now = get_current_ts_usec();
+        if (now - stats_ts >= PIPELINE_NDI_STATS_INTERVAL) {
+            pipeline_update_ndi_stats(ctx, &queue);
+            stats_ts = now;
+        }
+
+        // 检查分辨率是否变化
+        if (ctx->width != v_frame.xres || ctx->height != v_frame.yres) {
+            ndi_source_free_video(ctx->source, &v_frame);
+            pipeline_set_status(ctx, PIPELINE_STATUS_FORMAT_CHANGE, NULL);
+            break;
+        }
+        pipeline_counters_add(&ctx->capture_counters, 1, 0, 0);
+
+        AVBufferRef *item = ndi_video_frame_wrap(ctx->ndi_frame_pool,
+                                                 ctx->source, &v_frame);
+        if (!item) {
+            continue;
+        }
+        PROBE_FRAME_CAPTURED(0,
+                             atomic_load_explicit(&ctx->capture_counters.count,
+                                                  memory_order_relaxed),
+                             v_frame.timestamp, item->size);
+        if (!ndi_source_is_paced(ctx->source)) {
+            // 尽快回放时输入不会过时，等待下游而不是丢帧
+            while (spsc_queue_push_wait(ctx->video_capture_queue, item,
+                                        PIPELINE_WAIT_TIMEOUT)
+                   < 0) {
+                if (!pipeline_running(ctx)) {
+                    av_buffer_unref(&item);
+                    break;
+                }
+            }
+        }
+        else if (spsc_queue_push(ctx->video_capture_queue, item) < 0) {
+            pipeline_count_drop(ctx, PIPELINE_DROP_CAPTURE_FULL,
+                                AV_NOPTS_VALUE, item->size);
+            av_buffer_unref(&item);
+        }
+    }
+    return NULL;
+}
+
+// 音频采集阶段：NDI允许按媒体类型在不同线程并发采集
+static void *
+pipeline_audio_capture_thread(void *arg)
+{
+    PipelineCtx *ctx = arg;
+    PipelineAudioItem *item = NULL;
+    int64_t seq = 0;
+
+    trace_thread_name("audio capture");
+    while (pipeline_running(ctx)) {
+        // 描述结构优先取自回收队列，丢帧时留给下一次采集
+        if (!item) {
+            item = spsc_queue_pop(ctx->audio_capture_recycle);
+        }
+        if (!item) {
+            item = malloc(sizeof(PipelineAudioItem));
+            if (!item) {
+                continue;
+            }
+        }
+
+        int64_t trace_ts = trace_begin();
+        if (ndi_source_capture(ctx->source, NULL, &item->frame,
+                               PIPELINE_CAPTURE_TIMEOUT)
+            != NDIlib_frame_type_audio) {
+            continue;
+        }
+        item->capture_ts = get_current_ts_usec();
+        trace_end("NDIlib_recv_capture_v2", "audio", trace_ts,
+                  AV_NOPTS_VALUE, -1);
+        PROBE_FRAME_CAPTURED(1, ++seq, item->frame.timestamp,
+                             item->frame.channel_stride_in_bytes
+                                     * item->frame.no_channels);
+
+        // 音频丢帧会产生可闻的断续，短暂等待后仍满才丢弃，之后的帧按采集
+        // 时间重新对齐；尽快回放时一直等待
+        int ret = spsc_queue_push_wait(ctx->audio_capture_queue, item,
+                                       PIPELINE_WAIT_TIMEOUT);
+        while (ret < 0 && !ndi_source_is_paced(ctx->source)
+               && pipeline_running(ctx)) {
+            ret = spsc_queue_push_wait(ctx->audio_capture_queue, item,
+                                       PIPELINE_WAIT_TIMEOUT);
+        }
+        if (ret < 0) {
+            pipeline_count_drop(ctx, PIPELINE_DROP_AUDIO_CAPTURE_FULL,
+                                AV_NOPTS_VALUE,
+                                item->frame.channel_stride_in_bytes
+                                        * item->frame.no_channels);
+            ndi_source_free_audio(ctx->source, &item->frame);
+            continue;
+        }
+        item = NULL;
+    }
+    free(item);
+    return NULL;
+}
+
+// 视频转换阶段：NDI帧 -> AVFrame，转换器内部帧的引用被移动到新帧中再转交编码阶段
+static void *
+pipeline_video_convert_thread(void *arg)
+{
+    PipelineCtx *ctx = arg;
+
+    trace_thread_name("video convert");
+    while (pipeline_running(ctx)) {
+        AVBufferRef *item = spsc_queue_pop_wait(ctx->video_capture_queue,
+                                                PIPELINE_WAIT_TIMEOUT);
+        if (!item) {
+            continue;
+        }
+
+        // 已超过延迟上限的帧不值得转换
+        if (ctx->max_latency_us > 0
+            && get_current_ts_usec() - ndi_video_frame_capture_ts(item)
+                       > ctx->max_latency_us) {
+            pipeline_count_drop(ctx, PIPELINE_DROP_STALE_CONVERT,
+                                AV_NOPTS_VALUE, item->size);
+            av_buffer_unref(&item);
+            continue;
+        }
+
+        int64_t capture_ts = ndi_video_frame_capture_ts(item);
+        int64_t start_ts = get_current_ts_usec();
+        int64_t trace_ts = trace_begin();
+        AVFrame *frame = fc_ndi_video_frame_to_avframe(
+                ctx->fc_ctx, ctx->fa_ctx->video_codec_ctxs[0],
+                ndi_video_frame_get(item), item);
+        av_buffer_unref(&item);
+        if (!frame) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                ctx->fc_ctx->error_str);
+            break;
+        }
+        trace_end("fc_ndi_video_frame_to_avframe", "video", trace_ts,
+                  frame->pts, -1);
+        int64_t now = get_current_ts_usec();
+
+        pipeline_counters_add(&ctx->convert_counters, 1, 0, now - start_ts);
+        PROBE_FRAME_CONVERTED(
+                atomic_load_explicit(&ctx->convert_counters.count,
+                                     memory_order_relaxed),
+                frame->pts, capture_ts, now - start_ts);
+        if (atomic_load(&ctx->convert_counters.count)
+            == PIPELINE_ALLOC_WARMUP_FRAMES) {
+            atomic_store(&ctx->alloc_baseline, alloc_counter_get());
+        }
+
+        AVFrame *out = pipeline_get_frame(ctx->video_frame_recycle);
+        if (!out) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                "could not allocate video frame");
+            break;
+        }
+        av_frame_move_ref(out, frame);
+
+        latency_hist_record(&ctx->latency[PIPELINE_LATENCY_CONVERT],
+                            now - capture_ts);
+        // 缓冲池预热后不再分配，取不到时只是不统计后续环节
+        av_buffer_unref(&out->opaque_ref);
+        out->opaque_ref = av_buffer_pool_get(ctx->timing_pool);
+        PipelineFrameTiming *timing = pipeline_timing(out->opaque_ref);
+        if (timing) {
+            timing->capture_ts = capture_ts;
+            timing->convert_ts = now;
+        }
+
+        while (spsc_queue_push_wait(ctx->video_frame_queue, out,
+                                    PIPELINE_WAIT_TIMEOUT)
+               < 0) {
+            if (!pipeline_running(ctx)) {
+                av_frame_free(&out);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 让第rendition级编码器把下一帧编为关键帧。ultra模式使用帧内刷新，
+// 编码器此后不再自行产生关键帧，等待关键帧的输出只能靠这里恢复
+static void
+pipeline_request_keyframe(PipelineCtx *ctx, int rendition)
+{
+    atomic_store(&ctx->force_keyframe[rendition], 1);
+}
+
+// 取出并清除第rendition级编码器的关键帧请求，返回下一帧的帧类型
+static enum AVPictureType
+pipeline_take_keyframe(PipelineCtx *ctx, int rendition)
+{
+    return atomic_exchange(&ctx->force_keyframe[rendition], 0)
+                   ? AV_PICTURE_TYPE_I
+                   : AV_PICTURE_TYPE_NONE;
+}
+
+// 把数据包的一个引用交给一路输出。目标未连接、写出积压或视频缺口尚未
+// 等到关键帧时直接丢弃，编码线程从不等待任何一路输出。缺口中第一个被
+// 丢弃的非关键帧向编码器请求关键帧，不必等到下一个GOP
+static int
+pipeline_output_push(PipelineCtx *ctx, PipelineOutput *out, AVPacket *pkt,
+                     int is_audio)
+{
+    if (!atomic_load(&out->connected)) {
+        if (!is_audio) {
+            out->video_gap = 1;
+            out->keyframe_requested = 0;
+        }
+        return 0;
+    }
+
+    int size = pkt->size;
+    int drop = 0;
+    if (!is_audio && out->video_gap && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+        if (!out->keyframe_requested) {
+            pipeline_request_keyframe(ctx, out->target->rendition);
+            out->keyframe_requested = 1;
+        }
+        drop = 1;
+    }
+    else {
+        // 队列为空时总是放行，避免超大关键帧永远进不去
+        int64_t queued = atomic_load(&out->queued_bytes);
+        drop = queued > 0 && queued + size > PIPELINE_MUX_BYTE_BUDGET;
+    }
+
+    SpscQueue *queue
+            = is_audio ? out->audio_packet_queue : out->video_packet_queue;
+    SpscQueue *recycle
+            = is_audio ? out->audio_packet_recycle : out->video_packet_recycle;
+    AVPacket *ref = NULL;
+    if (!drop) {
+        ref = pipeline_get_packet(recycle);
+        if (!ref || av_packet_ref(ref, pkt) < 0) {
+            av_packet_free(&ref);
+            return AVERROR(ENOMEM);
+        }
+        if (spsc_queue_push(queue, ref) < 0) {
+            // 回收队列只能由封装线程写入，这里直接释放
+            av_packet_free(&ref);
+            drop = 1;
+        }
+    }
+
+    if (drop) {
+        if (!is_audio && !out->video_gap) {
+            out->video_gap = 1;
+            out->keyframe_requested = 0;
+        }
+        else if (!is_audio && (pkt->flags & AV_PKT_FLAG_KEY)) {
+            out->keyframe_requested = 0;  // 关键帧本身被丢弃，需要再请求
+        }
+        atomic_fetch_add(&out->dropped_packets, 1);
+        pipeline_count_drop(ctx, PIPELINE_DROP_OUTPUT_BEHIND, pkt->pts, size);
+        return 0;
+    }
+
+    if (!is_audio) {
+        out->video_gap = 0;
+    }
+    atomic_fetch_add(&out->queued_bytes, size);
+    pipeline_notify_mux(out);
+    return 0;
+}
+
+// 将编码器产出的数据包分发给输出，编码只做一次，各输出只持有同一份数据
+// 的引用。音频分发给所有输出，视频只分发给输出该清晰度的目标
+// @param rendition 视频编码器索引，音频时为-1
+static int
+pipeline_forward_packets(PipelineCtx *ctx, AVPacket *pkt, int rendition)
+{
+    int ret;
+    int is_audio = rendition < 0;
+    FFmpegOutputCtx *fa_ctx = ctx->fa_ctx;
+
+    for (;;) {
+        int64_t trace_ts = trace_begin();
+        ret = is_audio
+                      ? ffmpeg_output_receive_audio_packet(fa_ctx, pkt)
+                      : ffmpeg_output_receive_video_packet(fa_ctx, rendition,
+                                                           pkt);
+        if (ret < 0) {
+            break;
+        }
+        trace_end("avcodec_receive_packet", is_audio ? "audio" : "video",
+                  trace_ts, pkt->pts, rendition);
+        PROBE_PACKET_PRODUCED(rendition, pkt->pts, pkt->dts, pkt->size,
+                              !!(pkt->flags & AV_PKT_FLAG_KEY));
+        if (is_audio) {
+            pipeline_counters_add(&ctx->audio_counters, 0, pkt->size, 0);
+        }
+        else {
+            pipeline_mark_packet(ctx, pkt, rendition);
+            pipeline_counters_add(&ctx->encode_counters[rendition], 0,
+                                  pkt->size, 0);
+        }
+
+        for (int i = 0; i < ctx->nb_outputs && ret >= 0; ++i) {
+            PipelineOutput *out = &ctx->outputs[i];
+            if (is_audio || out->target->rendition == rendition) {
+                ret = pipeline_output_push(ctx, out, pkt, is_audio);
+            }
+        }
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// 把编码器输入帧的一个引用交给清晰度阶梯的下一级(level为renditions下标)，
+// 下一级积压时丢弃，不拖慢本级
+static int
+pipeline_cascade_frame(PipelineCtx *ctx, int level, const AVFrame *frame)
+{
+    if (level >= ctx->nb_renditions) {
+        return 0;
+    }
+
+    PipelineRendition *r = &ctx->renditions[level];
+    AVFrame *ref = pipeline_get_frame(r->frame_recycle);
+    if (!ref || av_frame_ref(ref, frame) < 0) {
+        av_frame_free(&ref);
+        return AVERROR(ENOMEM);
+    }
+    if (spsc_queue_push(r->frame_queue, ref) < 0) {
+        // 回收队列只能由下一级写入，这里直接释放
+        av_frame_free(&ref);
+        pipeline_count_drop(ctx, PIPELINE_DROP_RENDITION_BEHIND, frame->pts,
+                            0);
+    }
+    return 0;
+}
+
+// 视频编码阶段：AVFrame -> AVPacket
+static void *
+pipeline_video_encode_thread(void *arg)
+{
+    PipelineCtx *ctx = arg;
+    FFmpegOutputCtx *fa_ctx = ctx->fa_ctx;
+    AVPacket *pkt = av_packet_alloc();
+    int ret;
+
+    if (ctx->has_encoder_cpus)
+        thread_set_affinity(&ctx->encoder_cpus);
+
+    trace_thread_name("video encode 0");
+    while (pipeline_running(ctx)) {
+        AVFrame *frame = spsc_queue_pop_wait(ctx->video_frame_queue,
+                                             PIPELINE_WAIT_TIMEOUT);
+        if (!frame) {
+            continue;
+        }
+
+        // 未送入编码器的帧不会成为参考帧，此处丢弃不影响后续解码
+        if (pipeline_is_stale(ctx, frame->pts)) {
+            pipeline_count_drop(ctx, PIPELINE_DROP_STALE_ENCODE, frame->pts,
+                                0);
+            pipeline_put_frame(ctx->video_frame_recycle, frame);
+            continue;
+        }
+
+        int64_t start_ts = get_current_ts_usec();
+        ret = pipeline_cascade_frame(ctx, 0, frame);
+        if (ret >= 0) {
+            frame->pict_type = pipeline_take_keyframe(ctx, 0);
+            pipeline_mark_submit(ctx, frame, 0);
+            int64_t pts = frame->pts;
+            PROBE_FRAME_SUBMITTED(0, pts, frame->width, frame->height, 0);
+            int64_t trace_ts = trace_begin();
+            ret = ffmpeg_output_encode_video_frame(fa_ctx, 0, frame);
+            trace_end("avcodec_send_frame", "video", trace_ts, pts, 0);
+        }
+        pipeline_put_frame(ctx->video_frame_recycle, frame);
+        if (ret >= 0) {
+            ret = pipeline_forward_packets(ctx, pkt, 0);
+        }
+        pipeline_counters_add(&ctx->encode_counters[0], 1, 0,
+                              get_current_ts_usec() - start_ts);
+        if (ret < 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR, fa_ctx->error_str);
+            break;
+        }
+    }
+
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+// 较低清晰度的缩放+编码阶段：缩小上一级的编码器输入，先交给下一级再编码
+static void *
+pipeline_rendition_thread(void *arg)
+{
+    PipelineRendition *r = arg;
+    PipelineCtx *ctx = r->pl;
+    FFmpegOutputCtx *fa_ctx = ctx->fa_ctx;
+    AVCodecContext *codec_ctx = fa_ctx->video_codec_ctxs[r->index];
+    AVFrame *scaled = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    int ret;
+
+    if (ctx->has_encoder_cpus)
+        thread_set_affinity(&ctx->encoder_cpus);
+
+    char name[32];
+    snprintf(name, sizeof name, "video encode %d", r->index);
+    trace_thread_name(name);
+    while (pipeline_running(ctx)) {
+        AVFrame *frame = spsc_queue_pop_wait(r->frame_queue,
+                                             PIPELINE_WAIT_TIMEOUT);
+        if (!frame) {
+            continue;
+        }
+
+        int64_t start_ts = get_current_ts_usec();
+        int64_t trace_ts = trace_begin();
+        ret = fc_scale_video_frame(r->scaler, codec_ctx, frame, scaled);
+        trace_end("fc_scale_video_frame", "video", trace_ts, frame->pts,
+                  r->index);
+        pipeline_put_frame(r->frame_recycle, frame);
+        if (ret < 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                r->scaler->error_str);
+            break;
+        }
+
+        ret = pipeline_cascade_frame(ctx, r->index, scaled);
+        if (ret >= 0) {
+            scaled->pict_type = pipeline_take_keyframe(ctx, r->index);
+            pipeline_mark_submit(ctx, scaled, r->index);
+            int64_t pts = scaled->pts;
+            PROBE_FRAME_SUBMITTED(r->index, pts, scaled->width, scaled->height,
+                                  0);
+            trace_ts = trace_begin();
+            ret = ffmpeg_output_encode_video_frame(fa_ctx, r->index, scaled);
+            trace_end("avcodec_send_frame", "video", trace_ts, pts, r->index);
+        }
+        if (ret >= 0) {
+            ret = pipeline_forward_packets(ctx, pkt, r->index);
+        }
+        pipeline_counters_add(&ctx->encode_counters[r->index], 1, 0,
+                              get_current_ts_usec() - start_ts);
+        if (ret < 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR, fa_ctx->error_str);
+            break;
+        }
+    }
+
+    av_frame_free(&scaled);
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+// 音频编码阶段：重采样后直接编码，音频计算量小，无需再拆分线程
+static void *
+pipeline_audio_encode_thread(void *arg)
+{
+    PipelineCtx *ctx = arg;
+    FFmpegOutputCtx *fa_ctx = ctx->fa_ctx;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame;
+    int ret = 0;
+
+    trace_thread_name("audio encode");
+    while (pipeline_running(ctx)) {
+        PipelineAudioItem *item = spsc_queue_pop_wait(
+                ctx->audio_capture_queue, PIPELINE_WAIT_TIMEOUT);
+        if (!item) {
+            continue;
+        }
+
+        frame = fc_ndi_audio_frame_to_avframe(ctx->fc_ctx,
+                                              fa_ctx->audio_codec_ctx,
+                                              &item->frame, item->capture_ts);
+        pipeline_recycle_audio(ctx, item);
+
+        // 处理本帧及重采样器中可能剩余的音频帧
+        while (frame && ret >= 0) {
+            int64_t start_ts = get_current_ts_usec();
+            int64_t pts = frame->pts;
+            PROBE_FRAME_SUBMITTED(-1, pts, 0, 0, frame->nb_samples);
+            int64_t trace_ts = trace_begin();
+            ret = ffmpeg_output_encode_audio_frame(fa_ctx, frame);
+            trace_end("avcodec_send_frame", "audio", trace_ts, pts, -1);
+            if (ret >= 0) {
+                ret = pipeline_forward_packets(ctx, pkt, -1);
+            }
+            pipeline_counters_add(&ctx->audio_counters, 1, 0,
+                                  get_current_ts_usec() - start_ts);
+            frame = fc_ndi_audio_frame_to_avframe(
+                    ctx->fc_ctx, fa_ctx->audio_codec_ctx, NULL, 0);
+        }
+        atomic_store_explicit(
+                &ctx->audio_counters.level,
+                fc_audio_buffered_us(ctx->fc_ctx, fa_ctx->audio_codec_ctx),
+                memory_order_relaxed);
+        if (ret < 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR, fa_ctx->error_str);
+            break;
+        }
+    }
+
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+// IO中断回调：流水线停止时让阻塞中的连接和写出尽快返回
+static int
+pipeline_output_interrupt(void *opaque)
+{
+    PipelineOutput *out = opaque;
+    return !pipeline_running(out->pl);
+}
+
+// 清空一路输出中尚未写出的数据包
+static void
+pipeline_output_flush(PipelineOutput *out)
+{
+    AVPacket *pkt;
+    while ((pkt = spsc_queue_pop(out->video_packet_queue)) != NULL) {
+        atomic_fetch_sub(&out->queued_bytes, pkt->size);
+        pipeline_put_packet(out->video_packet_recycle, pkt);
+    }
+    while ((pkt = spsc_queue_pop(out->audio_packet_queue)) != NULL) {
+        atomic_fetch_sub(&out->queued_bytes, pkt->size);
+        pipeline_put_packet(out->audio_packet_recycle, pkt);
+    }
+}
+
+// 连接输出目标，成功后编码线程才开始向它分发数据包
+static int
+pipeline_output_connect(PipelineOutput *out)
+{
+    PipelineCtx *ctx = out->pl;
+    AVIOInterruptCB int_cb = { pipeline_output_interrupt, out };
+
+    int ret = ffmpeg_output_open_target(ctx->fa_ctx, out->target, &int_cb);
+    if (ret < 0) {
+        return ret;
+    }
+
+    // 上次断开时编码线程可能还在入队，连接前丢掉这些残留的数据包
+    pipeline_output_flush(out);
+    atomic_fetch_add(&out->connects, 1);
+    atomic_store(&out->connected, 1);
+    printf("[INFO] %s: connected\n", out->target->output);
+    return 0;
+}
+
+// 断开输出目标并丢弃尚未写出的数据包
+static void
+pipeline_output_disconnect(PipelineOutput *out)
+{
+    atomic_store(&out->connected, 0);
+    ffmpeg_output_close_target(out->target);
+    pipeline_output_flush(out);
+}
+
+// 等待重连间隔，期间响应停止请求
+static void
+pipeline_output_backoff(PipelineCtx *ctx)
+{
+    for (int waited = 0;
+         waited < PIPELINE_OUTPUT_RETRY_INTERVAL && pipeline_running(ctx);
+         waited += PIPELINE_WAIT_TIMEOUT) {
+        thread_sleep_ms(PIPELINE_WAIT_TIMEOUT);
+    }
+}
+
+// 封装阶段：每路输出一个线程，负责连接、交替取出音视频数据包写出和断线
+// 重连，网络阻塞或断开只影响本线程
+static void *
+pipeline_mux_thread(void *arg)
+{
+    PipelineOutput *out = arg;
+    PipelineCtx *ctx = out->pl;
+    int output_index = (int)(out - ctx->outputs);
+    int dropping_gop = 0;  // 正在丢弃视频数据包，直到下一个未超时的关键帧
+    int connect_attempts = 0;  // 本次断开后尝试连接的次数
+
+    char name[32];
+    snprintf(name, sizeof name, "mux %d", output_index);
+    trace_thread_name(name);
+
+    while (pipeline_running(ctx)) {
+        if (!atomic_load(&out->connected)) {
+            int ret = pipeline_output_connect(out);
+            PROBE_OUTPUT_RECONNECT(output_index, ++connect_attempts, ret);
+            if (ret >= 0) {
+                connect_attempts = 0;
+            }
+            else if (pipeline_running(ctx)) {
+                printf("[ERROR] %s: %s", out->target->output,
+                       out->target->error_str);
+                pipeline_output_backoff(ctx);
+            }
+            dropping_gop = 0;
+            continue;
+        }
+
+        SpscQueue *recycle = out->audio_packet_recycle;
+        AVPacket *pkt = spsc_queue_pop(out->audio_packet_queue);
+        if (!pkt) {
+            recycle = out->video_packet_recycle;
+            pkt = spsc_queue_pop(out->video_packet_queue);
+        }
+
+        if (!pkt) {
+            // 两个队列都为空，重新检查后再休眠，避免错过编码线程的唤醒
+            mutex_lock(&out->mux_mu);
+            atomic_store(&out->mux_waiting, 1);
+            if (spsc_queue_size(out->audio_packet_queue) == 0
+                && spsc_queue_size(out->video_packet_queue) == 0
+                && pipeline_running(ctx)) {
+                cond_timedwait(&out->mux_cv, &out->mux_mu,
+                               PIPELINE_WAIT_TIMEOUT);
+            }
+            atomic_store(&out->mux_waiting, 0);
+            mutex_unlock(&out->mux_mu);
+            continue;
+        }
+
+        int size = pkt->size;
+        int is_video = recycle == out->video_packet_recycle;
+
+        // 超时的视频只能整个GOP丢弃，否则解码端会引用缺失的帧。开始丢弃或
+        // 请求来的关键帧也已超时时再请求一个关键帧，帧内刷新的编码器不会
+        // 自己产生
+        int drop;
+        if (is_video) {
+            if (pipeline_is_stale(ctx, pkt->pts)) {
+                if (!dropping_gop || (pkt->flags & AV_PKT_FLAG_KEY)) {
+                    pipeline_request_keyframe(ctx, out->target->rendition);
+                }
+                dropping_gop = 1;
+            }
+            else if (pkt->flags & AV_PKT_FLAG_KEY) {
+                dropping_gop = 0;
+            }
+            drop = dropping_gop;
+        }
+        else {
+            drop = pipeline_is_stale(ctx, pkt->pts);
+        }
+        if (drop) {
+            pipeline_count_drop(ctx,
+                                is_video ? PIPELINE_DROP_STALE_GOP
+                                         : PIPELINE_DROP_STALE_AUDIO,
+                                pkt->pts, size);
+            pipeline_put_packet(recycle, pkt);
+            atomic_fetch_sub(&out->queued_bytes, size);
+            continue;
+        }
+
+        int64_t queued = atomic_load(&out->queued_bytes);
+        if (queued > atomic_load(&out->peak_bytes)) {
+            atomic_store(&out->peak_bytes, queued);
+        }
+
+        // 封装器会接管数据包的引用，时间戳先取出来。编码器不传递
+        // opaque_ref时按pts(即采集时间)估算总延迟
+        const PipelineFrameTiming *timing
+                = is_video ? pipeline_timing(pkt->opaque_ref) : NULL;
+        int has_timing = timing != NULL;
+        int64_t packet_ts = -1;
+        int64_t capture_ts = -1;
+        if (timing) {
+            packet_ts = timing->packet_ts[out->target->rendition];
+            capture_ts = timing->capture_ts;
+        }
+        else if (is_video && pkt->pts != AV_NOPTS_VALUE) {
+            capture_ts = ctx->fc_ctx->start_ts + pkt->pts;
+        }
+
+        int64_t pts = pkt->pts;
+        int64_t trace_ts = trace_begin();
+        int64_t start_ts = get_current_ts_usec();
+        int ret = ffmpeg_output_write_packet(ctx->fa_ctx, out->target, pkt);
+        int64_t end_ts = get_current_ts_usec();
+        trace_end("av_interleaved_write_frame", is_video ? "video" : "audio",
+                  trace_ts, pts, output_index);
+        int64_t elapsed = end_ts - start_ts;
+        PROBE_PACKET_WRITTEN(output_index, !is_video, pts, size, elapsed, ret);
+        pipeline_put_packet(recycle, pkt);
+
+        if (ret >= 0 && has_timing) {
+            latency_hist_record(&ctx->latency[PIPELINE_LATENCY_MUX],
+                                end_ts - packet_ts);
+        }
+        if (ret >= 0 && capture_ts >= 0) {
+            latency_hist_record(&ctx->latency[PIPELINE_LATENCY_TOTAL],
+                                end_ts - capture_ts);
+        }
+
+        atomic_fetch_sub(&out->queued_bytes, size);
+
+        pipeline_counters_add(is_video ? &out->video_writes
+                                       : &out->audio_writes,
+                              1, size, elapsed);
+        if (ret < 0 && pipeline_running(ctx)) {
+            // 只断开这一路，其他输出照常写出
+            printf("[ERROR] %s: %s", out->target->output,
+                   out->target->error_str);
+            pipeline_output_disconnect(out);
+            pipeline_output_backoff(ctx);
+        }
+    }
+
+    pipeline_output_disconnect(out);
+    return NULL;
+}
+
+PipelineCtx *
+new_pipeline_ctx(NdiSource *source, FrameConverterCtx *fc_ctx,
+                 FFmpegOutputCtx *fa_ctx)
+{
+    // 各线程的计数器按缓存行对齐，上下文本身也要按缓存行分配
+#ifdef _WIN32
+    PipelineCtx *ctx = _aligned_malloc(sizeof(PipelineCtx), PIPELINE_CACHE_LINE);
+#else
+    PipelineCtx *ctx = aligned_alloc(PIPELINE_CACHE_LINE, sizeof(PipelineCtx));
+#endif
+    if (!ctx) {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(PipelineCtx));
+    ctx->source = source;
+    ctx->fc_ctx = fc_ctx;
+    ctx->fa_ctx = fa_ctx;
+    ctx->video_capture_queue = new_spsc_queue(PIPELINE_VIDEO_CAPTURE_QUEUE_SIZE);
+    ctx->video_frame_queue = new_spsc_queue(PIPELINE_VIDEO_FRAME_QUEUE_SIZE);
+    ctx->audio_capture_queue = new_spsc_queue(PIPELINE_AUDIO_CAPTURE_QUEUE_SIZE);
+    // 流转中的外壳数 = 队列容量 + 各阶段手中的少量外壳
+    ctx->video_frame_recycle
+            = new_spsc_queue(PIPELINE_VIDEO_FRAME_QUEUE_SIZE * 2);
+    ctx->audio_capture_recycle
+            = new_spsc_queue(PIPELINE_AUDIO_CAPTURE_QUEUE_SIZE * 2);
+
+    ctx->nb_outputs = fa_ctx->nb_targets;
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineOutput *out = &ctx->outputs[i];
+        out->pl = ctx;
+        out->target = fa_ctx->targets[i];
+        out->video_packet_queue = new_spsc_queue(PIPELINE_PACKET_QUEUE_SIZE);
+        out->audio_packet_queue = new_spsc_queue(PIPELINE_PACKET_QUEUE_SIZE);
+        out->video_packet_recycle
+                = new_spsc_queue(PIPELINE_PACKET_QUEUE_SIZE * 2);
+        out->audio_packet_recycle
+                = new_spsc_queue(PIPELINE_PACKET_QUEUE_SIZE * 2);
+        mutex_init(&out->mux_mu);
+        cond_init(&out->mux_cv);
+
+        if (out->target->rendition > ctx->nb_renditions) {
+            ctx->nb_renditions = out->target->rendition;
+        }
+    }
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        PipelineRendition *r = &ctx->renditions[i];
+        r->pl = ctx;
+        r->index = i + 1;
+        r->scaler = new_fc_scaler();
+        if (r->scaler) {
+            fc_scaler_set_threads(r->scaler, fc_ctx->slice_pool,
+                                  fc_ctx->nb_threads);
+        }
+        r->frame_queue = new_spsc_queue(PIPELINE_VIDEO_FRAME_QUEUE_SIZE);
+        r->frame_recycle = new_spsc_queue(PIPELINE_VIDEO_FRAME_QUEUE_SIZE * 2);
+    }
+    ctx->timing_pool = av_buffer_pool_init(sizeof(PipelineFrameTiming), NULL);
+    ctx->ndi_frame_pool = ndi_video_frame_pool_init();
+    ctx->error_str = malloc(AV_ERROR_MAX_STRING_SIZE + 100);
+
+    // 任一分配失败时释放已分配的部分，free_pipeline_ctx可处理为NULL的成员
+    int ok = ctx->video_capture_queue && ctx->video_frame_queue
+             && ctx->audio_capture_queue && ctx->video_frame_recycle
+             && ctx->audio_capture_recycle && ctx->timing_pool
+             && ctx->ndi_frame_pool && ctx->error_str;
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineOutput *out = &ctx->outputs[i];
+        ok = ok && out->video_packet_queue && out->audio_packet_queue
+             && out->video_packet_recycle && out->audio_packet_recycle;
+    }
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        PipelineRendition *r = &ctx->renditions[i];
+        ok = ok && r->scaler && r->frame_queue && r->frame_recycle;
+    }
+    if (!ok) {
+        free_pipeline_ctx(&ctx);
+        return NULL;
+    }
+    ctx->error_str[0] = '\0';
+    atomic_store(&ctx->status, PIPELINE_STATUS_STOPPED);
+    return ctx;
+}
+
+void
+free_pipeline_ctx(PipelineCtx **ctx)
+{
+    free_spsc_queue(&(*ctx)->video_capture_queue);
+    free_spsc_queue(&(*ctx)->video_frame_queue);
+    free_spsc_queue(&(*ctx)->audio_capture_queue);
+    free_spsc_queue(&(*ctx)->video_frame_recycle);
+    free_spsc_queue(&(*ctx)->audio_capture_recycle);
+    for (int i = 0; i < (*ctx)->nb_outputs; ++i) {
+        PipelineOutput *out = &(*ctx)->outputs[i];
+        free_spsc_queue(&out->video_packet_queue);
+        free_spsc_queue(&out->audio_packet_queue);
+        free_spsc_queue(&out->video_packet_recycle);
+        free_spsc_queue(&out->audio_packet_recycle);
+        mutex_destroy(&out->mux_mu);
+        cond_destroy(&out->mux_cv);
+    }
+    for (int i = 0; i < (*ctx)->nb_renditions; ++i) {
+        PipelineRendition *r = &(*ctx)->renditions[i];
+        if (r->scaler) {
+            free_fc_scaler(&r->scaler);
+        }
+        free_spsc_queue(&r->frame_queue);
+        free_spsc_queue(&r->frame_recycle);
+    }
+    av_buffer_pool_uninit(&(*ctx)->timing_pool);
+    av_buffer_pool_uninit(&(*ctx)->ndi_frame_pool);
+    free((*ctx)->error_str);
+#ifdef _WIN32
+    _aligned_free(*ctx);
+#else
+    free(*ctx);
+#endif
+    *ctx = NULL;
+}
+
+int
+pipeline_start(PipelineCtx *ctx, int width, int height)
+{
+    static const ThreadFunc stage_funcs[PIPELINE_STAGE_NB] = {
+        [PIPELINE_STAGE_VIDEO_CAPTURE] = pipeline_video_capture_thread,
+        [PIPELINE_STAGE_VIDEO_CONVERT] = pipeline_video_convert_thread,
+        [PIPELINE_STAGE_VIDEO_ENCODE] = pipeline_video_encode_thread,
+        [PIPELINE_STAGE_AUDIO_CAPTURE] = pipeline_audio_capture_thread,
+        [PIPELINE_STAGE_AUDIO_ENCODE] = pipeline_audio_encode_thread,
+    };
+
+    if (ctx->fa_ctx->nb_renditions != ctx->nb_renditions + 1) {
+        sprintf(ctx->error_str, "expected %d video encoders, got %d",
+                ctx->nb_renditions + 1, ctx->fa_ctx->nb_renditions);
+        return -1;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->error_str[0] = '\0';
+    atomic_store(&ctx->alloc_baseline, -1);
+    for (int i = 0; i < FFMPEG_OUTPUT_MAX_RENDITIONS; ++i) {
+        atomic_store(&ctx->force_keyframe[i], 0);
+    }
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineOutput *out = &ctx->outputs[i];
+        out->video_gap = 1;
+        out->keyframe_requested = 0;
+        atomic_store(&out->connected, 0);
+        atomic_store(&out->queued_bytes, 0);
+        atomic_store(&out->connects, 0);
+        atomic_store(&out->dropped_packets, 0);
+        atomic_store(&out->peak_bytes, 0);
+        pipeline_counters_reset(&out->video_writes);
+        pipeline_counters_reset(&out->audio_writes);
+    }
+    pipeline_counters_reset(&ctx->capture_counters);
+    pipeline_counters_reset(&ctx->convert_counters);
+    for (int i = 0; i < FFMPEG_OUTPUT_MAX_RENDITIONS; ++i) {
+        pipeline_counters_reset(&ctx->encode_counters[i]);
+    }
+    pipeline_counters_reset(&ctx->audio_counters);
+    for (int i = 0; i < PIPELINE_DROP_NB; ++i) {
+        atomic_store(&ctx->drops[i], 0);
+    }
+    for (int i = 0; i < PIPELINE_LATENCY_NB; ++i) {
+        latency_hist_reset(&ctx->latency[i]);
+    }
+    atomic_store(&ctx->status, PIPELINE_STATUS_RUNNING);
+
+    // 从下游到上游依次启动，保证上游产出时下游已在等待
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        if (thread_start(&ctx->outputs[i].thread, pipeline_mux_thread,
+                         &ctx->outputs[i])
+            != 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                "could not start pipeline thread");
+            pipeline_stop(ctx);
+            return -1;
+        }
+    }
+    for (int i = ctx->nb_renditions - 1; i >= 0; --i) {
+        if (thread_start(&ctx->renditions[i].thread, pipeline_rendition_thread,
+                         &ctx->renditions[i])
+            != 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                "could not start pipeline thread");
+            pipeline_stop(ctx);
+            return -1;
+        }
+    }
+    for (int i = PIPELINE_STAGE_NB - 1; i >= 0; --i) {
+        if (thread_start(&ctx->threads[i], stage_funcs[i], ctx) != 0) {
+            pipeline_set_status(ctx, PIPELINE_STATUS_ERROR,
+                                "could not start pipeline thread");
+            pipeline_stop(ctx);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int
+pipeline_wait(PipelineCtx *ctx)
+{
+    while (eh_alive() && pipeline_running(ctx)) {
+        thread_sleep_ms(PIPELINE_WAIT_TIMEOUT);
+    }
+    pipeline_set_status(ctx, PIPELINE_STATUS_STOPPED, NULL);
+    return atomic_load(&ctx->status);
+}
+
+void
+pipeline_set_max_latency(PipelineCtx *ctx, int max_latency_ms)
+{
+    ctx->max_latency_us = max_latency_ms > 0 ? (int64_t)max_latency_ms * 1000
+                                             : 0;
+}
+
+void
+pipeline_set_encoder_affinity(PipelineCtx *ctx, const ThreadCpuSet *cpus)
+{
+    ctx->has_encoder_cpus = cpus != NULL;
+    if (cpus)
+        ctx->encoder_cpus = *cpus;
+}
+
+int64_t
+pipeline_get_drops(PipelineCtx *ctx, enum PipelineDropReason reason)
+{
+    return atomic_load(&ctx->drops[reason]);
+}
+
+void
+pipeline_get_latency(PipelineCtx *ctx, enum PipelineLatencyStage stage,
+                     LatencyHistStats *stats)
+{
+    latency_hist_get_stats(&ctx->latency[stage], stats);
+}
+
+const char *
+pipeline_latency_stage_name(enum PipelineLatencyStage stage)
+{
+    static const char *const names[PIPELINE_LATENCY_NB] = {
+        [PIPELINE_LATENCY_CONVERT] = "capture to converted",
+        [PIPELINE_LATENCY_ENCODE_WAIT] = "converted to encoder",
+        [PIPELINE_LATENCY_ENCODE] = "encoder",
+        [PIPELINE_LATENCY_MUX] = "packet to written",
+        [PIPELINE_LATENCY_TOTAL] = "capture to written",
+    };
+    return stage < PIPELINE_LATENCY_NB ? names[stage] : "unknown";
+}
+
+const char *
+pipeline_drop_reason_name(enum PipelineDropReason reason)
+{
+    static const char *const names[PIPELINE_DROP_NB] = {
+        [PIPELINE_DROP_NDI_BACKLOG] = "NDI receive queue backlog",
+        [PIPELINE_DROP_CAPTURE_FULL] = "capture queue full",
+        [PIPELINE_DROP_STALE_CONVERT] = "stale before conversion",
+        [PIPELINE_DROP_STALE_ENCODE] = "stale before encoding",
+        [PIPELINE_DROP_RENDITION_BEHIND] = "lower rendition behind",
+        [PIPELINE_DROP_STALE_GOP] = "stale GOP before muxing",
+        [PIPELINE_DROP_STALE_AUDIO] = "stale audio before muxing",
+        [PIPELINE_DROP_OUTPUT_BEHIND] = "output writer behind",
+        [PIPELINE_DROP_AUDIO_CAPTURE_FULL] = "audio capture queue full",
+    };
+    return reason < PIPELINE_DROP_NB ? names[reason] : "unknown";
+}
+
+void
+pipeline_get_ndi_stats(PipelineCtx *ctx, PipelineNdiStats *stats)
+{
+    stats->received_video = atomic_load(&ctx->ndi_received_video);
+    stats->received_audio = atomic_load(&ctx->ndi_received_audio);
+    stats->queued_video = atomic_load(&ctx->ndi_queued_video);
+    stats->queued_audio = atomic_load(&ctx->ndi_queued_audio);
+    stats->dropped_video = atomic_load(&ctx->ndi_dropped_video);
+    stats->dropped_audio = atomic_load(&ctx->ndi_dropped_audio);
+}
+
+void
+pipeline_get_writer_stats(PipelineCtx *ctx, int index,
+                          PipelineWriterStats *stats)
+{
+    PipelineOutput *out = &ctx->outputs[index];
+    stats->connected = atomic_load(&out->connected);
+    stats->connects = atomic_load(&out->connects);
+    stats->dropped_packets = atomic_load(&out->dropped_packets);
+    stats->queued_packets = (int64_t)(spsc_queue_size(out->audio_packet_queue)
+                                      + spsc_queue_size(out->video_packet_queue));
+    stats->queued_bytes = atomic_load(&out->queued_bytes);
+    stats->peak_queued_bytes = atomic_load(&out->peak_bytes);
+    stats->written_video_packets = atomic_load(&out->video_writes.count);
+    stats->written_packets = stats->written_video_packets
+                             + atomic_load(&out->audio_writes.count);
+    stats->written_bytes = atomic_load(&out->video_writes.bytes)
+                           + atomic_load(&out->audio_writes.bytes);
+    stats->write_time_us = atomic_load(&out->video_writes.time_us)
+                           + atomic_load(&out->audio_writes.time_us);
+    stats->write_time_avg_us = stats->written_packets > 0
+                                       ? stats->write_time_us
+                                                 / stats->written_packets
+                                       : 0;
+    stats->write_time_max_us = FFMAX(atomic_load(&out->video_writes.time_max_us),
+                                     atomic_load(&out->audio_writes.time_max_us));
+}
+
+void
+pipeline_get_stage_stats(PipelineCtx *ctx, PipelineStageStats *stats)
+{
+    stats->captured_frames = atomic_load(&ctx->capture_counters.count);
+    stats->converted_frames = atomic_load(&ctx->convert_counters.count);
+    stats->convert_time_us = atomic_load(&ctx->convert_counters.time_us);
+    stats->nb_encoders = ctx->nb_renditions + 1;
+    for (int i = 0; i < FFMPEG_OUTPUT_MAX_RENDITIONS; ++i) {
+        PipelineCounters *c = &ctx->encode_counters[i];
+        stats->encoded_frames[i] = atomic_load(&c->count);
+        stats->encoded_bytes[i] = atomic_load(&c->bytes);
+        stats->encode_time_us[i] = atomic_load(&c->time_us);
+    }
+    stats->audio_buffered_us = atomic_load(&ctx->audio_counters.level);
+}
+
+// 清空数据包队列
+static void
+pipeline_drain_packets(SpscQueue *queue)
+{
+    AVPacket *pkt;
+    while ((pkt = spsc_queue_pop(queue)) != NULL) {
+        av_packet_free(&pkt);
+    }
+}
+
+void
+pipeline_stop(PipelineCtx *ctx)
+{
+    void *item;
+
+    pipeline_set_status(ctx, PIPELINE_STATUS_STOPPED, NULL);
+    for (int i = 0; i < PIPELINE_STAGE_NB; ++i) {
+        thread_join(&ctx->threads[i]);
+    }
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        thread_join(&ctx->renditions[i].thread);
+    }
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        thread_join(&ctx->outputs[i].thread);
+    }
+
+    // 清空残留的帧和数据包
+    while ((item = spsc_queue_pop(ctx->video_capture_queue)) != NULL) {
+        AVBufferRef *buf = item;
+        av_buffer_unref(&buf);
+    }
+    while ((item = spsc_queue_pop(ctx->audio_capture_queue)) != NULL) {
+        pipeline_free_audio(ctx, item);
+    }
+    while ((item = spsc_queue_pop(ctx->video_frame_queue)) != NULL) {
+        AVFrame *frame = item;
+        av_frame_free(&frame);
+    }
+    while ((item = spsc_queue_pop(ctx->video_frame_recycle)) != NULL) {
+        AVFrame *frame = item;
+        av_frame_free(&frame);
+    }
+    while ((item = spsc_queue_pop(ctx->audio_capture_recycle)) != NULL) {
+        free(item);
+    }
+    for (int i = 0; i < ctx->nb_renditions; ++i) {
+        PipelineRendition *r = &ctx->renditions[i];
+        while ((item = spsc_queue_pop(r->frame_queue)) != NULL) {
+            AVFrame *frame = item;
+            av_frame_free(&frame);
+        }
+        while ((item = spsc_queue_pop(r->frame_recycle)) != NULL) {
+            AVFrame *frame = item;
+            av_frame_free(&frame);
+        }
+    }
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineOutput *out = &ctx->outputs[i];
+        pipeline_drain_packets(out->video_packet_queue);
+        pipeline_drain_packets(out->audio_packet_queue);
+        pipeline_drain_packets(out->video_packet_recycle);
+        pipeline_drain_packets(out->audio_packet_recycle);
+    }
+
+    NDIlib_recv_queue_t queue;
+    ndi_source_get_queue(ctx->source, &queue);
+    pipeline_update_ndi_stats(ctx, &queue);
+
+    PipelineNdiStats ns;
+    pipeline_get_ndi_stats(ctx, &ns);
+    if (ns.dropped_video > 0 || ns.dropped_audio > 0) {
+        printf("[INFO] NDI receiver dropped %lld video and %lld audio frames "
+               "since connecting\n",
+               (long long)ns.dropped_video, (long long)ns.dropped_audio);
+    }
+
+    for (int i = 0; i < ctx->nb_outputs; ++i) {
+        PipelineWriterStats ws;
+        pipeline_get_writer_stats(ctx, i, &ws);
+        if (ws.written_packets > 0) {
+            printf("[INFO] writer %s: %lld packets, %lld bytes, write time "
+                   "avg %lld us / max %lld us, peak queue %lld bytes, "
+                   "%lld dropped, %lld connects\n",
+                   ctx->outputs[i].target->output,
+                   (long long)ws.written_packets, (long long)ws.written_bytes,
+                   (long long)ws.write_time_avg_us,
+                   (long long)ws.write_time_max_us,
+                   (long long)ws.peak_queued_bytes,
+                   (long long)ws.dropped_packets, (long long)ws.connects);
+        }
+    }
+
+    for (int i = 0; i < PIPELINE_LATENCY_NB; ++i) {
+        LatencyHistStats ls;
+        pipeline_get_latency(ctx, i, &ls);
+        if (ls.count > 0) {
+            printf("[INFO] video latency, %s: %lld frames, mean %lld us, "
+                   "p50 %lld us, p99 %lld us, max %lld us\n",
+                   pipeline_latency_stage_name(i), (long long)ls.count,
+                   (long long)ls.mean_us, (long long)ls.p50_us,
+                   (long long)ls.p99_us, (long long)ls.max_us);
+        }
+    }
+
+    for (int i = 0; i < PIPELINE_DROP_NB; ++i) {
+        int64_t dropped = pipeline_get_drops(ctx, i);
+        if (dropped > 0) {
+            printf("[INFO] %lld %s dropped: %s\n", (long long)dropped,
+                   i == PIPELINE_DROP_AUDIO_CAPTURE_FULL ? "audio frames"
+                   : i >= PIPELINE_DROP_STALE_GOP        ? "packets"
+                                                         : "video frames",
+                   pipeline_drop_reason_name(i));
+        }
+    }
+
+#ifdef NDI_STREAMER_DEBUG_ALLOC
+    // 计数覆盖整个进程(所有源、编码器和输出)，不只是本流水线
+    int64_t baseline = atomic_load(&ctx->alloc_baseline);
+    if (baseline >= 0) {
+        printf("[DEBUG] %lld heap allocations in the process during %lld "
+               "video frames after warmup\n",
+               (long long)(alloc_counter_get() - baseline),
+               (long long)(atomic_load(&ctx->convert_counters.count)
+                           - PIPELINE_ALLOC_WARMUP_FRAMES));
+    }
+#endif
+}
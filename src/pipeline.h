@@ -0,0 +1,358 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 多线程处理流水线
+// 视频: 采集 -> 转换 -> 编码 三个阶段各占一个线程，较低的清晰度各占一个
+//       缩放+编码线程，逐级以上一级的编码器输入为输入
+// 音频: 采集 -> 转换+编码 两个阶段各占一个线程
+// 两条路径独立运行，编码结果分发给每个输出目标各自的封装线程，阶段之间
+// 通过有界SPSC无锁队列连接，慢速编码或网络阻塞不会拖慢NDI采集，音频延迟
+// 也不受视频编码耗时影响，一个输出变慢或断开也不影响其他输出
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <Processing.NDI.Lib.h>
+
+#include "ffmpeg_output.h"
+#include "frame_converter.h"
+#include "latency_hist.h"
+#include "ndi_source.h"
+#include "spsc_queue.h"
+#include "thread.h"
+
+#define PIPELINE_CACHE_LINE 64 // 缓存行大小，各线程的计数器按此对齐
+
+// 流水线阶段(封装线程按输出目标另行启动，不在此列)
+enum PipelineStage {
+    PIPELINE_STAGE_VIDEO_CAPTURE = 0, // NDI视频采集
+    PIPELINE_STAGE_VIDEO_CONVERT,     // 视频帧格式转换
+    PIPELINE_STAGE_VIDEO_ENCODE,      // 视频编码
+    PIPELINE_STAGE_AUDIO_CAPTURE,     // NDI音频采集
+    PIPELINE_STAGE_AUDIO_ENCODE,      // 音频重采样+编码
+    PIPELINE_STAGE_NB
+};
+
+// 流水线停止原因
+enum PipelineStatus {
+    PIPELINE_STATUS_RUNNING = 0,   // 运行中
+    PIPELINE_STATUS_STOPPED,       // 被外部停止
+    PIPELINE_STATUS_FORMAT_CHANGE, // 输入分辨率变化，需要重建编码器
+    PIPELINE_STATUS_ERROR,         // 某一阶段出错
+};
+
+// 丢弃原因
+enum PipelineDropReason {
+    PIPELINE_DROP_NDI_BACKLOG = 0,  // NDI接收队列积压，跳到最新帧(视频帧)
+    PIPELINE_DROP_CAPTURE_FULL,     // 转换阶段积压，采集队列已满(视频帧)
+    PIPELINE_DROP_STALE_CONVERT,    // 超过延迟上限，跳过转换(视频帧)
+    PIPELINE_DROP_STALE_ENCODE,     // 超过延迟上限，编码前丢弃(视频帧)
+    PIPELINE_DROP_RENDITION_BEHIND, // 较低清晰度的缩放/编码积压(视频帧)
+    PIPELINE_DROP_STALE_GOP,        // 超过延迟上限，封装前丢弃到下一个关键帧(视频数据包)
+    PIPELINE_DROP_STALE_AUDIO,      // 超过延迟上限，封装前丢弃(音频数据包)
+    PIPELINE_DROP_OUTPUT_BEHIND,    // 输出写出积压，丢弃到下一个关键帧(数据包)
+    PIPELINE_DROP_AUDIO_CAPTURE_FULL, // 音频编码积压，采集队列已满(音频帧)
+    PIPELINE_DROP_NB
+};
+
+// 视频帧在各环节花费的时间。各级清晰度都计入编码、封装和总延迟，
+// 转换和编码等待只在源分辨率上统计(较低清晰度的等待包含缩放)
+enum PipelineLatencyStage {
+    PIPELINE_LATENCY_CONVERT = 0,  // 从NDI取出 -> 转换完成(含采集队列等待)
+    PIPELINE_LATENCY_ENCODE_WAIT,  // 转换完成 -> 送入编码器
+    PIPELINE_LATENCY_ENCODE,       // 送入编码器 -> 取出数据包
+    PIPELINE_LATENCY_MUX,          // 取出数据包 -> 写出完成(含写出队列等待)
+    PIPELINE_LATENCY_TOTAL,        // 从NDI取出 -> 写出完成
+    PIPELINE_LATENCY_NB
+};
+
+// 一个线程独占的计数器。只有所属线程写入，不需要原子读改写；独占缓存行，
+// 其他线程随时读取(打印统计、导出指标)也不会与写入线程伪共享
+typedef struct PipelineCounters {
+    alignas(PIPELINE_CACHE_LINE) _Atomic(int64_t) count; // 处理的帧或数据包数
+    _Atomic(int64_t) bytes;       // 产出或写出的字节数
+    _Atomic(int64_t) time_us;     // 累计处理耗时(微秒)
+    _Atomic(int64_t) time_max_us; // 单次最大处理耗时(微秒)
+    _Atomic(int64_t) level;       // 当前缓冲深度等瞬时值，含义由所属阶段决定
+} PipelineCounters;
+
+// NDI接收器统计
+typedef struct PipelineNdiStats {
+    int64_t received_video; // NDI报告的收到视频帧数(自接收器创建起累计)
+    int64_t received_audio; // NDI报告的收到音频帧数(自接收器创建起累计)
+    int64_t queued_video;  // NDI接收队列中等待取出的视频帧数
+    int64_t queued_audio;  // NDI接收队列中等待取出的音频帧数
+    int64_t dropped_video; // NDI报告的丢弃视频帧数(自接收器创建起累计)
+    int64_t dropped_audio; // NDI报告的丢弃音频帧数(自接收器创建起累计)
+} PipelineNdiStats;
+
+// 封装(写出)线程统计
+typedef struct PipelineWriterStats {
+    int connected;             // 输出目标当前是否已连接
+    int64_t connects;          // 本次运行中成功连接的次数
+    int64_t dropped_packets;   // 写出积压或等待关键帧而丢弃的数据包数
+    int64_t queued_packets;    // 等待写出的数据包数
+    int64_t queued_bytes;      // 等待写出的字节数
+    int64_t peak_queued_bytes; // 本次运行中等待写出字节数的峰值
+    int64_t written_packets;   // 已写出的数据包数
+    int64_t written_video_packets; // 其中的视频数据包数
+    int64_t written_bytes;     // 已写出的字节数
+    int64_t write_time_us;     // 累计写出耗时(微秒)
+    int64_t write_time_avg_us; // 单个数据包的平均写出耗时(微秒)
+    int64_t write_time_max_us; // 单个数据包的最大写出耗时(微秒)
+} PipelineWriterStats;
+
+// 各阶段线程的处理统计
+typedef struct PipelineStageStats {
+    int64_t captured_frames;  // 从NDI取出的视频帧数(不含跳过的积压帧)
+    int64_t converted_frames; // 转换完成的视频帧数
+    int64_t convert_time_us;  // 累计转换耗时(微秒)
+    int nb_encoders;          // 视频编码器数(源分辨率和各级较低清晰度)
+    int64_t encoded_frames[FFMPEG_OUTPUT_MAX_RENDITIONS]; // 各编码器送入的帧数
+    int64_t encoded_bytes[FFMPEG_OUTPUT_MAX_RENDITIONS];  // 各编码器产出的字节数
+    // 各编码线程在缩放、送入编码器和取出数据包上的累计耗时(微秒)
+    int64_t encode_time_us[FFMPEG_OUTPUT_MAX_RENDITIONS];
+    int64_t audio_buffered_us; // 重采样器和音频FIFO中缓存的音频时长(微秒)
+} PipelineStageStats;
+
+struct PipelineCtx;
+
+// 一路输出目标的写出状态，由该目标自己的封装线程驱动。编码线程把每个
+// 数据包的引用分发给所有已连接的目标，目标之间互不等待
+typedef struct PipelineOutput {
+    struct PipelineCtx *pl;        // 所属流水线
+    FFmpegOutputTarget *target;    // 输出目标
+    Thread thread;                 // 封装线程
+
+    SpscQueue *video_packet_queue;   // 视频编码 -> 封装
+    SpscQueue *audio_packet_queue;   // 音频编码 -> 封装
+    SpscQueue *video_packet_recycle; // 封装 -> 视频编码(AVPacket)
+    SpscQueue *audio_packet_recycle; // 封装 -> 音频编码(AVPacket)
+
+    // 封装线程同时消费两个数据包队列，两者都为空时在此等待
+    Mutex mux_mu;
+    Cond mux_cv;
+    _Atomic(int) mux_waiting;
+
+    // 封装器已写出文件头，编码线程只向已连接的目标分发数据包
+    _Atomic(int) connected;
+    // 视频数据包有缺口，分发要等到下一个关键帧(仅视频编码线程读写)
+    int video_gap;
+    // 本次缺口已向编码器请求过关键帧(仅视频编码线程读写)
+    int keyframe_requested;
+
+    // 待写出数据包的字节数，超出预算时新数据包被丢弃而不是等待，
+    // 一个目标的网络阻塞只影响它自己
+    _Atomic(int64_t) queued_bytes;
+
+    // 写出统计，仅封装线程写入(dropped_packets由编码线程写入)
+    _Atomic(int64_t) connects;
+    _Atomic(int64_t) dropped_packets;
+    _Atomic(int64_t) peak_bytes;
+    PipelineCounters video_writes; // 写出的视频数据包
+    PipelineCounters audio_writes; // 写出的音频数据包
+} PipelineOutput;
+
+// 清晰度阶梯中低于源分辨率的一级：从上一级取得编码器输入帧的引用，缩小后
+// 先交给下一级，再送入本级编码器。完整分辨率的采集和转换只做一次
+typedef struct PipelineRendition {
+    struct PipelineCtx *pl;        // 所属流水线
+    int index;                     // 视频编码器索引(从1开始，0为源分辨率)
+    FcScaler *scaler;              // 上一级 -> 本级尺寸的缩放器
+    Thread thread;                 // 缩放+编码线程
+    SpscQueue *frame_queue;        // 上一级编码 -> 本级(AVFrame)
+    SpscQueue *frame_recycle;      // 本级 -> 上一级编码(AVFrame外壳)
+} PipelineRendition;
+
+typedef struct PipelineCtx {
+    NdiSource *source;           // NDI输入(接收器或回放)
+    FrameConverterCtx *fc_ctx;   // 帧转换上下文
+    FFmpegOutputCtx *fa_ctx;     // FFmpeg输出上下文
+
+    int width;                   // 当前会话的视频宽度
+    int height;                  // 当前会话的视频高度
+
+    SpscQueue *video_capture_queue; // 视频采集 -> 视频转换
+    SpscQueue *video_frame_queue;   // 视频转换 -> 视频编码
+    SpscQueue *audio_capture_queue; // 音频采集 -> 音频编码
+
+    // 回收队列：下游把用完的帧/数据包外壳交还上游复用，稳态下不再分配
+    SpscQueue *video_frame_recycle;   // 视频编码 -> 视频转换(AVFrame)
+    SpscQueue *audio_capture_recycle; // 音频编码 -> 音频采集(NDI音频帧描述)
+
+    Thread threads[PIPELINE_STAGE_NB]; // 各阶段线程
+
+    PipelineOutput outputs[FFMPEG_OUTPUT_MAX_TARGETS]; // 各输出目标
+    int nb_outputs;                // 输出目标数
+
+    // 低于源分辨率的各级清晰度，renditions[i]使用编码器i+1
+    PipelineRendition renditions[FFMPEG_OUTPUT_MAX_RENDITIONS - 1];
+    int nb_renditions;             // 低于源分辨率的清晰度数
+
+    _Atomic(int) status;         // 当前状态(enum PipelineStatus)
+    _Atomic(int64_t) drops[PIPELINE_DROP_NB]; // 按原因统计的丢弃数
+    LatencyHist latency[PIPELINE_LATENCY_NB]; // 各环节的延迟直方图
+    AVBufferPool *timing_pool;   // 随视频帧传递的时间戳缓冲池
+    AVBufferPool *ndi_frame_pool; // 包装NDI视频帧的缓冲池
+    int64_t max_latency_us;      // 采集到写出的延迟上限(微秒)，0表示不限制
+    // 各视频编码器的下一帧强制编为关键帧，由输出出现缺口时设置
+    _Atomic(int) force_keyframe[FFMPEG_OUTPUT_MAX_RENDITIONS];
+    ThreadCpuSet encoder_cpus;   // 视频编码线程(含各清晰度)的CPU亲和性
+    int has_encoder_cpus;        // 是否设置了encoder_cpus
+
+    // 各阶段线程的处理计数，每组只由一个线程写入
+    PipelineCounters capture_counters; // 视频采集线程
+    PipelineCounters convert_counters; // 视频转换线程
+    // 各视频编码器的编码线程，bytes为产出的数据包字节数
+    PipelineCounters encode_counters[FFMPEG_OUTPUT_MAX_RENDITIONS];
+    // 音频编码线程，level为重采样器和音频FIFO中缓存的音频时长(微秒)
+    PipelineCounters audio_counters;
+
+    // NDI接收器统计，由视频采集线程定期刷新
+    _Atomic(int64_t) ndi_received_video;
+    _Atomic(int64_t) ndi_received_audio;
+    _Atomic(int64_t) ndi_queued_video;
+    _Atomic(int64_t) ndi_queued_audio;
+    _Atomic(int64_t) ndi_dropped_video;
+    _Atomic(int64_t) ndi_dropped_audio;
+
+    _Atomic(int64_t) alloc_baseline; // 预热结束时的堆分配计数，-1表示尚未结束
+
+    char *error_str;             // 错误信息字符串
+} PipelineCtx;
+
+/**
+ * 创建流水线上下文
+ * @param source NDI输入
+ * @param fc_ctx 帧转换上下文
+ * @param fa_ctx FFmpeg输出上下文，输出目标必须已经全部添加，清晰度数按
+ *               输出目标使用的最大编码器索引确定
+ * @return 新创建的PipelineCtx指针，内存不足时返回NULL
+ */
+PipelineCtx *
+new_pipeline_ctx(NdiSource *source, FrameConverterCtx *fc_ctx,
+                 FFmpegOutputCtx *fa_ctx);
+
+/**
+ * 释放流水线上下文(必须先调用pipeline_stop)
+ * @param ctx 指向PipelineCtx指针的指针
+ */
+void
+free_pipeline_ctx(PipelineCtx **ctx);
+
+/**
+ * 启动所有阶段线程、各清晰度的编码线程和各输出目标的封装线程，
+ * 每个清晰度的编码器都必须已经就绪。
+ * 输出目标由各自的封装线程连接，连接失败或写出出错时只断开该目标并定期重连
+ * @param ctx 流水线上下文
+ * @param width 视频宽度，采集到的分辨率与之不同时流水线以FORMAT_CHANGE停止
+ * @param height 视频高度
+ * @return 成功返回0，失败返回-1
+ */
+int
+pipeline_start(PipelineCtx *ctx, int width, int height);
+
+/**
+ * 阻塞直到流水线自行停止或收到终止信号
+ * @param ctx 流水线上下文
+ * @return 停止原因(enum PipelineStatus)
+ */
+int
+pipeline_wait(PipelineCtx *ctx);
+
+/**
+ * 设置延迟上限，超过上限的帧在最便宜的环节被丢弃：转换前跳过、编码前丢弃，
+ * 已编码的视频则在封装前丢弃到下一个关键帧
+ * @param ctx 流水线上下文
+ * @param max_latency_ms 采集到写出的延迟上限(毫秒)，0表示不限制
+ * @note 必须在pipeline_start之前调用
+ */
+void
+pipeline_set_max_latency(PipelineCtx *ctx, int max_latency_ms);
+
+/**
+ * 把视频编码线程和各清晰度的缩放+编码线程绑定到指定CPU。编码库内部的线程
+ * 在打开编码器时创建，需要由打开编码器的线程自行设置亲和性
+ * @param ctx 流水线上下文
+ * @param cpus CPU集合，NULL表示不绑定
+ * @note 必须在pipeline_start之前调用
+ */
+void
+pipeline_set_encoder_affinity(PipelineCtx *ctx, const ThreadCpuSet *cpus);
+
+/**
+ * 获取本次运行中某一原因的丢弃数，可在任意线程调用
+ * @param ctx 流水线上下文
+ * @param reason 丢弃原因
+ * @return 丢弃的帧数或数据包数
+ */
+int64_t
+pipeline_get_drops(PipelineCtx *ctx, enum PipelineDropReason reason);
+
+/**
+ * 获取本次运行中视频帧在某一环节花费时间的摘要，可在任意线程调用
+ * @param ctx 流水线上下文
+ * @param stage 环节
+ * @param stats 输出的摘要
+ */
+void
+pipeline_get_latency(PipelineCtx *ctx, enum PipelineLatencyStage stage,
+                     LatencyHistStats *stats);
+
+/**
+ * 获取延迟环节的名称
+ * @param stage 环节
+ * @return 名称字符串
+ */
+const char *
+pipeline_latency_stage_name(enum PipelineLatencyStage stage);
+
+/**
+ * 获取丢弃原因的名称
+ * @param reason 丢弃原因
+ * @return 名称字符串
+ */
+const char *
+pipeline_drop_reason_name(enum PipelineDropReason reason);
+
+/**
+ * 获取NDI接收队列深度和NDI报告的丢帧数，可在任意线程调用
+ * @param ctx 流水线上下文
+ * @param stats 输出的统计数据
+ */
+void
+pipeline_get_ndi_stats(PipelineCtx *ctx, PipelineNdiStats *stats);
+
+/**
+ * 获取视频采集、转换、各编码器的处理计数和音频缓存深度，可在任意线程调用
+ * @param ctx 流水线上下文
+ * @param stats 输出的统计数据
+ */
+void
+pipeline_get_stage_stats(PipelineCtx *ctx, PipelineStageStats *stats);
+
+/**
+ * 获取一路输出的连接状态、写出队列深度和写出耗时，可在任意线程调用
+ * @param ctx 流水线上下文
+ * @param index 输出目标索引(0 .. nb_outputs-1)
+ * @param stats 输出的统计数据
+ */
+void
+pipeline_get_writer_stats(PipelineCtx *ctx, int index,
+                          PipelineWriterStats *stats);
+
+/**
+ * 停止所有阶段线程并清空队列中残留的帧和数据包
+ * @param ctx 流水线上下文
+ */
+void
+pipeline_stop(PipelineCtx *ctx);
+
+#endif
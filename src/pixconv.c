@@ -0,0 +1,285 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "pixconv.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "pixconv_internal.h"
+
+void
+pixconv_uyvy_to_i420_row2_c(const uint8_t *src0, const uint8_t *src1,
+                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                            int width)
+{
+    for (int x = 0; x < width / 2; ++x) {
+        const uint8_t *a = src0 + x * 4;
+        const uint8_t *b = src1 + x * 4;
+        y0[x * 2] = a[1];
+        y0[x * 2 + 1] = a[3];
+        y1[x * 2] = b[1];
+        y1[x * 2 + 1] = b[3];
+        u[x] = (uint8_t)((a[0] + b[0] + 1) >> 1);
+        v[x] = (uint8_t)((a[2] + b[2] + 1) >> 1);
+    }
+}
+
+void
+pixconv_uyvy_to_nv12_row2_c(const uint8_t *src0, const uint8_t *src1,
+                            uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+    for (int x = 0; x < width / 2; ++x) {
+        const uint8_t *a = src0 + x * 4;
+        const uint8_t *b = src1 + x * 4;
+        y0[x * 2] = a[1];
+        y0[x * 2 + 1] = a[3];
+        y1[x * 2] = b[1];
+        y1[x * 2 + 1] = b[3];
+        uv[x * 2] = (uint8_t)((a[0] + b[0] + 1) >> 1);
+        uv[x * 2 + 1] = (uint8_t)((a[2] + b[2] + 1) >> 1);
+    }
+}
+
+// 与向量化实现的饱和打包一致
+static inline uint8_t
+pixconv_clip_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// 一个像素(或2x2像素之和)的四个字节与系数的点积
+static inline int
+pixconv_dot4(const int *p, const int16_t *k)
+{
+    return p[0] * k[0] + p[1] * k[1] + p[2] * k[2] + p[3] * k[3];
+}
+
+static inline uint8_t
+pixconv_rgb32_y(const uint8_t *p, const PixconvRgbCoeffs *c)
+{
+    int px[4] = { p[0], p[1], p[2], p[3] };
+    return pixconv_clip_u8((pixconv_dot4(px, c->y) + c->y_bias) >> 15);
+}
+
+// 第x个色度样本对应的2x2像素各字节之和，奇数宽度的最后一个像素与自身配对
+static inline void
+pixconv_rgb32_sum2x2(const uint8_t *src0, const uint8_t *src1, int x,
+                     int width, int sum[4])
+{
+    int x0 = x * 2;
+    int x1 = x0 + 1 < width ? x0 + 1 : x0;
+    for (int i = 0; i < 4; ++i) {
+        sum[i] = src0[x0 * 4 + i] + src0[x1 * 4 + i] + src1[x0 * 4 + i]
+                 + src1[x1 * 4 + i];
+    }
+}
+
+void
+pixconv_rgb32_to_i420_row2_c(const uint8_t *src0, const uint8_t *src1,
+                             uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                             int width, const PixconvRgbCoeffs *c)
+{
+    for (int x = 0; x < width; ++x) {
+        y0[x] = pixconv_rgb32_y(src0 + x * 4, c);
+        y1[x] = pixconv_rgb32_y(src1 + x * 4, c);
+    }
+    for (int x = 0; x < (width + 1) / 2; ++x) {
+        int sum[4];
+        pixconv_rgb32_sum2x2(src0, src1, x, width, sum);
+        u[x] = pixconv_clip_u8((pixconv_dot4(sum, c->u) + c->uv_bias) >> 17);
+        v[x] = pixconv_clip_u8((pixconv_dot4(sum, c->v) + c->uv_bias) >> 17);
+    }
+}
+
+void
+pixconv_rgb32_to_nv12_row2_c(const uint8_t *src0, const uint8_t *src1,
+                             uint8_t *y0, uint8_t *y1, uint8_t *uv, int width,
+                             const PixconvRgbCoeffs *c)
+{
+    for (int x = 0; x < width; ++x) {
+        y0[x] = pixconv_rgb32_y(src0 + x * 4, c);
+        y1[x] = pixconv_rgb32_y(src1 + x * 4, c);
+    }
+    for (int x = 0; x < (width + 1) / 2; ++x) {
+        int sum[4];
+        pixconv_rgb32_sum2x2(src0, src1, x, width, sum);
+        uv[x * 2]
+                = pixconv_clip_u8((pixconv_dot4(sum, c->u) + c->uv_bias) >> 17);
+        uv[x * 2 + 1]
+                = pixconv_clip_u8((pixconv_dot4(sum, c->v) + c->uv_bias) >> 17);
+    }
+}
+
+static const PixconvFuncs pixconv_funcs_c = {
+    .level = PIXCONV_LEVEL_SCALAR,
+    .name = "scalar",
+    .uyvy_to_i420_row2 = pixconv_uyvy_to_i420_row2_c,
+    .uyvy_to_nv12_row2 = pixconv_uyvy_to_nv12_row2_c,
+    .rgb32_to_i420_row2 = pixconv_rgb32_to_i420_row2_c,
+    .rgb32_to_nv12_row2 = pixconv_rgb32_to_nv12_row2_c,
+};
+
+const PixconvFuncs *
+pixconv_get_funcs_for_level(enum PixconvLevel level)
+{
+    switch (level) {
+    case PIXCONV_LEVEL_SCALAR:
+        return &pixconv_funcs_c;
+#ifdef PIXCONV_ARCH_X86
+    case PIXCONV_LEVEL_SSE2:
+        return pixconv_detect_x86() >= level ? &pixconv_funcs_sse2 : NULL;
+    case PIXCONV_LEVEL_AVX2:
+        return pixconv_detect_x86() >= level ? &pixconv_funcs_avx2 : NULL;
+    case PIXCONV_LEVEL_AVX512:
+        return pixconv_detect_x86() >= level ? &pixconv_funcs_avx512 : NULL;
+#endif
+#ifdef PIXCONV_ARCH_NEON
+    case PIXCONV_LEVEL_NEON:
+        return &pixconv_funcs_neon;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+const PixconvFuncs *
+pixconv_get_funcs(void)
+{
+    // 检测结果与线程无关，并发首次调用最多重复检测一次
+    static _Atomic(const PixconvFuncs *) funcs = NULL;
+
+    const PixconvFuncs *res = atomic_load(&funcs);
+    if (res)
+        return res;
+
+    res = &pixconv_funcs_c;
+    for (int level = PIXCONV_LEVEL_NB - 1; level > PIXCONV_LEVEL_SCALAR;
+         --level) {
+        const PixconvFuncs *f = pixconv_get_funcs_for_level(level);
+        if (f) {
+            res = f;
+            break;
+        }
+    }
+    atomic_store(&funcs, res);
+    return res;
+}
+
+void
+pixconv_uyvy_to_i420(const uint8_t *src, int src_stride, uint8_t *const dst[3],
+                     const int dst_stride[3], int width, int height)
+{
+    PixconvUyvyToI420Row2 row2 = pixconv_get_funcs()->uyvy_to_i420_row2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s0 = src + (ptrdiff_t)y * src_stride;
+        uint8_t *y0 = dst[0] + (ptrdiff_t)y * dst_stride[0];
+        // 奇数高度的最后一行与自身配对
+        int last = y + 1 >= height;
+        row2(s0, last ? s0 : s0 + src_stride, y0, last ? y0 : y0 + dst_stride[0],
+             dst[1] + (ptrdiff_t)(y / 2) * dst_stride[1],
+             dst[2] + (ptrdiff_t)(y / 2) * dst_stride[2], width);
+    }
+}
+
+void
+pixconv_uyvy_to_nv12(const uint8_t *src, int src_stride, uint8_t *const dst[2],
+                     const int dst_stride[2], int width, int height)
+{
+    PixconvUyvyToNv12Row2 row2 = pixconv_get_funcs()->uyvy_to_nv12_row2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s0 = src + (ptrdiff_t)y * src_stride;
+        uint8_t *y0 = dst[0] + (ptrdiff_t)y * dst_stride[0];
+        // 奇数高度的最后一行与自身配对
+        int last = y + 1 >= height;
+        row2(s0, last ? s0 : s0 + src_stride, y0, last ? y0 : y0 + dst_stride[0],
+             dst[1] + (ptrdiff_t)(y / 2) * dst_stride[1], width);
+    }
+}
+
+// 四舍五入到整数(避免依赖libm)
+static int
+pixconv_round(double v)
+{
+    return (int)(v >= 0 ? v + 0.5 : v - 0.5);
+}
+
+void
+pixconv_rgb_coeffs_init(PixconvRgbCoeffs *c, enum PixconvRgbOrder order,
+                        enum PixconvMatrix matrix, int full_range)
+{
+    double kr = matrix == PIXCONV_MATRIX_BT709 ? 0.2126 : 0.299;
+    double kb = matrix == PIXCONV_MATRIX_BT709 ? 0.0722 : 0.114;
+    double y_scale = (full_range ? 255.0 : 219.0) / 255.0 * (1 << 15);
+    double c_scale = (full_range ? 255.0 : 224.0) / 255.0 * (1 << 15);
+
+    // G系数由其余系数推出，保证白色映射到最大亮度、灰色的色度恰为128
+    int yr = pixconv_round(kr * y_scale);
+    int yb = pixconv_round(kb * y_scale);
+    int yg = pixconv_round(y_scale) - yr - yb;
+    int ub = pixconv_round(0.5 * c_scale);
+    int ur = pixconv_round(-kr / (2.0 * (1.0 - kb)) * c_scale);
+    int ug = -ub - ur;
+    int vr = pixconv_round(0.5 * c_scale);
+    int vb = pixconv_round(-kb / (2.0 * (1.0 - kr)) * c_scale);
+    int vg = -vr - vb;
+
+    int ri = order == PIXCONV_ORDER_RGBA ? 0 : 2;
+    int bi = 2 - ri;
+
+    memset(c, 0, sizeof(*c));
+    for (int i = 0; i < 8; i += 4) {
+        c->y[i + ri] = (int16_t)yr;
+        c->y[i + 1] = (int16_t)yg;
+        c->y[i + bi] = (int16_t)yb;
+        c->u[i + ri] = (int16_t)ur;
+        c->u[i + 1] = (int16_t)ug;
+        c->u[i + bi] = (int16_t)ub;
+        c->v[i + ri] = (int16_t)vr;
+        c->v[i + 1] = (int16_t)vg;
+        c->v[i + bi] = (int16_t)vb;
+    }
+    c->y_bias = ((full_range ? 0 : 16) << 15) + (1 << 14);
+    c->uv_bias = (128 << 17) + (1 << 16);
+}
+
+void
+pixconv_rgb32_to_i420(const uint8_t *src, int src_stride, uint8_t *const dst[3],
+                      const int dst_stride[3], int width, int height,
+                      const PixconvRgbCoeffs *c)
+{
+    PixconvRgb32ToI420Row2 row2 = pixconv_get_funcs()->rgb32_to_i420_row2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s0 = src + (ptrdiff_t)y * src_stride;
+        uint8_t *y0 = dst[0] + (ptrdiff_t)y * dst_stride[0];
+        // 奇数高度的最后一行与自身配对
+        int last = y + 1 >= height;
+        row2(s0, last ? s0 : s0 + src_stride, y0, last ? y0 : y0 + dst_stride[0],
+             dst[1] + (ptrdiff_t)(y / 2) * dst_stride[1],
+             dst[2] + (ptrdiff_t)(y / 2) * dst_stride[2], width, c);
+    }
+}
+
+void
+pixconv_rgb32_to_nv12(const uint8_t *src, int src_stride, uint8_t *const dst[2],
+                      const int dst_stride[2], int width, int height,
+                      const PixconvRgbCoeffs *c)
+{
+    PixconvRgb32ToNv12Row2 row2 = pixconv_get_funcs()->rgb32_to_nv12_row2;
+
+    for (int y = 0; y < height; y += 2) {
+        const uint8_t *s0 = src + (ptrdiff_t)y * src_stride;
+        uint8_t *y0 = dst[0] + (ptrdiff_t)y * dst_stride[0];
+        // 奇数高度的最后一行与自身配对
+        int last = y + 1 >= height;
+        row2(s0, last ? s0 : s0 + src_stride, y0, last ? y0 : y0 + dst_stride[0],
+             dst[1] + (ptrdiff_t)(y / 2) * dst_stride[1], width, c);
+    }
+}
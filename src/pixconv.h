@@ -0,0 +1,190 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 像素格式转换内核
+// 提供标量参考实现和 SSE2/AVX2/AVX-512/NEON 向量化实现，运行时按CPU能力分派。
+// 所有实现的输出与标量版本逐位一致
+// 支持 UYVY 及32位RGB(BGRA/BGRX/RGBA/RGBX) 到 I420/NV12 的转换
+
+#ifndef PIXCONV_H
+#define PIXCONV_H
+
+#include <stdint.h>
+
+// 指令集级别，数值越大越优先
+enum PixconvLevel {
+    PIXCONV_LEVEL_SCALAR = 0, // 标量参考实现
+    PIXCONV_LEVEL_SSE2,
+    PIXCONV_LEVEL_AVX2,
+    PIXCONV_LEVEL_AVX512,     // AVX-512F + AVX-512BW
+    PIXCONV_LEVEL_NEON,
+    PIXCONV_LEVEL_NB
+};
+
+// RGB->YUV转换矩阵
+enum PixconvMatrix {
+    PIXCONV_MATRIX_BT601,
+    PIXCONV_MATRIX_BT709,
+};
+
+// 32位RGB像素的字节顺序，第四个字节(A或X)不参与计算
+enum PixconvRgbOrder {
+    PIXCONV_ORDER_BGRA, // BGRA、BGRX
+    PIXCONV_ORDER_RGBA, // RGBA、RGBX
+};
+
+// 定点RGB->YUV系数，由pixconv_rgb_coeffs_init生成
+// 系数按像素内的字节顺序排列(每像素4个，重复两次)，可直接用于16位乘加指令
+typedef struct PixconvRgbCoeffs {
+    int16_t y[8];    // 亮度系数，Q15
+    int16_t u[8];    // U系数，Q15
+    int16_t v[8];    // V系数，Q15
+    int32_t y_bias;  // 亮度偏移与舍入，Q15
+    int32_t uv_bias; // 色度偏移与舍入，Q17(作用于2x2像素之和)
+} PixconvRgbCoeffs;
+
+/**
+ * 两行UYVY -> 两行Y + 一行U + 一行V(I420)
+ * @param src0 第一行UYVY
+ * @param src1 第二行UYVY(单独最后一行时与src0相同)
+ * @param y0 第一行亮度输出
+ * @param y1 第二行亮度输出(单独最后一行时与y0相同)
+ * @param u 色度U输出(width/2个)
+ * @param v 色度V输出(width/2个)
+ * @param width 像素宽度(偶数)
+ */
+typedef void (*PixconvUyvyToI420Row2)(const uint8_t *src0, const uint8_t *src1,
+                                      uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                      uint8_t *v, int width);
+
+/**
+ * 两行UYVY -> 两行Y + 一行交织UV(NV12)
+ * @param uv 交织色度输出(width个字节)
+ * @note 其余参数同PixconvUyvyToI420Row2
+ */
+typedef void (*PixconvUyvyToNv12Row2)(const uint8_t *src0, const uint8_t *src1,
+                                      uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                      int width);
+
+/**
+ * 两行32位RGB -> 两行Y + 一行U + 一行V(I420)，色度取2x2像素的平均
+ * @param src0 第一行RGB
+ * @param src1 第二行RGB(单独最后一行时与src0相同)
+ * @param y0 第一行亮度输出
+ * @param y1 第二行亮度输出(单独最后一行时与y0相同)
+ * @param u 色度U输出((width+1)/2个)
+ * @param v 色度V输出((width+1)/2个)
+ * @param width 像素宽度(奇数宽度时最后一个像素与自身配对)
+ * @param c 转换系数
+ */
+typedef void (*PixconvRgb32ToI420Row2)(const uint8_t *src0,
+                                       const uint8_t *src1, uint8_t *y0,
+                                       uint8_t *y1, uint8_t *u, uint8_t *v,
+                                       int width, const PixconvRgbCoeffs *c);
+
+/**
+ * 两行32位RGB -> 两行Y + 一行交织UV(NV12)
+ * @param uv 交织色度输出((width+1)/2*2个字节)
+ * @note 其余参数同PixconvRgb32ToI420Row2
+ */
+typedef void (*PixconvRgb32ToNv12Row2)(const uint8_t *src0,
+                                       const uint8_t *src1, uint8_t *y0,
+                                       uint8_t *y1, uint8_t *uv, int width,
+                                       const PixconvRgbCoeffs *c);
+
+// 某一指令集级别的内核集合
+typedef struct PixconvFuncs {
+    enum PixconvLevel level;                // 指令集级别
+    const char *name;                       // 级别名称(如"avx2")
+    PixconvUyvyToI420Row2 uyvy_to_i420_row2;
+    PixconvUyvyToNv12Row2 uyvy_to_nv12_row2;
+    PixconvRgb32ToI420Row2 rgb32_to_i420_row2;
+    PixconvRgb32ToNv12Row2 rgb32_to_nv12_row2;
+} PixconvFuncs;
+
+/**
+ * 获取当前CPU支持的最优内核集合(首次调用时检测CPU)
+ * @return 内核集合
+ */
+const PixconvFuncs *
+pixconv_get_funcs(void);
+
+/**
+ * 获取指定指令集级别的内核集合，用于对比测试和基准测试
+ * @param level 指令集级别
+ * @return 内核集合，CPU或编译器不支持该级别时返回NULL
+ */
+const PixconvFuncs *
+pixconv_get_funcs_for_level(enum PixconvLevel level);
+
+/**
+ * UYVY -> I420(YUV420P)，色度取上下两行的四舍五入平均
+ * @param src UYVY数据
+ * @param src_stride UYVY行字节数
+ * @param dst Y/U/V平面
+ * @param dst_stride Y/U/V平面行字节数
+ * @param width 像素宽度(偶数)
+ * @param height 像素高度
+ */
+void
+pixconv_uyvy_to_i420(const uint8_t *src, int src_stride, uint8_t *const dst[3],
+                     const int dst_stride[3], int width, int height);
+
+/**
+ * UYVY -> NV12，色度取上下两行的四舍五入平均
+ * @param src UYVY数据
+ * @param src_stride UYVY行字节数
+ * @param dst Y/UV平面
+ * @param dst_stride Y/UV平面行字节数
+ * @param width 像素宽度(偶数)
+ * @param height 像素高度
+ */
+void
+pixconv_uyvy_to_nv12(const uint8_t *src, int src_stride, uint8_t *const dst[2],
+                     const int dst_stride[2], int width, int height);
+
+/**
+ * 生成RGB->YUV定点系数
+ * @param c 输出系数
+ * @param order 输入像素字节顺序
+ * @param matrix 转换矩阵
+ * @param full_range 非0表示全范围(0-255)，否则为有限范围(Y 16-235, UV 16-240)
+ */
+void
+pixconv_rgb_coeffs_init(PixconvRgbCoeffs *c, enum PixconvRgbOrder order,
+                        enum PixconvMatrix matrix, int full_range);
+
+/**
+ * 32位RGB -> I420(YUV420P)
+ * @param src RGB数据
+ * @param src_stride RGB行字节数
+ * @param dst Y/U/V平面
+ * @param dst_stride Y/U/V平面行字节数
+ * @param width 像素宽度
+ * @param height 像素高度
+ * @param c 转换系数
+ */
+void
+pixconv_rgb32_to_i420(const uint8_t *src, int src_stride, uint8_t *const dst[3],
+                      const int dst_stride[3], int width, int height,
+                      const PixconvRgbCoeffs *c);
+
+/**
+ * 32位RGB -> NV12
+ * @param src RGB数据
+ * @param src_stride RGB行字节数
+ * @param dst Y/UV平面
+ * @param dst_stride Y/UV平面行字节数
+ * @param width 像素宽度
+ * @param height 像素高度
+ * @param c 转换系数
+ */
+void
+pixconv_rgb32_to_nv12(const uint8_t *src, int src_stride, uint8_t *const dst[2],
+                      const int dst_stride[2], int width, int height,
+                      const PixconvRgbCoeffs *c);
+
+#endif
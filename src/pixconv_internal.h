@@ -0,0 +1,65 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 像素格式转换内核的内部声明，仅供 pixconv*.c 使用
+
+#ifndef PIXCONV_INTERNAL_H
+#define PIXCONV_INTERNAL_H
+
+#include "pixconv.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)              \
+        || defined(_M_IX86)
+#define PIXCONV_ARCH_X86 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)                                \
+        || (defined(__ARM_NEON) && defined(__arm__))
+#define PIXCONV_ARCH_NEON 1
+#endif
+
+// 在单个源文件内为函数启用更高的指令集(MSVC无需额外标记)
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXCONV_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PIXCONV_TARGET(isa)
+#endif
+
+// 标量参考实现，向量化实现用它处理行尾不足一个向量的像素
+void
+pixconv_uyvy_to_i420_row2_c(const uint8_t *src0, const uint8_t *src1,
+                            uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                            int width);
+
+void
+pixconv_uyvy_to_nv12_row2_c(const uint8_t *src0, const uint8_t *src1,
+                            uint8_t *y0, uint8_t *y1, uint8_t *uv, int width);
+
+void
+pixconv_rgb32_to_i420_row2_c(const uint8_t *src0, const uint8_t *src1,
+                             uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                             int width, const PixconvRgbCoeffs *c);
+
+void
+pixconv_rgb32_to_nv12_row2_c(const uint8_t *src0, const uint8_t *src1,
+                             uint8_t *y0, uint8_t *y1, uint8_t *uv, int width,
+                             const PixconvRgbCoeffs *c);
+
+#ifdef PIXCONV_ARCH_X86
+// 检测x86 CPU支持的最高级别
+enum PixconvLevel
+pixconv_detect_x86(void);
+
+extern const PixconvFuncs pixconv_funcs_sse2;
+extern const PixconvFuncs pixconv_funcs_avx2;
+extern const PixconvFuncs pixconv_funcs_avx512;
+#endif
+
+#ifdef PIXCONV_ARCH_NEON
+extern const PixconvFuncs pixconv_funcs_neon;
+#endif
+
+#endif
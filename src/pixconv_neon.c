@@ -0,0 +1,166 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// ARM NEON 向量化像素格式转换内核
+
+#include "pixconv_internal.h"
+
+#ifdef PIXCONV_ARCH_NEON
+
+#include <arm_neon.h>
+
+// 每次处理32个像素：vld4q按字节解交织为U、Y0、V、Y1四个向量
+
+static void
+pixconv_uyvy_to_i420_row2_neon(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                               int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 2);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 2);
+
+        vst2q_u8(y0 + x, (uint8x16x2_t){ { a.val[1], a.val[3] } });
+        vst2q_u8(y1 + x, (uint8x16x2_t){ { b.val[1], b.val[3] } });
+        vst1q_u8(u + x / 2, vrhaddq_u8(a.val[0], b.val[0]));
+        vst1q_u8(v + x / 2, vrhaddq_u8(a.val[2], b.val[2]));
+    }
+
+    pixconv_uyvy_to_i420_row2_c(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                u + x / 2, v + x / 2, width - x);
+}
+
+static void
+pixconv_uyvy_to_nv12_row2_neon(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 2);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 2);
+
+        vst2q_u8(y0 + x, (uint8x16x2_t){ { a.val[1], a.val[3] } });
+        vst2q_u8(y1 + x, (uint8x16x2_t){ { b.val[1], b.val[3] } });
+        vst2q_u8(uv + x, (uint8x16x2_t){ { vrhaddq_u8(a.val[0], b.val[0]),
+                                           vrhaddq_u8(a.val[2], b.val[2]) } });
+    }
+
+    pixconv_uyvy_to_nv12_row2_c(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                uv + x, width - x);
+}
+
+// 32位RGB -> YUV，每次处理16个像素：vld4q按字节解交织出四个通道，
+// 色度用vpaddlq求水平相邻像素之和
+
+// 8个位置上四个通道(16位)与系数k的点积，加偏移后算术右移并饱和为8位
+static inline uint8x8_t
+pixconv_neon_dot8(const int16x8_t ch[4], const int16_t *k, int32x4_t bias,
+                  int32x4_t shift)
+{
+    int32x4_t lo = bias;
+    int32x4_t hi = bias;
+
+    for (int i = 0; i < 4; ++i) {
+        lo = vmlal_n_s16(lo, vget_low_s16(ch[i]), k[i]);
+        hi = vmlal_n_s16(hi, vget_high_s16(ch[i]), k[i]);
+    }
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(vshlq_s32(lo, shift)),
+                                    vqmovn_s32(vshlq_s32(hi, shift))));
+}
+
+// 一行16个像素 -> 16个亮度
+static inline void
+pixconv_neon_rgb32_y16(const uint8x16x4_t px, uint8_t *y,
+                       const PixconvRgbCoeffs *c)
+{
+    const int32x4_t bias = vdupq_n_s32(c->y_bias);
+    const int32x4_t shift = vdupq_n_s32(-15);
+    int16x8_t lo[4], hi[4];
+
+    for (int i = 0; i < 4; ++i) {
+        lo[i] = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(px.val[i])));
+        hi[i] = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(px.val[i])));
+    }
+    vst1q_u8(y, vcombine_u8(pixconv_neon_dot8(lo, c->y, bias, shift),
+                            pixconv_neon_dot8(hi, c->y, bias, shift)));
+}
+
+// 两行各16个像素 -> 8个U和8个V
+static inline void
+pixconv_neon_rgb32_uv8(const uint8x16x4_t a, const uint8x16x4_t b,
+                       const PixconvRgbCoeffs *c, uint8x8_t *u, uint8x8_t *v)
+{
+    const int32x4_t bias = vdupq_n_s32(c->uv_bias);
+    const int32x4_t shift = vdupq_n_s32(-17);
+    int16x8_t sum[4];
+
+    for (int i = 0; i < 4; ++i) {
+        sum[i] = vreinterpretq_s16_u16(
+                vaddq_u16(vpaddlq_u8(a.val[i]), vpaddlq_u8(b.val[i])));
+    }
+    *u = pixconv_neon_dot8(sum, c->u, bias, shift);
+    *v = pixconv_neon_dot8(sum, c->v, bias, shift);
+}
+
+static void
+pixconv_rgb32_to_i420_row2_neon(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                uint8_t *v, int width,
+                                const PixconvRgbCoeffs *c)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 4);
+        uint8x8_t u8, v8;
+
+        pixconv_neon_rgb32_y16(a, y0 + x, c);
+        pixconv_neon_rgb32_y16(b, y1 + x, c);
+        pixconv_neon_rgb32_uv8(a, b, c, &u8, &v8);
+        vst1_u8(u + x / 2, u8);
+        vst1_u8(v + x / 2, v8);
+    }
+
+    pixconv_rgb32_to_i420_row2_c(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                 u + x / 2, v + x / 2, width - x, c);
+}
+
+static void
+pixconv_rgb32_to_nv12_row2_neon(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                int width, const PixconvRgbCoeffs *c)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 4);
+        uint8x8x2_t uv8;
+
+        pixconv_neon_rgb32_y16(a, y0 + x, c);
+        pixconv_neon_rgb32_y16(b, y1 + x, c);
+        pixconv_neon_rgb32_uv8(a, b, c, &uv8.val[0], &uv8.val[1]);
+        vst2_u8(uv + x, uv8);
+    }
+
+    pixconv_rgb32_to_nv12_row2_c(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                 uv + x, width - x, c);
+}
+
+const PixconvFuncs pixconv_funcs_neon = {
+    .level = PIXCONV_LEVEL_NEON,
+    .name = "neon",
+    .uyvy_to_i420_row2 = pixconv_uyvy_to_i420_row2_neon,
+    .uyvy_to_nv12_row2 = pixconv_uyvy_to_nv12_row2_neon,
+    .rgb32_to_i420_row2 = pixconv_rgb32_to_i420_row2_neon,
+    .rgb32_to_nv12_row2 = pixconv_rgb32_to_nv12_row2_neon,
+};
+
+#endif
@@ -0,0 +1,765 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// x86 向量化像素格式转换内核(SSE2/AVX2/AVX-512)
+
+#include "pixconv_internal.h"
+
+#ifdef PIXCONV_ARCH_X86
+
+#include <immintrin.h>
+#include <stdatomic.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// 执行CPUID指令
+static void
+pixconv_cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// 读取XCR0，确认操作系统会保存YMM/ZMM寄存器状态
+static unsigned long long
+pixconv_xgetbv(void)
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+enum PixconvLevel
+pixconv_detect_x86(void)
+{
+    // 检测结果与线程无关，并发首次调用最多重复检测一次
+    static _Atomic(int) detected = -1;
+    int cached = atomic_load(&detected);
+    if (cached >= 0)
+        return (enum PixconvLevel)cached;
+
+    unsigned regs[4];
+    enum PixconvLevel level = PIXCONV_LEVEL_SCALAR;
+
+    pixconv_cpuid(0, 0, regs);
+    unsigned max_leaf = regs[0];
+
+    pixconv_cpuid(1, 0, regs);
+    int sse2 = (regs[3] >> 26) & 1;
+    int osxsave = (regs[2] >> 27) & 1;
+    int avx = (regs[2] >> 28) & 1;
+
+    if (sse2)
+        level = PIXCONV_LEVEL_SSE2;
+
+    if (osxsave && avx && max_leaf >= 7) {
+        unsigned long long xcr0 = pixconv_xgetbv();
+        pixconv_cpuid(7, 0, regs);
+        int avx2 = (regs[1] >> 5) & 1;
+        int avx512f = (regs[1] >> 16) & 1;
+        int avx512bw = (regs[1] >> 30) & 1;
+
+        if (avx2 && (xcr0 & 0x6) == 0x6)
+            level = PIXCONV_LEVEL_AVX2;
+        if (avx512f && avx512bw && (xcr0 & 0xe6) == 0xe6)
+            level = PIXCONV_LEVEL_AVX512;
+    }
+
+    atomic_store(&detected, level);
+    return level;
+}
+
+// ---------------------------------------------------------------- SSE2
+// 每次处理32个像素(每行64字节UYVY)
+
+// 两行各32像素UYVY -> 两行Y(各32字节)及两行平均后的交织UV(2x16字节)
+PIXCONV_TARGET("sse2") static inline void
+pixconv_sse2_uyvy_block(const uint8_t *s0, const uint8_t *s1, uint8_t *y0,
+                        uint8_t *y1, __m128i *uv_lo, __m128i *uv_hi)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    __m128i a[4], b[4];
+
+    for (int i = 0; i < 4; ++i) {
+        a[i] = _mm_loadu_si128((const __m128i *)s0 + i);
+        b[i] = _mm_loadu_si128((const __m128i *)s1 + i);
+    }
+
+    // 亮度位于每个16位字的高字节
+    for (int i = 0; i < 2; ++i) {
+        _mm_storeu_si128((__m128i *)y0 + i,
+                         _mm_packus_epi16(_mm_srli_epi16(a[i * 2], 8),
+                                          _mm_srli_epi16(a[i * 2 + 1], 8)));
+        _mm_storeu_si128((__m128i *)y1 + i,
+                         _mm_packus_epi16(_mm_srli_epi16(b[i * 2], 8),
+                                          _mm_srli_epi16(b[i * 2 + 1], 8)));
+    }
+
+    // 色度位于低字节，打包后得到UVUV...，再与下一行四舍五入平均
+    *uv_lo = _mm_avg_epu8(_mm_packus_epi16(_mm_and_si128(a[0], mask),
+                                           _mm_and_si128(a[1], mask)),
+                          _mm_packus_epi16(_mm_and_si128(b[0], mask),
+                                           _mm_and_si128(b[1], mask)));
+    *uv_hi = _mm_avg_epu8(_mm_packus_epi16(_mm_and_si128(a[2], mask),
+                                           _mm_and_si128(a[3], mask)),
+                          _mm_packus_epi16(_mm_and_si128(b[2], mask),
+                                           _mm_and_si128(b[3], mask)));
+}
+
+PIXCONV_TARGET("sse2") static void
+pixconv_uyvy_to_i420_row2_sse2(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                               int width)
+{
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m128i uv_lo, uv_hi;
+        pixconv_sse2_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                &uv_lo, &uv_hi);
+        _mm_storeu_si128((__m128i *)(u + x / 2),
+                         _mm_packus_epi16(_mm_and_si128(uv_lo, mask),
+                                          _mm_and_si128(uv_hi, mask)));
+        _mm_storeu_si128((__m128i *)(v + x / 2),
+                         _mm_packus_epi16(_mm_srli_epi16(uv_lo, 8),
+                                          _mm_srli_epi16(uv_hi, 8)));
+    }
+
+    pixconv_uyvy_to_i420_row2_c(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                u + x / 2, v + x / 2, width - x);
+}
+
+PIXCONV_TARGET("sse2") static void
+pixconv_uyvy_to_nv12_row2_sse2(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        __m128i uv_lo, uv_hi;
+        pixconv_sse2_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                &uv_lo, &uv_hi);
+        _mm_storeu_si128((__m128i *)(uv + x), uv_lo);
+        _mm_storeu_si128((__m128i *)(uv + x) + 1, uv_hi);
+    }
+
+    pixconv_uyvy_to_nv12_row2_c(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                uv + x, width - x);
+}
+
+// 32位RGB -> YUV：像素字节扩展为16位后与系数做madd，每像素得到两个部分和，
+// 再用shuffle_ps把部分和按像素顺序相加。每次处理16个像素
+
+// 16位像素数据lo(像素0、1)和hi(像素2、3)与系数k的点积 -> 4个32位结果
+PIXCONV_TARGET("sse2") static inline __m128i
+pixconv_sse2_dot4(__m128i lo, __m128i hi, __m128i k)
+{
+    __m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, k));
+    __m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, k));
+    return _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// 一行16个像素 -> 16个亮度
+PIXCONV_TARGET("sse2") static inline void
+pixconv_sse2_rgb32_y16(const uint8_t *s, uint8_t *y, __m128i k, __m128i bias)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i d[4];
+
+    for (int i = 0; i < 4; ++i) {
+        __m128i px = _mm_loadu_si128((const __m128i *)s + i);
+        d[i] = _mm_srai_epi32(
+                _mm_add_epi32(pixconv_sse2_dot4(_mm_unpacklo_epi8(px, zero),
+                                                _mm_unpackhi_epi8(px, zero), k),
+                              bias),
+                15);
+    }
+    _mm_storeu_si128((__m128i *)y,
+                     _mm_packus_epi16(_mm_packs_epi32(d[0], d[1]),
+                                      _mm_packs_epi32(d[2], d[3])));
+}
+
+// 两行各16个像素 -> 8个U和8个V(16位，未饱和到8位)
+PIXCONV_TARGET("sse2") static inline void
+pixconv_sse2_rgb32_uv8(const uint8_t *s0, const uint8_t *s1,
+                       const PixconvRgbCoeffs *c, __m128i *u, __m128i *v)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ku = _mm_loadu_si128((const __m128i *)c->u);
+    const __m128i kv = _mm_loadu_si128((const __m128i *)c->v);
+    const __m128i bias = _mm_set1_epi32(c->uv_bias);
+    __m128i sum[4];
+
+    // sum[i]为第2i、2i+1个色度样本对应的2x2像素和
+    for (int i = 0; i < 4; ++i) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s0 + i);
+        __m128i b = _mm_loadu_si128((const __m128i *)s1 + i);
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                   _mm_unpacklo_epi8(b, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                   _mm_unpackhi_epi8(b, zero));
+        sum[i] = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi),
+                               _mm_unpackhi_epi64(lo, hi));
+    }
+
+    *u = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(pixconv_sse2_dot4(sum[0], sum[1], ku), bias), 17),
+            _mm_srai_epi32(_mm_add_epi32(pixconv_sse2_dot4(sum[2], sum[3], ku), bias), 17));
+    *v = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(pixconv_sse2_dot4(sum[0], sum[1], kv), bias), 17),
+            _mm_srai_epi32(_mm_add_epi32(pixconv_sse2_dot4(sum[2], sum[3], kv), bias), 17));
+}
+
+PIXCONV_TARGET("sse2") static void
+pixconv_rgb32_to_i420_row2_sse2(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                uint8_t *v, int width,
+                                const PixconvRgbCoeffs *c)
+{
+    const __m128i ky = _mm_loadu_si128((const __m128i *)c->y);
+    const __m128i y_bias = _mm_set1_epi32(c->y_bias);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i u16, v16;
+        pixconv_sse2_rgb32_y16(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_sse2_rgb32_y16(src1 + x * 4, y1 + x, ky, y_bias);
+        pixconv_sse2_rgb32_uv8(src0 + x * 4, src1 + x * 4, c, &u16, &v16);
+        _mm_storel_epi64((__m128i *)(u + x / 2), _mm_packus_epi16(u16, u16));
+        _mm_storel_epi64((__m128i *)(v + x / 2), _mm_packus_epi16(v16, v16));
+    }
+
+    pixconv_rgb32_to_i420_row2_c(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                 u + x / 2, v + x / 2, width - x, c);
+}
+
+PIXCONV_TARGET("sse2") static void
+pixconv_rgb32_to_nv12_row2_sse2(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                int width, const PixconvRgbCoeffs *c)
+{
+    const __m128i ky = _mm_loadu_si128((const __m128i *)c->y);
+    const __m128i y_bias = _mm_set1_epi32(c->y_bias);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i u16, v16;
+        pixconv_sse2_rgb32_y16(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_sse2_rgb32_y16(src1 + x * 4, y1 + x, ky, y_bias);
+        pixconv_sse2_rgb32_uv8(src0 + x * 4, src1 + x * 4, c, &u16, &v16);
+        _mm_storeu_si128((__m128i *)(uv + x),
+                         _mm_unpacklo_epi8(_mm_packus_epi16(u16, u16),
+                                           _mm_packus_epi16(v16, v16)));
+    }
+
+    pixconv_rgb32_to_nv12_row2_c(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                 uv + x, width - x, c);
+}
+
+const PixconvFuncs pixconv_funcs_sse2 = {
+    .level = PIXCONV_LEVEL_SSE2,
+    .name = "sse2",
+    .uyvy_to_i420_row2 = pixconv_uyvy_to_i420_row2_sse2,
+    .uyvy_to_nv12_row2 = pixconv_uyvy_to_nv12_row2_sse2,
+    .rgb32_to_i420_row2 = pixconv_rgb32_to_i420_row2_sse2,
+    .rgb32_to_nv12_row2 = pixconv_rgb32_to_nv12_row2_sse2,
+};
+
+// ---------------------------------------------------------------- AVX2
+// 每次处理64个像素(每行128字节UYVY)。packus按128位通道工作，载入时把
+// 相隔32字节的两个16字节块放进同一寄存器的两个通道，打包结果即为按像素
+// 顺序的Y和交织UV，不需要跨通道调整；只有I420的U、V再打包一次后需要在
+// 存储前用permute4x64恢复顺序
+
+// 载入lo、hi处各16字节，分别放在低、高128位通道
+PIXCONV_TARGET("avx2") static inline __m256i
+pixconv_avx2_load2(const uint8_t *lo, const uint8_t *hi)
+{
+    return _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)lo)),
+            _mm_loadu_si128((const __m128i *)hi), 1);
+}
+
+// 两行各64像素UYVY -> 两行Y(各64字节)及两行平均后的交织UV(2x32字节)
+PIXCONV_TARGET("avx2") static inline void
+pixconv_avx2_uyvy_block(const uint8_t *s0, const uint8_t *s1, uint8_t *y0,
+                        uint8_t *y1, __m256i *uv_lo, __m256i *uv_hi)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    __m256i a[4], b[4];
+
+    // a[2i]为像素32i..32i+7和32i+16..32i+23，a[2i+1]为紧随其后的各8个像素
+    for (int i = 0; i < 2; ++i) {
+        a[i * 2] = pixconv_avx2_load2(s0 + i * 64, s0 + i * 64 + 32);
+        a[i * 2 + 1] = pixconv_avx2_load2(s0 + i * 64 + 16, s0 + i * 64 + 48);
+        b[i * 2] = pixconv_avx2_load2(s1 + i * 64, s1 + i * 64 + 32);
+        b[i * 2 + 1] = pixconv_avx2_load2(s1 + i * 64 + 16, s1 + i * 64 + 48);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        _mm256_storeu_si256((__m256i *)y0 + i,
+                            _mm256_packus_epi16(_mm256_srli_epi16(a[i * 2], 8),
+                                                _mm256_srli_epi16(a[i * 2 + 1], 8)));
+        _mm256_storeu_si256((__m256i *)y1 + i,
+                            _mm256_packus_epi16(_mm256_srli_epi16(b[i * 2], 8),
+                                                _mm256_srli_epi16(b[i * 2 + 1], 8)));
+    }
+
+    *uv_lo = _mm256_avg_epu8(
+            _mm256_packus_epi16(_mm256_and_si256(a[0], mask),
+                                _mm256_and_si256(a[1], mask)),
+            _mm256_packus_epi16(_mm256_and_si256(b[0], mask),
+                                _mm256_and_si256(b[1], mask)));
+    *uv_hi = _mm256_avg_epu8(
+            _mm256_packus_epi16(_mm256_and_si256(a[2], mask),
+                                _mm256_and_si256(a[3], mask)),
+            _mm256_packus_epi16(_mm256_and_si256(b[2], mask),
+                                _mm256_and_si256(b[3], mask)));
+}
+
+// 交织UV中的U或V按通道打包后恢复顺序
+PIXCONV_TARGET("avx2") static inline __m256i
+pixconv_avx2_packus(__m256i a, __m256i b)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+}
+
+PIXCONV_TARGET("avx2") static void
+pixconv_uyvy_to_i420_row2_avx2(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v,
+                               int width)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        __m256i uv_lo, uv_hi;
+        pixconv_avx2_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                &uv_lo, &uv_hi);
+        _mm256_storeu_si256((__m256i *)(u + x / 2),
+                            pixconv_avx2_packus(_mm256_and_si256(uv_lo, mask),
+                                                _mm256_and_si256(uv_hi, mask)));
+        _mm256_storeu_si256((__m256i *)(v + x / 2),
+                            pixconv_avx2_packus(_mm256_srli_epi16(uv_lo, 8),
+                                                _mm256_srli_epi16(uv_hi, 8)));
+    }
+    _mm256_zeroupper();
+
+    pixconv_uyvy_to_i420_row2_sse2(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                   u + x / 2, v + x / 2, width - x);
+}
+
+PIXCONV_TARGET("avx2") static void
+pixconv_uyvy_to_nv12_row2_avx2(const uint8_t *src0, const uint8_t *src1,
+                               uint8_t *y0, uint8_t *y1, uint8_t *uv, int width)
+{
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        __m256i uv_lo, uv_hi;
+        pixconv_avx2_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                &uv_lo, &uv_hi);
+        _mm256_storeu_si256((__m256i *)(uv + x), uv_lo);
+        _mm256_storeu_si256((__m256i *)(uv + x) + 1, uv_hi);
+    }
+    _mm256_zeroupper();
+
+    pixconv_uyvy_to_nv12_row2_sse2(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                   uv + x, width - x);
+}
+
+// 32位RGB -> YUV，每次处理32个像素。madd/shuffle_ps/packs均按128位通道
+// 工作，打包结果用permutevar8x32恢复顺序
+
+// 按通道打包的32位分组恢复顺序
+PIXCONV_TARGET("avx2") static inline __m256i
+pixconv_avx2_unlane(__m256i a)
+{
+    return _mm256_permutevar8x32_epi32(a, _mm256_setr_epi32(0, 4, 1, 5, 2, 6,
+                                                             3, 7));
+}
+
+// lo(每通道像素0、1)和hi(每通道像素2、3)与系数k的点积 -> 8个32位结果
+PIXCONV_TARGET("avx2") static inline __m256i
+pixconv_avx2_dot8(__m256i lo, __m256i hi, __m256i k)
+{
+    __m256 a = _mm256_castsi256_ps(_mm256_madd_epi16(lo, k));
+    __m256 b = _mm256_castsi256_ps(_mm256_madd_epi16(hi, k));
+    return _mm256_add_epi32(
+            _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// 一行32个像素 -> 32个亮度
+PIXCONV_TARGET("avx2") static inline void
+pixconv_avx2_rgb32_y32(const uint8_t *s, uint8_t *y, __m256i k, __m256i bias)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i d[4];
+
+    for (int i = 0; i < 4; ++i) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)s + i);
+        d[i] = _mm256_srai_epi32(
+                _mm256_add_epi32(
+                        pixconv_avx2_dot8(_mm256_unpacklo_epi8(px, zero),
+                                          _mm256_unpackhi_epi8(px, zero), k),
+                        bias),
+                15);
+    }
+    _mm256_storeu_si256((__m256i *)y,
+                        pixconv_avx2_unlane(_mm256_packus_epi16(
+                                _mm256_packs_epi32(d[0], d[1]),
+                                _mm256_packs_epi32(d[2], d[3]))));
+}
+
+// 两行各32个像素 -> 打包后的色度，低128位为U0-7/V0-7，高128位为U8-15/V8-15
+PIXCONV_TARGET("avx2") static inline __m256i
+pixconv_avx2_rgb32_uv16(const uint8_t *s0, const uint8_t *s1,
+                        const PixconvRgbCoeffs *c)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ku = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)c->u));
+    const __m256i kv = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)c->v));
+    const __m256i bias = _mm256_set1_epi32(c->uv_bias);
+    __m256i sum[4];
+
+    for (int i = 0; i < 4; ++i) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s0 + i);
+        __m256i b = _mm256_loadu_si256((const __m256i *)s1 + i);
+        __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero),
+                                      _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero),
+                                      _mm256_unpackhi_epi8(b, zero));
+        sum[i] = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi),
+                                  _mm256_unpackhi_epi64(lo, hi));
+    }
+
+    __m256i u = pixconv_avx2_unlane(_mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(pixconv_avx2_dot8(sum[0], sum[1], ku), bias), 17),
+            _mm256_srai_epi32(_mm256_add_epi32(pixconv_avx2_dot8(sum[2], sum[3], ku), bias), 17)));
+    __m256i v = pixconv_avx2_unlane(_mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(pixconv_avx2_dot8(sum[0], sum[1], kv), bias), 17),
+            _mm256_srai_epi32(_mm256_add_epi32(pixconv_avx2_dot8(sum[2], sum[3], kv), bias), 17)));
+    return _mm256_packus_epi16(u, v);
+}
+
+PIXCONV_TARGET("avx2") static void
+pixconv_rgb32_to_i420_row2_avx2(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                uint8_t *v, int width,
+                                const PixconvRgbCoeffs *c)
+{
+    const __m256i ky = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)c->y));
+    const __m256i y_bias = _mm256_set1_epi32(c->y_bias);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        pixconv_avx2_rgb32_y32(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_avx2_rgb32_y32(src1 + x * 4, y1 + x, ky, y_bias);
+        __m256i uv = _mm256_permute4x64_epi64(
+                pixconv_avx2_rgb32_uv16(src0 + x * 4, src1 + x * 4, c), 0xd8);
+        _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(uv));
+        _mm_storeu_si128((__m128i *)(v + x / 2),
+                         _mm256_extracti128_si256(uv, 1));
+    }
+    _mm256_zeroupper();
+
+    pixconv_rgb32_to_i420_row2_sse2(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                    u + x / 2, v + x / 2, width - x, c);
+}
+
+PIXCONV_TARGET("avx2") static void
+pixconv_rgb32_to_nv12_row2_avx2(const uint8_t *src0, const uint8_t *src1,
+                                uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                int width, const PixconvRgbCoeffs *c)
+{
+    const __m256i ky = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)c->y));
+    const __m256i y_bias = _mm256_set1_epi32(c->y_bias);
+    // 每通道内把U0-7/V0-7交织为U0V0U1V1...
+    const __m256i interleave = _mm256_setr_epi8(
+            0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15,
+            0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+    int x = 0;
+
+    for (; x + 32 <= width; x += 32) {
+        pixconv_avx2_rgb32_y32(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_avx2_rgb32_y32(src1 + x * 4, y1 + x, ky, y_bias);
+        _mm256_storeu_si256(
+                (__m256i *)(uv + x),
+                _mm256_shuffle_epi8(
+                        pixconv_avx2_rgb32_uv16(src0 + x * 4, src1 + x * 4, c),
+                        interleave));
+    }
+    _mm256_zeroupper();
+
+    pixconv_rgb32_to_nv12_row2_sse2(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                    uv + x, width - x, c);
+}
+
+const PixconvFuncs pixconv_funcs_avx2 = {
+    .level = PIXCONV_LEVEL_AVX2,
+    .name = "avx2",
+    .uyvy_to_i420_row2 = pixconv_uyvy_to_i420_row2_avx2,
+    .uyvy_to_nv12_row2 = pixconv_uyvy_to_nv12_row2_avx2,
+    .rgb32_to_i420_row2 = pixconv_rgb32_to_i420_row2_avx2,
+    .rgb32_to_nv12_row2 = pixconv_rgb32_to_nv12_row2_avx2,
+};
+
+// ---------------------------------------------------------------- AVX-512
+// 每次处理128个像素(每行256字节UYVY)，需要AVX-512BW的字节/字指令
+
+// 按通道打包后恢复顺序
+PIXCONV_TARGET("avx512f,avx512bw") static inline __m512i
+pixconv_avx512_packus(__m512i a, __m512i b)
+{
+    const __m512i idx = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    return _mm512_permutexvar_epi64(idx, _mm512_packus_epi16(a, b));
+}
+
+// 两行各128像素UYVY -> 两行Y(各128字节)及两行平均后的交织UV(2x64字节)
+PIXCONV_TARGET("avx512f,avx512bw") static inline void
+pixconv_avx512_uyvy_block(const uint8_t *s0, const uint8_t *s1, uint8_t *y0,
+                          uint8_t *y1, __m512i *uv_lo, __m512i *uv_hi)
+{
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    __m512i a[4], b[4];
+
+    for (int i = 0; i < 4; ++i) {
+        a[i] = _mm512_loadu_si512((const void *)(s0 + i * 64));
+        b[i] = _mm512_loadu_si512((const void *)(s1 + i * 64));
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        _mm512_storeu_si512((void *)(y0 + i * 64),
+                            pixconv_avx512_packus(
+                                    _mm512_srli_epi16(a[i * 2], 8),
+                                    _mm512_srli_epi16(a[i * 2 + 1], 8)));
+        _mm512_storeu_si512((void *)(y1 + i * 64),
+                            pixconv_avx512_packus(
+                                    _mm512_srli_epi16(b[i * 2], 8),
+                                    _mm512_srli_epi16(b[i * 2 + 1], 8)));
+    }
+
+    *uv_lo = _mm512_avg_epu8(
+            pixconv_avx512_packus(_mm512_and_si512(a[0], mask),
+                                  _mm512_and_si512(a[1], mask)),
+            pixconv_avx512_packus(_mm512_and_si512(b[0], mask),
+                                  _mm512_and_si512(b[1], mask)));
+    *uv_hi = _mm512_avg_epu8(
+            pixconv_avx512_packus(_mm512_and_si512(a[2], mask),
+                                  _mm512_and_si512(a[3], mask)),
+            pixconv_avx512_packus(_mm512_and_si512(b[2], mask),
+                                  _mm512_and_si512(b[3], mask)));
+}
+
+PIXCONV_TARGET("avx512f,avx512bw") static void
+pixconv_uyvy_to_i420_row2_avx512(const uint8_t *src0, const uint8_t *src1,
+                                 uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                 uint8_t *v, int width)
+{
+    const __m512i mask = _mm512_set1_epi16(0x00ff);
+    int x = 0;
+
+    for (; x + 128 <= width; x += 128) {
+        __m512i uv_lo, uv_hi;
+        pixconv_avx512_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                  &uv_lo, &uv_hi);
+        _mm512_storeu_si512((void *)(u + x / 2),
+                            pixconv_avx512_packus(
+                                    _mm512_and_si512(uv_lo, mask),
+                                    _mm512_and_si512(uv_hi, mask)));
+        _mm512_storeu_si512((void *)(v + x / 2),
+                            pixconv_avx512_packus(_mm512_srli_epi16(uv_lo, 8),
+                                                  _mm512_srli_epi16(uv_hi, 8)));
+    }
+    _mm256_zeroupper();
+
+    pixconv_uyvy_to_i420_row2_avx2(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                   u + x / 2, v + x / 2, width - x);
+}
+
+PIXCONV_TARGET("avx512f,avx512bw") static void
+pixconv_uyvy_to_nv12_row2_avx512(const uint8_t *src0, const uint8_t *src1,
+                                 uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                 int width)
+{
+    int x = 0;
+
+    for (; x + 128 <= width; x += 128) {
+        __m512i uv_lo, uv_hi;
+        pixconv_avx512_uyvy_block(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                  &uv_lo, &uv_hi);
+        _mm512_storeu_si512((void *)(uv + x), uv_lo);
+        _mm512_storeu_si512((void *)(uv + x + 64), uv_hi);
+    }
+    _mm256_zeroupper();
+
+    pixconv_uyvy_to_nv12_row2_avx2(src0 + x * 2, src1 + x * 2, y0 + x, y1 + x,
+                                   uv + x, width - x);
+}
+
+// 32位RGB -> YUV，每次处理64个像素。四个128位通道的结果用
+// permutexvar_epi32恢复顺序
+
+// 按通道打包的32位分组恢复顺序
+PIXCONV_TARGET("avx512f,avx512bw") static inline __m512i
+pixconv_avx512_unlane(__m512i a)
+{
+    const __m512i idx = _mm512_set_epi32(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5,
+                                         1, 12, 8, 4, 0);
+    return _mm512_permutexvar_epi32(idx, a);
+}
+
+PIXCONV_TARGET("avx512f,avx512bw") static inline __m512i
+pixconv_avx512_dot16(__m512i lo, __m512i hi, __m512i k)
+{
+    __m512 a = _mm512_castsi512_ps(_mm512_madd_epi16(lo, k));
+    __m512 b = _mm512_castsi512_ps(_mm512_madd_epi16(hi, k));
+    return _mm512_add_epi32(
+            _mm512_castps_si512(_mm512_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm512_castps_si512(_mm512_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// 一行64个像素 -> 64个亮度
+PIXCONV_TARGET("avx512f,avx512bw") static inline void
+pixconv_avx512_rgb32_y64(const uint8_t *s, uint8_t *y, __m512i k, __m512i bias)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i d[4];
+
+    for (int i = 0; i < 4; ++i) {
+        __m512i px = _mm512_loadu_si512((const void *)(s + i * 64));
+        d[i] = _mm512_srai_epi32(
+                _mm512_add_epi32(
+                        pixconv_avx512_dot16(_mm512_unpacklo_epi8(px, zero),
+                                             _mm512_unpackhi_epi8(px, zero), k),
+                        bias),
+                15);
+    }
+    _mm512_storeu_si512((void *)y,
+                        pixconv_avx512_unlane(_mm512_packus_epi16(
+                                _mm512_packs_epi32(d[0], d[1]),
+                                _mm512_packs_epi32(d[2], d[3]))));
+}
+
+// 两行各64个像素 -> 打包后的色度，第k个128位通道为U(8k..8k+7)/V(8k..8k+7)
+PIXCONV_TARGET("avx512f,avx512bw") static inline __m512i
+pixconv_avx512_rgb32_uv32(const uint8_t *s0, const uint8_t *s1,
+                          const PixconvRgbCoeffs *c)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i ku = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)c->u));
+    const __m512i kv = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)c->v));
+    const __m512i bias = _mm512_set1_epi32(c->uv_bias);
+    __m512i sum[4];
+
+    for (int i = 0; i < 4; ++i) {
+        __m512i a = _mm512_loadu_si512((const void *)(s0 + i * 64));
+        __m512i b = _mm512_loadu_si512((const void *)(s1 + i * 64));
+        __m512i lo = _mm512_add_epi16(_mm512_unpacklo_epi8(a, zero),
+                                      _mm512_unpacklo_epi8(b, zero));
+        __m512i hi = _mm512_add_epi16(_mm512_unpackhi_epi8(a, zero),
+                                      _mm512_unpackhi_epi8(b, zero));
+        sum[i] = _mm512_add_epi16(_mm512_unpacklo_epi64(lo, hi),
+                                  _mm512_unpackhi_epi64(lo, hi));
+    }
+
+    __m512i u = pixconv_avx512_unlane(_mm512_packs_epi32(
+            _mm512_srai_epi32(_mm512_add_epi32(pixconv_avx512_dot16(sum[0], sum[1], ku), bias), 17),
+            _mm512_srai_epi32(_mm512_add_epi32(pixconv_avx512_dot16(sum[2], sum[3], ku), bias), 17)));
+    __m512i v = pixconv_avx512_unlane(_mm512_packs_epi32(
+            _mm512_srai_epi32(_mm512_add_epi32(pixconv_avx512_dot16(sum[0], sum[1], kv), bias), 17),
+            _mm512_srai_epi32(_mm512_add_epi32(pixconv_avx512_dot16(sum[2], sum[3], kv), bias), 17)));
+    return _mm512_packus_epi16(u, v);
+}
+
+PIXCONV_TARGET("avx512f,avx512bw") static void
+pixconv_rgb32_to_i420_row2_avx512(const uint8_t *src0, const uint8_t *src1,
+                                  uint8_t *y0, uint8_t *y1, uint8_t *u,
+                                  uint8_t *v, int width,
+                                  const PixconvRgbCoeffs *c)
+{
+    const __m512i ky = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)c->y));
+    const __m512i y_bias = _mm512_set1_epi32(c->y_bias);
+    const __m512i idx = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        pixconv_avx512_rgb32_y64(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_avx512_rgb32_y64(src1 + x * 4, y1 + x, ky, y_bias);
+        __m512i uv = _mm512_permutexvar_epi64(
+                idx, pixconv_avx512_rgb32_uv32(src0 + x * 4, src1 + x * 4, c));
+        _mm256_storeu_si256((__m256i *)(u + x / 2),
+                            _mm512_castsi512_si256(uv));
+        _mm256_storeu_si256((__m256i *)(v + x / 2),
+                            _mm512_extracti64x4_epi64(uv, 1));
+    }
+    _mm256_zeroupper();
+
+    pixconv_rgb32_to_i420_row2_avx2(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                    u + x / 2, v + x / 2, width - x, c);
+}
+
+PIXCONV_TARGET("avx512f,avx512bw") static void
+pixconv_rgb32_to_nv12_row2_avx512(const uint8_t *src0, const uint8_t *src1,
+                                  uint8_t *y0, uint8_t *y1, uint8_t *uv,
+                                  int width, const PixconvRgbCoeffs *c)
+{
+    const __m512i ky = _mm512_broadcast_i32x4(
+            _mm_loadu_si128((const __m128i *)c->y));
+    const __m512i y_bias = _mm512_set1_epi32(c->y_bias);
+    const __m512i interleave = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15));
+    int x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        pixconv_avx512_rgb32_y64(src0 + x * 4, y0 + x, ky, y_bias);
+        pixconv_avx512_rgb32_y64(src1 + x * 4, y1 + x, ky, y_bias);
+        _mm512_storeu_si512(
+                (void *)(uv + x),
+                _mm512_shuffle_epi8(
+                        pixconv_avx512_rgb32_uv32(src0 + x * 4, src1 + x * 4, c),
+                        interleave));
+    }
+    _mm256_zeroupper();
+
+    pixconv_rgb32_to_nv12_row2_avx2(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x,
+                                    uv + x, width - x, c);
+}
+
+const PixconvFuncs pixconv_funcs_avx512 = {
+    .level = PIXCONV_LEVEL_AVX512,
+    .name = "avx512",
+    .uyvy_to_i420_row2 = pixconv_uyvy_to_i420_row2_avx512,
+    .uyvy_to_nv12_row2 = pixconv_uyvy_to_nv12_row2_avx512,
+    .rgb32_to_i420_row2 = pixconv_rgb32_to_i420_row2_avx512,
+    .rgb32_to_nv12_row2 = pixconv_rgb32_to_nv12_row2_avx512,
+};
+
+#endif
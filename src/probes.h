@@ -0,0 +1,120 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// USDT静态探针
+// 以-DNDI_STREAMER_USDT=ON配置时，流水线的关键位置编译为sys/sdt.h探针
+// (提供者ndi_streamer)，可用bpftrace或perf挂到运行中的进程上，无需重启。
+// 未挂载时每个探针只是一条nop指令，参数都是已在寄存器或栈上的值，
+// 不调用任何函数；未启用该选项时不产生任何代码
+//
+// 除NDI时间戳外时间均为微秒，pts为编码器时间基(即相对转换器起始时间的微秒数)，
+// 音频的rendition为-1
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef NDI_STREAMER_USDT
+#include <sys/sdt.h>
+
+/**
+ * 从NDI取出一帧
+ * @param is_audio 0为视频，1为音频
+ * @param seq 本次运行中该媒体类型的帧序号(从1开始)
+ * @param timestamp 发送端给出的NDI时间戳(100纳秒)
+ * @param size 帧数据字节数
+ */
+#define PROBE_FRAME_CAPTURED(is_audio, seq, timestamp, size) \
+    DTRACE_PROBE4(ndi_streamer, frame_captured, is_audio, seq, timestamp, size)
+
+/**
+ * 视频帧转换完成
+ * @param seq 本次运行中转换的帧序号(从1开始)
+ * @param pts 帧的pts
+ * @param capture_ts 取出时的本地时间
+ * @param convert_us 转换耗时
+ */
+#define PROBE_FRAME_CONVERTED(seq, pts, capture_ts, convert_us) \
+    DTRACE_PROBE4(ndi_streamer, frame_converted, seq, pts, capture_ts, \
+                  convert_us)
+
+/**
+ * 即将把一帧送入编码器
+ * @param rendition 视频编码器索引，音频为-1
+ * @param pts 帧的pts
+ * @param width 视频宽度，音频为0
+ * @param height 视频高度，音频为0
+ * @param nb_samples 音频样本数，视频为0
+ */
+#define PROBE_FRAME_SUBMITTED(rendition, pts, width, height, nb_samples) \
+    DTRACE_PROBE5(ndi_streamer, frame_submitted, rendition, pts, width, \
+                  height, nb_samples)
+
+/**
+ * 编码器产出一个数据包
+ * @param rendition 视频编码器索引，音频为-1
+ * @param pts 数据包的pts
+ * @param dts 数据包的dts
+ * @param size 数据包字节数
+ * @param is_key 是否关键帧
+ */
+#define PROBE_PACKET_PRODUCED(rendition, pts, dts, size, is_key) \
+    DTRACE_PROBE5(ndi_streamer, packet_produced, rendition, pts, dts, size, \
+                  is_key)
+
+/**
+ * 一个数据包已写出到输出目标
+ * @param output 输出目标索引
+ * @param is_audio 0为视频，1为音频
+ * @param pts 数据包的pts
+ * @param size 数据包字节数
+ * @param write_us 写出耗时
+ * @param ret 写出结果，负数为FFmpeg错误码
+ */
+#define PROBE_PACKET_WRITTEN(output, is_audio, pts, size, write_us, ret) \
+    DTRACE_PROBE6(ndi_streamer, packet_written, output, is_audio, pts, size, \
+                  write_us, ret)
+
+/**
+ * 丢弃了一帧或一个数据包
+ * @param reason 丢弃原因(enum PipelineDropReason的值)
+ * @param pts 帧或数据包的pts，尚未转换的帧为AV_NOPTS_VALUE
+ * @param size 字节数，未知时为0
+ */
+#define PROBE_FRAME_DROPPED(reason, pts, size) \
+    DTRACE_PROBE3(ndi_streamer, frame_dropped, reason, pts, size)
+
+/**
+ * 一次连接输出目标的尝试结束(首次连接和断线重连)
+ * @param output 输出目标索引
+ * @param attempt 本次断开后的第几次尝试(从1开始)
+ * @param ret 连接结果，负数为FFmpeg错误码
+ */
+#define PROBE_OUTPUT_RECONNECT(output, attempt, ret) \
+    DTRACE_PROBE3(ndi_streamer, output_reconnect, output, attempt, ret)
+
+#else
+
+// 参数都是无副作用的值，转为void只为避免未使用变量的警告
+#define PROBE_FRAME_CAPTURED(is_audio, seq, timestamp, size) \
+    ((void)(is_audio), (void)(seq), (void)(timestamp), (void)(size))
+#define PROBE_FRAME_CONVERTED(seq, pts, capture_ts, convert_us) \
+    ((void)(seq), (void)(pts), (void)(capture_ts), (void)(convert_us))
+#define PROBE_FRAME_SUBMITTED(rendition, pts, width, height, nb_samples) \
+    ((void)(rendition), (void)(pts), (void)(width), (void)(height), \
+     (void)(nb_samples))
+#define PROBE_PACKET_PRODUCED(rendition, pts, dts, size, is_key) \
+    ((void)(rendition), (void)(pts), (void)(dts), (void)(size), (void)(is_key))
+#define PROBE_PACKET_WRITTEN(output, is_audio, pts, size, write_us, ret) \
+    ((void)(output), (void)(is_audio), (void)(pts), (void)(size), \
+     (void)(write_us), (void)(ret))
+#define PROBE_FRAME_DROPPED(reason, pts, size) \
+    ((void)(reason), (void)(pts), (void)(size))
+#define PROBE_OUTPUT_RECONNECT(output, attempt, ret) \
+    ((void)(output), (void)(attempt), (void)(ret))
+
+#endif
+
+#endif
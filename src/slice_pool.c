@@ -0,0 +1,183 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "slice_pool.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "thread.h"
+
+// 工作线程的参数
+typedef struct SliceWorker {
+    struct SlicePool *pool;
+    int home;                // 优先查找的批次位置
+} SliceWorker;
+
+// 一次slice_pool_run登记的一批分片，位于调用方的栈上
+typedef struct SliceBatch {
+    SlicePoolFunc func;      // 任务函数
+    void *arg;               // 传给func的参数
+    int nb_jobs;             // 分片数
+    int workers;             // 正在领取本批次分片的工作线程数(受mu保护)
+    _Atomic int next_job;    // 下一个待领取的分片
+} SliceBatch;
+
+struct SlicePool {
+    Thread *threads;         // 工作线程
+    SliceWorker *workers;    // 工作线程的参数
+    int nb_workers;          // 工作线程数
+
+    Mutex mu;                // 保护batches、各批次的workers和stop
+    Cond work_cv;            // 有新批次时唤醒工作线程
+    Cond done_cv;            // 某一批次的工作线程全部离开时唤醒调用方
+    SliceBatch *batches[SLICE_POOL_MAX_BATCHES]; // 已登记的批次，空位为NULL
+    int stop;                // 要求工作线程退出
+};
+
+// 领取并执行分片，直到该批次的分片全部被领取
+static void
+slice_pool_work(SliceBatch *batch)
+{
+    int job;
+    while ((job = atomic_fetch_add(&batch->next_job, 1)) < batch->nb_jobs)
+        batch->func(batch->arg, job, batch->nb_jobs);
+}
+
+// 从home开始查找仍有未领取分片的批次(调用时必须持有mu)
+static SliceBatch *
+slice_pool_find(SlicePool *pool, int home)
+{
+    for (int i = 0; i < SLICE_POOL_MAX_BATCHES; ++i) {
+        SliceBatch *batch = pool->batches[(home + i) % SLICE_POOL_MAX_BATCHES];
+        if (batch && atomic_load(&batch->next_job) < batch->nb_jobs)
+            return batch;
+    }
+    return NULL;
+}
+
+static void *
+slice_pool_worker(void *arg)
+{
+    SliceWorker *worker = arg;
+    SlicePool *pool = worker->pool;
+
+    mutex_lock(&pool->mu);
+    for (;;) {
+        SliceBatch *batch = NULL;
+        while (!pool->stop && !(batch = slice_pool_find(pool, worker->home)))
+            cond_wait(&pool->work_cv, &pool->mu);
+        if (pool->stop)
+            break;
+
+        // workers>0期间调用方不会撤销该批次
+        batch->workers++;
+        mutex_unlock(&pool->mu);
+
+        slice_pool_work(batch);
+
+        mutex_lock(&pool->mu);
+        if (--batch->workers == 0)
+            cond_broadcast(&pool->done_cv);
+    }
+    mutex_unlock(&pool->mu);
+    return NULL;
+}
+
+SlicePool *
+new_slice_pool(int nb_threads)
+{
+    SlicePool *pool = calloc(1, sizeof(SlicePool));
+    if (!pool)
+        return NULL;
+
+    mutex_init(&pool->mu);
+    cond_init(&pool->work_cv);
+    cond_init(&pool->done_cv);
+
+    int nb_workers = nb_threads > 1 ? nb_threads - 1 : 0;
+    if (nb_workers > 0) {
+        pool->threads = calloc(nb_workers, sizeof(Thread));
+        pool->workers = calloc(nb_workers, sizeof(SliceWorker));
+        if (!pool->threads || !pool->workers) {
+            free_slice_pool(&pool);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < nb_workers; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].home = i % SLICE_POOL_MAX_BATCHES;
+        if (thread_start(&pool->threads[i], slice_pool_worker,
+                         &pool->workers[i])
+            != 0)
+            break;
+        pool->nb_workers++;
+    }
+    return pool;
+}
+
+void
+free_slice_pool(SlicePool **pool)
+{
+    SlicePool *p = *pool;
+    if (!p)
+        return;
+
+    mutex_lock(&p->mu);
+    p->stop = 1;
+    cond_broadcast(&p->work_cv);
+    mutex_unlock(&p->mu);
+
+    for (int i = 0; i < p->nb_workers; ++i)
+        thread_join(&p->threads[i]);
+
+    cond_destroy(&p->done_cv);
+    cond_destroy(&p->work_cv);
+    mutex_destroy(&p->mu);
+    free(p->workers);
+    free(p->threads);
+    free(p);
+    *pool = NULL;
+}
+
+int
+slice_pool_threads(const SlicePool *pool)
+{
+    return pool->nb_workers + 1;
+}
+
+void
+slice_pool_run(SlicePool *pool, SlicePoolFunc func, void *arg, int nb_jobs)
+{
+    SliceBatch batch = { .func = func, .arg = arg, .nb_jobs = nb_jobs };
+    atomic_init(&batch.next_job, 0);
+
+    int slot = -1;
+    if (pool->nb_workers > 0 && nb_jobs > 1) {
+        mutex_lock(&pool->mu);
+        for (int i = 0; i < SLICE_POOL_MAX_BATCHES && slot < 0; ++i) {
+            if (!pool->batches[i])
+                slot = i;
+        }
+        if (slot >= 0) {
+            pool->batches[slot] = &batch;
+            cond_broadcast(&pool->work_cv);
+        }
+        mutex_unlock(&pool->mu);
+    }
+
+    // 调用线程同样参与计算；没有工作线程或登记已满时独自完成
+    slice_pool_work(&batch);
+    if (slot < 0)
+        return;
+
+    // 分片已全部被领取，等待仍在执行本批次的工作线程后撤销登记
+    mutex_lock(&pool->mu);
+    while (batch.workers > 0)
+        cond_wait(&pool->done_cv, &pool->mu);
+    pool->batches[slot] = NULL;
+    mutex_unlock(&pool->mu);
+}
@@ -0,0 +1,61 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 分片并行执行的线程池
+// 调用方把一帧拆成若干互不重叠的分片，slice_pool_run 在工作线程和调用线程上
+// 并行执行这些分片，全部完成后才返回(fork/join)
+// 同一线程池可由多条流水线的转换线程同时使用：每次调用登记一个批次，
+// 空闲的工作线程从自己优先的批次开始查找，没有剩余分片时去领取其他批次的
+// 分片，多路流共用一组按CPU核数确定的工作线程而不会超额占用
+
+#ifndef SLICE_POOL_H
+#define SLICE_POOL_H
+
+#define SLICE_POOL_MAX_BATCHES 64  // 同时登记的批次数上限
+
+// 分片任务函数，job取值为[0, nb_jobs)
+typedef void (*SlicePoolFunc)(void *arg, int job, int nb_jobs);
+
+// 分片线程池(不透明结构体，具体实现在.c文件中)
+typedef struct SlicePool SlicePool;
+
+/**
+ * 创建分片线程池
+ * @param nb_threads 参与计算的线程总数(包括调用slice_pool_run的线程)，
+ *                   会额外启动nb_threads-1个工作线程
+ * @return 新创建的线程池，失败返回NULL
+ */
+SlicePool *
+new_slice_pool(int nb_threads);
+
+/**
+ * 停止工作线程并释放线程池
+ * @param pool 指向线程池指针的指针
+ */
+void
+free_slice_pool(SlicePool **pool);
+
+/**
+ * 获取参与计算的线程总数
+ * @param pool 线程池
+ * @return 线程数
+ */
+int
+slice_pool_threads(const SlicePool *pool);
+
+/**
+ * 并行执行nb_jobs个分片并等待全部完成
+ * @param pool 线程池
+ * @param func 分片任务函数
+ * @param arg 传给func的参数
+ * @param nb_jobs 分片数
+ * @note 可由多个线程同时调用，同时登记的批次超过SLICE_POOL_MAX_BATCHES时
+ *       多出的调用在调用线程上依次执行
+ */
+void
+slice_pool_run(SlicePool *pool, SlicePoolFunc func, void *arg, int nb_jobs);
+
+#endif
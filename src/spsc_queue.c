@@ -0,0 +1,206 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "spsc_queue.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+
+#define CACHE_LINE_SIZE 64
+
+// 队列内部结构，生产者与消费者各自写入的字段放在不同缓存行，避免伪共享
+struct SpscQueue {
+    alignas(CACHE_LINE_SIZE) _Atomic(size_t) head; // 消费者读取位置
+    size_t cached_tail;                            // 消费者缓存的写入位置
+
+    alignas(CACHE_LINE_SIZE) _Atomic(size_t) tail; // 生产者写入位置
+    size_t cached_head;                            // 生产者缓存的读取位置
+
+    alignas(CACHE_LINE_SIZE) size_t mask;          // 容量-1
+    void **slots;                                  // 元素槽位
+
+    // 慢路径：仅在需要等待时使用
+    Mutex mu;
+    Cond cv;
+    _Atomic(int) waiters;                          // 正在等待的线程数
+};
+
+static void
+spsc_queue_aligned_free(SpscQueue *q)
+{
+#ifdef _WIN32
+    _aligned_free(q);
+#else
+    free(q);
+#endif
+}
+
+SpscQueue *
+new_spsc_queue(size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+#ifdef _WIN32
+    SpscQueue *q = _aligned_malloc(sizeof(SpscQueue), CACHE_LINE_SIZE);
+#else
+    SpscQueue *q = aligned_alloc(CACHE_LINE_SIZE, sizeof(SpscQueue));
+#endif
+    if (!q)
+        return NULL;
+    memset(q, 0, sizeof(SpscQueue));
+
+    q->slots = calloc(size, sizeof(void *));
+    if (!q->slots) {
+        spsc_queue_aligned_free(q);
+        return NULL;
+    }
+    q->mask = size - 1;
+    mutex_init(&q->mu);
+    cond_init(&q->cv);
+    return q;
+}
+
+void
+free_spsc_queue(SpscQueue **q)
+{
+    if (!*q)
+        return;
+    mutex_destroy(&(*q)->mu);
+    cond_destroy(&(*q)->cv);
+    free((*q)->slots);
+    spsc_queue_aligned_free(*q);
+    *q = NULL;
+}
+
+// 有线程在等待时唤醒它们；无等待者时不触碰互斥锁
+static void
+spsc_queue_notify(SpscQueue *q)
+{
+    if (atomic_load(&q->waiters) > 0) {
+        mutex_lock(&q->mu);
+        cond_broadcast(&q->cv);
+        mutex_unlock(&q->mu);
+    }
+}
+
+// 尝试入队，不做唤醒
+static int
+spsc_queue_try_push(SpscQueue *q, void *item)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - q->cached_head > q->mask) {
+        q->cached_head = atomic_load(&q->head);
+        if (tail - q->cached_head > q->mask) {
+            return -1;
+        }
+    }
+
+    q->slots[tail & q->mask] = item;
+    // seq_cst存储与spsc_queue_notify中读取waiters配对，避免丢失唤醒
+    atomic_store(&q->tail, tail + 1);
+    return 0;
+}
+
+// 尝试出队，不做唤醒
+static void *
+spsc_queue_try_pop(SpscQueue *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == q->cached_tail) {
+        q->cached_tail = atomic_load(&q->tail);
+        if (head == q->cached_tail) {
+            return NULL;
+        }
+    }
+
+    void *item = q->slots[head & q->mask];
+    atomic_store(&q->head, head + 1);
+    return item;
+}
+
+int
+spsc_queue_push(SpscQueue *q, void *item)
+{
+    if (spsc_queue_try_push(q, item) < 0)
+        return -1;
+    spsc_queue_notify(q);
+    return 0;
+}
+
+void *
+spsc_queue_pop(SpscQueue *q)
+{
+    void *item = spsc_queue_try_pop(q);
+    if (item)
+        spsc_queue_notify(q);
+    return item;
+}
+
+int
+spsc_queue_push_wait(SpscQueue *q, void *item, int timeout_ms)
+{
+    if (spsc_queue_push(q, item) == 0)
+        return 0;
+
+    mutex_lock(&q->mu);
+    atomic_fetch_add(&q->waiters, 1);
+    int ret = spsc_queue_try_push(q, item);
+    if (ret < 0) {
+        cond_timedwait(&q->cv, &q->mu, timeout_ms);
+        ret = spsc_queue_try_push(q, item);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    mutex_unlock(&q->mu);
+
+    if (ret == 0)
+        spsc_queue_notify(q);
+    return ret;
+}
+
+void *
+spsc_queue_pop_wait(SpscQueue *q, int timeout_ms)
+{
+    void *item = spsc_queue_pop(q);
+    if (item)
+        return item;
+
+    mutex_lock(&q->mu);
+    atomic_fetch_add(&q->waiters, 1);
+    item = spsc_queue_try_pop(q);
+    if (!item) {
+        cond_timedwait(&q->cv, &q->mu, timeout_ms);
+        item = spsc_queue_try_pop(q);
+    }
+    atomic_fetch_sub(&q->waiters, 1);
+    mutex_unlock(&q->mu);
+
+    if (item)
+        spsc_queue_notify(q);
+    return item;
+}
+
+void
+spsc_queue_wake(SpscQueue *q)
+{
+    mutex_lock(&q->mu);
+    cond_broadcast(&q->cv);
+    mutex_unlock(&q->mu);
+}
+
+size_t
+spsc_queue_size(SpscQueue *q)
+{
+    size_t tail = atomic_load(&q->tail);
+    size_t head = atomic_load(&q->head);
+    return tail - head;
+}
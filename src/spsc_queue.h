@@ -0,0 +1,85 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 有界单生产者/单消费者(SPSC)无锁环形队列
+// 入队/出队在快速路径上只使用原子操作；仅当队列为空(或满)且
+// 调用方选择等待时，才会退化为在条件变量上休眠
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+
+// SPSC队列(不透明结构体，具体实现在.c文件中)
+typedef struct SpscQueue SpscQueue;
+
+/**
+ * 创建SPSC队列
+ * @param capacity 队列容量(向上取整为2的幂)
+ * @return 新创建的队列，失败返回NULL
+ */
+SpscQueue *
+new_spsc_queue(size_t capacity);
+
+/**
+ * 释放SPSC队列(不会释放队列中残留的元素)
+ * @param q 指向队列指针的指针
+ */
+void
+free_spsc_queue(SpscQueue **q);
+
+/**
+ * 非阻塞入队，仅允许生产者线程调用
+ * @param q 队列
+ * @param item 元素(不能为NULL)
+ * @return 成功返回0，队列已满返回-1
+ */
+int
+spsc_queue_push(SpscQueue *q, void *item);
+
+/**
+ * 非阻塞出队，仅允许消费者线程调用
+ * @param q 队列
+ * @return 队首元素，队列为空返回NULL
+ */
+void *
+spsc_queue_pop(SpscQueue *q);
+
+/**
+ * 入队，队列已满时最多等待timeout_ms毫秒
+ * @param q 队列
+ * @param item 元素(不能为NULL)
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 成功返回0，超时或被唤醒时仍满返回-1
+ */
+int
+spsc_queue_push_wait(SpscQueue *q, void *item, int timeout_ms);
+
+/**
+ * 出队，队列为空时最多等待timeout_ms毫秒
+ * @param q 队列
+ * @param timeout_ms 超时时间(毫秒)
+ * @return 队首元素，超时或被唤醒时仍为空返回NULL
+ */
+void *
+spsc_queue_pop_wait(SpscQueue *q, int timeout_ms);
+
+/**
+ * 唤醒所有在队列上等待的线程(用于停止流水线)
+ * @param q 队列
+ */
+void
+spsc_queue_wake(SpscQueue *q);
+
+/**
+ * 获取队列中当前元素个数(近似值)
+ * @param q 队列
+ * @return 元素个数
+ */
+size_t
+spsc_queue_size(SpscQueue *q);
+
+#endif
@@ -0,0 +1,329 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#endif
+
+#include "thread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// Windows线程入口适配，将DWORD WINAPI签名转为ThreadFunc
+static DWORD WINAPI
+thread_trampoline(LPVOID param)
+{
+    Thread *t = (Thread *)param;
+    t->func(t->arg);
+    return 0;
+}
+
+int
+thread_start(Thread *t, ThreadFunc func, void *arg)
+{
+    t->func = func;
+    t->arg = arg;
+    t->handle = CreateThread(NULL, 0, thread_trampoline, t, 0, NULL);
+    t->started = t->handle != NULL;
+    return t->started ? 0 : -1;
+}
+
+void
+thread_join(Thread *t)
+{
+    if (!t->started)
+        return;
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    t->started = 0;
+}
+
+void
+thread_sleep_ms(int ms)
+{
+    Sleep(ms);
+}
+
+uint64_t
+thread_id(void)
+{
+    return GetCurrentThreadId();
+}
+
+// Windows的线程亲和性掩码只覆盖当前处理器组的前64个CPU
+int
+thread_get_affinity(ThreadCpuSet *set)
+{
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask,
+                                &system_mask))
+        return -1;
+    // 没有直接读取线程掩码的API：设置后立即恢复，取得原来的掩码
+    DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), process_mask);
+    if (!old)
+        return -1;
+    SetThreadAffinityMask(GetCurrentThread(), old);
+    memset(set, 0, sizeof(ThreadCpuSet));
+    set->bits[0] = old;
+    return 0;
+}
+
+int
+thread_set_affinity(const ThreadCpuSet *set)
+{
+    DWORD_PTR mask = (DWORD_PTR)set->bits[0];
+    return mask && SetThreadAffinityMask(GetCurrentThread(), mask) ? 0 : -1;
+}
+
+void
+mutex_init(Mutex *m)
+{
+    InitializeSRWLock(&m->lock);
+}
+
+void
+mutex_destroy(Mutex *m)
+{
+    (void)m;  // SRWLOCK无需销毁
+}
+
+void
+mutex_lock(Mutex *m)
+{
+    AcquireSRWLockExclusive(&m->lock);
+}
+
+void
+mutex_unlock(Mutex *m)
+{
+    ReleaseSRWLockExclusive(&m->lock);
+}
+
+void
+cond_init(Cond *c)
+{
+    InitializeConditionVariable(&c->cv);
+}
+
+void
+cond_destroy(Cond *c)
+{
+    (void)c;  // CONDITION_VARIABLE无需销毁
+}
+
+void
+cond_timedwait(Cond *c, Mutex *m, int timeout_ms)
+{
+    SleepConditionVariableSRW(&c->cv, &m->lock, timeout_ms, 0);
+}
+
+void
+cond_wait(Cond *c, Mutex *m)
+{
+    SleepConditionVariableSRW(&c->cv, &m->lock, INFINITE, 0);
+}
+
+void
+cond_broadcast(Cond *c)
+{
+    WakeAllConditionVariable(&c->cv);
+}
+
+#else
+int
+thread_start(Thread *t, ThreadFunc func, void *arg)
+{
+    t->func = func;
+    t->arg = arg;
+    t->started = pthread_create(&t->handle, NULL, func, arg) == 0;
+    return t->started ? 0 : -1;
+}
+
+void
+thread_join(Thread *t)
+{
+    if (!t->started)
+        return;
+    pthread_join(t->handle, NULL);
+    t->started = 0;
+}
+
+void
+thread_sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+uint64_t
+thread_id(void)
+{
+#if defined(__linux__)
+    return (uint64_t)syscall(SYS_gettid);
+#elif defined(__APPLE__)
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return tid;
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+#ifdef __linux__
+int
+thread_get_affinity(ThreadCpuSet *set)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (pthread_getaffinity_np(pthread_self(), sizeof cpus, &cpus) != 0)
+        return -1;
+    memset(set, 0, sizeof(ThreadCpuSet));
+    for (int i = 0; i < THREAD_MAX_CPUS && i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &cpus))
+            set->bits[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+    return 0;
+}
+
+int
+thread_set_affinity(const ThreadCpuSet *set)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int i = 0; i < THREAD_MAX_CPUS && i < CPU_SETSIZE; ++i) {
+        if (set->bits[i / 64] & ((uint64_t)1 << (i % 64)))
+            CPU_SET(i, &cpus);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus) == 0
+                   ? 0
+                   : -1;
+}
+#else
+// macOS等平台没有可用的线程亲和性API
+int
+thread_get_affinity(ThreadCpuSet *set)
+{
+    (void)set;
+    return -1;
+}
+
+int
+thread_set_affinity(const ThreadCpuSet *set)
+{
+    (void)set;
+    return -1;
+}
+#endif
+
+void
+mutex_init(Mutex *m)
+{
+    pthread_mutex_init(&m->lock, NULL);
+}
+
+void
+mutex_destroy(Mutex *m)
+{
+    pthread_mutex_destroy(&m->lock);
+}
+
+void
+mutex_lock(Mutex *m)
+{
+    pthread_mutex_lock(&m->lock);
+}
+
+void
+mutex_unlock(Mutex *m)
+{
+    pthread_mutex_unlock(&m->lock);
+}
+
+void
+cond_init(Cond *c)
+{
+    pthread_cond_init(&c->cv, NULL);
+}
+
+void
+cond_destroy(Cond *c)
+{
+    pthread_cond_destroy(&c->cv);
+}
+
+void
+cond_timedwait(Cond *c, Mutex *m, int timeout_ms)
+{
+    struct timeval now;
+    struct timespec deadline;
+
+    gettimeofday(&now, NULL);
+    long long nsec = (long long)now.tv_usec * 1000
+                     + (long long)(timeout_ms % 1000) * 1000000;
+    deadline.tv_sec = now.tv_sec + timeout_ms / 1000 + nsec / 1000000000;
+    deadline.tv_nsec = (long)(nsec % 1000000000);
+    pthread_cond_timedwait(&c->cv, &m->lock, &deadline);
+}
+
+void
+cond_wait(Cond *c, Mutex *m)
+{
+    pthread_cond_wait(&c->cv, &m->lock);
+}
+
+void
+cond_broadcast(Cond *c)
+{
+    pthread_cond_broadcast(&c->cv);
+}
+#endif
+
+int
+thread_cpu_set_parse(ThreadCpuSet *set, const char *list)
+{
+    memset(set, 0, sizeof(ThreadCpuSet));
+    const char *p = list;
+    int any = 0;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return -1;
+        }
+        if (first < 0 || last < first || last >= THREAD_MAX_CPUS)
+            return -1;
+        for (long i = first; i <= last; ++i)
+            set->bits[i / 64] |= (uint64_t)1 << (i % 64);
+        any = 1;
+
+        if (*end == ',')
+            ++end;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return any ? 0 : -1;
+}
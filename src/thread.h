@@ -0,0 +1,153 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 跨平台线程原语
+// 对 POSIX pthread 与 Windows 线程API做最小封装，供流水线各阶段使用
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define THREAD_MAX_CPUS 256 // CPU亲和性能表示的CPU数上限
+
+// 线程入口函数类型
+typedef void *(*ThreadFunc)(void *arg);
+
+typedef struct Thread {
+#ifdef _WIN32
+    HANDLE handle;   // Windows线程句柄
+#else
+    pthread_t handle; // POSIX线程句柄
+#endif
+    ThreadFunc func; // 线程入口函数
+    void *arg;       // 入口函数参数
+    int started;     // 线程是否已启动
+} Thread;
+
+// CPU集合，用于设置线程亲和性
+typedef struct ThreadCpuSet {
+    uint64_t bits[THREAD_MAX_CPUS / 64];
+} ThreadCpuSet;
+
+typedef struct Mutex {
+#ifdef _WIN32
+    SRWLOCK lock;          // Windows读写锁(独占模式使用)
+#else
+    pthread_mutex_t lock;  // POSIX互斥锁
+#endif
+} Mutex;
+
+typedef struct Cond {
+#ifdef _WIN32
+    CONDITION_VARIABLE cv; // Windows条件变量
+#else
+    pthread_cond_t cv;     // POSIX条件变量
+#endif
+} Cond;
+
+/**
+ * 启动线程
+ * @param t 线程结构体
+ * @param func 线程入口函数
+ * @param arg 入口函数参数
+ * @return 成功返回0，失败返回非0
+ */
+int
+thread_start(Thread *t, ThreadFunc func, void *arg);
+
+/**
+ * 等待线程结束，未启动的线程直接返回
+ * @param t 线程结构体
+ */
+void
+thread_join(Thread *t);
+
+/**
+ * 休眠指定毫秒数
+ * @param ms 毫秒数
+ */
+void
+thread_sleep_ms(int ms);
+
+/**
+ * 获取当前线程的系统线程ID，用于跟踪文件中区分线程
+ * @return 线程ID
+ */
+uint64_t
+thread_id(void);
+
+/**
+ * 解析CPU列表，如"0-3,8"
+ * @param set 输出的CPU集合
+ * @param list CPU编号和编号范围，以','分隔
+ * @return 成功返回0，格式错误、为空或编号超出THREAD_MAX_CPUS返回-1
+ */
+int
+thread_cpu_set_parse(ThreadCpuSet *set, const char *list);
+
+/**
+ * 获取当前线程的CPU亲和性
+ * @param set 输出的CPU集合
+ * @return 成功返回0，平台不支持或失败返回-1
+ */
+int
+thread_get_affinity(ThreadCpuSet *set);
+
+/**
+ * 设置当前线程的CPU亲和性。Linux上此后由该线程创建的线程(包括编码库
+ * 内部的线程)继承同样的亲和性；Windows上只作用于当前线程；macOS不支持
+ * @param set CPU集合
+ * @return 成功返回0，平台不支持或失败返回-1
+ */
+int
+thread_set_affinity(const ThreadCpuSet *set);
+
+void
+mutex_init(Mutex *m);
+
+void
+mutex_destroy(Mutex *m);
+
+void
+mutex_lock(Mutex *m);
+
+void
+mutex_unlock(Mutex *m);
+
+void
+cond_init(Cond *c);
+
+void
+cond_destroy(Cond *c);
+
+/**
+ * 在条件变量上等待，最多等待timeout_ms毫秒
+ * @param c 条件变量
+ * @param m 已加锁的互斥锁
+ * @param timeout_ms 超时时间(毫秒)
+ */
+void
+cond_timedwait(Cond *c, Mutex *m, int timeout_ms);
+
+/**
+ * 在条件变量上等待，直到被唤醒
+ * @param c 条件变量
+ * @param m 已加锁的互斥锁
+ */
+void
+cond_wait(Cond *c, Mutex *m);
+
+void
+cond_broadcast(Cond *c);
+
+#endif
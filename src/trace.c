@@ -0,0 +1,231 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#include "trace.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/avutil.h>
+
+#include "common.h"
+#include "thread.h"
+
+#define TRACE_POLL_INTERVAL 100  // 写文件线程检查写出请求的间隔(毫秒)
+#define TRACE_MAX_THREADS 256    // 可命名的线程数上限
+#define TRACE_THREAD_NAME_SIZE 32
+
+// 一个片段。seq为写入时的序号+1，写入过程中为0，读取方据此跳过
+// 正在写入或已被覆盖的片段
+typedef struct TraceEvent {
+    _Atomic(uint64_t) seq;
+    const char *name;
+    const char *cat;
+    int64_t start_ts;
+    int64_t dur;
+    int64_t pts;
+    uint64_t tid;
+    int index;
+} TraceEvent;
+
+typedef struct TraceThread {
+    uint64_t tid;
+    char name[TRACE_THREAD_NAME_SIZE];
+} TraceThread;
+
+static _Atomic(int) trace_active = 0;          // 是否启用跟踪
+static _Atomic(int) trace_dump_requested = 0;  // 收到SIGUSR1，等待写出
+static _Atomic(int) trace_running = 0;         // 写文件线程是否继续运行
+static _Atomic(uint64_t) trace_next = 0;       // 下一个片段的序号
+static TraceEvent *trace_ring = NULL;
+static char trace_path[1024];
+static Thread trace_thread;
+
+static TraceThread trace_threads[TRACE_MAX_THREADS];
+static _Atomic(int) trace_nb_threads = 0;
+
+int64_t
+trace_begin(void)
+{
+    return atomic_load_explicit(&trace_active, memory_order_relaxed)
+                   ? get_current_ts_usec()
+                   : 0;
+}
+
+void
+trace_end(const char *name, const char *cat, int64_t start_ts, int64_t pts,
+          int index)
+{
+    if (!start_ts) {
+        return;
+    }
+    int64_t end_ts = get_current_ts_usec();
+
+    uint64_t n = atomic_fetch_add_explicit(&trace_next, 1,
+                                           memory_order_relaxed);
+    TraceEvent *e = &trace_ring[n & (TRACE_RING_SIZE - 1)];
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    e->name = name;
+    e->cat = cat;
+    e->start_ts = start_ts;
+    e->dur = end_ts - start_ts;
+    e->pts = pts;
+    e->tid = thread_id();
+    e->index = index;
+    atomic_store_explicit(&e->seq, n + 1, memory_order_release);
+}
+
+void
+trace_thread_name(const char *name)
+{
+    if (!atomic_load(&trace_active)) {
+        return;
+    }
+    int i = atomic_fetch_add(&trace_nb_threads, 1);
+    if (i >= TRACE_MAX_THREADS) {
+        return;
+    }
+    trace_threads[i].tid = thread_id();
+    snprintf(trace_threads[i].name, TRACE_THREAD_NAME_SIZE, "%s", name);
+}
+
+// 把环形缓冲区中完整的片段写成Chrome跟踪格式
+static int
+trace_dump(void)
+{
+    FILE *f = fopen(trace_path, "w");
+    if (!f) {
+        printf("[ERROR] couldn't open trace file \"%s\"\n", trace_path);
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"args\":{\"name\":\"ndi-streamer\"}}");
+    int nb_threads = FFMIN(atomic_load(&trace_nb_threads), TRACE_MAX_THREADS);
+    for (int i = 0; i < nb_threads; ++i) {
+        if (!trace_threads[i].tid) {
+            continue;
+        }
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%llu,\"args\":{\"name\":\"%s\"}}",
+                (unsigned long long)trace_threads[i].tid,
+                trace_threads[i].name);
+    }
+
+    uint64_t end = atomic_load(&trace_next);
+    uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    int nb_events = 0;
+    for (uint64_t n = begin; n < end; ++n) {
+        TraceEvent *e = &trace_ring[n & (TRACE_RING_SIZE - 1)];
+        if (atomic_load_explicit(&e->seq, memory_order_acquire) != n + 1) {
+            continue;
+        }
+        TraceEvent ev;
+        ev.name = e->name;
+        ev.cat = e->cat;
+        ev.start_ts = e->start_ts;
+        ev.dur = e->dur;
+        ev.pts = e->pts;
+        ev.tid = e->tid;
+        ev.index = e->index;
+        // 复制期间被覆盖的片段丢弃
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) != n + 1) {
+            continue;
+        }
+
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                   "\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%llu,"
+                   "\"args\":{",
+                ev.name, ev.cat, (long long)ev.start_ts, (long long)ev.dur,
+                (unsigned long long)ev.tid);
+        const char *sep = "";
+        if (ev.pts != AV_NOPTS_VALUE) {
+            fprintf(f, "\"pts\":%lld", (long long)ev.pts);
+            sep = ",";
+        }
+        if (ev.index >= 0) {
+            fprintf(f, "%s\"index\":%d", sep, ev.index);
+        }
+        fprintf(f, "}}");
+        nb_events++;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    printf("[INFO] wrote %d trace events to %s\n", nb_events, trace_path);
+    return 0;
+}
+
+#ifdef SIGUSR1
+static void
+trace_signal_handler(int sig)
+{
+    (void)sig;
+    atomic_store(&trace_dump_requested, 1);
+}
+#endif
+
+// 写文件线程：信号处理函数中不能写文件，由这里代为写出
+static void *
+trace_dump_thread(void *arg)
+{
+    (void)arg;
+    while (atomic_load(&trace_running)) {
+        thread_sleep_ms(TRACE_POLL_INTERVAL);
+        if (atomic_exchange(&trace_dump_requested, 0)) {
+            trace_dump();
+        }
+    }
+    return NULL;
+}
+
+int
+trace_start(const char *path)
+{
+    trace_ring = calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+    if (!trace_ring) {
+        return -1;
+    }
+    snprintf(trace_path, sizeof trace_path, "%s", path);
+    atomic_store(&trace_next, 0);
+    atomic_store(&trace_running, 1);
+    if (thread_start(&trace_thread, trace_dump_thread, NULL) != 0) {
+        free(trace_ring);
+        trace_ring = NULL;
+        return -1;
+    }
+
+#ifdef SIGUSR1
+    struct sigaction action = {};
+    action.sa_handler = &trace_signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+#endif
+    atomic_store(&trace_active, 1);
+    return 0;
+}
+
+void
+trace_stop(void)
+{
+    if (!trace_ring) {
+        return;
+    }
+    // 调用方已停止所有记录片段的线程
+    atomic_store(&trace_active, 0);
+    atomic_store(&trace_running, 0);
+    thread_join(&trace_thread);
+    trace_dump();
+    free(trace_ring);
+    trace_ring = NULL;
+}
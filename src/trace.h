@@ -0,0 +1,61 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 逐帧跟踪
+// 把各线程中的耗时片段(采集、转换、编码、写出)记录到预先分配的无锁环形
+// 缓冲区中，收到SIGUSR1或退出时写成Chrome跟踪格式(JSON)，可在
+// chrome://tracing或Perfetto中按时间线查看每一帧。未启用时每个片段只有
+// 一次原子读取的开销
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE (1 << 17) // 环形缓冲区能保存的片段数，写满后覆盖最旧的
+
+/**
+ * 启用跟踪：分配环形缓冲区并启动写文件的线程，POSIX平台上收到SIGUSR1时
+ * 写出一次当前缓冲区的内容
+ * @param path 跟踪文件路径，每次写出都覆盖
+ * @return 成功返回0，失败返回-1
+ */
+int
+trace_start(const char *path);
+
+/**
+ * 写出跟踪文件并停用跟踪，未启用时直接返回
+ */
+void
+trace_stop(void);
+
+/**
+ * 为当前线程命名，跟踪文件中以此名称显示该线程
+ * @param name 线程名称(会被复制)
+ */
+void
+trace_thread_name(const char *name);
+
+/**
+ * 开始一个片段
+ * @return 开始时间(微秒)，未启用跟踪时返回0
+ */
+int64_t
+trace_begin(void);
+
+/**
+ * 结束一个片段，start_ts为0(未启用跟踪)时直接返回
+ * @param name 片段名称，必须是常量字符串
+ * @param cat 类别("video"或"audio")，必须是常量字符串
+ * @param start_ts trace_begin的返回值
+ * @param pts 帧或数据包的时间戳(编码器时间基)，未知时为AV_NOPTS_VALUE
+ * @param index 编码器或输出目标的索引，不适用时为-1
+ */
+void
+trace_end(const char *name, const char *cat, int64_t start_ts, int64_t pts,
+          int index);
+
+#endif
@@ -132,6 +132,14 @@ op_init(const ProgramOption *options)
     char *ptr, *short_options, *name;
     OPInternalCtx *res;
 
+    // 重置getopt的扫描状态，同一进程可以解析多组参数(如每个NDI源一行)
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+    optreset = 1;
+    optind = 1;
+#else
+    optind = 0;
+#endif
+
     // 计算短选项参数数量
     for (n = 0; options[n].name != NULL; ++n) {
         ptr = strchr(options[n].name, ',');
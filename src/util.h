@@ -43,7 +43,7 @@ void
 eh_wait();
 
 /**
- * 初始化选项解析器
+ * 初始化选项解析器，同时重置getopt的扫描状态
  * @param options 程序选项数组
  * @return 初始化后的选项解析器上下文
  */
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Copyright 2022 Alim Zanibekov
+#
+# Use of this source code is governed by an MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT.
+
+# 视频转换分片线程数测试
+# 先用模拟NDI录制几秒4K画面，再以不同的--convert_threads单路fast模式回放，
+# 从Prometheus指标读出每帧平均转换耗时。ndi-streamer需以
+# -DNDI_STREAMER_MOCK_NDI=ON 构建
+#
+#   tests/bench_convert_threads.sh ./ndi-streamer [THREADS...]   默认1 2 4 8
+#
+# 环境变量:
+#   BENCH_SECONDS       每轮测量的秒数(默认10)
+#   BENCH_ARGS          传给ndi-streamer的编码参数(默认 -v libx264 -a aac)
+#   BENCH_METRICS_PORT  指标端口(默认9187)
+#   NDI_MOCK_VIDEO      录制画面的分辨率和帧率(默认3840x2160@60)
+#   NDI_MOCK_FOURCC等   录制画面的其他参数，见README
+
+set -e
+
+bin=${1:?usage: $0 BINARY [THREADS...]}
+shift
+[ $# -gt 0 ] || set -- 1 2 4 8
+seconds=${BENCH_SECONDS:-10}
+args=${BENCH_ARGS:--v libx264 -a aac}
+port=${BENCH_METRICS_PORT:-9187}
+NDI_MOCK_VIDEO=${NDI_MOCK_VIDEO:-3840x2160@60}
+export NDI_MOCK_VIDEO
+dir=$(mktemp -d)
+pid=
+trap '[ -z "$pid" ] || kill "$pid" 2>/dev/null; rm -rf "$dir"' EXIT
+
+# 指标的值: metric NAME LABEL
+metric() {
+    curl -s "http://127.0.0.1:$port/metrics" | awk -v m="$1" -v l="$2" '
+        index($0, m "{") == 1 && index($0, l) { s += $NF }
+        END { printf "%.6f\n", s }'
+}
+
+# 后台启动ndi-streamer，stop结束它
+start() {
+    "$bin" "$@" >"$dir/run.log" 2>&1 &
+    pid=$!
+}
+
+stop() {
+    kill "$pid" 2>/dev/null || true
+    wait "$pid" 2>/dev/null || true
+    pid=
+}
+
+echo "recording 3 s of $NDI_MOCK_VIDEO from the mock NDI source..."
+# shellcheck disable=SC2086
+start -n 127.0.0.1:5961 $args -o "$dir/rec.flv" \
+      --record_file "$dir/rec.ndirec"
+sleep 3
+stop
+
+# 线程池按CPU核数创建，实际线程数取自转换器的启动日志
+printf '%8s %8s %12s %10s\n' threads used ms_per_frame speedup
+base=
+for n in "$@"; do
+    # shellcheck disable=SC2086
+    start --replay_file "$dir/rec.ndirec" --replay_mode fast \
+          --convert_threads "$n" $args -o "$dir/out.flv" \
+          --metrics_port "$port"
+    sleep 2  # 跳过启动和编码器预热
+    f0=$(metric ndi_streamer_video_frames_total 'stage="convert"')
+    t0=$(metric ndi_streamer_video_convert_seconds_total 'source=')
+    sleep "$seconds"
+    f1=$(metric ndi_streamer_video_frames_total 'stage="convert"')
+    t1=$(metric ndi_streamer_video_convert_seconds_total 'source=')
+    stop
+    used=$(sed -n 's/.*video conversion:.*threads: \([0-9]*\).*/\1/p' \
+           "$dir/run.log" | head -n 1)
+
+    ms=$(awk -v f="$f1" -v g="$f0" -v t="$t1" -v u="$t0" \
+         'BEGIN { printf "%.3f", f > g ? (t - u) * 1e3 / (f - g) : 0 }')
+    [ -n "$base" ] || base=$ms
+    awk -v n="$n" -v used="${used:-?}" -v ms="$ms" -v b="$base" \
+        'BEGIN { printf "%8d %8s %12.3f %9.2fx\n", n, used, ms,
+                 ms > 0 ? b / ms : 0 }'
+done
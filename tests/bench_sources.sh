@@ -0,0 +1,82 @@
+#!/bin/sh
+# Copyright 2022 Alim Zanibekov
+#
+# Use of this source code is governed by an MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT.
+
+# 多路源吞吐量测试
+# 先用模拟NDI录制几秒画面，再让N路源同时以fast模式回放同一文件，从
+# Prometheus指标读出所有源合计的每秒转换帧数和编码帧数。ndi-streamer需以
+# -DNDI_STREAMER_MOCK_NDI=ON 构建
+#
+#   tests/bench_sources.sh ./ndi-streamer [SOURCES...]   默认测量1 2 4 8路
+#
+# 环境变量:
+#   BENCH_SECONDS       每轮测量的秒数(默认10)
+#   BENCH_ARGS          传给ndi-streamer的编码参数(默认 -v libx264 -a aac)
+#   BENCH_METRICS_PORT  指标端口(默认9187)
+#   NDI_MOCK_VIDEO等    录制画面的参数，见README
+
+set -e
+
+bin=${1:?usage: $0 BINARY [SOURCES...]}
+shift
+[ $# -gt 0 ] || set -- 1 2 4 8
+seconds=${BENCH_SECONDS:-10}
+args=${BENCH_ARGS:--v libx264 -a aac}
+port=${BENCH_METRICS_PORT:-9187}
+dir=$(mktemp -d)
+pid=
+trap '[ -z "$pid" ] || kill "$pid" 2>/dev/null; rm -rf "$dir"' EXIT
+
+# 所有源合计的计数: metric NAME LABEL
+metric() {
+    curl -s "http://127.0.0.1:$port/metrics" | awk -v m="$1" -v l="$2" '
+        index($0, m "{") == 1 && index($0, l) { s += $NF }
+        END { printf "%d\n", s }'
+}
+
+# 后台启动ndi-streamer，stop结束它
+start() {
+    "$bin" "$@" >"$dir/run.log" 2>&1 &
+    pid=$!
+}
+
+stop() {
+    kill "$pid" 2>/dev/null || true
+    wait "$pid" 2>/dev/null || true
+    pid=
+}
+
+echo "recording 3 s from the mock NDI source..."
+# shellcheck disable=SC2086
+start -n 127.0.0.1:5961 $args -o "$dir/rec.flv" \
+      --record_file "$dir/rec.ndirec"
+sleep 3
+stop
+
+printf '%8s %14s %14s\n' sources convert_fps encode_fps
+for n in "$@"; do
+    : >"$dir/sources.txt"
+    i=0
+    while [ "$i" -lt "$n" ]; do
+        echo "--replay_file $dir/rec.ndirec -o $dir/out$i.flv" \
+             >>"$dir/sources.txt"
+        i=$((i + 1))
+    done
+
+    # shellcheck disable=SC2086
+    start --sources "$dir/sources.txt" --replay_mode fast $args \
+          --metrics_port "$port"
+    sleep 2  # 跳过启动和编码器预热
+    c0=$(metric ndi_streamer_video_frames_total 'stage="convert"')
+    e0=$(metric ndi_streamer_encoder_frames_total 'rendition="0"')
+    sleep "$seconds"
+    c1=$(metric ndi_streamer_video_frames_total 'stage="convert"')
+    e1=$(metric ndi_streamer_encoder_frames_total 'rendition="0"')
+    stop
+
+    awk -v n="$n" -v c=$((c1 - c0)) -v e=$((e1 - e0)) -v t="$seconds" \
+        'BEGIN { printf "%8d %14.1f %14.1f\n", n, c / t, e / t }'
+done
@@ -0,0 +1,660 @@
+// Copyright 2022 Alim Zanibekov
+//
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+// 像素格式转换内核测试
+// 对比每个CPU支持的向量化级别与标量参考实现的输出，要求逐位一致，覆盖
+// 奇数宽度、未对齐的地址、奇数行跨度和奇数高度，并检查不会写出行尾。
+// 不依赖FFmpeg和NDI
+//
+//   pixconv_test                        对比测试，全部一致时返回0
+//   pixconv_test --bench [WxH]          各级别各内核的吞吐量(默认1920x1080)
+//   pixconv_test --bench_slices [WxH]   整帧按行分片在线程池上转换的耗时与
+//                                       分片数(--convert_threads)的关系
+//                                       (默认3840x2160)
+//
+// 定义PIXCONV_TEST_SWSCALE并链接libswscale时(pixconv_bench目标)，
+// --bench另外以整帧为单位对比pixconv与swscale
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixconv.h"
+#include "slice_pool.h"
+
+#ifdef PIXCONV_TEST_SWSCALE
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libswscale/swscale.h>
+#endif
+
+#define GUARD 64          // 输出缓冲区前后的保护字节数
+#define GUARD_BYTE 0xA5   // 保护字节的值
+#define BENCH_SECONDS 0.5 // 每项基准测试的最短时长
+
+static int failures = 0;
+
+static const char *const level_names[PIXCONV_LEVEL_NB] = {
+    "scalar", "sse2", "avx2", "avx512", "neon",
+};
+
+// xorshift32，测试数据可复现
+static uint32_t rng_state = 0x12345678;
+
+static uint8_t
+rng_byte(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (uint8_t)(rng_state >> 24);
+}
+
+static void
+fill_random(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        buf[i] = rng_byte();
+}
+
+static double
+now_sec(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// 带前后保护字节的输出缓冲区，data相对分配地址偏移offset字节(用于未对齐测试)
+typedef struct OutBuf {
+    uint8_t *alloc;
+    uint8_t *data;
+    size_t size;
+} OutBuf;
+
+static void
+out_buf_init(OutBuf *b, size_t size, int offset)
+{
+    b->alloc = malloc(size + 2 * GUARD + offset);
+    b->data = b->alloc + GUARD + offset;
+    b->size = size;
+    memset(b->alloc, GUARD_BYTE, size + 2 * GUARD + offset);
+}
+
+static void
+out_buf_free(OutBuf *b)
+{
+    free(b->alloc);
+}
+
+// 两个缓冲区内容一致，且保护字节未被改写
+static int
+out_buf_check(const OutBuf *ref, const OutBuf *b)
+{
+    if (memcmp(ref->data, b->data, b->size) != 0)
+        return 0;
+    for (uint8_t *p = b->alloc; p < b->data; ++p)
+        if (*p != GUARD_BYTE)
+            return 0;
+    for (size_t i = 0; i < GUARD; ++i)
+        if (b->data[b->size + i] != GUARD_BYTE)
+            return 0;
+    return 1;
+}
+
+// 两组亮度行(各两行)一致
+static int
+y_rows_check(OutBuf y[2][2])
+{
+    return out_buf_check(&y[0][0], &y[1][0])
+           && out_buf_check(&y[0][1], &y[1][1]);
+}
+
+static void
+report(const char *level, const char *kernel, const char *what, int width,
+       int offset, int same_rows)
+{
+    printf("FAIL %s %s: %s differs (width %d, offset %d%s)\n", level, kernel,
+           what, width, offset, same_rows ? ", last row" : "");
+    failures++;
+}
+
+// 对比一个级别的UYVY行内核
+static void
+test_uyvy_rows(const PixconvFuncs *ref, const PixconvFuncs *f, int width,
+               int offset, int same_rows)
+{
+    size_t src_size = (size_t)width * 2;
+    uint8_t *src = malloc(2 * src_size + offset);
+    uint8_t *s0 = src + offset;
+    uint8_t *s1 = same_rows ? s0 : s0 + src_size;
+    fill_random(s0, 2 * src_size);
+
+    OutBuf y[2][2], u[2], v[2], uv[2];
+    for (int i = 0; i < 2; ++i) {
+        out_buf_init(&y[i][0], width, offset);
+        out_buf_init(&y[i][1], width, offset);
+        out_buf_init(&u[i], width / 2, offset);
+        out_buf_init(&v[i], width / 2, offset);
+        out_buf_init(&uv[i], width, offset);
+    }
+
+    const PixconvFuncs *funcs[2] = { ref, f };
+    for (int i = 0; i < 2; ++i) {
+        uint8_t *y1 = same_rows ? y[i][0].data : y[i][1].data;
+        funcs[i]->uyvy_to_i420_row2(s0, s1, y[i][0].data, y1, u[i].data,
+                                    v[i].data, width);
+    }
+    if (!y_rows_check(y))
+        report(f->name, "uyvy_to_i420", "Y", width, offset, same_rows);
+    if (!out_buf_check(&u[0], &u[1]) || !out_buf_check(&v[0], &v[1]))
+        report(f->name, "uyvy_to_i420", "UV", width, offset, same_rows);
+
+    for (int i = 0; i < 2; ++i) {
+        memset(y[i][0].data, 0, width);
+        memset(y[i][1].data, 0, width);
+        uint8_t *y1 = same_rows ? y[i][0].data : y[i][1].data;
+        funcs[i]->uyvy_to_nv12_row2(s0, s1, y[i][0].data, y1, uv[i].data,
+                                    width);
+    }
+    if (!y_rows_check(y))
+        report(f->name, "uyvy_to_nv12", "Y", width, offset, same_rows);
+    if (!out_buf_check(&uv[0], &uv[1]))
+        report(f->name, "uyvy_to_nv12", "UV", width, offset, same_rows);
+
+    for (int i = 0; i < 2; ++i) {
+        out_buf_free(&y[i][0]);
+        out_buf_free(&y[i][1]);
+        out_buf_free(&u[i]);
+        out_buf_free(&v[i]);
+        out_buf_free(&uv[i]);
+    }
+    free(src);
+}
+
+// 对比一个级别的32位RGB行内核
+static void
+test_rgb_rows(const PixconvFuncs *ref, const PixconvFuncs *f, int width,
+              int offset, int same_rows, const PixconvRgbCoeffs *c)
+{
+    int chroma_width = (width + 1) / 2;
+    size_t src_size = (size_t)width * 4;
+    uint8_t *src = malloc(2 * src_size + offset);
+    uint8_t *s0 = src + offset;
+    uint8_t *s1 = same_rows ? s0 : s0 + src_size;
+    fill_random(s0, 2 * src_size);
+
+    OutBuf y[2][2], u[2], v[2], uv[2];
+    for (int i = 0; i < 2; ++i) {
+        out_buf_init(&y[i][0], width, offset);
+        out_buf_init(&y[i][1], width, offset);
+        out_buf_init(&u[i], chroma_width, offset);
+        out_buf_init(&v[i], chroma_width, offset);
+        out_buf_init(&uv[i], (size_t)chroma_width * 2, offset);
+    }
+
+    const PixconvFuncs *funcs[2] = { ref, f };
+    for (int i = 0; i < 2; ++i) {
+        uint8_t *y1 = same_rows ? y[i][0].data : y[i][1].data;
+        funcs[i]->rgb32_to_i420_row2(s0, s1, y[i][0].data, y1, u[i].data,
+                                     v[i].data, width, c);
+    }
+    if (!y_rows_check(y))
+        report(f->name, "rgb32_to_i420", "Y", width, offset, same_rows);
+    if (!out_buf_check(&u[0], &u[1]) || !out_buf_check(&v[0], &v[1]))
+        report(f->name, "rgb32_to_i420", "UV", width, offset, same_rows);
+
+    for (int i = 0; i < 2; ++i) {
+        memset(y[i][0].data, 0, width);
+        memset(y[i][1].data, 0, width);
+        uint8_t *y1 = same_rows ? y[i][0].data : y[i][1].data;
+        funcs[i]->rgb32_to_nv12_row2(s0, s1, y[i][0].data, y1, uv[i].data,
+                                     width, c);
+    }
+    if (!y_rows_check(y))
+        report(f->name, "rgb32_to_nv12", "Y", width, offset, same_rows);
+    if (!out_buf_check(&uv[0], &uv[1]))
+        report(f->name, "rgb32_to_nv12", "UV", width, offset, same_rows);
+
+    for (int i = 0; i < 2; ++i) {
+        out_buf_free(&y[i][0]);
+        out_buf_free(&y[i][1]);
+        out_buf_free(&u[i]);
+        out_buf_free(&v[i]);
+        out_buf_free(&uv[i]);
+    }
+    free(src);
+}
+
+// 整帧转换(当前CPU的最优级别)与逐行调用标量内核的结果对比，覆盖奇数
+// 行跨度和奇数高度
+static void
+test_frames(const PixconvFuncs *ref, int width, int height,
+            const PixconvRgbCoeffs *c)
+{
+    int uyvy_width = width & ~1;
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    int src_stride = width * 4 + 13;
+    int stride[3] = { width + 7, chroma_width + 5, chroma_width + 3 };
+    int nv12_stride[2] = { width + 7, chroma_width * 2 + 5 };
+    // 色度平面按I420和NV12中较大的行跨度分配
+    size_t plane_size[3] = { (size_t)stride[0] * height,
+                             (size_t)nv12_stride[1] * chroma_height,
+                             (size_t)stride[2] * chroma_height };
+
+    uint8_t *src = malloc((size_t)src_stride * height);
+    fill_random(src, (size_t)src_stride * height);
+
+    uint8_t *planes[2][3];
+    for (int i = 0; i < 2; ++i)
+        for (int p = 0; p < 3; ++p)
+            planes[i][p] = calloc(1, plane_size[p]);
+
+    // 逐行调用标量内核得到参考结果
+    for (int rgb = 0; rgb < 2; ++rgb) {
+        for (int nv12 = 0; nv12 < 2; ++nv12) {
+            const int *st = nv12 ? nv12_stride : stride;
+            int w = rgb ? width : uyvy_width;
+            for (int i = 0; i < 2; ++i)
+                for (int p = 0; p < 3; ++p)
+                    memset(planes[i][p], 0, plane_size[p]);
+
+            for (int y = 0; y < height; y += 2) {
+                int last = y + 1 >= height;
+                const uint8_t *s0 = src + (size_t)y * src_stride;
+                const uint8_t *s1 = last ? s0 : s0 + src_stride;
+                uint8_t *y0 = planes[0][0] + (size_t)y * st[0];
+                uint8_t *y1 = last ? y0 : y0 + st[0];
+                uint8_t *c0 = planes[0][1] + (size_t)(y / 2) * st[1];
+                uint8_t *c1 = planes[0][2] + (size_t)(y / 2) * stride[2];
+                if (rgb && nv12)
+                    ref->rgb32_to_nv12_row2(s0, s1, y0, y1, c0, w, c);
+                else if (rgb)
+                    ref->rgb32_to_i420_row2(s0, s1, y0, y1, c0, c1, w, c);
+                else if (nv12)
+                    ref->uyvy_to_nv12_row2(s0, s1, y0, y1, c0, w);
+                else
+                    ref->uyvy_to_i420_row2(s0, s1, y0, y1, c0, c1, w);
+            }
+
+            if (rgb && nv12)
+                pixconv_rgb32_to_nv12(src, src_stride, planes[1], st, w,
+                                      height, c);
+            else if (rgb)
+                pixconv_rgb32_to_i420(src, src_stride, planes[1], st, w,
+                                      height, c);
+            else if (nv12)
+                pixconv_uyvy_to_nv12(src, src_stride, planes[1], st, w,
+                                     height);
+            else
+                pixconv_uyvy_to_i420(src, src_stride, planes[1], st, w,
+                                     height);
+
+            for (int p = 0; p < (nv12 ? 2 : 3); ++p) {
+                if (memcmp(planes[0][p], planes[1][p], plane_size[p]) != 0) {
+                    printf("FAIL %s %s_to_%s frame %dx%d: plane %d differs\n",
+                           pixconv_get_funcs()->name, rgb ? "rgb32" : "uyvy",
+                           nv12 ? "nv12" : "i420", w, height, p);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; ++i)
+        for (int p = 0; p < 3; ++p)
+            free(planes[i][p]);
+    free(src);
+}
+
+static int
+run_tests(void)
+{
+    static const int wide[] = { 1918, 1919, 1920, 1921, 3839, 3840 };
+    const PixconvFuncs *ref = pixconv_get_funcs_for_level(PIXCONV_LEVEL_SCALAR);
+
+    PixconvRgbCoeffs coeffs[8];
+    int nb_coeffs = 0;
+    for (int order = PIXCONV_ORDER_BGRA; order <= PIXCONV_ORDER_RGBA; ++order)
+        for (int m = PIXCONV_MATRIX_BT601; m <= PIXCONV_MATRIX_BT709; ++m)
+            for (int full = 0; full <= 1; ++full)
+                pixconv_rgb_coeffs_init(&coeffs[nb_coeffs++], order, m, full);
+
+    for (int level = PIXCONV_LEVEL_SCALAR + 1; level < PIXCONV_LEVEL_NB;
+         ++level) {
+        const PixconvFuncs *f = pixconv_get_funcs_for_level(level);
+        if (!f) {
+            printf("%s: not supported, skipped\n", level_names[level]);
+            continue;
+        }
+        int before = failures;
+        for (int offset = 0; offset < 4; ++offset) {
+            for (int same_rows = 0; same_rows <= 1; ++same_rows) {
+                for (int w = 1; w <= 160 + (int)(sizeof wide / sizeof wide[0]);
+                     ++w) {
+                    int width = w <= 160 ? w : wide[w - 161];
+                    if (width % 2 == 0)
+                        test_uyvy_rows(ref, f, width, offset, same_rows);
+                    for (int i = 0; i < nb_coeffs; ++i)
+                        test_rgb_rows(ref, f, width, offset, same_rows,
+                                      &coeffs[i]);
+                }
+            }
+        }
+        printf("%s: %s\n", f->name, failures == before ? "ok" : "FAILED");
+    }
+
+    test_frames(ref, 1, 1, &coeffs[0]);
+    test_frames(ref, 37, 23, &coeffs[1]);
+    test_frames(ref, 1921, 9, &coeffs[3]);
+    test_frames(ref, 1280, 720, &coeffs[6]);
+    printf("frames (%s): %s\n", pixconv_get_funcs()->name,
+           failures ? "FAILED" : "ok");
+
+    return failures ? 1 : 0;
+}
+
+// 每个级别每个内核转换整帧的吞吐量
+static int
+run_bench(int width, int height)
+{
+    int chroma_width = (width + 1) / 2;
+    uint8_t *src = malloc((size_t)width * 4 * 2);
+    uint8_t *y = malloc((size_t)width * 2);
+    uint8_t *u = malloc(chroma_width);
+    uint8_t *v = malloc(chroma_width);
+    uint8_t *uv = malloc((size_t)chroma_width * 2);
+    if (!src || !y || !u || !v || !uv)
+        return 1;
+    fill_random(src, (size_t)width * 4 * 2);
+
+    PixconvRgbCoeffs c;
+    pixconv_rgb_coeffs_init(&c, PIXCONV_ORDER_BGRA, PIXCONV_MATRIX_BT709, 0);
+
+    printf("%dx%d, Mpix/s (frames/s)\n", width, height);
+    printf("%-8s %18s %18s %18s %18s\n", "level", "uyvy_to_i420",
+           "uyvy_to_nv12", "rgb32_to_i420", "rgb32_to_nv12");
+    for (int level = PIXCONV_LEVEL_SCALAR; level < PIXCONV_LEVEL_NB; ++level) {
+        const PixconvFuncs *f = pixconv_get_funcs_for_level(level);
+        if (!f)
+            continue;
+        printf("%-8s", f->name);
+        for (int kernel = 0; kernel < 4; ++kernel) {
+            // 两行源数据反复使用，测的是计算而不是内存带宽
+            long frames = 0;
+            double start = now_sec(), elapsed;
+            do {
+                for (int row = 0; row < height; row += 2) {
+                    const uint8_t *s1 = src + (size_t)width * 4;
+                    if (kernel == 0)
+                        f->uyvy_to_i420_row2(src, s1, y, y + width, u, v,
+                                             width & ~1);
+                    else if (kernel == 1)
+                        f->uyvy_to_nv12_row2(src, s1, y, y + width, uv,
+                                             width & ~1);
+                    else if (kernel == 2)
+                        f->rgb32_to_i420_row2(src, s1, y, y + width, u, v,
+                                              width, &c);
+                    else
+                        f->rgb32_to_nv12_row2(src, s1, y, y + width, uv,
+                                              width, &c);
+                }
+                frames++;
+                elapsed = now_sec() - start;
+            } while (elapsed < BENCH_SECONDS);
+            double fps = frames / elapsed;
+            printf(" %10.0f (%5.0f)", fps * width * height / 1e6, fps);
+        }
+        printf("\n");
+    }
+
+    free(src);
+    free(y);
+    free(u);
+    free(v);
+    free(uv);
+    return 0;
+}
+
+// 分片转换任务参数，kernel含义与run_bench相同
+typedef struct BenchSlices {
+    int kernel;
+    const uint8_t *src;
+    int src_stride;
+    uint8_t *dst[3];
+    int dst_stride[3];
+    int width, height;
+    const PixconvRgbCoeffs *c;
+} BenchSlices;
+
+/**
+ * 转换第job个水平分片，按帧转换器的方式分片：起始行为偶数，各分片互不重叠
+ */
+static void
+bench_slice(void *arg, int job, int nb_jobs)
+{
+    BenchSlices *s = arg;
+    int rows = ((s->height + nb_jobs - 1) / nb_jobs + 1) & ~1;
+    int y0 = job * rows;
+    int y1 = y0 + rows < s->height ? y0 + rows : s->height;
+    if (y0 >= y1)
+        return;
+
+    const uint8_t *src = s->src + (size_t)y0 * s->src_stride;
+    uint8_t *dst[3] = {
+        s->dst[0] + (size_t)y0 * s->dst_stride[0],
+        s->dst[1] + (size_t)(y0 / 2) * s->dst_stride[1],
+        s->kernel == 0 || s->kernel == 2
+                ? s->dst[2] + (size_t)(y0 / 2) * s->dst_stride[2]
+                : NULL,
+    };
+    if (s->kernel == 0)
+        pixconv_uyvy_to_i420(src, s->src_stride, dst, s->dst_stride, s->width,
+                             y1 - y0);
+    else if (s->kernel == 1)
+        pixconv_uyvy_to_nv12(src, s->src_stride, dst, s->dst_stride, s->width,
+                             y1 - y0);
+    else if (s->kernel == 2)
+        pixconv_rgb32_to_i420(src, s->src_stride, dst, s->dst_stride, s->width,
+                              y1 - y0, s->c);
+    else
+        pixconv_rgb32_to_nv12(src, s->src_stride, dst, s->dst_stride, s->width,
+                              y1 - y0, s->c);
+}
+
+// 整帧输入输出下每帧转换耗时与分片数的关系。每个分片数使用同样大小的
+// 线程池，对应ndi-streamer --convert_threads N(线程池按CPU核数创建时
+// N不超过核数)
+static int
+run_bench_slices(int width, int height)
+{
+    static const int nb_slices[] = { 1, 2, 4, 8 };
+    int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    size_t src_size = (size_t)width * 4 * height;
+    size_t luma_size = (size_t)width * height;
+    size_t chroma_size = (size_t)chroma_width * 2 * chroma_height;
+    uint8_t *src = malloc(src_size);
+    uint8_t *dst = malloc(luma_size + chroma_size);
+    if (!src || !dst)
+        return 1;
+    fill_random(src, src_size);
+    memset(dst, 0, luma_size + chroma_size);
+
+    PixconvRgbCoeffs c;
+    pixconv_rgb_coeffs_init(&c, PIXCONV_ORDER_BGRA, PIXCONV_MATRIX_BT709, 0);
+
+    printf("%dx%d whole frames, %s, ms/frame (speedup over 1 slice)\n", width,
+           height, pixconv_get_funcs()->name);
+    printf("%-8s %18s %18s %18s %18s\n", "slices", "uyvy_to_i420",
+           "uyvy_to_nv12", "rgb32_to_i420", "rgb32_to_nv12");
+    double ms[4] = {};
+    for (size_t i = 0; i < sizeof(nb_slices) / sizeof(nb_slices[0]); ++i) {
+        SlicePool *pool = new_slice_pool(nb_slices[i]);
+        if (!pool)
+            return 1;
+        printf("%-8d", nb_slices[i]);
+        for (int kernel = 0; kernel < 4; ++kernel) {
+            int i420 = kernel == 0 || kernel == 2;
+            BenchSlices s = {
+                .kernel = kernel,
+                .src = src,
+                .src_stride = kernel < 2 ? width * 2 : width * 4,
+                .dst = { dst, dst + luma_size,
+                         dst + luma_size + chroma_size / 2 },
+                .dst_stride = { width, i420 ? chroma_width : chroma_width * 2,
+                                chroma_width },
+                .width = width,
+                .height = height,
+                .c = &c,
+            };
+            long frames = 0;
+            double start = now_sec(), elapsed;
+            do {
+                slice_pool_run(pool, bench_slice, &s, nb_slices[i]);
+                frames++;
+                elapsed = now_sec() - start;
+            } while (elapsed < BENCH_SECONDS);
+            double frame_ms = elapsed * 1e3 / frames;
+            if (i == 0)
+                ms[kernel] = frame_ms;
+            printf(" %10.2f (%4.1fx)", frame_ms, ms[kernel] / frame_ms);
+        }
+        printf("\n");
+        free_slice_pool(&pool);
+    }
+
+    free(src);
+    free(dst);
+    return 0;
+}
+
+#ifdef PIXCONV_TEST_SWSCALE
+// 整帧转换一次，kernel含义与run_bench相同
+static void
+bench_frame_convert(int kernel, struct SwsContext *sws, uint8_t *src[4],
+                    int src_stride[4], uint8_t *dst[4], int dst_stride[4],
+                    int width, int height, const PixconvRgbCoeffs *c)
+{
+    if (sws)
+        sws_scale(sws, (const uint8_t *const *)src, src_stride, 0, height, dst,
+                  dst_stride);
+    else if (kernel == 0)
+        pixconv_uyvy_to_i420(src[0], src_stride[0], dst, dst_stride, width,
+                             height);
+    else if (kernel == 1)
+        pixconv_uyvy_to_nv12(src[0], src_stride[0], dst, dst_stride, width,
+                             height);
+    else if (kernel == 2)
+        pixconv_rgb32_to_i420(src[0], src_stride[0], dst, dst_stride, width,
+                              height, c);
+    else
+        pixconv_rgb32_to_nv12(src[0], src_stride[0], dst, dst_stride, width,
+                              height, c);
+}
+
+// 整帧输入输出(含内存带宽)下，自动选择级别的pixconv与单线程swscale的
+// 吞吐量。swscale使用转换器swscale路径的SWS_BICUBIC，尺寸相同时走其
+// 不缩放的专用转换
+static int
+run_bench_swscale(int width, int height)
+{
+    static const enum AVPixelFormat src_fmts[4] = {
+        AV_PIX_FMT_UYVY422, AV_PIX_FMT_UYVY422, AV_PIX_FMT_BGRA,
+        AV_PIX_FMT_BGRA
+    };
+    static const enum AVPixelFormat dst_fmts[4] = {
+        AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P,
+        AV_PIX_FMT_NV12
+    };
+    double mpix[2][4] = {};
+
+    PixconvRgbCoeffs c;
+    pixconv_rgb_coeffs_init(&c, PIXCONV_ORDER_BGRA, PIXCONV_MATRIX_BT601, 0);
+
+    for (int kernel = 0; kernel < 4; ++kernel) {
+        uint8_t *src[4], *dst[4];
+        int src_stride[4], dst_stride[4];
+        if (av_image_alloc(src, src_stride, width, height, src_fmts[kernel],
+                           64)
+            < 0)
+            return 1;
+        if (av_image_alloc(dst, dst_stride, width, height, dst_fmts[kernel],
+                           64)
+            < 0) {
+            av_freep(&src[0]);
+            return 1;
+        }
+        fill_random(src[0], (size_t)src_stride[0] * height);
+        struct SwsContext *sws = sws_getContext(
+                width, height, src_fmts[kernel], width, height,
+                dst_fmts[kernel], SWS_BICUBIC, NULL, NULL, NULL);
+
+        for (int impl = 0; impl < 2 && (impl == 0 || sws); ++impl) {
+            long frames = 0;
+            double start = now_sec(), elapsed;
+            do {
+                bench_frame_convert(kernel, impl ? sws : NULL, src,
+                                    src_stride, dst, dst_stride, width,
+                                    height, &c);
+                frames++;
+                elapsed = now_sec() - start;
+            } while (elapsed < BENCH_SECONDS);
+            mpix[impl][kernel] = frames / elapsed * width * height / 1e6;
+        }
+
+        sws_freeContext(sws);
+        av_freep(&src[0]);
+        av_freep(&dst[0]);
+    }
+
+    printf("\n%dx%d whole frames, Mpix/s (speedup over swscale)\n", width,
+           height);
+    printf("%-8s %18s %18s %18s %18s\n", "", "uyvy_to_i420", "uyvy_to_nv12",
+           "rgb32_to_i420", "rgb32_to_nv12");
+    printf("%-8s", pixconv_get_funcs()->name);
+    for (int kernel = 0; kernel < 4; ++kernel)
+        printf(" %10.0f (%4.1fx)", mpix[0][kernel],
+               mpix[1][kernel] > 0 ? mpix[0][kernel] / mpix[1][kernel] : 0);
+    printf("\n%-8s", "swscale");
+    for (int kernel = 0; kernel < 4; ++kernel)
+        printf(" %10.0f%s", mpix[1][kernel], kernel < 3 ? "        " : "");
+    printf("\n");
+    return 0;
+}
+#endif
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--bench_slices") == 0) {
+        int width = 3840, height = 2160;
+        if (argc > 2 && (sscanf(argv[2], "%dx%d", &width, &height) != 2
+                         || width <= 0 || height <= 0)) {
+            printf("couldn't parse size \"%s\", expected WxH\n", argv[2]);
+            return 1;
+        }
+        return run_bench_slices(width, height);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        int width = 1920, height = 1080;
+        if (argc > 2 && (sscanf(argv[2], "%dx%d", &width, &height) != 2
+                         || width <= 0 || height <= 0)) {
+            printf("couldn't parse size \"%s\", expected WxH\n", argv[2]);
+            return 1;
+        }
+#ifdef PIXCONV_TEST_SWSCALE
+        if (run_bench(width, height) != 0)
+            return 1;
+        return run_bench_swscale(width, height);
+#else
+        return run_bench(width, height);
+#endif
+    }
+    return run_tests();
+}